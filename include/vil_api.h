@@ -232,6 +232,35 @@ typedef bool (*PFN_vilOverlayTextEvent)(VilOverlay, const char* utf8);
 typedef void (*PFN_vilOverlayMouseMoveEvent)(VilOverlay, int x, int y);
 typedef void (*PFN_vilOverlayKeyboardModifier)(VilOverlay, enum VilKeyMod mod, bool active);
 
+// Statistics of the built-in lock contention profiler for a single
+// call site, aggregated over all threads. Times are in nanoseconds.
+// The strings remain valid as long as the layer is loaded.
+typedef struct VilLockSiteStats {
+	const char* file;
+	const char* function;
+	uint32_t line;
+	bool shared; // whether the lock was acquired in shared mode
+	uint64_t acquisitions;
+	uint64_t contended; // number of acquisitions that had to wait
+	uint64_t waitTotalNs;
+	uint64_t waitMaxNs;
+	uint64_t holdTotalNs;
+	uint64_t holdMaxNs;
+} VilLockSiteStats;
+
+// Enables or disables the lock contention profiler.
+// Disabled by default, unless the VIL_LOCK_PROFILER environment variable is set.
+typedef void (*PFN_vilLockProfilerEnable)(bool enable);
+
+// Retrieves the lock statistics, sorted by total wait time, vulkan-style:
+// If 'stats' is NULL, returns the number of available sites in 'count'.
+// Otherwise, writes at most 'count' entries and sets 'count' to the
+// number of written entries. Returns false if not all entries were written.
+typedef bool (*PFN_vilGetLockSiteStats)(uint32_t* count, VilLockSiteStats* stats);
+
+// Resets all lock statistics.
+typedef void (*PFN_vilResetLockSiteStats)(void);
+
 typedef struct VilApi {
 	PFN_vilCreateOverlayForLastCreatedSwapchain CreateOverlayForLastCreatedSwapchain;
 
@@ -243,6 +272,10 @@ typedef struct VilApi {
 	PFN_vilOverlayKeyEvent OverlayKeyEvent;
 	PFN_vilOverlayTextEvent OverlayTextEvent;
 	PFN_vilOverlayKeyboardModifier OverlayKeyboardModifier;
+
+	PFN_vilLockProfilerEnable LockProfilerEnable;
+	PFN_vilGetLockSiteStats GetLockSiteStats;
+	PFN_vilResetLockSiteStats ResetLockSiteStats;
 } VilApi;
 
 // Must be called only *after* a vulkan device was created.
@@ -285,6 +318,9 @@ static inline int vilLoadApi(VilApi* api) {
 	vilLoadSym(OverlayKeyEvent);
 	vilLoadSym(OverlayTextEvent);
 	vilLoadSym(OverlayKeyboardModifier);
+	vilLoadSym(LockProfilerEnable);
+	vilLoadSym(GetLockSiteStats);
+	vilLoadSym(ResetLockSiteStats);
 
 	vilCloseLib();
 
@@ -6,6 +6,7 @@
 #include <window.hpp>
 #include <gui/gui.hpp>
 #include <util/export.hpp>
+#include <util/lockProfiler.hpp>
 #include <swapchain.hpp>
 #include <overlay.hpp>
 #include <imgui/imgui.h>
@@ -164,3 +165,40 @@ extern "C" VIL_EXPORT void vilOverlayKeyboardModifier(VilOverlay overlay, enum V
 
 	ov.gui->addKeyEvent(key, active);
 }
+
+extern "C" VIL_EXPORT void vilLockProfilerEnable(bool enable) {
+	lockProfilerEnabled.store(enable);
+}
+
+extern "C" VIL_EXPORT bool vilGetLockSiteStats(uint32_t* count, VilLockSiteStats* out) {
+	dlg_assert(count);
+
+	auto stats = lockProfilerStats();
+	if(!out) {
+		*count = u32(stats.size());
+		return true;
+	}
+
+	auto written = std::min<u32>(*count, u32(stats.size()));
+	for(auto i = 0u; i < written; ++i) {
+		auto& src = stats[i];
+		auto& dst = out[i];
+		dst.file = src.site.file;
+		dst.function = src.site.function;
+		dst.line = src.site.line;
+		dst.shared = src.shared;
+		dst.acquisitions = src.acquisitions;
+		dst.contended = src.contended;
+		dst.waitTotalNs = src.waitTotal;
+		dst.waitMaxNs = src.waitMax;
+		dst.holdTotalNs = src.holdTotal;
+		dst.holdMaxNs = src.holdMax;
+	}
+
+	*count = written;
+	return written == stats.size();
+}
+
+extern "C" VIL_EXPORT void vilResetLockSiteStats() {
+	resetLockProfiler();
+}
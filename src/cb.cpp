@@ -20,6 +20,7 @@
 #include <util/chain.hpp>
 #include <util/ext.hpp>
 #include <util/profiling.hpp>
+#include <vkutil/enumString.hpp>
 
 namespace vil {
 
@@ -46,8 +47,13 @@ void DescriptorState::bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstS
 		span<DescriptorSet* const> sets, span<const u32> dynOffsets) {
 	ExtZoneScoped;
 
-	this->descriptorSets = copyEnsureSizeUndef(cb, descriptorSets,
-		firstSet + sets.size());
+	// Binds between two draws (and for multiple sets) all work on
+	// the same state, we only have to re-allocate the first time.
+	if(!ownsDescriptorSets || descriptorSets.size() < firstSet + sets.size()) {
+		this->descriptorSets = copyEnsureSizeUndef(cb, descriptorSets,
+			firstSet + sets.size());
+		ownsDescriptorSets = true;
+	}
 
 	// NOTE: the "ds disturbing" part of vulkan is hard to grasp IMO.
 	// There may be errors here.
@@ -83,7 +89,7 @@ void DescriptorState::bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstS
 			}
 #endif // DS_DISTURB_CHECKS
 
-			descriptorSets[i] = {};
+			descriptorSets[s] = {};
 			continue;
 		}
 
@@ -114,6 +120,45 @@ void DescriptorState::bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstS
 #endif // DS_DISTURB_CHECKS
 }
 
+// Maximum number of replaced records that are queued before the next
+// reset of a command buffer takes the slow path, disconnecting them.
+// Applications might record a lot without ever submitting.
+constexpr auto maxReplacedRecords = 256u;
+
+void pushReplacedRecord(Device& dev, IntrusivePtr<CommandRecord> rec) {
+	dlg_assert(rec);
+	dlg_assert(!rec->nextReplaced);
+
+	auto* raw = rec.release();
+	auto* head = dev.replacedRecords.load(std::memory_order_relaxed);
+	do {
+		raw->nextReplaced = head;
+	} while(!dev.replacedRecords.compare_exchange_weak(head, raw,
+		std::memory_order_release, std::memory_order_relaxed));
+
+	dev.replacedRecordCount.fetch_add(1u, std::memory_order_relaxed);
+}
+
+void disconnectReplacedRecordsLocked(Device& dev,
+		std::vector<IntrusivePtr<CommandRecord>>& released) {
+	assertOwned(dev.mutex);
+
+	auto* rec = dev.replacedRecords.exchange(nullptr, std::memory_order_acquire);
+	while(rec) {
+		auto* next = rec->nextReplaced;
+		rec->nextReplaced = nullptr;
+
+		if(rec->cb) {
+			rec->cb = nullptr;
+			clearHookRecordsLocked(*rec);
+		}
+
+		released.emplace_back(acquireOwnership, rec);
+		dev.replacedRecordCount.fetch_sub(1u, std::memory_order_relaxed);
+		rec = next;
+	}
+}
+
 // CommandBuffer
 CommandBuffer::CommandBuffer(CommandPool& xpool, VkCommandBuffer xhandle) :
 		handle(xhandle), pool_(&xpool) {
@@ -127,11 +172,16 @@ CommandBuffer::~CommandBuffer() {
 	dlg_assert(!pool_);
 	dlg_assert(!this->handle);
 
+	// Replaced records might still reference this command buffer.
+	// Destroyed outside the critical section.
+	std::vector<IntrusivePtr<CommandRecord>> replaced;
+
 	// Wait for completion, free all data and allocated stuff,
 	// unregister from everything
 	{
 		std::lock_guard lock(dev->mutex);
 
+		disconnectReplacedRecordsLocked(*dev, replaced);
 		clearPendingLocked();
 
 		if(builder_.record_) {
@@ -170,8 +220,20 @@ void CommandBuffer::clearPendingLocked() {
 
 	// checkLocked will automtically remove it from this cb
 	while(!this->pending.empty()) {
-		auto res = checkLocked(*this->pending.front()->parent);
-		dlg_assert(res);
+		auto& batch = *this->pending.front()->parent;
+		if(checkLocked(batch)) {
+			continue;
+		}
+
+		// The application guarantees that the submission has completed.
+		// But our view of it (e.g. the submission counter of the queue)
+		// might lag behind what the application waited for.
+		auto res = waitLocked(batch);
+		if(res != VK_SUCCESS || !checkLocked(batch)) {
+			dlg_error("Can't retire pending submission of reset command buffer ({})",
+				vk::name(res));
+			break;
+		}
 	}
 }
 
@@ -181,12 +243,48 @@ void CommandBuffer::doReset(bool startRecord) {
 	// Make sure to never destroy a CommandBufferRecord inside the
 	// device lock.
 	IntrusivePtr<CommandRecord> keepAliveRecord;
+	std::vector<IntrusivePtr<CommandRecord>> replaced;
 
-	{
+	auto setState = [&]{
+		if(startRecord) {
+			++recordCount_;
+			// actually start the new record below, outside of the critical section
+			// since it will allocate memory and it's not publicly exposed.
+			state_ = CommandBuffer::State::recording;
+		} else {
+			state_ = CommandBuffer::State::initial;
+		}
+	};
+
+	// Fast path: when this command buffer isn't pending and we don't
+	// interrupt a recording, nothing but this command buffer is involved.
+	// The previous record is disconnected later on, the next time the
+	// device mutex is locked anyways (e.g. on submission).
+	// pendingCount can't become non-zero concurrently: the application
+	// isn't allowed to submit a command buffer while resetting it.
+	if(!builder_.record_ && pendingCount.load(std::memory_order_acquire) == 0u &&
+			dev->replacedRecordCount.load(std::memory_order_relaxed) < maxReplacedRecords) {
+		{
+			std::lock_guard lock(mutex_);
+			if(lastRecord_ && lastRecord_->cb) {
+				dlg_assert(lastRecord_->cb == this);
+				keepAliveRecord = std::move(lastRecord_);
+			}
+
+			setState();
+		}
+
+		if(keepAliveRecord) {
+			pushReplacedRecord(*dev, std::move(keepAliveRecord));
+		}
+	} else {
 		std::lock_guard lock(dev->mutex);
 
 		// Make sure this command buffer isn't pending anymore
 		clearPendingLocked();
+		disconnectReplacedRecordsLocked(*dev, replaced);
+
+		std::lock_guard cbLock(mutex_);
 
 		// if this was called while we were still recording, make
 		// sure to properly terminate the pending record
@@ -209,16 +307,7 @@ void CommandBuffer::doReset(bool startRecord) {
 			keepAliveRecord = std::move(lastRecord_);
 		}
 
-		// We have to lock our own mutex since other threads might read
-		// our data at the same time.
-		if(startRecord) {
-			++recordCount_;
-			// actually start the new record below, outside of the critical section
-			// since it will allocate memory and it's not publicly exposed.
-			state_ = CommandBuffer::State::recording;
-		} else {
-			state_ = CommandBuffer::State::initial;
-		}
+		setState();
 	}
 
 	if(startRecord) {
@@ -232,6 +321,10 @@ void CommandBuffer::doReset(bool startRecord) {
 		computeState_ = &construct<ComputeState>(*this);
 		graphicsState_ = &construct<GraphicsState>(*this);
 		rayTracingState_ = &construct<RayTracingState>(*this);
+		computeStateShared_ = false;
+		graphicsStateShared_ = false;
+		rayTracingStateShared_ = false;
+		pushConstantsShared_ = false;
 	}
 }
 
@@ -253,6 +346,10 @@ void CommandBuffer::doEnd() {
 	computeState_ = {};
 	rayTracingState_ = {};
 	pushConstants_ = {};
+	graphicsStateShared_ = {};
+	computeStateShared_ = {};
+	rayTracingStateShared_ = {};
+	pushConstantsShared_ = {};
 
 	builder_.section_ = nullptr;
 	builder_.lastCommand_ = nullptr;
@@ -266,23 +363,29 @@ void CommandBuffer::doEnd() {
 	rpAttachments_ = {};
 
 	auto& rec = *builder_.record_;
+	rec.used.compact();
+	rec.writes.build(rec.writtenHandles);
 
-	// Make sure to never call CommandRecord destructor inside lock.
-	// Don't just call reset() here or move lastRecord_ so that always have a valid
-	// lastRecord_ as state (some other thread could query it before we lock)
-	auto keepAliveRecord = lastRecord_;
+	// The replaced record was already disconnected from this cb in doReset
+	// but other threads might still access it while holding the device
+	// mutex, see lastRecordLocked.
+	IntrusivePtr<CommandRecord> replacedRecord;
 
-	// Critical section, update our state
+	// Critical section, publish the record
 	{
-		std::lock_guard lock(dev->mutex);
+		std::lock_guard lock(mutex_);
 
 		dlg_assert(state_ == State::recording);
 		dlg_assert(!rec.finished);
 
+		rec.finished.store(true, std::memory_order_release);
+		replacedRecord = std::move(lastRecord_);
+		lastRecord_ = std::move(builder_.record_);
 		state_ = State::executable;
-		rec.finished = true;
+	}
 
-		lastRecord_ = std::move(builder_.record_);
+	if(replacedRecord) {
+		pushReplacedRecord(*dev, std::move(replacedRecord));
 	}
 
 	// NOTE: this is just for testing/validation
@@ -324,6 +427,8 @@ void CommandBuffer::invalidateLocked() {
 
 	clearPendingLocked();
 
+	std::lock_guard lock(mutex_);
+
 	// Free the hook data (as soon as possible), it's no longer
 	// needed as this record will never be submitted again.
 	clearHookRecordsLocked(*lastRecord_);
@@ -332,21 +437,65 @@ void CommandBuffer::invalidateLocked() {
 	this->state_ = State::invalid;
 }
 
+template<typename State>
+State& copyOnWrite(CommandBuffer& cb, State*& state, bool& shared) {
+	dlg_assert(state);
+	if(shared) {
+		// the spans are shared with the previous state now
+		state = &construct<State>(cb, *state);
+		state->ownsDescriptorSets = false;
+		shared = false;
+	}
+
+	return *state;
+}
+
 ComputeState& CommandBuffer::newComputeState() {
-	computeState_ = &construct<ComputeState>(*this, *computeState_);
-	return *computeState_;
+	return copyOnWrite(*this, computeState_, computeStateShared_);
 }
 
 GraphicsState& CommandBuffer::newGraphicsState() {
-	graphicsState_ = &construct<GraphicsState>(*this, *graphicsState_);
-	return *graphicsState_;
+	return copyOnWrite(*this, graphicsState_, graphicsStateShared_);
 }
 
 RayTracingState& CommandBuffer::newRayTracingState() {
-	rayTracingState_ = &construct<RayTracingState>(*this, *rayTracingState_);
+	return copyOnWrite(*this, rayTracingState_, rayTracingStateShared_);
+}
+
+const ComputeState& CommandBuffer::computeState() {
+	computeStateShared_ = true;
+	return *computeState_;
+}
+
+const GraphicsState& CommandBuffer::graphicsState() {
+	graphicsStateShared_ = true;
+	return *graphicsState_;
+}
+
+const RayTracingState& CommandBuffer::rayTracingState() {
+	rayTracingStateShared_ = true;
 	return *rayTracingState_;
 }
 
+const PushConstantData& CommandBuffer::pushConstants() {
+	pushConstantsShared_ = true;
+	return pushConstants_;
+}
+
+void CommandBuffer::updatePushConstants(u32 offset, span<const std::byte> data) {
+	auto& pc = pushConstants_.data;
+	auto size = std::max<std::size_t>(offset + data.size(), pc.size());
+	if(pushConstantsShared_ || pc.size() < size) {
+		// keep the previously pushed values, zero-initialize the rest
+		auto old = pc;
+		pc = alloc<std::byte>(*this, size);
+		std::copy(old.begin(), old.end(), pc.begin());
+		pushConstantsShared_ = false;
+	}
+
+	std::memcpy(pc.data() + offset, data.data(), data.size());
+}
+
 void CommandPool::onApiDestroy() {
 	// When a CommandPool is destroyed, all command buffers created from
 	// it are automatically freed.
@@ -663,56 +812,47 @@ template<typename T>
 auto& useHandleImpl(CommandRecord& rec, Command& cmd, T& handle) {
 	ExtZoneScoped;
 	auto& set = GetUsedSet::get(rec, handle);
-	auto it = find(set, handle);
+	auto [use, inserted] = set.insert(&handle);
 
-	if(it == set.end()) {
-		RefHandle<T> rh(rec.alloc);
-		rh.handle.reset(&handle);
-		it = set.insert(std::move(rh)).first;
+	if(inserted) {
+		use->handle.reset(&handle);
 	} else {
-		dlg_assert(handle.refCount > 1u);
+		// kept alive via HandleReclaimer, not the record
+		dlg_assert(handle.refCount > 0u);
 	}
 
-	auto& use = const_cast<RefHandle<T>&>(*it);
-	// use.commands.push_back(&cmd);
+	// use->commands.push_back(&cmd);
 	(void) cmd;
-	return use;
+	return *use;
 }
 
 UsedImage& useHandleImpl(CommandRecord& rec, Command& cmd, Image& img) {
 	ExtZoneScoped;
-	auto& set = rec.used.images;
-	auto it = find(set, img);
+	auto [use, inserted] = rec.used.images.insert(&img);
 
-	if(it == set.end()) {
-		UsedImage rh(rec.alloc);
-		rh.handle.reset(&img);
-		it = set.insert(std::move(rh)).first;
+	if(inserted) {
+		use->handle.reset(&img);
 	} else {
-		dlg_assert(img.refCount > 1u);
+		// kept alive via HandleReclaimer, not the record
+		dlg_assert(img.refCount > 0u);
 	}
 
-	auto& use = const_cast<UsedImage&>(*it);
-	// use.commands.push_back(&cmd);
+	// use->commands.push_back(&cmd);
 	(void) cmd;
-	return use;
+	return *use;
 }
 
 UsedDescriptorSet& useHandleImpl(CommandRecord& rec, Command& cmd, DescriptorSet& ds) {
 	ExtZoneScoped;
-	auto& set = rec.used.descriptorSets;
-	auto it = find(set, ds);
+	auto [use, inserted] = rec.used.descriptorSets.insert(&ds);
 
-	if(it == set.end()) {
-		UsedDescriptorSet rh(rec.alloc);
-		rh.ds = static_cast<void*>(&ds);
-		it = set.insert(std::move(rh)).first;
+	if(inserted) {
+		use->ds = static_cast<void*>(&ds);
 	}
 
-	auto& use = const_cast<UsedDescriptorSet&>(*it);
-	// use.commands.push_back(&cmd);
+	// use->commands.push_back(&cmd);
 	(void) cmd;
-	return use;
+	return *use;
 }
 
 template<typename T>
@@ -768,6 +908,40 @@ decltype(auto) useHandle(CommandBuffer& cb, Args&&... args) {
 	return useHandle(*cb.builder().record_, std::forward<Args>(args)...);
 }
 
+// Marks the given handle as potentially written by the record,
+// see CommandRecord::writtenHandles.
+void markWritten(CommandBuffer& cb, const Handle& handle) {
+	auto& written = cb.builder().record_->writtenHandles;
+	// commands often write the same handle multiple times in a row
+	if(written.empty() || written.back() != &handle) {
+		written.push_back(&handle);
+	}
+}
+
+void markWritten(CommandBuffer& cb, const ImageView& view) {
+	dlg_assert(view.img);
+	if(view.img) {
+		markWritten(cb, *view.img);
+	}
+}
+
+// Writing an acceleration structure writes its backing buffer.
+void markWritten(CommandBuffer& cb, const AccelStruct& accelStruct) {
+	if(accelStruct.buf) {
+		markWritten(cb, *accelStruct.buf);
+	}
+}
+
+bool transitions(const VkImageMemoryBarrier& imgb) {
+	return imgb.oldLayout != imgb.newLayout ||
+		imgb.srcQueueFamilyIndex != imgb.dstQueueFamilyIndex;
+}
+
+bool transitions(const VkImageMemoryBarrier2& imgb) {
+	return imgb.oldLayout != imgb.newLayout ||
+		imgb.srcQueueFamilyIndex != imgb.dstQueueFamilyIndex;
+}
+
 // commands
 void cmdBarrier(
 		CommandBuffer& cb,
@@ -788,6 +962,9 @@ void cmdBarrier(
 		cmd.images[i] = &img;
 		useHandle(cb, cmd, img,
 			ImageSubresourceLayout{imgb.subresourceRange, imgb.newLayout});
+		if(transitions(imgb)) {
+			markWritten(cb, img);
+		}
 
 		imgb.image = img.handle;
 	}
@@ -828,6 +1005,9 @@ void cmdBarrier(CommandBuffer& cb, Barrier2CmdBase& cmd,
 		cmd.images[i] = &img;
 		useHandle(cb, cmd, img,
 			ImageSubresourceLayout{imgb.subresourceRange, imgb.newLayout});
+		if(transitions(imgb)) {
+			markWritten(cb, img);
+		}
 
 		imgb.image = img.handle;
 	}
@@ -944,6 +1124,7 @@ void cmdBeginRenderPass(CommandBuffer& cb,
 			dlg_assert(attachment.img);
 
 			useHandle(cb, cmd, attachment, false);
+			markWritten(cb, attachment);
 
 			const auto finalLayout = cmd.rp->desc.attachments[i].finalLayout;
 			useHandle(cb, cmd, *attachment.img,
@@ -974,6 +1155,7 @@ void cmdBeginRenderPass(CommandBuffer& cb,
 
 			cmd.attachments[i] = attachment;
 			useHandle(cb, cmd, *attachment, false);
+			markWritten(cb, *attachment);
 
 			const auto finalLayout = cmd.rp->desc.attachments[i].finalLayout;
 			useHandle(cb, cmd, *attachment->img,
@@ -1513,6 +1695,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdCopyImage(cb.handle,
 		src.handle, srcImageLayout,
@@ -1538,6 +1721,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	auto copy = *info;
 	copy.dstImage = dst.handle;
@@ -1569,6 +1753,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBlitImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdBlitImage(cb.handle,
 		src.handle, srcImageLayout,
@@ -1595,6 +1780,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBlitImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	auto copy = *info;
 	copy.srcImage = src.handle;
@@ -1622,6 +1808,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBufferToImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdCopyBufferToImage(cb.handle,
 		src.handle, dst.handle, dstImageLayout, regionCount, pRegions);
@@ -1644,6 +1831,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBufferToImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	auto copy = *info;
 	copy.srcBuffer = src.handle;
@@ -1671,6 +1859,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImageToBuffer(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdCopyImageToBuffer(cb.handle,
 		src.handle, srcImageLayout, dst.handle, regionCount, pRegions);
@@ -1693,6 +1882,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyImageToBuffer2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	auto copy = *info;
 	copy.dstBuffer = dst.handle;
@@ -1717,6 +1907,7 @@ VKAPI_ATTR void VKAPI_CALL CmdClearColorImage(
 	cmd.ranges = copySpan(cb, pRanges, rangeCount);
 
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdClearColorImage(cb.handle,
 		dst.handle, imageLayout, pColor, rangeCount, pRanges);
@@ -1739,6 +1930,7 @@ VKAPI_ATTR void VKAPI_CALL CmdClearDepthStencilImage(
 	cmd.ranges = copySpan(cb, pRanges, rangeCount);
 
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdClearDepthStencilImage(cb.handle, dst.handle,
 		imageLayout, pDepthStencil, rangeCount, pRanges);
@@ -1784,6 +1976,7 @@ VKAPI_ATTR void VKAPI_CALL CmdResolveImage(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	cb.dev->dispatch.CmdResolveImage(cb.handle, src.handle, srcImageLayout,
 		dst.handle, dstImageLayout, regionCount, pRegions);
@@ -1807,6 +2000,7 @@ VKAPI_ATTR void VKAPI_CALL CmdResolveImage2(
 
 	useHandle(cb, cmd, src);
 	useHandle(cb, cmd, dst);
+	markWritten(cb, dst);
 
 	auto copy = *info;
 	copy.dstImage = dst.handle;
@@ -1913,6 +2107,12 @@ VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(
 				uimg.layoutChanges.begin(), uimg.layoutChanges.end());
 		}
 
+		cb.builder().record_->categories |= rec.categories;
+
+		auto& written = cb.builder().record_->writtenHandles;
+		written.insert(written.end(), rec.writes.handles().begin(),
+			rec.writes.handles().end());
+
 		cb.builder().record_->secondaries.push_back(std::move(recordPtr));
 		cbHandles[i] = secondary.handle,
 		last = &childCmd;
@@ -1940,6 +2140,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBuffer(
 
 	useHandle(cb, cmd, srcBuf);
 	useHandle(cb, cmd, dstBuf);
+	markWritten(cb, dstBuf);
 
 	cb.dev->dispatch.CmdCopyBuffer(cb.handle,
 		srcBuf.handle, dstBuf.handle, regionCount, pRegions);
@@ -1961,6 +2162,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyBuffer2(
 
 	useHandle(cb, cmd, srcBuf);
 	useHandle(cb, cmd, dstBuf);
+	markWritten(cb, dstBuf);
 
 	auto copy = *info;
 	copy.srcBuffer = srcBuf.handle;
@@ -1985,6 +2187,7 @@ VKAPI_ATTR void VKAPI_CALL CmdUpdateBuffer(
 	cmd.offset = dstOffset;
 
 	useHandle(cb, cmd, buf);
+	markWritten(cb, buf);
 
 	cb.dev->dispatch.CmdUpdateBuffer(cb.handle, buf.handle, dstOffset, dataSize, pData);
 }
@@ -2005,6 +2208,7 @@ VKAPI_ATTR void VKAPI_CALL CmdFillBuffer(
 	cmd.data = data;
 
 	useHandle(cb, cmd, buf);
+	markWritten(cb, buf);
 
 	cb.dev->dispatch.CmdFillBuffer(cb.handle, buf.handle, dstOffset, size, data);
 }
@@ -2266,6 +2470,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyQueryPoolResults(
 
 	useHandle(cb, cmd, *cmd.pool);
 	useHandle(cb, cmd, *cmd.dstBuffer);
+	markWritten(cb, *cmd.dstBuffer);
 
 	cb.dev->dispatch.CmdCopyQueryPoolResults(cb.handle, cmd.pool->handle,
 		firstQuery, queryCount, cmd.dstBuffer->handle, dstOffset, stride, flags);
@@ -2293,11 +2498,7 @@ VKAPI_ATTR void VKAPI_CALL CmdPushConstants(
 	auto ptr = static_cast<const std::byte*>(pValues);
 	cmd.values = copySpan(cb, static_cast<const std::byte*>(ptr), size);
 
-	// reallocate push constants
-	auto& pc = cb.pushConstants().data;
-	auto allocSize = std::max<u32>(offset + size, pc.size());
-	pc = alloc<std::byte>(cb, allocSize);
-	std::memcpy(pc.data() + offset, pValues, size);
+	cb.updatePushConstants(offset, {ptr, size});
 
 	{
 		ExtZoneScopedN("dispatch");
@@ -2508,6 +2709,7 @@ void handlePushDescriptor(CommandBuffer& cb, Command& cmd,
 		VkWriteDescriptorSet& write,
 		span<DescriptorStateRef> descriptorStates, bool inplace) {
 
+	const auto storage = isStorage(write.descriptorType);
 	switch(category(write.descriptorType)) {
 		case DescriptorCategory::buffer: {
 			dlg_assert(write.pBufferInfo);
@@ -2519,9 +2721,12 @@ void handlePushDescriptor(CommandBuffer& cb, Command& cmd,
 				copies[i] = write.pBufferInfo[i];
 				copies[i].buffer = buf.handle;
 				useHandle(cb, cmd, buf);
+				if(storage) {
+					markWritten(cb, buf);
+				}
 
 				for(auto& dstState : descriptorStates) {
-					auto& dstBuffer = dsBuffer(dstState, write.dstBinding, write.dstArrayElement + i);
+					auto& dstBuffer = dsBufferWrite(dstState, write.dstBinding, write.dstArrayElement + i);
 					dstBuffer.buffer = &buf;
 					dstBuffer.offset = copies[i].offset;
 					dstBuffer.range = copies[i].range;
@@ -2542,6 +2747,9 @@ void handlePushDescriptor(CommandBuffer& cb, Command& cmd,
 					iv = &get(*cb.dev, write.pImageInfo[i].imageView);
 					copies[i].imageView = iv->handle;
 					useHandle(cb, cmd, *iv);
+					if(storage) {
+						markWritten(cb, *iv);
+					}
 				}
 				if(copies[i].sampler) {
 					sampler = &get(*cb.dev, write.pImageInfo[i].sampler);
@@ -2550,7 +2758,7 @@ void handlePushDescriptor(CommandBuffer& cb, Command& cmd,
 				}
 
 				for(auto& dstState : descriptorStates) {
-					auto& dstImage = dsImage(dstState, write.dstBinding, write.dstArrayElement + i);
+					auto& dstImage = dsImageWrite(dstState, write.dstBinding, write.dstArrayElement + i);
 					dstImage.imageView = iv;
 					dstImage.sampler = sampler;
 					dstImage.layout = copies[i].imageLayout;
@@ -2567,9 +2775,12 @@ void handlePushDescriptor(CommandBuffer& cb, Command& cmd,
 				auto& bv = get(*cb.dev, write.pTexelBufferView[i]);
 				copies[i] = bv.handle;
 				useHandle(cb, cmd, bv);
+				if(storage && bv.buffer) {
+					markWritten(cb, *bv.buffer);
+				}
 
 				for(auto& dstState : descriptorStates) {
-					auto& dstBufViews = dsBufferView(dstState, write.dstBinding, write.dstArrayElement + i);
+					auto& dstBufViews = dsBufferViewWrite(dstState, write.dstBinding, write.dstArrayElement + i);
 					dstBufViews.bufferView = &bv;
 				}
 			}
@@ -2591,7 +2802,7 @@ void handlePushDescriptor(CommandBuffer& cb, Command& cmd,
 				useHandle(cb, cmd, as);
 
 				for(auto& dstState : descriptorStates) {
-					auto& dstAccelStruct = dsAccelStruct(dstState, write.dstBinding, write.dstArrayElement + i);
+					auto& dstAccelStruct = dsAccelStructWrite(dstState, write.dstBinding, write.dstArrayElement + i);
 					dstAccelStruct.accelStruct = &as;
 				}
 			}
@@ -2634,7 +2845,7 @@ span<std::byte> handlePushDescriptorsWithTemplate(CommandBuffer& cb,
 	auto descriptorStates = forkPushDescriptors(tms, cb, cmd.set,
 		*cmd.pipeLayout, dsLayout, states);
 
-	auto dataSize = totalUpdateDataSize(*cmd.updateTemplate);
+	auto dataSize = cmd.updateTemplate->dataSize;
 	auto copied = copySpan(cb, reinterpret_cast<const std::byte*>(pData), dataSize);
 
 	for(auto& entry : cmd.updateTemplate->entries) {
@@ -3055,6 +3266,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBuildAccelerationStructuresKHR(
 		cmd.dsts[i] = &get(*cb.dev, buildInfo.dstAccelerationStructure);
 		buildInfo.dstAccelerationStructure = cmd.dsts[i]->handle;
 		useHandle(cb, cmd, *cmd.dsts[i]);
+		markWritten(cb, *cmd.dsts[i]);
 
 		cmd.buildRangeInfos[i] = copySpan(cb, ppBuildRangeInfos[i], buildInfo.geometryCount);
 
@@ -3112,6 +3324,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBuildAccelerationStructuresIndirectKHR(
 		cmd.dsts[i] = &get(*cb.dev, buildInfo.dstAccelerationStructure);
 		buildInfo.dstAccelerationStructure = cmd.dsts[i]->handle;
 		useHandle(cb, cmd, *cmd.dsts[i]);
+		markWritten(cb, *cmd.dsts[i]);
 
 		cmd.indirectAddresses[i] = pIndirectDeviceAddresses[i];
 		cmd.indirectStrides[i] = pIndirectStrides[i];
@@ -3142,6 +3355,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyAccelerationStructureKHR(
 
 	useHandle(cb, cmd, *cmd.src);
 	useHandle(cb, cmd, *cmd.dst);
+	markWritten(cb, *cmd.dst);
 
 	auto& copy = cb.builder().record_->accelStructCopies.emplace_back();
 	copy.src = cmd.src;
@@ -3183,6 +3397,7 @@ VKAPI_ATTR void VKAPI_CALL CmdCopyMemoryToAccelerationStructureKHR(
 	cmd.mode = pInfo->mode;
 
 	useHandle(cb, cmd, *cmd.dst);
+	markWritten(cb, *cmd.dst);
 	// TODO: useHandle for buffers of associated device addresses?
 
 	auto fwd = *pInfo;
@@ -3310,11 +3525,13 @@ VKAPI_ATTR void VKAPI_CALL CmdBeginRendering(
 		if(src.imageView) {
 			dst.view = &unwrap(src.imageView);
 			useHandle(cb, cmd, *dst.view);
+			markWritten(cb, *dst.view);
 		}
 
 		if(src.resolveImageView) {
 			dst.resolveView = &unwrap(src.resolveImageView);
 			useHandle(cb, cmd, *dst.resolveView);
+			markWritten(cb, *dst.resolveView);
 		}
 
 		return dst.view;
@@ -3703,11 +3920,7 @@ VKAPI_ATTR void VKAPI_CALL CmdPushConstants2(
 	cmd.pNext = copyChain(cb, pPushConstantsInfo->pNext);
 	cmd.v2 = true;
 
-	// reallocate push constants
-	auto& pc = cb.pushConstants().data;
-	auto allocSize = std::max<u32>(info.offset + info.size, pc.size());
-	pc = alloc<std::byte>(cb, allocSize);
-	std::memcpy(pc.data() + info.offset, info.pValues, info.size);
+	cb.updatePushConstants(info.offset, {ptr, info.size});
 
 	{
 		ExtZoneScopedN("dispatch");
@@ -29,7 +29,11 @@ struct CommandPool : SharedDeviceHandle {
 //   buffer to invalidate state) is not allowed since this is race situation
 //   and the command buffer might be in invalid state before/during the
 //   record command, which is invalid.
-// - State changes are synchronized via the device mutex.
+// - State changes and lastRecord_ are synchronized via the per-cb mutex.
+//   Beginning and ending a recording don't lock the device mutex unless
+//   the command buffer is still pending or a recording is interrupted.
+//   Records replaced without the device mutex are disconnected from the
+//   command buffer later on, see disconnectReplacedRecordsLocked.
 struct CommandBuffer : SharedDeviceHandle {
 public:
 	enum class State {
@@ -45,6 +49,9 @@ public:
 	// List of pending submissions including this cb.
 	// Access synchronized via device mutex.
 	std::vector<Submission*> pending;
+	// Mirrors pending.size(), can be read without the device mutex.
+	// Only modified while the device mutex is locked.
+	std::atomic<u32> pendingCount {};
 	VkCommandBuffer handle {}; // immutable
 
 public:
@@ -53,8 +60,7 @@ public:
 
 	CommandPool& pool() const { return *pool_; }
 
-	// Synchronized via dev.mutex (must only be called while mutex is locked)
-	State state() const { return state_; }
+	State state() const { return state_.load(std::memory_order_acquire); }
 	u32 recordCount() const { return recordCount_; }
 
 	// Returns the last complete recorded state.
@@ -62,14 +68,17 @@ public:
 	// Otherwise it's the previous state.
 	IntrusivePtr<CommandRecord> lastRecordPtrLocked() const {
 		assertOwned(dev->mutex);
-		return lastRecord_;
+		return lastRecordPtr();
 	}
 	IntrusivePtr<CommandRecord> lastRecordPtr() const {
-		std::lock_guard lock(dev->mutex);
-		return lastRecordPtrLocked();
+		std::lock_guard lock(mutex_);
+		return lastRecord_;
 	}
+	// The returned record stays alive as long as the device mutex is
+	// locked, replaced records are only released after it was unlocked.
 	CommandRecord* lastRecordLocked() const {
 		assertOwned(dev->mutex);
+		std::lock_guard lock(mutex_);
 		return lastRecord_.get();
 	}
 
@@ -83,8 +92,12 @@ private:
 	friend CommandPool;
 	CommandPool* pool_ {};
 
+	// Synchronizes state_, lastRecord_ and recordCount_.
+	// Must be locked after the device mutex.
+	mutable vilDefMutex(mutex_);
+
 	// The last recorded state.
-	State state_ {State::initial}; // synchronized via dev mutex
+	std::atomic<State> state_ {State::initial};
 
 	// The last valid state of this command buffer. We store this since
 	// it can be useful to know when inspecting a command buffer.
@@ -101,6 +114,14 @@ private:
 	u32 ignoreEndDebugLabels_ {}; // See docs/debug-utils-label-nesting.md
 	PushConstantData pushConstants_ {};
 
+	// Whether the current state was referenced by a command since it
+	// was last modified. Shared state is immutable, it's copied on
+	// the next modification. See newGraphicsState.
+	bool computeStateShared_ {};
+	bool graphicsStateShared_ {};
+	bool rayTracingStateShared_ {};
+	bool pushConstantsShared_ {};
+
 	RecordBuilder builder_;
 
 public: // Only public for recording, should not be accessed outside api
@@ -117,17 +138,27 @@ public: // Only public for recording, should not be accessed outside api
 	void popLabelSections();
 	auto& ignoreEndDebugLabels() { return ignoreEndDebugLabels_; }
 
-	const ComputeState& computeState() { return *computeState_; }
-	const GraphicsState& graphicsState() { return *graphicsState_; }
-	const RayTracingState& rayTracingState() { return *rayTracingState_; }
-	PushConstantData& pushConstants() { return pushConstants_; }
-
+	// Return the current state for a command referencing it.
+	// The returned state is immutable from then on.
+	const ComputeState& computeState();
+	const GraphicsState& graphicsState();
+	const RayTracingState& rayTracingState();
+	const PushConstantData& pushConstants();
+
+	// Return the current state for modification. A new state is only
+	// created when the current one was referenced by a command since the
+	// last modification, i.e. multiple binds between two draws all
+	// modify the same state.
 	ComputeState& newComputeState();
 	GraphicsState& newGraphicsState();
 	RayTracingState& newRayTracingState();
 
+	// Writes the given data into the current push constants, at 'offset'.
+	void updatePushConstants(u32 offset, span<const std::byte> data);
+
 	// Expects device mutex to be locked
 	void clearPendingLocked();
+	// Might lock the device mutex, expects it to be unlocked.
 	void doReset(bool record);
 	void doEnd();
 
@@ -137,6 +168,16 @@ public: // Only public for recording, should not be accessed outside api
 	}
 };
 
+// Queues a record that was replaced as lastRecord_ of its command buffer
+// without holding the device mutex. Lock-free.
+void pushReplacedRecord(Device& dev, IntrusivePtr<CommandRecord> rec);
+
+// Disconnects all queued replaced records from their command buffers.
+// Expects device mutex to be locked. The references are moved into
+// 'released', they must only be destroyed after the mutex is unlocked.
+void disconnectReplacedRecordsLocked(Device& dev,
+	std::vector<IntrusivePtr<CommandRecord>>& released);
+
 inline CommandBuffer& getCommandBuffer(VkCommandBuffer handle) {
 	if(HandleDesc<VkCommandBuffer>::wrap) {
 		return unwrap(handle);
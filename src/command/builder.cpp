@@ -126,6 +126,7 @@ void RecordBuilder::append(Command& cmd) {
 #endif // VIL_COMMAND_CALLSTACKS
 
 	// add to stats
+	record_->categories |= cmd.category();
 	++section_->cmd->stats_.numTotalCommands;
 	switch(cmd.category()) {
 		case CommandCategory::draw:
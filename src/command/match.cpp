@@ -9,8 +9,10 @@
 #include <sync.hpp>
 #include <image.hpp>
 #include <buffer.hpp>
+#include <util/util.hpp>
 #include <util/dlg.hpp>
 #include <util/profiling.hpp>
+#include <unordered_map>
 
 // We interpret matching of two command sequences submitted
 // to the gpu as an instance of the common longest subsequence
@@ -60,7 +62,76 @@ void addBits(MatchVal& m, T a, T b) {
 	}
 }
 
+u64 computeMatchHash(const RenderPassDesc& desc) {
+	// Must only include what equal() compares, in the same way.
+	std::size_t h = 0u;
+	hash_combine(h, desc.attachments.size());
+	hash_combine(h, desc.subpasses.size());
+
+	for(auto& att : desc.attachments) {
+		hash_combine(h, u32(att.format));
+		hash_combine(h, u32(att.loadOp));
+		hash_combine(h, u32(att.storeOp));
+		hash_combine(h, u32(att.initialLayout));
+		hash_combine(h, u32(att.finalLayout));
+		hash_combine(h, u32(att.stencilLoadOp));
+		hash_combine(h, u32(att.stencilStoreOp));
+		hash_combine(h, u32(att.samples));
+	}
+
+	auto hashRef = [&](const VkAttachmentReference2& ref) {
+		hash_combine(h, ref.attachment);
+		if(ref.attachment != VK_ATTACHMENT_UNUSED) {
+			hash_combine(h, ref.aspectMask);
+		}
+	};
+
+	for(auto& sub : desc.subpasses) {
+		hash_combine(h, sub.colorAttachmentCount);
+		hash_combine(h, sub.preserveAttachmentCount);
+		hash_combine(h, bool(sub.pDepthStencilAttachment));
+		hash_combine(h, bool(sub.pResolveAttachments));
+		hash_combine(h, sub.inputAttachmentCount);
+		hash_combine(h, u32(sub.pipelineBindPoint));
+
+		for(auto j = 0u; j < sub.colorAttachmentCount; ++j) {
+			hashRef(sub.pColorAttachments[j]);
+		}
+
+		for(auto j = 0u; j < sub.inputAttachmentCount; ++j) {
+			hashRef(sub.pInputAttachments[j]);
+		}
+
+		for(auto j = 0u; j < sub.preserveAttachmentCount; ++j) {
+			hash_combine(h, sub.pPreserveAttachments[j]);
+		}
+
+		if(sub.pResolveAttachments) {
+			for(auto j = 0u; j < sub.colorAttachmentCount; ++j) {
+				hashRef(sub.pResolveAttachments[j]);
+			}
+		}
+
+		if(sub.pDepthStencilAttachment) {
+			hashRef(*sub.pDepthStencilAttachment);
+		}
+	}
+
+	// zero means 'not computed'
+	return h ? u64(h) : 1u;
+}
+
 bool equal(const RenderPassDesc& a, const RenderPassDesc& b) {
+	if(&a == &b) {
+		return true;
+	}
+
+	// Cheap early-out, this is called for every candidate pair when
+	// matching render passes and graphics pipelines.
+	if(a.matchHash && b.matchHash && a.matchHash != b.matchHash) {
+		return false;
+	}
+
 	if(a.subpasses.size() != b.subpasses.size() ||
 			a.attachments.size() != b.attachments.size()) {
 		return false;
@@ -336,7 +407,7 @@ MatchVal matchPipe(const ComputePipeline& a, const ComputePipeline& b) {
 	return matchStages({{a.stage}}, {{b.stage}}, 10.f);
 }
 
-MatchVal matchDeep(const Pipeline& a, const Pipeline& b) {
+MatchVal matchPipes(const Pipeline& a, const Pipeline& b) {
 	if(a.type != b.type) {
 		return MatchVal::noMatch();
 	}
@@ -365,6 +436,49 @@ MatchVal matchDeep(const Pipeline& a, const Pipeline& b) {
 	}
 }
 
+namespace {
+
+struct PipeIDPairHash {
+	std::size_t operator()(const std::pair<u64, u64>& ids) const {
+		std::size_t h = 0u;
+		hash_combine(h, ids.first);
+		hash_combine(h, ids.second);
+		return h;
+	}
+};
+
+} // anon namespace
+
+MatchVal matchDeep(const Pipeline& a, const Pipeline& b) {
+	// Pipelines (and everything compared for them) are immutable, so the
+	// result for a pair never changes. The same pairs are compared over and
+	// over though, for every candidate pair of bind commands in every
+	// matching. Thread-local since matching happens concurrently in
+	// submissions and the gui, avoiding any locking.
+	// NOTE: shader modules are compared by name as well, renaming them
+	// after the pipeline was first matched isn't reflected.
+	constexpr auto maxCacheSize = 16 * 1024u;
+	thread_local std::unordered_map<std::pair<u64, u64>, MatchVal,
+		PipeIDPairHash> cache;
+
+	auto key = std::pair(a.id, b.id);
+	auto it = cache.find(key);
+	if(it != cache.end()) {
+		return it->second;
+	}
+
+	auto ret = matchPipes(a, b);
+
+	// Ids are never reused, entries of destroyed pipelines would just
+	// stay around. Dropping everything now and then is simplest.
+	if(cache.size() >= maxCacheSize) {
+		cache.clear();
+	}
+
+	cache.emplace(key, ret);
+	return ret;
+}
+
 float eval(const MatchVal& m) {
 	dlg_assertm(valid(m), "match {}, total {}", m.match, m.total);
 	if(m.match == 0.f) { // no match
@@ -850,12 +964,15 @@ float approxTotalWeight(const FrameSubmission& subm) {
 	return ret;
 }
 
+// The matcher may allocate from localMem.tc outside of nested scopes
+// as well, e.g. to store its evaluations.
+template<typename Matcher>
 LazyMatrixMarch::Result runLMM(u32 width, u32 height,
-		LinAllocScope& localMem, LazyMatrixMarch::Matcher matcher) {
+		LinAllocScope& localMem, Matcher&& matcher) {
 	constexpr auto branchThreshold = 0.9f;
 	auto customUse = localMem.customUse();
-	LazyMatrixMarch lmm(width, height, localMem.tc, matcher, branchThreshold);
-	return lmm.run();
+	LazyMatrixMarch lmm(width, height, localMem.tc, branchThreshold);
+	return lmm.run(matcher);
 }
 
 // For command matching
@@ -930,8 +1047,10 @@ CommandSectionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 		++id;
 	}
 
-	// the resulting matches, filled lazily
-	auto evalMatches = localMem.alloc<CommandSectionMatch>(numSectionsA * numSectionsB);
+	// the resulting matches in evaluation order, filled lazily.
+	// Only the fields visited by the LMM are evaluated, see
+	// LazyMatrixMarch::ResultMatch::evalID.
+	LinAllocVector<CommandSectionMatch> evalMatches(localMem.tc);
 
 	// our matcher as passed to the matching algorithm below
 	auto matchingFunc = [&](u32 i, u32 j) {
@@ -940,8 +1059,8 @@ CommandSectionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 		auto& parentA = *sectionsA[i];
 		auto& parentB = *sectionsB[j];
 
-		auto& dst = evalMatches[j * numSectionsA + i];
-		dlg_assert(!dst.a);
+		// must be allocated before localNext
+		auto& dst = evalMatches.emplace_back();
 
 		// make sure that we can re-use the local memory after this
 		LinAllocScope localNext(localMem.tc);
@@ -967,8 +1086,9 @@ CommandSectionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 	auto nextI = 0u;
 	auto nextJ = 0u;
 	for(auto& match : lmmRes.matches) {
-		auto& src = evalMatches[match.j * numSectionsA + match.i];
-		dlg_assert(src.a);
+		auto& src = evalMatches[match.evalID];
+		dlg_assert(src.a == sectionsA[match.i]);
+		dlg_assert(src.b == sectionsB[match.j]);
 
 		ret.children[id] = src;
 		ret.match.match += src.match.match;
@@ -1030,11 +1150,12 @@ FrameSubmissionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 		return ret;
 	}
 
-	// the resulting matches, filled lazily
-	auto evalMatches = localMem.alloc<CommandRecordMatch>(
-		a.submissions.size() * b.submissions.size());
+	// the resulting matches in evaluation order, filled lazily
+	LinAllocVector<CommandRecordMatch> evalMatches(localMem.tc);
 
 	auto matchingFunc = [&](u32 i, u32 j) {
+		// must be allocated before nextLocalMem
+		auto& dst = evalMatches.emplace_back();
 		LinAllocScope nextLocalMem(localMem.tc);
 
 		// TODO: consider name and other properties of the records?
@@ -1044,11 +1165,11 @@ FrameSubmissionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 		auto ret = match(retMem, nextLocalMem,
 			mt, *recA.commands, *recB.commands);
 
-		evalMatches[j * a.submissions.size() + i].a = &recA;
-		evalMatches[j * a.submissions.size() + i].b = &recB;
-		evalMatches[j * a.submissions.size() + i].matches = retMem.alloc<CommandSectionMatch>(1u);
-		evalMatches[j * a.submissions.size() + i].matches[0] = ret;
-		evalMatches[j * a.submissions.size() + i].match = ret.match;
+		dst.a = &recA;
+		dst.b = &recB;
+		dst.matches = retMem.alloc<CommandSectionMatch>(1u);
+		dst.matches[0] = ret;
+		dst.match = ret.match;
 
 		return eval(ret.match);
 	};
@@ -1062,7 +1183,7 @@ FrameSubmissionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 	auto nextI = 0u;
 	auto nextJ = 0u;
 	for(auto& match : lmmRes.matches) {
-		auto& src = evalMatches[match.j * a.submissions.size() + match.i];
+		auto& src = evalMatches[match.evalID];
 		ret.matches[id] = src;
 		ret.match.match += src.match.match;
 		ret.match.total += src.match.total;
@@ -1104,15 +1225,15 @@ FrameMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 		return {MatchVal::noMatch(), {}};
 	}
 
-	// the resulting matches, filled lazily
-	auto evalMatches = localMem.alloc<FrameSubmissionMatch>(
-		a.size() * b.size());
+	// the resulting matches in evaluation order, filled lazily
+	LinAllocVector<FrameSubmissionMatch> evalMatches(localMem.tc);
 
 	auto matchingFunc = [&](u32 i, u32 j) {
+		// must be allocated before nextLocalMem
+		auto& dst = evalMatches.emplace_back();
 		LinAllocScope nextLocalMem(localMem.tc);
-		auto ret = match(retMem, nextLocalMem, mt, a[i], b[j]);
-		evalMatches[j * a.size() + i] = ret;
-		return eval(ret.match);
+		dst = match(retMem, nextLocalMem, mt, a[i], b[j]);
+		return eval(dst.match);
 	};
 
 	auto lmmRes = runLMM(a.size(), b.size(), localMem, matchingFunc);
@@ -1124,7 +1245,7 @@ FrameMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 	auto nextI = 0u;
 	auto nextJ = 0u;
 	for(auto& match : lmmRes.matches) {
-		auto& src = evalMatches[match.j * a.size() + match.i];
+		auto& src = evalMatches[match.evalID];
 		ret.matches[id] = src;
 		ret.match.match += src.match.match;
 		ret.match.total += src.match.total;
@@ -0,0 +1,378 @@
+#include <command/reclaim.hpp>
+#include <command/record.hpp>
+#include <stats.hpp>
+#include <util/profiling.hpp>
+#include <algorithm>
+#include <chrono>
+
+namespace vil {
+
+namespace {
+
+// Whether the current thread is the thread of a DestroyQueue.
+thread_local bool onDestroyThread = false;
+
+u64 nowNs() {
+	using namespace std::chrono;
+	return u64(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+} // anon namespace
+
+HandleReclaimer::~HandleReclaimer() {
+	dlg_assertm(aliveRecords_ == 0u, "{}", aliveRecords_);
+	dlg_assert(!newRecords_.load());
+	releaseAll();
+}
+
+void HandleReclaimer::registerRecord(CommandRecord& rec) {
+	auto& entry = rec.reclaimEntry;
+	dlg_assert(!entry.registered);
+	entry.registered = true;
+
+	auto* head = newRecords_.load(std::memory_order_relaxed);
+	do {
+		entry.nextNew = head;
+	} while(!newRecords_.compare_exchange_weak(head, &rec,
+		std::memory_order_release, std::memory_order_relaxed));
+}
+
+void HandleReclaimer::addNewRecordsLocked() {
+	auto* rec = newRecords_.exchange(nullptr, std::memory_order_acquire);
+	if(!rec) {
+		return;
+	}
+
+	// Records not added yet can't reference handles retired before,
+	// see registerRecord.
+	if(gens_.empty() || !gens_.back().retired.empty()) {
+		gens_.emplace_back();
+	}
+
+	auto& gen = gens_.back();
+	while(rec) {
+		auto& entry = rec->reclaimEntry;
+		auto* next = entry.nextNew;
+		entry.gen = &gen;
+		entry.index = u32(gen.records.size());
+		entry.nextNew = nullptr;
+		gen.records.push_back(rec);
+		++aliveRecords_;
+		rec = next;
+	}
+}
+
+void HandleReclaimer::unregisterRecord(CommandRecord& rec) {
+	ZoneScoped;
+
+	auto& entry = rec.reclaimEntry;
+	dlg_assert(entry.registered);
+
+	// destroyed outside the critical section
+	std::vector<RetiredHandle> released;
+
+	{
+		std::lock_guard lock(mutex_);
+		if(!entry.gen) {
+			addNewRecordsLocked();
+		}
+
+		dlg_assert(entry.gen);
+		auto& records = entry.gen->records;
+		dlg_assert(entry.index < records.size());
+		dlg_assert(records[entry.index] == &rec);
+
+		records[entry.index] = records.back();
+		records[entry.index]->reclaimEntry.index = entry.index;
+		records.pop_back();
+
+		dlg_assert(aliveRecords_ > 0u);
+		--aliveRecords_;
+		entry = {};
+
+		popUnreferenced(released);
+	}
+}
+
+void HandleReclaimer::retireLocked(const void* handle, RetiredHandle ref,
+		std::vector<RetiredHandle>& released) {
+	std::lock_guard lock(mutex_);
+	addNewRecordsLocked();
+
+	if(aliveRecords_ == 0u) {
+		released.push_back(std::move(ref));
+		return;
+	}
+
+	dlg_assert(!gens_.empty());
+	gens_.back().retired.push_back({handle, std::move(ref)});
+	++retiredCount_;
+	++DebugStats::get().retiredHandles;
+
+	if(retiredCount_ >= sweepCount_) {
+		sweepLocked(released);
+		sweepCount_ = std::max(minSweepCount, 2 * retiredCount_);
+	}
+}
+
+void HandleReclaimer::popUnreferenced(std::vector<RetiredHandle>& released) {
+	// The retired handles of a generation can only be referenced by
+	// records of the same or earlier generations.
+	while(!gens_.empty() && gens_.front().records.empty()) {
+		auto& front = gens_.front();
+		for(auto& retired : front.retired) {
+			released.push_back(std::move(retired.ref));
+		}
+
+		dlg_assert(retiredCount_ >= front.retired.size());
+		retiredCount_ -= u32(front.retired.size());
+		DebugStats::get().retiredHandles -= u32(front.retired.size());
+		gens_.pop_front();
+	}
+}
+
+void HandleReclaimer::moveRecords(Generation& src, Generation& dst) {
+	for(auto* rec : src.records) {
+		rec->reclaimEntry.gen = &dst;
+		rec->reclaimEntry.index = u32(dst.records.size());
+		dst.records.push_back(rec);
+	}
+
+	src.records.clear();
+}
+
+void HandleReclaimer::sweepLocked(std::vector<RetiredHandle>& released) {
+	ZoneScoped;
+
+	// Only reached when old records keep retired handles alive, e.g.
+	// records of command buffers that are recorded once and then
+	// submitted forever. Check which of the retired handles are actually
+	// used by those records.
+	// NOTE: we can only inspect finished records, the used handles of
+	// records that are still being recorded are changing. They are
+	// immutable once 'finished' is set, see CommandBuffer::doEnd.
+	std::vector<const CommandRecord*> older;
+	auto unfinished = false;
+	for(auto& gen : gens_) {
+		for(auto* rec : gen.records) {
+			unfinished |= !rec->finished.load(std::memory_order_acquire);
+			older.push_back(rec);
+		}
+
+		if(unfinished) {
+			break;
+		}
+
+		auto isUsed = [&](const Retired& retired) {
+			for(auto* rec : older) {
+				if(rec->used.contains(retired.handle)) {
+					return true;
+				}
+			}
+
+			return false;
+		};
+
+		auto it = std::stable_partition(gen.retired.begin(), gen.retired.end(), isUsed);
+		auto count = u32(gen.retired.end() - it);
+		for(auto rit = it; rit != gen.retired.end(); ++rit) {
+			released.push_back(std::move(rit->ref));
+		}
+
+		gen.retired.erase(it, gen.retired.end());
+		retiredCount_ -= count;
+		DebugStats::get().retiredHandles -= count;
+	}
+
+	// Merge generations without retired handles into the next one.
+	// That doesn't change anything since the retired handles of the next
+	// generation already wait for the records of this one.
+	for(auto it = gens_.begin(); it != gens_.end() && std::next(it) != gens_.end();) {
+		if(it->retired.empty()) {
+			moveRecords(*it, *std::next(it));
+			it = gens_.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	popUnreferenced(released);
+}
+
+void HandleReclaimer::releaseAll() {
+	std::vector<RetiredHandle> released;
+
+	{
+		std::lock_guard lock(mutex_);
+		for(auto& gen : gens_) {
+			for(auto& retired : gen.retired) {
+				released.push_back(std::move(retired.ref));
+			}
+
+			gen.retired.clear();
+		}
+
+		DebugStats::get().retiredHandles -= retiredCount_;
+		retiredCount_ = 0u;
+	}
+}
+
+u32 HandleReclaimer::retiredCount() const {
+	std::lock_guard lock(mutex_);
+	return retiredCount_;
+}
+
+// DestroyQueue
+DestroyQueue::~DestroyQueue() {
+	stop();
+}
+
+void DestroyQueue::start() {
+	dlg_assert(!thread_.joinable());
+
+	run_ = true;
+	running_.store(true, std::memory_order_release);
+	thread_ = std::thread([this]{ run(); });
+}
+
+void DestroyQueue::stop() {
+	if(!thread_.joinable()) {
+		return;
+	}
+
+	// From here on, new pushes destroy their object inline
+	running_.store(false);
+
+	{
+		std::lock_guard lock(mutex_);
+		run_ = false;
+	}
+
+	cv_.notify_one();
+	thread_.join();
+
+	// Pushes that saw the queue running might still be adding their
+	// node after the thread destroyed the last ones. Wait for them and
+	// destroy what they pushed here.
+	while(pushing_.load() != 0u) {
+		std::this_thread::yield();
+	}
+
+	destroyPending();
+	dlg_assert(!head_.load());
+}
+
+void DestroyQueue::push(DestroyNode& node) {
+	dlg_assert(node.object && node.destroy);
+
+	if(onDestroyThread) {
+		node.destroy(node.object);
+		return;
+	}
+
+	// Announced before checking running_, see stop
+	++pushing_;
+	if(!running_.load()) {
+		--pushing_;
+		node.destroy(node.object);
+		return;
+	}
+
+	node.enqueueTime = nowNs();
+	++DebugStats::get().destroyQueueDepth;
+	pushed_.fetch_add(1u, std::memory_order_relaxed);
+
+	auto* head = head_.load(std::memory_order_relaxed);
+	do {
+		node.next = head;
+	} while(!head_.compare_exchange_weak(head, &node,
+		std::memory_order_release, std::memory_order_relaxed));
+
+	// Only wake up the thread when the queue was empty. Locking the mutex
+	// makes sure the thread either sees the new node when checking its
+	// wait condition or is already waiting.
+	if(!head) {
+		{
+			std::lock_guard lock(mutex_);
+		}
+
+		cv_.notify_one();
+	}
+
+	pushing_.fetch_sub(1u, std::memory_order_release);
+}
+
+void DestroyQueue::flush() {
+	if(onDestroyThread || !running()) {
+		return;
+	}
+
+	auto target = pushed_.load(std::memory_order_acquire);
+	std::unique_lock lock(mutex_);
+	doneCv_.wait(lock, [&]{
+		return destroyed_.load(std::memory_order_acquire) >= target;
+	});
+}
+
+void DestroyQueue::run() {
+	onDestroyThread = true;
+
+	while(true) {
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{
+				return !run_ || head_.load(std::memory_order_relaxed);
+			});
+
+			if(!run_ && !head_.load(std::memory_order_relaxed)) {
+				break;
+			}
+		}
+
+		destroyPending();
+	}
+}
+
+void DestroyQueue::destroyPending() {
+	ZoneScoped;
+
+	// the list is in reverse push order
+	auto* node = head_.exchange(nullptr, std::memory_order_acquire);
+	DestroyNode* ordered {};
+	while(node) {
+		auto* next = node->next;
+		node->next = ordered;
+		ordered = node;
+		node = next;
+	}
+
+	auto count = 0u;
+	auto maxLatency = u64(0u);
+	while(ordered) {
+		auto* next = ordered->next;
+		maxLatency = std::max(maxLatency, nowNs() - ordered->enqueueTime);
+		// might destroy the node
+		ordered->destroy(ordered->object);
+		ordered = next;
+		++count;
+	}
+
+	auto& stats = DebugStats::get();
+	stats.destroyQueueDepth -= count;
+	stats.destroyQueueLatency.store(maxLatency, std::memory_order_relaxed);
+
+	auto oldMax = stats.destroyQueueMaxLatency.load(std::memory_order_relaxed);
+	while(oldMax < maxLatency && !stats.destroyQueueMaxLatency.compare_exchange_weak(
+		oldMax, maxLatency, std::memory_order_relaxed)) {
+	}
+
+	destroyed_.fetch_add(count, std::memory_order_release);
+
+	{
+		std::lock_guard lock(mutex_);
+	}
+
+	doneCv_.notify_all();
+}
+
+} // namespace vil
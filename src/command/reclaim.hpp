@@ -0,0 +1,212 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/debugMutex.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace vil {
+
+// Whether handles of type T can be in CommandRecord::used, i.e. whether
+// they have to be retired on destruction, see HandleReclaimer.
+template<typename T> constexpr bool usedByRecords =
+	std::is_same_v<T, Image> ||
+	std::is_same_v<T, Buffer> ||
+	std::is_same_v<T, ImageView> ||
+	std::is_same_v<T, BufferView> ||
+	std::is_same_v<T, Sampler> ||
+	std::is_same_v<T, AccelStruct> ||
+	std::is_same_v<T, Event> ||
+	std::is_same_v<T, QueryPool> ||
+	std::is_same_v<T, RenderPass> ||
+	std::is_same_v<T, Framebuffer> ||
+	std::is_same_v<T, DescriptorPool> ||
+	std::is_same_v<T, PipelineLayout> ||
+	std::is_same_v<T, DescriptorUpdateTemplate> ||
+	std::is_same_v<T, GraphicsPipeline> ||
+	std::is_same_v<T, ComputePipeline> ||
+	std::is_same_v<T, RayTracingPipeline> ||
+	std::is_same_v<T, ShaderObject> ||
+	std::is_same_v<T, IndirectCommandsLayout> ||
+	std::is_same_v<T, IndirectExecutionSet>;
+
+// Type-erased reference to a destroyed handle, see HandleReclaimer.
+using RetiredHandle = std::unique_ptr<void, void(*)(void*)>;
+
+// Deferred reclamation of the handles used by CommandRecords.
+// CommandRecords don't reference count the handles they use. That would
+// mean an atomic operation on a shared cache line for every handle used
+// by a record (and again on destruction of the record), heavily
+// contended for handles used by every record, e.g. the depth buffer.
+// Instead, records register themselves in the current generation on
+// creation. When the application destroys a handle, the device hands a
+// reference to it to the reclaimer instead of just dropping it. It is
+// retired into the latest generation: only records registered in this
+// or earlier generations can reference it. Records registered after
+// that are put into a new generation. The reference is released when
+// no such records are alive anymore or, on the occasional sweep, when
+// none of them actually uses the handle.
+// Registration is lock-free: records are pushed onto a list and only put
+// into a generation the next time the mutex is locked anyways. That is
+// correct since a record that uses a handle registered before the handle
+// was destroyed, so retiring it sees the record.
+// Unregistering still locks the mutex. It runs in the destructor of the
+// record, on the DestroyQueue thread when that is running.
+class HandleReclaimer {
+public:
+	struct Generation;
+
+	// Position of a registered record, stored in the record.
+	struct RecordEntry {
+		bool registered {};
+		// Null while the record is only in the list of new records.
+		// Only accessed while the mutex is locked.
+		Generation* gen {};
+		u32 index {};
+		CommandRecord* nextNew {}; // see newRecords_
+	};
+
+	// Minimum number of retired handles that triggers a sweep.
+	static constexpr auto minSweepCount = 64u;
+
+public:
+	HandleReclaimer() = default;
+	~HandleReclaimer();
+
+	HandleReclaimer(const HandleReclaimer&) = delete;
+	HandleReclaimer& operator=(const HandleReclaimer&) = delete;
+
+	// Lock-free.
+	void registerRecord(CommandRecord& rec);
+
+	// Releases the retired handles that can't be referenced anymore.
+	// Must not be called while the device mutex is locked.
+	void unregisterRecord(CommandRecord& rec);
+
+	// Keeps a reference to the given destroyed handle until no record
+	// can reference it anymore.
+	// Must be called while the device mutex is locked. References that
+	// can be released right away are appended to 'released', they must
+	// only be destroyed after the device mutex is unlocked.
+	template<typename P>
+	void retireLocked(const P& ptr, std::vector<RetiredHandle>& released) {
+		RetiredHandle ref(new P(ptr), [](void* p) { delete static_cast<P*>(p); });
+		retireLocked(static_cast<const void*>(ptr.get()), std::move(ref), released);
+	}
+
+	// Releases all retired handles, no matter whether they might still be
+	// referenced. Only used on device destruction.
+	void releaseAll();
+
+	// Number of retired handles not yet released.
+	u32 retiredCount() const;
+
+	struct Retired {
+		const void* handle;
+		RetiredHandle ref;
+	};
+
+	struct Generation {
+		std::vector<CommandRecord*> records;
+		std::vector<Retired> retired;
+	};
+
+private:
+	void retireLocked(const void* handle, RetiredHandle ref,
+		std::vector<RetiredHandle>& released);
+	void popUnreferenced(std::vector<RetiredHandle>& released);
+	void sweepLocked(std::vector<RetiredHandle>& released);
+	void moveRecords(Generation& src, Generation& dst);
+	void addNewRecordsLocked();
+
+	// Records registered since the mutex was last locked, linked via
+	// RecordEntry::nextNew.
+	std::atomic<CommandRecord*> newRecords_ {};
+
+	mutable vilDefMutex(mutex_);
+	std::list<Generation> gens_;
+	u32 aliveRecords_ {};
+	u32 retiredCount_ {};
+	u32 sweepCount_ {minSweepCount};
+};
+
+// Entry of a DestroyQueue. Embedded into the objects whose destruction
+// is deferred, e.g. CommandRecord.
+struct DestroyNode {
+	DestroyNode* next {};
+	void* object {};
+	void (*destroy)(void* object) {};
+	u64 enqueueTime {}; // in ns, steady clock
+};
+
+// Layer-owned thread that destroys objects whose last reference was
+// dropped on another thread. Destroying a CommandRecord (or a copied
+// descriptor state) is expensive: it frees its memory blocks, unregisters
+// from the HandleReclaimer and destroys its hook records. With the queue
+// running, application threads only enqueue the object.
+// Pushing is lock-free, the background thread destroys the objects
+// in push order.
+class DestroyQueue {
+public:
+	DestroyQueue() = default;
+	~DestroyQueue();
+
+	DestroyQueue(const DestroyQueue&) = delete;
+	DestroyQueue& operator=(const DestroyQueue&) = delete;
+
+	void start();
+
+	// Joins the thread and destroys all pending objects, also the ones of
+	// pushes racing with stopping. Objects pushed afterwards are destroyed
+	// inline.
+	void stop();
+
+	// Enqueues the given node, node.object and node.destroy must be set.
+	// When the thread isn't running or this is called from the thread
+	// itself (destructors releasing further objects), the object is
+	// destroyed immediately.
+	void push(DestroyNode& node);
+
+	// Destroys the given value on the background thread.
+	template<typename T>
+	void pushValue(T&& value) {
+		struct Boxed {
+			DestroyNode node;
+			std::decay_t<T> value;
+		};
+
+		auto* boxed = new Boxed{{}, std::forward<T>(value)};
+		boxed->node.object = boxed;
+		boxed->node.destroy = [](void* ptr) { delete static_cast<Boxed*>(ptr); };
+		push(boxed->node);
+	}
+
+	// Blocks until all objects pushed before were destroyed.
+	void flush();
+
+	bool running() const { return running_.load(std::memory_order_acquire); }
+
+private:
+	void run();
+	void destroyPending();
+
+	std::atomic<DestroyNode*> head_ {};
+	std::atomic<bool> running_ {};
+	std::atomic<u32> pushing_ {}; // number of pushes in progress, see stop
+	std::atomic<u64> pushed_ {};
+	std::atomic<u64> destroyed_ {};
+
+	std::mutex mutex_;
+	std::condition_variable cv_; // signaled when the queue becomes non-empty
+	std::condition_variable doneCv_; // signaled after destroying a batch
+	bool run_ {}; // protected by mutex_
+	std::thread thread_;
+};
+
+} // namespace vil
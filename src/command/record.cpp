@@ -72,8 +72,13 @@ CommandRecord::CommandRecord(ManualTag, Device* xdev) :
 		pushLables(alloc),
 		accelStructCopies(alloc),
 		used(alloc),
-		secondaries(alloc) {
+		secondaries(alloc),
+		writtenHandles(alloc) {
 	++DebugStats::get().aliveRecords;
+
+	if(dev) {
+		dev->reclaimer.registerRecord(*this);
+	}
 }
 
 CommandRecord::~CommandRecord() {
@@ -89,10 +94,29 @@ CommandRecord::~CommandRecord() {
 		dlg_assert(hookRecords.empty());
 	}
 
+	// the used handles might be destroyed after this
+	if(reclaimEntry.registered) {
+		dev->reclaimer.unregisterRecord(*this);
+	}
+
 	dlg_assert(DebugStats::get().aliveRecords > 0);
 	--DebugStats::get().aliveRecords;
 }
 
+void IntrusiveDeleter<CommandRecord>::operator()(CommandRecord* rec) const {
+	if(!rec->dev) {
+		delete rec;
+		return;
+	}
+
+	rec->destroyNode.object = rec;
+	rec->destroyNode.destroy = [](void* ptr) {
+		delete static_cast<CommandRecord*>(ptr);
+	};
+
+	rec->dev->destroyQueue.push(rec->destroyNode);
+}
+
 // util
 void bindPushDescriptors(Device& dev, VkCommandBuffer cb, VkPipelineBindPoint bbp,
 		BoundDescriptorSet& bds, u32 setID) {
@@ -401,6 +425,172 @@ CommandRecord::UsedHandles::UsedHandles(LinAllocator& alloc) :
 		images(alloc) {
 }
 
+void CommandRecord::UsedHandles::compact() {
+	ZoneScoped;
+
+	buffers.compact();
+	graphicsPipes.compact();
+	computePipes.compact();
+	rtPipes.compact();
+	pipeLayouts.compact();
+	dsuTemplates.compact();
+	renderPasses.compact();
+	framebuffers.compact();
+	queryPools.compact();
+	imageViews.compact();
+	bufferViews.compact();
+	samplers.compact();
+	accelStructs.compact();
+	events.compact();
+	dsPools.compact();
+	shaderObjects.compact();
+	indirectCommandLayouts.compact();
+	indirectExecutionSets.compact();
+	descriptorSets.compact();
+	images.compact();
+}
+
+namespace {
+
+// Calls the given function for all Images and Buffers bound as storage
+// descriptors in the given state.
+template<typename F>
+void forEachStorageHandle(DescriptorStateRef state, F&& f) {
+	for(auto b = 0u; b < state.layout->bindings.size(); ++b) {
+		auto type = state.layout->bindings[b].descriptorType;
+		if(type != VK_DESCRIPTOR_TYPE_MUTABLE_EXT && !isStorage(type)) {
+			continue;
+		}
+
+		for(auto e = 0u; e < descriptorCount(state, b); ++e) {
+			switch(descriptorType(state, b, e)) {
+				case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: {
+					auto* view = dsImage(state, b, e).imageView;
+					if(view && view->img) {
+						f(*view->img);
+					}
+					break;
+				} case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+				case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: {
+					auto* buf = dsBuffer(state, b, e).buffer;
+					if(buf) {
+						f(*buf);
+					}
+					break;
+				} case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: {
+					auto* view = dsBufferView(state, b, e).bufferView;
+					if(view && view->buffer) {
+						f(*view->buffer);
+					}
+					break;
+				} default:
+					break;
+			}
+		}
+	}
+}
+
+bool canUpdateWhilePending(const DescriptorSetLayout& layout) {
+	constexpr auto pendingFlags =
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	for(auto& binding : layout.bindings) {
+		if((binding.flags & pendingFlags) &&
+				(binding.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT ||
+				 isStorage(binding.descriptorType))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // anon namespace
+
+void resolveWritesLocked(CommandRecord& rec) {
+	assertOwned(rec.dev->mutex);
+	dlg_assert(rec.finished);
+
+	if(rec.writesResolved) {
+		return;
+	}
+
+	ZoneScoped;
+
+	ThreadMemScope tms;
+	ScopedVector<const void*> handles(tms);
+	handles.insert(handles.end(), rec.writes.handles().begin(),
+		rec.writes.handles().end());
+	auto count = handles.size();
+
+	for(auto& uds : rec.used.descriptorSets) {
+		// we know that the descriptor set is valid while the record
+		// is being submitted
+		auto& ds = *static_cast<DescriptorSet*>(uds.ds);
+		dlg_assert(ds.layout);
+		if(canUpdateWhilePending(*ds.layout)) {
+			rec.volatileWriteSets.push_back(&ds);
+			continue;
+		}
+
+		auto lock = ds.lock();
+		forEachStorageHandle(ds, [&](const Handle& handle) {
+			handles.push_back(&handle);
+		});
+	}
+
+	if(handles.size() != count) {
+		rec.writes.build(handles);
+	}
+
+	rec.writesResolved = true;
+}
+
+bool potentiallyWritesLocked(CommandRecord& rec, const Handle& handle) {
+	resolveWritesLocked(rec);
+
+	if(rec.writes.contains(&handle)) {
+		return true;
+	}
+
+	for(auto* ds : rec.volatileWriteSets) {
+		// important that the ds mutex is locked for update_unused_while_pending
+		auto lock = ds->lock();
+		auto found = false;
+		forEachStorageHandle(*ds, [&](const Handle& bound) {
+			found |= (&bound == &handle);
+		});
+
+		if(found) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CommandRecord::UsedHandles::contains(const void* handle) const {
+	return buffers.contains(handle) ||
+		images.contains(handle) ||
+		imageViews.contains(handle) ||
+		bufferViews.contains(handle) ||
+		graphicsPipes.contains(handle) ||
+		computePipes.contains(handle) ||
+		rtPipes.contains(handle) ||
+		pipeLayouts.contains(handle) ||
+		dsuTemplates.contains(handle) ||
+		renderPasses.contains(handle) ||
+		framebuffers.contains(handle) ||
+		queryPools.contains(handle) ||
+		samplers.contains(handle) ||
+		accelStructs.contains(handle) ||
+		events.contains(handle) ||
+		dsPools.contains(handle) ||
+		shaderObjects.contains(handle) ||
+		indirectCommandLayouts.contains(handle) ||
+		indirectExecutionSets.contains(handle);
+}
+
 UsedImage::UsedImage(LinAllocator& alloc) noexcept :
 	RefHandle<Image>(alloc), layoutChanges(alloc) {}
 
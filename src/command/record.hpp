@@ -2,13 +2,18 @@
 
 #include <fwd.hpp>
 #include <nytl/span.hpp>
+#include <nytl/flags.hpp>
 #include <util/linalloc.hpp>
 #include <util/intrusive.hpp>
 #include <util/debugMutex.hpp>
+#include <command/usedHandleSet.hpp>
+#include <command/writeSet.hpp>
+#include <command/reclaim.hpp>
 #include <threadContext.hpp>
 #include <imageLayout.hpp>
 #include <vk/vulkan.h>
 
+#include <atomic>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -62,7 +67,12 @@ using BufferViewDescriptorRef = BufferView*;
 struct DescriptorState {
 	span<BoundDescriptorSet> descriptorSets;
 
-	// Will always re-allocate the descriptorSets span
+	// Whether 'descriptorSets' was allocated for this state, i.e. isn't
+	// shared with any previous state. Only relevant while recording, see
+	// CommandBuffer::newGraphicsState.
+	bool ownsDescriptorSets {};
+
+	// Re-allocates the descriptorSets span unless it's owned by this state.
 	void bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstSet,
 		span<DescriptorSet* const> sets, span<const u32> offsets);
 };
@@ -179,7 +189,18 @@ template<typename K,
 constexpr struct ManualTag {} manualTag;
 
 // NOTE: we don't need RefHandle.commands atm, so we comment it out.
-// Until we use C++20 transparent lookup, it's a major performance impact (see useHandleImpl in cb.cpp)
+// It's a major performance impact (see useHandleImpl in cb.cpp)
+
+// Handler for handle pointers that don't touch the reference count.
+// The handles used by a record are kept alive via HandleReclaimer.
+template<typename T>
+struct NoRefCountHandler {
+	void inc(T&) const noexcept {}
+	void dec(T&) const noexcept {}
+};
+
+template<typename T>
+using UnrefPtr = HandledPtr<T, NoRefCountHandler<T>>;
 
 // Links a 'DeviceHandle' to a 'CommandRecord'.
 template<typename T>
@@ -189,7 +210,7 @@ struct RefHandle {
 	// List of commands where the associated handle is used inside the
 	// associated record.
 	// CommandAllocList<Command*> commands;
-	IntrusivePtr<T> handle;
+	UnrefPtr<T> handle;
 };
 
 template<typename T>
@@ -223,54 +244,8 @@ inline bool operator!=(const UsedDescriptorSet& a, const UsedDescriptorSet& b) {
 	return a.ds != b.ds;
 }
 
-struct RefHandleHash {
-	template<typename T>
-	size_t operator()(const RefHandle<T>& x) const {
-		auto ptr = x.handle.get();
-		return std::hash<std::remove_reference_t<decltype(ptr)>>{}(ptr);
-	}
-};
-
-struct UsedDescriptorHash {
-	size_t operator()(const UsedDescriptorSet& x) const {
-		return std::hash<void*>{}(x.ds);
-	}
-};
-
 template<typename T>
-using UsedHandleSet = CommandAllocHashSet<RefHandle<T>, RefHandleHash>;
-
-template<typename K>
-auto find(UsedHandleSet<K>& used, K& elem) {
-	// TODO: better, transparent find with c++20
-	RefHandle<K> rh(ThreadContext::instance.linalloc_);
-	rh.handle = IntrusivePtr<K>(acquireOwnership, &elem);
-	auto it = used.find(rh);
-	(void) rh.handle.release();
-	return it;
-}
-
-// TODO: kinda hacky, only a template so we don't have to include stuff
-template<typename Image>
-auto find(CommandAllocHashSet<UsedImage, RefHandleHash>& used, Image& elem) {
-	// TODO: better, transparent find with c++20
-	UsedImage rh(ThreadContext::instance.linalloc_);
-	rh.handle = IntrusivePtr<Image>(acquireOwnership, &elem);
-	auto it = used.find(rh);
-	(void) rh.handle.release();
-	return it;
-}
-
-// TODO: kinda hacky, only a template so we don't have to include stuff
-template<typename DescriptorSet>
-inline auto find(CommandAllocHashSet<UsedDescriptorSet, UsedDescriptorHash>& used,
-		DescriptorSet& ds) {
-	// TODO: better, transparent find with c++20
-	UsedDescriptorSet rh(ThreadContext::instance.linalloc_);
-	rh.ds = &ds;
-	auto it = used.find(rh);
-	return it;
-}
+using UsedHandleSet = FlatUsedSet<RefHandle<T>>;
 
 struct AccelStructCopy {
 	AccelStruct* src;
@@ -297,12 +272,19 @@ struct CommandRecord {
 	// Stored separately from cb so that information is retained when cb is unset.
 	// Allocated in memory of CommandRecord.
 	const char* cbName {};
-	// whether the recording is finished (i.e. EndCommandBuffer called)
-	bool finished {};
+	// whether the recording is finished (i.e. EndCommandBuffer called).
+	// Set with release semantics, 'used' is immutable afterwards.
+	std::atomic<bool> finished {};
+	// Link in Device::replacedRecords, see pushReplacedRecord.
+	CommandRecord* nextReplaced {};
 	// whether the record always needs a hook. Currently only true
 	// for records containing CmdBuildAccelerationStructures(Indirect)
 	// since we need to copy the data using for the acceleration structure.
 	bool buildsAccelStructs {};
+	// The categories of all commands in this record, including the ones
+	// of executed secondary records. Allows CommandHook to quickly reject
+	// records that can't contain the hook target.
+	CommandCategoryFlags categories {};
 	// Whether the record has a broken label hierarchy.
 	// Labels allow nesting in ways that mess with a strict hierarchy view.
 	// Will display such records differently by default.
@@ -348,10 +330,17 @@ struct CommandRecord {
 		UsedHandleSet<IndirectCommandsLayout> indirectCommandLayouts;
 		UsedHandleSet<IndirectExecutionSet> indirectExecutionSets;
 
-		CommandAllocHashSet<UsedDescriptorSet, UsedDescriptorHash> descriptorSets;
-		CommandAllocHashSet<UsedImage, RefHandleHash> images;
+		FlatUsedSet<UsedDescriptorSet> descriptorSets;
+		FlatUsedSet<UsedImage> images;
 
 		UsedHandles(LinAllocator& alloc);
+
+		// Compacts all sets, see FlatUsedSet::compact.
+		// Called when the recording ends.
+		void compact();
+
+		// Returns whether the given handle is contained in any of the sets.
+		bool contains(const void* handle) const;
 	} used;
 
 	// We have to keep the secondary records (via cmdExecuteCommands) alive
@@ -359,6 +348,23 @@ struct CommandRecord {
 	// we only reference the CommandRecord objects, don't copy them.
 	CommandAllocList<IntrusivePtr<CommandRecord>> secondaries;
 
+	// Image and Buffer handles directly written by the recorded commands
+	// (transfer destinations, attachments, layout transitions), collected
+	// while recording. Merged into 'writes' when the recording ends.
+	CommandAllocVector<const void*> writtenHandles;
+
+	// Summary of the Image and Buffer handles potentially written by this
+	// record. The storage descriptors of the used descriptor sets are only
+	// added on the first submission since we can only safely access the
+	// sets while the record is pending, see resolveWritesLocked.
+	// Synced via dev mutex once the record is finished.
+	WriteSet writes;
+	bool writesResolved {};
+	// Used descriptor sets that can be updated while the record is
+	// pending (update_after_bind, update_unused_while_pending). They can't
+	// be summarized in 'writes' and have to be checked on every query.
+	std::vector<DescriptorSet*> volatileWriteSets;
+
 	// Ownership of this CommandRecord is shared: while generally it is
 	// not needed anymore as soon as the associated CommandBuffer is
 	// destroyed or a new record completed in it, it may be kept alive
@@ -367,12 +373,30 @@ struct CommandRecord {
 	// though since it may still be in use by command buffer.
 	std::atomic<u32> refCount {0};
 
+	// Registration in the HandleReclaimer of the device.
+	// Only valid for records with a device.
+	HandleReclaimer::RecordEntry reclaimEntry {};
+
+	// Destruction is deferred to the DestroyQueue of the device.
+	DestroyNode destroyNode {};
+
 	// For CommandHook: can store hooked versions of this record here.
 	// Only valid hook records are listed here. Synced via dev mutex.
 	// There may still be invalid hook-records associated with this alive
 	// when they are still in submission.
 	std::vector<CommandHookRecord*> hookRecords;
 
+	// For CommandHook: result of the last search for the hook target in
+	// this record. The commands of a finished record never change, the
+	// result stays valid until the hook target changes or the hook is
+	// invalidated. Synced via dev mutex.
+	struct HookFindCache {
+		u32 hookCounter {}; // CommandHook::counter_
+		u64 targetGeneration {}; // CommandHook::targetGeneration_, 0 is invalid
+		float match {};
+		std::vector<const Command*> hierarchy; // empty if not found
+	} hookFind;
+
 	CommandRecord(CommandBuffer& cb);
 	explicit CommandRecord(ManualTag, Device* dev); // mainly for testing
 	~CommandRecord();
@@ -383,6 +407,16 @@ struct CommandRecord {
 
 void clearHookRecordsLocked(CommandRecord& record);
 
+// Adds the storage descriptors of the descriptor sets used by the given
+// record to its write summary, if not already done.
+// Must only be called while the record is being submitted or pending,
+// i.e. while its descriptor sets are guaranteed to be valid.
+void resolveWritesLocked(CommandRecord& record);
+
+// Returns whether the given record potentially writes the given Image or
+// Buffer. Must only be called while the record is pending.
+bool potentiallyWritesLocked(CommandRecord& record, const Handle& handle);
+
 // Checks if the given bound DescriptorSet is still valid.
 // If so, returns it (and a lock making sure it's kept alive).
 // NOTE: returns nullptr for push descriptors.
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/linalloc.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace vil {
+
+// Flat, open-addressing set of the handles used in a CommandRecord,
+// keyed by the raw handle pointer. Lookup is transparent, we never have
+// to construct an entry (or touch the reference count of a handle) to
+// find something.
+// The entries are allocated from the LinAllocator of the record and
+// have stable addresses, only the slot table grows. While recording, the
+// slots form a linear-probing hash table with a cache for the last
+// inserted handle (the same handle is usually used by many consecutive
+// commands, e.g. the bound pipeline). When the recording ends, the set is
+// compacted into an array sorted by key, for fast later queries
+// and iteration.
+// Entry must be constructible from a LinAllocator&.
+template<typename Entry>
+class FlatUsedSet {
+public:
+	struct Slot {
+		const void* key;
+		Entry* entry;
+	};
+
+	class Iterator {
+	public:
+		Iterator() = default;
+		Iterator(Slot* it, Slot* end) : it_(it), end_(end) { skipEmpty(); }
+
+		Entry& operator*() const { return *it_->entry; }
+		Entry* operator->() const { return it_->entry; }
+		Iterator& operator++() { ++it_; skipEmpty(); return *this; }
+
+		bool operator==(const Iterator& rhs) const { return it_ == rhs.it_; }
+		bool operator!=(const Iterator& rhs) const { return it_ != rhs.it_; }
+
+	private:
+		void skipEmpty() {
+			while(it_ != end_ && !it_->key) {
+				++it_;
+			}
+		}
+
+		Slot* it_ {};
+		Slot* end_ {};
+	};
+
+	static constexpr auto minSlotCount = 8u;
+
+public:
+	explicit FlatUsedSet(LinAllocator& alloc) noexcept : alloc_(&alloc) {}
+	~FlatUsedSet() {
+		for(auto& entry : *this) {
+			std::destroy_at(&entry);
+		}
+	}
+
+	FlatUsedSet(const FlatUsedSet&) = delete;
+	FlatUsedSet& operator=(const FlatUsedSet&) = delete;
+
+	// Returns the entry for the given handle, nullptr if there is none.
+	Entry* find(const void* key) const {
+		dlg_assert(key);
+		if(key == lastKey_) {
+			return lastEntry_;
+		}
+
+		if(compacted_) {
+			auto cmp = [](const Slot& slot, const void* key) {
+				return std::less<const void*>{}(slot.key, key);
+			};
+			auto end = slots_ + slotCount_;
+			auto it = std::lower_bound(slots_, end, key, cmp);
+			return (it != end && it->key == key) ? it->entry : nullptr;
+		}
+
+		if(!slotCount_) {
+			return nullptr;
+		}
+
+		auto mask = slotCount_ - 1;
+		for(auto i = hash(key) & mask; ; i = (i + 1) & mask) {
+			auto& slot = slots_[i];
+			if(slot.key == key) {
+				return slot.entry;
+			} else if(!slot.key) {
+				return nullptr;
+			}
+		}
+	}
+
+	bool contains(const void* key) const {
+		return find(key) != nullptr;
+	}
+
+	// Returns the entry for the given handle and whether it was newly
+	// created. New entries are default-constructed with the allocator.
+	std::pair<Entry*, bool> insert(const void* key) {
+		dlg_assert(key);
+		if(key == lastKey_) VIL_LIKELY {
+			return {lastEntry_, false};
+		}
+
+		// Only happens when a finished record is extended, shouldn't
+		// really happen.
+		if(compacted_) VIL_UNLIKELY {
+			decompact();
+		}
+
+		if(2 * (size_ + 1) > slotCount_) {
+			rehash(std::max<u32>(minSlotCount, 2 * slotCount_));
+		}
+
+		auto& slot = probe(key);
+		if(!slot.key) {
+			auto* raw = alloc_->allocate(sizeof(Entry), alignof(Entry));
+			slot.entry = new(raw) Entry(*alloc_);
+			slot.key = key;
+			++size_;
+
+			lastKey_ = key;
+			lastEntry_ = slot.entry;
+			return {slot.entry, true};
+		}
+
+		lastKey_ = key;
+		lastEntry_ = slot.entry;
+		return {slot.entry, false};
+	}
+
+	// Sorts the entries into a compact array, dropping the hash table.
+	// Called when the recording ends.
+	void compact() {
+		if(compacted_) {
+			return;
+		}
+
+		auto sorted = alloc_->allocUndef<Slot>(size_);
+		auto count = 0u;
+		for(auto i = 0u; i < slotCount_; ++i) {
+			if(slots_[i].key) {
+				sorted[count++] = slots_[i];
+			}
+		}
+
+		dlg_assert(count == size_);
+		std::sort(sorted.begin(), sorted.end(), [](const Slot& a, const Slot& b) {
+			return std::less<const void*>{}(a.key, b.key);
+		});
+
+		slots_ = sorted.data();
+		slotCount_ = size_;
+		compacted_ = true;
+	}
+
+	bool compacted() const { return compacted_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0u; }
+
+	Iterator begin() const { return {slots_, slots_ + slotCount_}; }
+	Iterator end() const { return {slots_ + slotCount_, slots_ + slotCount_}; }
+
+private:
+	static size_t hash(const void* key) {
+		// handles are at least 8-byte aligned, mix the higher bits down
+		auto val = u64(reinterpret_cast<std::uintptr_t>(key));
+		val = (val >> 3u) * 0x9E3779B97F4A7C15ull;
+		return size_t(val >> 32u);
+	}
+
+	Slot& probe(const void* key) {
+		dlg_assert(!compacted_ && slotCount_ > 0u);
+		auto mask = slotCount_ - 1;
+		for(auto i = hash(key) & mask; ; i = (i + 1) & mask) {
+			auto& slot = slots_[i];
+			if(!slot.key || slot.key == key) {
+				return slot;
+			}
+		}
+	}
+
+	// NOTE: the old table just stays in the allocator. Since we
+	// grow exponentially, that's at most the size of the final table.
+	void rehash(u32 newCount) {
+		auto oldSlots = slots_;
+		auto oldCount = slotCount_;
+
+		slots_ = alloc_->allocRaw<Slot>(newCount);
+		slotCount_ = newCount;
+		compacted_ = false;
+
+		for(auto i = 0u; i < oldCount; ++i) {
+			if(oldSlots[i].key) {
+				probe(oldSlots[i].key) = oldSlots[i];
+			}
+		}
+	}
+
+	void decompact() {
+		dlg_assert(compacted_);
+		auto count = 2u;
+		while(count < 2 * (size_ + 1)) {
+			count *= 2u;
+		}
+
+		rehash(std::max(minSlotCount, count));
+	}
+
+	LinAllocator* alloc_ {};
+	Slot* slots_ {};
+	u32 slotCount_ {}; // power of two, unless compacted
+	u32 size_ {};
+	bool compacted_ {};
+
+	// cache for the last inserted handle
+	const void* lastKey_ {};
+	Entry* lastEntry_ {};
+};
+
+} // namespace vil
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <nytl/span.hpp>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <vector>
+
+namespace vil {
+
+// Summary of the Image and Buffer handles a CommandRecord potentially
+// writes, keyed by the raw handle pointer. Stored as an array sorted by
+// key, with a small bloom filter in front of it: most queries are for
+// handles that aren't written at all and are answered without touching
+// the array.
+class WriteSet {
+public:
+	static constexpr auto bloomBits = 256u;
+
+	// Replaces the content of this set with the given handles.
+	// They may contain duplicates.
+	void build(span<const void* const> handles) {
+		handles_.assign(handles.begin(), handles.end());
+		std::sort(handles_.begin(), handles_.end(), std::less<const void*>{});
+		handles_.erase(std::unique(handles_.begin(), handles_.end()), handles_.end());
+		handles_.shrink_to_fit();
+
+		bloom_ = {};
+		for(auto* handle : handles_) {
+			auto [a, b] = bloomIndices(handle);
+			bloom_[a / 64u] |= (1ull << (a % 64u));
+			bloom_[b / 64u] |= (1ull << (b % 64u));
+		}
+	}
+
+	// Returns false if the handle is definitely not contained.
+	bool mayContain(const void* handle) const {
+		auto [a, b] = bloomIndices(handle);
+		return (bloom_[a / 64u] & (1ull << (a % 64u))) &&
+			(bloom_[b / 64u] & (1ull << (b % 64u)));
+	}
+
+	bool contains(const void* handle) const {
+		return mayContain(handle) && std::binary_search(handles_.begin(),
+			handles_.end(), handle, std::less<const void*>{});
+	}
+
+	span<const void* const> handles() const { return handles_; }
+	size_t size() const { return handles_.size(); }
+	bool empty() const { return handles_.empty(); }
+
+private:
+	static std::pair<u32, u32> bloomIndices(const void* handle) {
+		// handles are at least 8-byte aligned, mix the higher bits down
+		auto val = u64(reinterpret_cast<std::uintptr_t>(handle));
+		val = (val >> 3u) * 0x9E3779B97F4A7C15ull;
+		return {u32(val >> 56u), u32((val >> 48u) & 0xFFu)};
+	}
+
+	std::array<u64, bloomBits / 64u> bloom_ {};
+	std::vector<const void*> handles_;
+};
+
+} // namespace vil
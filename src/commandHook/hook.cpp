@@ -73,6 +73,45 @@
 
 namespace vil {
 
+namespace {
+
+// Returns whether the given record might contain a command like 'cmd',
+// based on the categories of its commands. Only action commands are
+// considered, e.g. ExecuteCommandsChildCmd isn't tracked in
+// CommandRecord::categories.
+bool mayContain(const CommandRecord& rec, const Command& cmd) {
+	constexpr auto tracked =
+		CommandCategory::draw |
+		CommandCategory::dispatch |
+		CommandCategory::traceRays |
+		CommandCategory::transfer |
+		CommandCategory::buildAccelStruct;
+
+	auto category = cmd.category();
+	if(!(tracked & category)) {
+		return true;
+	}
+
+	return bool(rec.categories & category);
+}
+
+// Returns whether a queue with the given flags can execute a command
+// like 'cmd' at all.
+bool mayExecute(VkQueueFlags flags, const Command& cmd) {
+	switch(cmd.category()) {
+		case CommandCategory::draw:
+			return flags & VK_QUEUE_GRAPHICS_BIT;
+		case CommandCategory::dispatch:
+		case CommandCategory::traceRays:
+		case CommandCategory::buildAccelStruct:
+			return flags & VK_QUEUE_COMPUTE_BIT;
+		default:
+			return true;
+	}
+}
+
+} // anon namespace
+
 // Expects a and to have the same layout.
 // If the descriptor at (bindingID, elemID) needs to be copied by CommandHook,
 // returns whether its the same in a and b.
@@ -140,6 +179,8 @@ void invalidate(CommandHookRecord& rec) {
 CommandHook::CommandHook(Device& dev) {
 	dev_ = &dev;
 	hookAccelStructBuilds = checkEnvBinary("VIL_CAPTURE_ACCEL_STRUCTS", true);
+	profiler.init(dev);
+	tracyGpuZones = TracyGpuZones::create(dev);
 	initImageCopyPipes(dev);
 	initVertexCopy(dev);
 	if(hasAppExt(dev, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) &&
@@ -172,6 +213,18 @@ CommandHook::~CommandHook() {
 	update.newTarget = Target {};
 	this->updateHook(std::move(update));
 
+	// The profiles might hold the last references to records. Drop them
+	// while the state used by hook records is still alive, not in
+	// ~GpuProfiler. Destroyed outside the critical section since
+	// ~CommandRecord locks the device mutex.
+	{
+		std::vector<FrameProfile> profiles;
+		{
+			std::lock_guard lock(dev.mutex);
+			profiler.clearLocked(profiles);
+		}
+	}
+
 	for(auto& pipe : sampleImagePipes_) {
 		dev.dispatch.DestroyPipeline(dev.handle, pipe, nullptr);
 	}
@@ -462,7 +515,10 @@ bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record) {
 
 void CommandHook::hook(QueueSubmitter& subm) {
 	auto& dev = *dev_;
-	keepAliveLC_.clear();
+	if(!keepAliveLC_.empty()) {
+		dev.destroyQueue.pushValue(std::move(keepAliveLC_));
+		keepAliveLC_.clear();
+	}
 
 	// sparse bindings can't be hooked
 	dlg_assert(subm.dstBatch->type == SubmissionType::command);
@@ -470,12 +526,14 @@ void CommandHook::hook(QueueSubmitter& subm) {
 	// make sure we never have too many submissions
 	// can become a memory problem at some point (e.g. when never
 	// retrieved & cleared by gui for whatever reason).
+	// We can't delete CompletedHook objects while holding
+	// device mutex since their destruction might trigger
+	// a CommandRecord destruction
+	std::vector<CompletedHook> keepAlive;
+	std::vector<FrameProfile> keepAliveProfiles;
 	{
-		// We can't delete CompletedHook objects while holding
-		// device mutex since their destruction might trigger
-		// a CommandRecord destruction
-		std::vector<CompletedHook> keepAlive;
 		std::lock_guard lock(dev.mutex);
+		profiler.trimLocked(keepAliveProfiles);
 		if(completed_.size() > maxCompletedHooks) {
 			auto upTo = completed_.size() - maxCompletedHooks;
 			for(auto i = 0u; i < upTo; ++i) {
@@ -486,6 +544,14 @@ void CommandHook::hook(QueueSubmitter& subm) {
 		}
 	}
 
+	// Destroying the completed hooks (and with them maybe the last
+	// reference to their records and states) is deferred to the destroy
+	// thread, not done on the submitting thread.
+	if(!keepAlive.empty() || !keepAliveProfiles.empty()) {
+		dev.destroyQueue.pushValue(std::make_pair(
+			std::move(keepAlive), std::move(keepAliveProfiles)));
+	}
+
 	// we put all of this in a critical section to protect against changes
 	// of target_ and ops_ and the list of hooked records.
 	// TODO: might be possible to just use internal mutex, try it.
@@ -556,8 +622,26 @@ void CommandHook::hook(QueueSubmitter& subm) {
 		trySkipHook = !frameDstRecord;
 	}
 
+	// Targets that are searched via find() can't be in submissions to
+	// queues that can't execute the target command.
+	const Command* findTarget = nullptr;
+	auto targetOnQueue = true;
+	if(!target_.command.empty() && (target_.type == TargetType::all ||
+			target_.type == TargetType::commandBuffer ||
+			target_.type == TargetType::commandRecord)) {
+		dlg_assert(subm.queue->family < dev.queueFamilies.size());
+		auto& qfam = dev.queueFamilies[subm.queue->family];
+		findTarget = target_.command.back();
+		targetOnQueue = mayExecute(qfam.props.queueFlags, *findTarget);
+		trySkipHook |= !targetOnQueue;
+	}
+
+	// whole-frame profiling
+	u64 profileFrameID {};
+	const bool profile = profiler.sampleLocked(profileFrameID);
+
 	// fast early-outs
-	if(trySkipHook && localCaptures_.empty() && !forceHook.load()) {
+	if(trySkipHook && localCaptures_.empty() && !forceHook.load() && !profile) {
 		auto hasBuildCmd = false;
 		for(auto [subID, sub] : enumerate(subm.dstBatch->submissions)) {
 			auto& cmdSub = std::get<CommandSubmission>(sub.data);
@@ -629,10 +713,10 @@ void CommandHook::hook(QueueSubmitter& subm) {
 					hookViaFind = true;
 				}
 
+				hookViaFind &= targetOnQueue &&
+					(!findTarget || mayContain(rec, *findTarget));
 				if(hookViaFind) {
-					auto findRes = find(matchType,
-						*rec.commands, target_.command,
-						target_.descriptors);
+					auto& findRes = findTargetLocked(rec);
 					if(findRes.match > 0.f) {
 						hooked = doHook(rec, findRes.hierarchy,
 							findRes.match, sub, hookData);
@@ -640,9 +724,17 @@ void CommandHook::hook(QueueSubmitter& subm) {
 				}
 			}
 
-			if(!hookData && (forceHook.load() || (rec.buildsAccelStructs && hookAccelStructBuilds))) {
+			// NOTE: records that are hooked for other reasons are not
+			// profiled, they are missing in the frame profile.
+			if(!hookData && (profile || forceHook.load() ||
+					(rec.buildsAccelStructs && hookAccelStructBuilds))) {
 				dlg_assert(!hooked);
-				hooked = doHook(rec, {}, 0.f, sub, hookData);
+				hooked = doHook(rec, {}, 0.f, sub, hookData, nullptr, profile);
+
+				if(profile) {
+					hookData->profileFrameID = profileFrameID;
+					profiler.addPendingLocked(profileFrameID);
+				}
 			}
 
 			dlg_assert(!!hooked == !!hookData);
@@ -668,95 +760,106 @@ void CommandHook::hook(QueueSubmitter& subm) {
 	}
 }
 
-VkCommandBuffer CommandHook::hook(CommandRecord& record,
-		span<const CommandSectionMatch> matchData,
-		Submission& subm,
-		std::unique_ptr<CommandHookSubmission>& data) {
-
-	float dstMatch {1.f};
+std::vector<const Command*> findHookTarget(MatchType matchType,
+		const CommandRecord& record, span<const Command*> target,
+		const CommandDescriptorSnapshot& descriptors,
+		span<const CommandSectionMatch> matchData, float& dstMatch) {
+	dstMatch = 1.f;
 	std::vector<const Command*> dstHierarchy;
 
-	if(target_.command.empty()) {
+	if(target.empty()) {
 		// hook on the whole recording, mainly for time queries or testing
 		dstHierarchy.push_back(record.commands);
-	} else {
-		auto hierarchy = span<const Command*>(target_.command);
-		span<const CommandSectionMatch> sectionMatches = matchData;
-
-		// our matching algorithm (the data in matchData) only matches sections,
-		// trying to match *all* compute and draw commands would be too expensive.
-		// When the command in the hierarchy is a parent command, we can find
-		// it via the matching result, otherwise we have to run an additional
-		// local 'find' on it.
-		auto finalCmdIsParent = !!target_.command.back()->children();
-		if(!finalCmdIsParent) {
-			hierarchy = hierarchy.first(hierarchy.size() - 1);
-		}
+		return dstHierarchy;
+	}
 
-		auto found = true;
-		while(!hierarchy.empty() && found) {
-			auto foundSection = false;
-			for(auto& cmdMatch : sectionMatches) {
-				if(cmdMatch.a != hierarchy[0]) {
-					continue;
-				}
+	auto hierarchy = target;
+	span<const CommandSectionMatch> sectionMatches = matchData;
+
+	// our matching algorithm (the data in matchData) only matches sections,
+	// trying to match *all* compute and draw commands would be too expensive.
+	// When the command in the hierarchy is a parent command, we can find
+	// it via the matching result, otherwise we have to run an additional
+	// local 'find' on it.
+	auto finalCmdIsParent = !!target.back()->children();
+	if(!finalCmdIsParent) {
+		hierarchy = hierarchy.first(hierarchy.size() - 1);
+	}
 
-				dstMatch *= eval(cmdMatch.match);
-				foundSection = true;
-				hierarchy = hierarchy.subspan(1u);
-				sectionMatches = cmdMatch.children;
-				dstHierarchy.push_back(cmdMatch.b);
-				break;
+	auto found = true;
+	while(!hierarchy.empty() && found) {
+		auto foundSection = false;
+		for(auto& cmdMatch : sectionMatches) {
+			if(cmdMatch.a != hierarchy[0]) {
+				continue;
 			}
 
-			if(!foundSection) {
-				found = false;
-			}
+			dstMatch *= eval(cmdMatch.match);
+			foundSection = true;
+			hierarchy = hierarchy.subspan(1u);
+			sectionMatches = cmdMatch.children;
+			dstHierarchy.push_back(cmdMatch.b);
+			break;
 		}
 
-		// no hook needed
-		if(!found) {
-			return VK_NULL_HANDLE;
+		if(!foundSection) {
+			found = false;
 		}
+	}
 
-		if(!finalCmdIsParent) {
-			dlg_assert(dstHierarchy.size() == target_.command.size() - 1);
-			auto* parent = static_cast<const ParentCommand*>(dstHierarchy.back());
-			auto findResult = find(matchType, *parent, span(target_.command).last(2),
-				target_.descriptors);
+	if(!found) {
+		return {};
+	}
 
-			// no hook needed
-			if(findResult.hierarchy.empty()) {
-				return VK_NULL_HANDLE;
-			}
+	if(!finalCmdIsParent) {
+		dlg_assert(dstHierarchy.size() == target.size() - 1);
+		auto* parent = static_cast<const ParentCommand*>(dstHierarchy.back());
+		auto findResult = find(matchType, *parent, target.last(2), descriptors);
+		if(findResult.hierarchy.empty()) {
+			return {};
+		}
 
-			dstMatch *= findResult.match;
+		dstMatch *= findResult.match;
 
+		dlg_assert(findResult.hierarchy.size() == 2u);
+		dlg_assert(findResult.hierarchy[0] == parent);
+
+		dstHierarchy.push_back(findResult.hierarchy[1]);
+	} else {
+		dlg_assert(dstHierarchy.size() == target.size());
+
+		// Run 'find' as debug check
+		// There may be cases where 'find' and 'match' result in differences
+		// but we should debug each of them carefully, both functions should
+		// be correct
+		dlg_check({
+			dlg_assert(dstHierarchy.size() >= 2);
+			auto* parent = static_cast<const ParentCommand*>(
+				dstHierarchy[dstHierarchy.size() - 2]);
+			auto findResult = find(matchType, *parent, target.last(2), descriptors);
+			dlg_assert(!findResult.hierarchy.empty());
 			dlg_assert(findResult.hierarchy.size() == 2u);
 			dlg_assert(findResult.hierarchy[0] == parent);
+			dlg_assertlm(dlg_level_warn,
+				findResult.hierarchy[1] == dstHierarchy.back(),
+				"Mismatch between 'find' and 'match' result");
+		});
+	}
 
-			dstHierarchy.push_back(findResult.hierarchy[1]);
-		} else {
-			dlg_assert(dstHierarchy.size() == target_.command.size());
-
-			// Run 'find' as debug check
-			// There may be cases where 'find' and 'match' result in differences
-			// but we should debug each of them carefully, both functions should
-			// be correct
-			dlg_check({
-				dlg_assert(dstHierarchy.size() >= 2);
-				auto* parent = static_cast<const ParentCommand*>(
-					dstHierarchy[dstHierarchy.size() - 2]);
-				auto findResult = find(matchType, *parent,
-					span(target_.command).last(2), target_.descriptors);
-				dlg_assert(!findResult.hierarchy.empty());
-				dlg_assert(findResult.hierarchy.size() == 2u);
-				dlg_assert(findResult.hierarchy[0] == parent);
-				dlg_assertlm(dlg_level_warn,
-					findResult.hierarchy[1] == dstHierarchy.back(),
-					"Mismatch between 'find' and 'match' result");
-			});
-		}
+	return dstHierarchy;
+}
+
+VkCommandBuffer CommandHook::hook(CommandRecord& record,
+		span<const CommandSectionMatch> matchData,
+		Submission& subm,
+		std::unique_ptr<CommandHookSubmission>& data) {
+	float dstMatch;
+	auto dstHierarchy = findHookTarget(matchType, record, target_.command,
+		target_.descriptors, matchData, dstMatch);
+
+	// no hook needed
+	if(dstHierarchy.empty()) {
+		return VK_NULL_HANDLE;
 	}
 
 	return doHook(record, dstHierarchy, dstMatch, subm, data);
@@ -882,10 +985,41 @@ void fillLocalCaptureHookOps(Flags<LocalCaptureBits> flags, CommandHookOps& opsT
 	}
 }
 
+const CommandRecord::HookFindCache& CommandHook::findTargetLocked(
+		CommandRecord& record) {
+	assertOwned(dev_->mutex);
+	dlg_assert(record.finished.load());
+
+	// Static command buffers are resubmitted every frame, only search
+	// them again when the target changed.
+	// NOTE: the match value could theoretically change when the
+	// update_after_bind descriptors bound in the record are updated.
+	// Since that doesn't change which command is found in practice,
+	// we don't care about it here. Changed descriptors are still
+	// detected when reusing the hook record, see copiedDescriptorChanged.
+	auto& cache = record.hookFind;
+	if(cache.hookCounter == counter_ &&
+			cache.targetGeneration == targetGeneration_) {
+		return cache;
+	}
+
+	auto findRes = find(matchType, *record.commands, target_.command,
+		target_.descriptors);
+	cache.hookCounter = counter_;
+	cache.targetGeneration = targetGeneration_;
+	cache.match = findRes.match;
+	cache.hierarchy = std::move(findRes.hierarchy);
+	if(cache.match <= 0.f) {
+		cache.hierarchy.clear();
+	}
+
+	return cache;
+}
+
 VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 		span<const Command*> dstCommand, float dstCommandMatch,
 		Submission& subm, std::unique_ptr<CommandHookSubmission>& data,
-		LocalCapture* localCapture) {
+		LocalCapture* localCapture, bool profile) {
 
 	// Check if there already is a valid CommandHookRecord we can use.
 	CommandHookRecord* foundHookRecord {};
@@ -913,13 +1047,17 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 				continue;
 			}
 
+			if(hookRecord->profile != profile) {
+				continue;
+			}
+
 			// Accel Structure stuff re-use is hard due to ordering.
 			// PERF: we could make some of this work in theory.
 			if(!hookRecord->accelStructOps.empty()) {
 				continue;
 			}
 
-			if(hookRecord->state->refCount > 1u) {
+			if(hookRecord->state && hookRecord->state->refCount > 1u) {
 				// We can't reuse this hook record, its state is still needded
 				// somewhere, e.g. referenced in gui or our completed list.
 				// The one ref count is always there and comes from the record.
@@ -1009,6 +1147,10 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 			dlg_trace("Creating hook record for local capture");
 			fillLocalCaptureHookOps(localCapture->flags, opsTmp, dstCommand);
 			ops = &opsTmp;
+		} else if(profile) {
+			dlg_assert(dstCommand.empty());
+			opsTmp.profile = true;
+			ops = &opsTmp;
 		}
 
 		auto hook = new CommandHookRecord(*this, record,
@@ -1057,9 +1199,14 @@ std::vector<CompletedHook> CommandHook::moveCompleted() {
 			auto swapchain = dev_->swapchainPtrLocked();
 			dlg_assert(swapchain);
 
+			auto presentedEnd = u64(0u);
+			if(swapchain && !swapchain->frameHistory->empty()) {
+				presentedEnd = swapchain->frameHistory->front()->submissionEnd;
+			}
+
 			while(swapchain && !moved.empty()) {
 				auto& last = moved.back();
-				if(last.submissionID <= swapchain->frameSubmissions[0].submissionEnd) {
+				if(last.submissionID <= presentedEnd) {
 					break;
 				}
 
@@ -1109,7 +1256,7 @@ void CommandHook::removeRecordLocked(CommandHookRecord& record) {
 	invalidate(record);
 }
 
-CommandHookState::CommandHookState() {
+CommandHookState::CommandHookState() : id(nextUniqueID<CommandHookState>()) {
 	++DebugStats::get().aliveHookStates;
 }
 
@@ -1129,6 +1276,7 @@ void CommandHook::updateHook(Update&& update) {
 			if(update.newTarget) {
 				oldTarget = std::move(target_);
 				target_ = std::move(*update.newTarget);
+				++targetGeneration_;
 
 				// validate
 				if(target_.type == TargetType::inFrame) {
@@ -2,6 +2,8 @@
 
 #include <fwd.hpp>
 #include <commandHook/state.hpp>
+#include <commandHook/profiler.hpp>
+#include <commandHook/tracyGpu.hpp>
 #include <command/record.hpp>
 #include <util/intrusive.hpp>
 #include <nytl/bytes.hpp>
@@ -70,6 +72,10 @@ struct CommandHookOps {
 	bool copyVertexInput {};
 	bool copyXfb {}; // transform feedback
 	u32  vertexCmd {}; // for multi draw, specifies the command for which to copy
+	// For direct draws, the captured transform feedback is limited to
+	// pages of CommandHookRecord::maxXfbVertices vertices. Specifies
+	// the page to capture, see splitDraw.
+	u32  xfbPage {};
 
 	IntrusivePtr<ShaderCaptureHook> shaderCapture {};
 	Vec3u32 shaderCaptureInput {}; // globalThreadID/vertexID/...
@@ -79,6 +85,11 @@ struct CommandHookOps {
 	std::vector<AttachmentCopyOp> attachmentCopies; // only for cmd inside renderpass
 	bool queryTime {};
 
+	// Whether to time all relevant commands of the record, for the
+	// GpuProfiler. Never set in the global ops but only for the
+	// internally created profiling hooks.
+	bool profile {};
+
 	// transfer
 	bool copyTransferSrcBefore {};
 	bool copyTransferSrcAfter {};
@@ -203,6 +214,17 @@ public:
 	// as we need it to have accelStruct data.
 	std::atomic<bool> hookAccelStructBuilds {true};
 
+	// Whole-frame profiler, see GpuProfiler::sampleInterval.
+	// Destroyed after the hook state below. That is fine since
+	// ~CommandHook invalidates all hook records (which return their
+	// query pools here) and then drops the profiles, so on destruction
+	// the profiler only owns its free query pools.
+	GpuProfiler profiler;
+
+	// Only set when tracy gpu zones are enabled and supported,
+	// see VIL_TRACY_GPU_ZONES.
+	std::unique_ptr<TracyGpuZones> tracyGpuZones;
+
 public:
 	CommandHook(Device& dev);
 	~CommandHook();
@@ -266,7 +288,11 @@ private:
 		span<const Command*> dstCommand, // might be empty
 		float dstCommandMatch,
 		Submission& subm, std::unique_ptr<CommandHookSubmission>& data,
-		LocalCapture* localCapture = nullptr);
+		LocalCapture* localCapture = nullptr, bool profile = false);
+
+	// Returns the result of find() for the current target in the given
+	// record, cached in the record.
+	const CommandRecord::HookFindCache& findTargetLocked(CommandRecord& record);
 
 	VkCommandBuffer hook(CommandRecord& record,
 		span<const CommandSectionMatch> matchData,
@@ -279,6 +305,10 @@ private:
 	Device* dev_ {};
 
 	u32 counter_ {0};
+	// Incremented every time target_ (and with it the descriptor snapshot
+	// of the target command) changes. Used as key for the find results
+	// cached in the records, see CommandRecord::hookFind.
+	u64 targetGeneration_ {1u};
 	std::vector<CommandHookRecord*> records_; // all alive & valid hooked records
 
 	std::vector<CompletedHook> completed_;
@@ -337,4 +367,14 @@ public: // TODO, for copying. Maybe just move them to Device?
 	vku::DescriptorAllocator dsAlloc_;
 };
 
+// Finds the equivalent of the 'target' command hierarchy in the given record.
+// 'matchData' is the section matching result of the target record with
+// 'record', as computed by CommandHook::hook. Returns an empty vector if
+// the target can't be found, otherwise the match value via 'dstMatch'.
+// Does not need a device, also used by vilreplay.
+std::vector<const Command*> findHookTarget(MatchType,
+	const CommandRecord& record, span<const Command*> target,
+	const CommandDescriptorSnapshot& descriptors,
+	span<const CommandSectionMatch> matchData, float& dstMatch);
+
 } // namespace vil
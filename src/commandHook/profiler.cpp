@@ -0,0 +1,212 @@
+#include <commandHook/profiler.hpp>
+#include <commandHook/record.hpp>
+#include <command/record.hpp>
+#include <device.hpp>
+#include <swapchain.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+
+namespace vil {
+
+GpuProfiler::~GpuProfiler() {
+	if(!dev_) {
+		return;
+	}
+
+	// Already cleared by ~CommandHook, see clearLocked
+	dlg_assert(pending_.empty());
+	dlg_assert(completed_.empty());
+
+	for(auto& free : freeQueryPools_) {
+		dev_->dispatch.DestroyQueryPool(dev_->handle, free.pool, nullptr);
+	}
+}
+
+void GpuProfiler::init(Device& dev) {
+	dev_ = &dev;
+}
+
+bool GpuProfiler::sampleLocked(u64& frameID) {
+	assertOwned(dev_->mutex);
+
+	auto interval = sampleInterval.load();
+	if(interval == 0u) {
+		return false;
+	}
+
+	// we need the present counter to know which frame a submission
+	// belongs to. Without swapchain, there are no frames to profile.
+	auto* swapchain = dev_->swapchainLocked();
+	if(!swapchain) {
+		return false;
+	}
+
+	frameID = swapchain->presentCounter;
+	completeLocked(frameID);
+
+	return frameID % interval == 0u;
+}
+
+void GpuProfiler::addPendingLocked(u64 frameID) {
+	assertOwned(dev_->mutex);
+
+	auto it = find_if(pending_, [&](auto& profile) {
+		return profile.frameID == frameID;
+	});
+
+	if(it == pending_.end()) {
+		auto& profile = pending_.emplace_back();
+		profile.frameID = frameID;
+		it = pending_.end() - 1;
+	}
+
+	++it->pending;
+}
+
+void GpuProfiler::addResultsLocked(u64 frameID, u64 submissionID,
+		const CommandHookRecord& hookRecord, span<const u64> timestamps) {
+	ZoneScoped;
+	assertOwned(dev_->mutex);
+
+	auto it = find_if(pending_, [&](auto& profile) {
+		return profile.frameID == frameID;
+	});
+
+	// might have been completed already, see maxPendingFrames
+	if(it == pending_.end()) {
+		return;
+	}
+
+	auto& profile = *it;
+	dlg_assert(profile.pending > 0u);
+	--profile.pending;
+
+	auto& src = hookRecord.profiledCommands;
+	if(!timestamps.empty()) {
+		dlg_assert(timestamps.size() == 2 * src.size());
+
+		auto& rec = *hookRecord.record;
+		auto& dst = profile.records.emplace_back();
+		dst.record = IntrusivePtr<CommandRecord>(&rec);
+		dst.submissionID = submissionID;
+		dst.firstCommand = u32(profile.commands.size());
+		dst.commandCount = u32(src.size());
+
+		const auto validBits = dev_->queueFamilies[rec.queueFamily].props.timestampValidBits;
+		const auto mask = validBits >= 64u ? u64(-1) : (u64(1) << validBits) - 1;
+		const double period = dev_->props.limits.timestampPeriod;
+
+		for(auto [i, cmd] : enumerate(src)) {
+			auto& pc = profile.commands.emplace_back(cmd);
+			if(pc.parent != u32(-1)) {
+				pc.parent += dst.firstCommand;
+			}
+
+			pc.begin = u64(period * (timestamps[2 * i + 0] & mask));
+			pc.end = u64(period * (timestamps[2 * i + 1] & mask));
+			pc.end = std::max(pc.begin, pc.end);
+
+			profile.start = std::min(profile.start, pc.begin);
+			profile.end = std::max(profile.end, pc.end);
+		}
+	}
+
+	auto* swapchain = dev_->swapchainLocked();
+	completeLocked(swapchain ? swapchain->presentCounter : u64(-1));
+}
+
+void GpuProfiler::completeLocked(u64 currentFrameID) {
+	for(auto it = pending_.begin(); it != pending_.end();) {
+		auto done = (it->pending == 0u && it->frameID < currentFrameID) ||
+			(it->frameID + maxPendingFrames < currentFrameID);
+		if(!done) {
+			++it;
+			continue;
+		}
+
+		dlg_assertlm(dlg_level_warn, it->pending == 0u,
+			"Completing frame profile with {} outstanding submissions",
+			it->pending);
+
+		// make the timings relative to the frame start
+		auto& profile = *it;
+		if(profile.commands.empty()) {
+			profile.start = 0u;
+		}
+
+		for(auto& cmd : profile.commands) {
+			cmd.begin -= profile.start;
+			cmd.end -= profile.start;
+		}
+
+		completed_.push_back(std::move(profile));
+		it = pending_.erase(it);
+	}
+}
+
+VkQueryPool GpuProfiler::allocQueryPoolLocked(u32& count) {
+	assertOwned(dev_->mutex);
+
+	auto size = minQueryPoolSize;
+	while(size < count) {
+		size *= 2;
+	}
+
+	count = size;
+	for(auto it = freeQueryPools_.begin(); it != freeQueryPools_.end(); ++it) {
+		if(it->count == size) {
+			auto pool = it->pool;
+			freeQueryPools_.erase(it);
+			return pool;
+		}
+	}
+
+	auto& dev = *dev_;
+	VkQueryPoolCreateInfo qci {};
+	qci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	qci.queryCount = size;
+	qci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+
+	VkQueryPool pool {};
+	VK_CHECK(dev.dispatch.CreateQueryPool(dev.handle, &qci, nullptr, &pool));
+	nameHandle(dev, pool, "GpuProfiler:queryPool");
+
+	return pool;
+}
+
+void GpuProfiler::freeQueryPoolLocked(VkQueryPool pool, u32 count) {
+	assertOwned(dev_->mutex);
+	freeQueryPools_.push_back({pool, count});
+}
+
+std::vector<FrameProfile> GpuProfiler::moveCompleted() {
+	std::lock_guard lock(dev_->mutex);
+	return std::move(completed_);
+}
+
+void GpuProfiler::trimLocked(std::vector<FrameProfile>& keepAlive) {
+	assertOwned(dev_->mutex);
+
+	if(completed_.size() > maxCompletedProfiles) {
+		auto upTo = completed_.size() - maxCompletedProfiles;
+		for(auto i = 0u; i < upTo; ++i) {
+			keepAlive.push_back(std::move(completed_[i]));
+		}
+
+		completed_.erase(completed_.begin(), completed_.begin() + upTo);
+	}
+}
+
+void GpuProfiler::clearLocked(std::vector<FrameProfile>& keepAlive) {
+	assertOwned(dev_->mutex);
+
+	for(auto* profiles : {&pending_, &completed_}) {
+		for(auto& profile : *profiles) {
+			keepAlive.push_back(std::move(profile));
+		}
+
+		profiles->clear();
+	}
+}
+
+} // namespace vil
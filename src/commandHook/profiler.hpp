@@ -0,0 +1,114 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/intrusive.hpp>
+#include <nytl/span.hpp>
+#include <vk/vulkan.h>
+#include <vector>
+#include <atomic>
+
+namespace vil {
+
+// A single command timed by the frame profiler.
+struct ProfiledCommand {
+	// Points into the associated ProfiledRecord::record, kept alive by it.
+	const Command* command {};
+	// Index of the closest timed ancestor in FrameProfile::commands.
+	// u32(-1) for commands that have no timed ancestor.
+	u32 parent {u32(-1)};
+	u32 depth {};
+	// In nanoseconds, relative to FrameProfile::start after the profile
+	// was completed.
+	u64 begin {};
+	u64 end {};
+};
+
+struct ProfiledRecord {
+	IntrusivePtr<CommandRecord> record;
+	u64 submissionID {}; // global submission id (dev.submissionCounter)
+	// Range of this record inside FrameProfile::commands
+	u32 firstCommand {};
+	u32 commandCount {};
+};
+
+// The timing results for all submissions of a single presented frame.
+struct FrameProfile {
+	u64 frameID {}; // swapchain presentCounter at profiling time
+	u64 start {u64(-1)}; // first timestamp in ns
+	u64 end {}; // last timestamp in ns
+
+	std::vector<ProfiledRecord> records;
+	std::vector<ProfiledCommand> commands;
+
+	// Number of hooked submissions that did not finish yet
+	u32 pending {};
+};
+
+// Whole-frame GPU profiler. When enabled, CommandHook re-records every
+// record submitted in a sampled frame, writing timestamps around all
+// draw, dispatch, traceRays, transfer and render pass/label sections.
+// All state is synchronized via the device mutex unless noted otherwise.
+struct GpuProfiler {
+	// Only every n-th presented frame is profiled. 0 disables the profiler.
+	// Can be changed at any time.
+	std::atomic<u32> sampleInterval {};
+
+	// maximum number of completed profiles we store at a time.
+	static constexpr auto maxCompletedProfiles = 4u;
+	// Pending profiles older than this (in frames) are considered complete,
+	// even if not all of their submissions reported back.
+	static constexpr auto maxPendingFrames = 8u;
+	// Query pools are pooled in power-of-two size classes, at least this.
+	static constexpr auto minQueryPoolSize = 64u;
+
+	GpuProfiler() = default;
+	~GpuProfiler();
+
+	void init(Device& dev);
+
+	// Returns whether the submission currently being hooked is part of a
+	// sampled frame and should be profiled. Returns the frame id in that case.
+	bool sampleLocked(u64& frameID);
+
+	// Registers a hooked submission for the given frame/receives the
+	// results of it. Timestamps are given as raw ticks, two per profiled
+	// command in the given hook record. Empty timestamps signal that the
+	// results could not be retrieved.
+	void addPendingLocked(u64 frameID);
+	void addResultsLocked(u64 frameID, u64 submissionID,
+		const CommandHookRecord&, span<const u64> timestamps);
+
+	// Returns a query pool with at least 'count' timestamp queries.
+	// 'count' is adjusted to the size of the returned pool.
+	VkQueryPool allocQueryPoolLocked(u32& count);
+	void freeQueryPoolLocked(VkQueryPool pool, u32 count);
+
+	// Moves out all completed frame profiles, oldest first.
+	// Must not be called with the device mutex locked.
+	[[nodiscard]] std::vector<FrameProfile> moveCompleted();
+
+	// Removes completed profiles exceeding maxCompletedProfiles, moving them
+	// into the given vector. They must be destroyed outside the critical
+	// section since they might hold the last reference to a record.
+	void trimLocked(std::vector<FrameProfile>& keepAlive);
+
+	// Moves all pending and completed profiles into the given vector,
+	// with the same requirements as trimLocked. Called by ~CommandHook
+	// while the hook state used by the records is still alive.
+	void clearLocked(std::vector<FrameProfile>& keepAlive);
+
+private:
+	void completeLocked(u64 currentFrameID);
+
+	struct FreeQueryPool {
+		VkQueryPool pool;
+		u32 count;
+	};
+
+	Device* dev_ {};
+	std::vector<FreeQueryPool> freeQueryPools_;
+	std::vector<FrameProfile> pending_;
+	std::vector<FrameProfile> completed_;
+};
+
+} // namespace vil
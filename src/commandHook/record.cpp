@@ -7,6 +7,7 @@
 #include <util/util.hpp>
 #include <util/fmt.hpp>
 #include <util/chain.hpp>
+#include <threadContext.hpp>
 #include <device.hpp>
 #include <stats.hpp>
 #include <buffer.hpp>
@@ -19,10 +20,217 @@
 #include <rp.hpp>
 #include <ds.hpp>
 #include <vk/format_utils.h>
+#include <spirv_cross.hpp>
 #include <numeric>
 
 namespace vil {
 
+// Returns whether the given command is timed by the GpuProfiler
+bool profiledCommand(const Command& cmd) {
+	switch(cmd.category()) {
+		case CommandCategory::draw:
+		case CommandCategory::dispatch:
+		case CommandCategory::traceRays:
+		case CommandCategory::transfer:
+		case CommandCategory::buildAccelStruct:
+		case CommandCategory::beginRenderPass:
+			return true;
+		default:
+			break;
+	}
+
+	return cmd.type() == CommandType::beginRendering ||
+		cmd.type() == CommandType::beginDebugUtilsLabel;
+}
+
+u32 countProfiledCommands(const Command* cmd) {
+	auto count = 0u;
+	while(cmd) {
+		if(profiledCommand(*cmd)) {
+			++count;
+		}
+
+		count += countProfiledCommands(cmd->children());
+		cmd = cmd->next;
+	}
+
+	return count;
+}
+
+// With multiview, timestamps inside a render pass instance write multiple
+// queries, we don't support that for profiling.
+bool usesMultiview(const Command& cmd) {
+	if(auto* rpCmd = commandCast<const BeginRenderPassCmd*>(&cmd); rpCmd) {
+		dlg_assert(rpCmd->rp);
+		for(auto& subpass : rpCmd->rp->desc.subpasses) {
+			if(subpass.viewMask) {
+				return true;
+			}
+		}
+	} else if(auto* renderingCmd = commandCast<const BeginRenderingCmd*>(&cmd); renderingCmd) {
+		return renderingCmd->viewMask != 0u;
+	}
+
+	return false;
+}
+
+// Returns the number of vertices per primitive for list topologies,
+// zero for all other topologies.
+u32 listPrimitiveSize(VkPrimitiveTopology topology) {
+	switch(topology) {
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST: return 1u;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST: return 2u;
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST: return 3u;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY: return 4u;
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY: return 6u;
+		default: return 0u;
+	}
+}
+
+// Returns the number of vertices shared by consecutive primitives for
+// the strip topologies that can be split up without changing the
+// generated primitives, zero for all other topologies.
+u32 stripOverlap(VkPrimitiveTopology topology) {
+	switch(topology) {
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP: return 1u;
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP: return 2u;
+		default: return 0u;
+	}
+}
+
+// Upper bound for the number of vertices transform feedback writes,
+// also for topologies where topologyOutputCount doesn't know it.
+u32 xfbOutputBound(VkPrimitiveTopology topology, u32 vertexCount) {
+	return std::max(vertexCount, topologyOutputCount(topology, vertexCount));
+}
+
+// Returns whether any of the given stages of the pipeline reads the
+// given builtin.
+// Must only be called while the device mutex is locked, see specializeSpirv.
+bool readsBuiltin(const GraphicsPipeline& pipe, spv::BuiltIn builtin,
+		VkShaderStageFlags stages) {
+	for(auto& stage : pipe.stages) {
+		if(!(stage.stage & stages)) {
+			continue;
+		}
+
+		auto& compiled = specializeSpirv(stage);
+		compiled.update_active_builtins();
+		if(compiled.has_active_builtin(builtin, spv::StorageClassInput)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+u32 topologyOutputCount(VkPrimitiveTopology topo, u32 in) {
+	switch(topo) {
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST:
+			return in;
+
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+			return in > 1u ? 2u * (in - 1u) : 0u;
+
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+			return in / 2u;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+			return in > 3u ? 2u * (in - 3u) : 0u;
+
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN:
+			return in > 2u ? 3u * (in - 2u) : 0u;
+
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY:
+			return in / 2u;
+		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+			return 0u;
+
+		default:
+			dlg_error("Invalid topology {}", u32(topo));
+			return 0u;
+	}
+}
+
+DrawSplit splitDraw(VkPrimitiveTopology topology, u32 vertexCount,
+		u32 instanceCount, u32 page, u32 maxVertices, bool splitVertices) {
+	dlg_assert(maxVertices > 0u);
+
+	DrawSplit ret;
+	auto primSize = splitVertices ? listPrimitiveSize(topology) : 0u;
+	auto overlap = splitVertices ? stripOverlap(topology) : 0u;
+	auto window = 0u;
+	if(instanceCount == 1u && primSize != 0u) {
+		ret.total = vertexCount;
+		window = std::max(primSize, maxVertices - maxVertices % primSize);
+	} else if(instanceCount == 1u && overlap != 0u) {
+		ret.overlap = overlap;
+		ret.total = vertexCount > overlap ? vertexCount - overlap : 0u;
+
+		// every primitive writes overlap + 1 vertices
+		window = std::max(1u, maxVertices / (overlap + 1u));
+		if(topology == VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP) {
+			// odd triangles have flipped winding order
+			window = std::max(2u, window - window % 2u);
+		}
+	} else {
+		// NOTE: a single instance might still have more than maxVertices
+		// vertices, its capture is truncated.
+		ret.byInstance = true;
+		ret.total = instanceCount;
+		auto perInstance = xfbOutputBound(topology, vertexCount);
+		window = std::max(1u, maxVertices / std::max(1u, perInstance));
+	}
+
+	ret.pageCount = std::max(1u, u32((u64(ret.total) + window - 1) / window));
+	ret.page = std::min(page, ret.pageCount - 1);
+	ret.begin = u32(std::min(u64(ret.page) * window, u64(ret.total)));
+	ret.end = u32(std::min(u64(ret.begin) + window, u64(ret.total)));
+
+	return ret;
+}
+
+DrawSplit splitMultiDraw(VkPrimitiveTopology topology, span<const u32> counts,
+		u32 instanceCount, u32 page, u32 maxVertices, bool splitDraws) {
+	dlg_assert(maxVertices > 0u);
+
+	DrawSplit ret;
+	ret.byDraw = true;
+	ret.total = u32(counts.size());
+	ret.pageCount = 0u;
+
+	// Pages can't be computed directly since draws have different sizes.
+	// Remembers the last page not after the requested one, clamping it.
+	auto pageBegin = 0u;
+	auto pageVertices = u64(0u);
+	auto finishPage = [&](u32 end) {
+		if(ret.pageCount <= page) {
+			ret.page = ret.pageCount;
+			ret.begin = pageBegin;
+			ret.end = end;
+		}
+
+		++ret.pageCount;
+		pageBegin = end;
+		pageVertices = 0u;
+	};
+
+	for(auto i = 0u; i < counts.size(); ++i) {
+		auto vertices = u64(xfbOutputBound(topology, counts[i])) * instanceCount;
+		if(splitDraws && i != pageBegin && pageVertices + vertices > maxVertices) {
+			finishPage(i);
+		}
+
+		pageVertices += vertices;
+	}
+
+	finishPage(u32(counts.size()));
+	return ret;
+}
+
 // record
 CommandHookRecord::CommandHookRecord(CommandHook& hook,
 	CommandRecord& xrecord, std::vector<const Command*> hooked,
@@ -90,6 +298,21 @@ CommandHookRecord::CommandHookRecord(CommandHook& hook,
 		}
 	}
 
+	if(ops.profile) {
+		this->profile = true;
+
+		auto validBits = dev.queueFamilies[xrecord.queueFamily].props.timestampValidBits;
+		auto count = 2 * countProfiledCommands(record->commands);
+		if(validBits == 0u) {
+			dlg_info("Queue family {} does not support timing queries", xrecord.queueFamily);
+		} else if(count > 0u) {
+			profileQueryCount = count;
+			profileQueryPool = hook.profiler.allocQueryPoolLocked(profileQueryCount);
+			dev.dispatch.CmdResetQueryPool(cb, profileQueryPool, 0, profileQueryCount);
+			profiledCommands.reserve(count / 2);
+		}
+	}
+
 	unsigned maxHookLevel {};
 	info.maxHookLevel = &maxHookLevel;
 
@@ -147,6 +370,11 @@ CommandHookRecord::~CommandHookRecord() {
 	dev.dispatch.FreeCommandBuffers(dev.handle, commandPool, 1, &cb);
 	dev.dispatch.DestroyQueryPool(dev.handle, queryPool, nullptr);
 
+	if(profileQueryPool) {
+		commandHook().profiler.freeQueryPoolLocked(profileQueryPool,
+			profileQueryCount);
+	}
+
 	dev.dispatch.DestroyRenderPass(dev.handle, rp0, nullptr);
 	dev.dispatch.DestroyRenderPass(dev.handle, rp1, nullptr);
 	dev.dispatch.DestroyRenderPass(dev.handle, rp2, nullptr);
@@ -456,6 +684,7 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 
 	// transform feedback
 	auto endXfb = false;
+	auto splitXfb = false;
 	if(cmd.category() == CommandCategory::draw) {
 		auto* drawCmd = deriveCast<DrawCmdBase*>(&cmd);
 		dlg_assert(drawCmd->state->pipe);
@@ -466,10 +695,77 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 			dlg_assert(dev.dispatch.CmdBindTransformFeedbackBuffersEXT);
 			dlg_assert(dev.dispatch.CmdEndTransformFeedbackEXT);
 
-			// init xfb buffer
-			auto vertexCount = vertexCountHint(*drawCmd, info);
-			if(vertexCount == 0u) {
-				vertexCount = 1 * 1024 * 1024;
+			// For direct draws, we only capture a window of the draw,
+			// bounding the size of the xfb buffer.
+			auto vertexCount = 0u;
+			auto& pipe = *drawCmd->state->pipe;
+			auto topology = pipe.inputAssemblyState.topology;
+			auto& split = state->xfbSplit;
+			auto* dcmd = commandCast<const DrawCmd*>(drawCmd);
+			auto* dicmd = commandCast<const DrawIndexedCmd*>(drawCmd);
+			auto* dmcmd = commandCast<const DrawMultiCmd*>(drawCmd);
+			auto* dmicmd = commandCast<const DrawMultiIndexedCmd*>(drawCmd);
+			if(dcmd || dicmd) {
+				auto count = dcmd ? dcmd->vertexCount : dicmd->indexCount;
+				auto instanceCount = dcmd ? dcmd->instanceCount : dicmd->instanceCount;
+
+				// We don't know the topology when it's dynamic, the
+				// primitive class might differ. With primitive restart,
+				// a window could start inside a restarted strip.
+				auto restart = dicmd && (pipe.inputAssemblyState.primitiveRestartEnable ||
+					pipe.dynamicState.count(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE));
+				auto splitVertices = instanceCount == 1u &&
+					xfbOutputBound(topology, count) > maxXfbVertices &&
+					!restart &&
+					!pipe.dynamicState.count(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY) &&
+					!readsBuiltin(pipe, spv::BuiltInPrimitiveId,
+						VK_SHADER_STAGE_ALL_GRAPHICS & ~VK_SHADER_STAGE_VERTEX_BIT);
+
+				split = splitDraw(topology, count, instanceCount,
+					info.ops.xfbPage, maxXfbVertices, splitVertices);
+
+				if(split.byInstance) {
+					vertexCount = (split.end - split.begin) *
+						xfbOutputBound(topology, count);
+				} else {
+					vertexCount = xfbOutputBound(topology,
+						split.end - split.begin + split.overlap);
+				}
+
+				splitXfb = true;
+			} else if(dmcmd || dmicmd) {
+				ThreadMemScope tms;
+				auto drawCount = dmcmd ? dmcmd->vertexInfos.size() : dmicmd->indexInfos.size();
+				auto counts = tms.alloc<u32>(drawCount);
+				for(auto i = 0u; i < drawCount; ++i) {
+					counts[i] = dmcmd ?
+						dmcmd->vertexInfos[i].vertexCount :
+						dmicmd->indexInfos[i].indexCount;
+				}
+
+				// gl_DrawID starts at zero again for every part
+				auto instanceCount = dmcmd ? dmcmd->instanceCount : dmicmd->instanceCount;
+				auto splitDraws = !readsBuiltin(pipe, spv::BuiltInDrawIndex,
+					VK_SHADER_STAGE_VERTEX_BIT);
+				split = splitMultiDraw(topology, counts, instanceCount,
+					info.ops.xfbPage, maxXfbVertices, splitDraws);
+
+				for(auto i = split.begin; i < split.end; ++i) {
+					vertexCount += xfbOutputBound(topology, counts[i]) * instanceCount;
+				}
+
+				splitXfb = true;
+			} else {
+				// init xfb buffer
+				vertexCount = vertexCountHint(*drawCmd, info);
+				if(vertexCount == 0u) {
+					vertexCount = 1 * 1024 * 1024;
+				}
+			}
+
+			// Draws that can't be split are truncated
+			if(splitXfb) {
+				vertexCount = std::clamp(vertexCount, 1u, maxXfbVertices);
 			}
 
 			// TODO: for large captures, allow only capturing position
@@ -488,9 +784,12 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 			dev.dispatch.CmdBindTransformFeedbackBuffersEXT(cb, 0u, 1u,
 				&state->transformFeedback.buf, &offset,
 				&state->transformFeedback.size);
-			dev.dispatch.CmdBeginTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
 
-			endXfb = true;
+			// When splitting, recordSplitDraw begins and ends xfb
+			if(!splitXfb) {
+				dev.dispatch.CmdBeginTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
+				endXfb = true;
+			}
 		}
 	}
 
@@ -540,6 +839,8 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 
 	if(info.ops.shaderCapture && cmd.category() == CommandCategory::traceRays) {
 		hookRecordDstHookShaderTable(cmd, info);
+	} else if(splitXfb) {
+		recordSplitDraw(static_cast<const DrawCmdBase&>(cmd));
 	} else {
 		dispatchRecord(cmd, info);
 	}
@@ -583,6 +884,57 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 	hookRecordAfterDst(cmd, info);
 }
 
+void CommandHookRecord::recordSplitDraw(const DrawCmdBase& cmd) {
+	auto& dev = *record->dev;
+	auto& split = state->xfbSplit;
+
+	// records the part [begin, end) of the draw
+	auto recordPart = [&](u32 begin, u32 end) {
+		if(begin == end) {
+			return;
+		}
+
+		// strips need the vertices shared with the following primitives
+		auto count = end - begin + split.overlap;
+		if(auto* dcmd = commandCast<const DrawCmd*>(&cmd); dcmd) {
+			if(split.byInstance) {
+				dev.dispatch.CmdDraw(cb, dcmd->vertexCount, end - begin,
+					dcmd->firstVertex, dcmd->firstInstance + begin);
+			} else {
+				dev.dispatch.CmdDraw(cb, count, dcmd->instanceCount,
+					dcmd->firstVertex + begin, dcmd->firstInstance);
+			}
+		} else if(auto* dcmd = commandCast<const DrawIndexedCmd*>(&cmd); dcmd) {
+			if(split.byInstance) {
+				dev.dispatch.CmdDrawIndexed(cb, dcmd->indexCount, end - begin,
+					dcmd->firstIndex, dcmd->vertexOffset, dcmd->firstInstance + begin);
+			} else {
+				dev.dispatch.CmdDrawIndexed(cb, count, dcmd->instanceCount,
+					dcmd->firstIndex + begin, dcmd->vertexOffset, dcmd->firstInstance);
+			}
+		} else if(auto* dcmd = commandCast<const DrawMultiCmd*>(&cmd); dcmd) {
+			dlg_assert(split.byDraw);
+			dev.dispatch.CmdDrawMultiEXT(cb, end - begin,
+				dcmd->vertexInfos.data() + begin, dcmd->instanceCount,
+				dcmd->firstInstance, sizeof(VkMultiDrawInfoEXT));
+		} else if(auto* dcmd = commandCast<const DrawMultiIndexedCmd*>(&cmd); dcmd) {
+			dlg_assert(split.byDraw);
+			dev.dispatch.CmdDrawMultiIndexedEXT(cb, end - begin,
+				dcmd->indexInfos.data() + begin, dcmd->instanceCount,
+				dcmd->firstInstance, sizeof(VkMultiDrawIndexedInfoEXT),
+				dcmd->vertexOffset ? &*dcmd->vertexOffset : nullptr);
+		} else {
+			dlg_error("Unexpected command for draw splitting");
+		}
+	};
+
+	recordPart(0u, split.begin);
+	dev.dispatch.CmdBeginTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
+	recordPart(split.begin, split.end);
+	dev.dispatch.CmdEndTransformFeedbackEXT(cb, 0u, 0u, nullptr, nullptr);
+	recordPart(split.end, split.total);
+}
+
 void CommandHookRecord::hookRecordDstHookShaderTable(Command& dst, RecordInfo& info) {
 	// TODO: this computation is included in the queryTime.
 
@@ -768,6 +1120,8 @@ void CommandHookRecord::hookRecord(Command* cmd, RecordInfo& info) {
 					--info.nextHookLevel;
 				}
 			}
+		} else if(info.ops.profile) {
+			profileRecord(*cmd, info);
 		} else {
 			dispatchRecord(*cmd, info);
 			if(auto parentCmd = dynamic_cast<const ParentCommand*>(cmd); parentCmd) {
@@ -779,6 +1133,55 @@ void CommandHookRecord::hookRecord(Command* cmd, RecordInfo& info) {
 	}
 }
 
+void CommandHookRecord::profileRecord(Command& cmd, RecordInfo& info) {
+	auto& dev = *record->dev;
+
+	const auto timed = profileQueryPool && !info.profileSkip &&
+		profiledCommand(cmd);
+	const auto id = u32(profiledCommands.size());
+
+	// NOTE: we don't insert any barriers here (in contrast to the
+	// timing of single commands), the timings of commands therefore
+	// overlap. That is intended, we want to know how the frame behaves
+	// and not distort it.
+	if(timed) {
+		dlg_assert(2 * (id + 1) <= profileQueryCount);
+
+		auto& pc = profiledCommands.emplace_back();
+		pc.command = &cmd;
+		pc.parent = info.profileParent;
+		pc.depth = info.profileDepth;
+
+		dev.dispatch.CmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			profileQueryPool, 2 * id);
+	}
+
+	dispatchRecord(cmd, info);
+
+	if(auto parentCmd = dynamic_cast<const ParentCommand*>(&cmd); parentCmd) {
+		auto oldParent = info.profileParent;
+		auto oldDepth = info.profileDepth;
+		auto oldSkip = info.profileSkip;
+
+		if(timed) {
+			info.profileParent = id;
+			++info.profileDepth;
+		}
+
+		info.profileSkip |= usesMultiview(cmd);
+		hookRecord(parentCmd->children(), info);
+
+		info.profileParent = oldParent;
+		info.profileDepth = oldDepth;
+		info.profileSkip = oldSkip;
+	}
+
+	if(timed) {
+		dev.dispatch.CmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			profileQueryPool, 2 * id + 1);
+	}
+}
+
 void CommandHookRecord::copyDs(Command& bcmd, RecordInfo& info,
 		const DescriptorCopyOp& copyDesc, unsigned dstID,
 		CommandHookState::CopiedDescriptor& dst,
@@ -4,6 +4,7 @@
 #include <util/ownbuf.hpp>
 #include <command/record.hpp>
 #include <commandHook/state.hpp>
+#include <commandHook/profiler.hpp>
 #include <vkutil/dynds.hpp>
 #include <variant>
 
@@ -28,6 +29,7 @@ struct CommandHookRecord {
 	std::vector<const Command*> hcommand;
 	float match {}; // how much the original command matched the searched one
 	bool invalid {}; // if this was invalidated (e.g. by a hook update)
+	bool profile {}; // whether this was hooked for the GpuProfiler
 
 	// When there is currently a (hook) submission using this record,
 	// it is stored here. Synchronized via device mutex.
@@ -57,6 +59,13 @@ struct CommandHookRecord {
 	VkRenderPass rp1 {};
 	VkRenderPass rp2 {};
 
+	// Only when hooked for the GpuProfiler. The begin and end timestamps
+	// of profiledCommands[i] are written to queries 2 * i and 2 * i + 1.
+	// Only command, parent and depth are set in profiledCommands.
+	VkQueryPool profileQueryPool {};
+	u32 profileQueryCount {};
+	std::vector<ProfiledCommand> profiledCommands;
+
 	IntrusivePtr<ShaderCaptureHook> shaderCapture {}; // keep alive
 
 	IntrusivePtr<CommandHookState> state {};
@@ -171,6 +180,11 @@ private:
 		unsigned* maxHookLevel {};
 
 		bool rebindComputeState {};
+
+		// profiling state, see profileRecord
+		u32 profileParent {u32(-1)};
+		u32 profileDepth {};
+		bool profileSkip {}; // inside multiview render pass
 	};
 
 	void initState(RecordInfo&);
@@ -197,6 +211,10 @@ private:
 	// Recursively records the given linked list of commands.
 	void hookRecord(Command* cmdChain, RecordInfo&);
 
+	// Records the given command (and its children) with timestamps
+	// around it, if it is relevant for the GpuProfiler.
+	void profileRecord(Command& cmd, RecordInfo&);
+
 	// Returns the state of the *last* AccelStruct build for the acceleration
 	// structure at the given address, or null if there is none.
 	IntrusivePtr<AccelStructState> lastAccelStructBuild(u64 accelStructAddress);
@@ -219,6 +237,10 @@ private:
 
 	u32 vertexCountHint(const DrawCmdBase& cmd, const RecordInfo& info) const;
 
+	// Records the given direct draw split up as described by state->xfbSplit,
+	// with transform feedback only active for the captured window.
+	void recordSplitDraw(const DrawCmdBase& cmd);
+
 	// TODO: kinda arbitrary, allow more. Configurable via settings?
 	// In general, the problem is that we can't know the relevant
 	// size for sub-allocated buffers. Theoretically, we could analyze
@@ -228,6 +250,13 @@ private:
 	// viewer. Even if that means we have a frame delay
 	static constexpr auto maxBufCopySize = VkDeviceSize(2 * 1024 * 1024);
 
+	// The maximum number of vertices captured via transform feedback
+	// for a direct draw. Larger draws are split up and captured in pages,
+	// see splitDraw. The capture of draws that can't be split is
+	// truncated, transform feedback just stops writing when the buffer
+	// is full.
+	static constexpr auto maxXfbVertices = u32(64 * 1024);
+
 	// TODO: should the whole buffer be copied for transfer operations?
 	// bad idea in many cases, e.g. when huge upload heaps are used.
 	static constexpr auto copyFullTransferBuffer = false;
@@ -237,4 +266,34 @@ private:
 	static constexpr auto timingBarrierAfter = true;
 };
 
+// Returns the number of vertices transform feedback writes for a draw
+// of the given number of vertices with the given topology.
+// Returns zero for patches and triangle strips with adjacency, the
+// output isn't known for them.
+u32 topologyOutputCount(VkPrimitiveTopology, u32 vertexCount);
+
+// Returns how to split up a direct draw with the given vertex (or index)
+// and instance count so that only the given page, producing at most
+// maxVertices transform feedback vertices, is captured.
+// Non-instanced draws are split along vertices when splitVertices is true.
+// For list topologies, the pages are aligned to primitives. Line and
+// triangle strips are split along primitives, parts overlap by the shared
+// vertices and triangle strip pages start at even primitives so the
+// winding order is preserved. Fans can't be split without changing the
+// generated primitives and splitting along vertices changes
+// gl_PrimitiveID. All other draws are split along instances.
+// The parts keep their original firstVertex/firstIndex and firstInstance
+// offsets, so gl_VertexIndex and gl_InstanceIndex are preserved.
+// gl_DrawID is always zero for direct draws.
+DrawSplit splitDraw(VkPrimitiveTopology, u32 vertexCount, u32 instanceCount,
+	u32 page, u32 maxVertices, bool splitVertices);
+
+// Returns how to split up a multi draw with the given per-draw vertex
+// (or index) counts along its draws. Pages hold as many consecutive draws
+// as fit into maxVertices transform feedback vertices, but at least one.
+// When splitDraws is false, everything is put into a single page.
+// Splitting changes gl_DrawID for all but the first part.
+DrawSplit splitMultiDraw(VkPrimitiveTopology, span<const u32> counts,
+	u32 instanceCount, u32 page, u32 maxVertices, bool splitDraws);
+
 } // namespace vil
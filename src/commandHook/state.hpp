@@ -59,6 +59,27 @@ struct AttachmentCopyOp {
 	bool before {}; // whether to copy before or after target command
 };
 
+// Describes how a direct draw was split up to capture only a window of
+// it via transform feedback, see splitDraw and splitMultiDraw.
+// The draw is recorded as (up to) three draws, in order: [0, begin),
+// [begin, end) with transform feedback active and [end, total).
+struct DrawSplit {
+	// Whether the draw was split along instances.
+	bool byInstance {};
+	// Whether a multi draw was split along its draws.
+	bool byDraw {};
+	// Otherwise it was split along vertices (or indices for indexed draws).
+	// For strips, begin/end/total count primitives and the part [b, e)
+	// draws the vertices [b, e + overlap), overlap being the number of
+	// vertices shared by consecutive primitives. Zero for lists.
+	u32 overlap {};
+	u32 begin {};
+	u32 end {};
+	u32 total {}; // total number of instances/vertices/draws of the draw
+	u32 page {};
+	u32 pageCount {1u};
+};
+
 // Collection of data we got out of a submission/command.
 struct CommandHookState {
 	struct CapturedAccelStruct {
@@ -91,6 +112,10 @@ struct CommandHookState {
 	// have finished).
 	std::atomic<u32> refCount {};
 
+	// Lets the gui tell whether the captured contents changed since the
+	// last frame, a new state might be allocated at the old address.
+	const u64 id;
+
 	// Time needed for the given command.
 	// Set to u64(-1) on error.
 	u64 neededTime {u64(-1)};
@@ -106,6 +131,9 @@ struct CommandHookState {
 	std::vector<OwnBuffer> vertexBufCopies {}; // draw cmd: Copy of all vertex buffers
 	OwnBuffer indexBufCopy {}; // draw cmd: Copy of index buffer
 	OwnBuffer transformFeedback {}; // draw cmd: position output of vertex stage
+	// draw cmd: the captured window of a direct draw. When no window
+	// was used, [0, total) is captured in a single page.
+	DrawSplit xfbSplit {};
 
 	// Only for transfer commands
 	CopiedTransferIO transferSrcBefore {};
@@ -7,6 +7,7 @@
 #include <device.hpp>
 #include <ds.hpp>
 #include <accelStruct.hpp>
+#include <threadContext.hpp>
 
 namespace vil {
 
@@ -68,6 +69,12 @@ void CommandHookSubmission::finish(Submission& subm) {
 	ZoneScoped;
 	dlg_assert(record->writer == &subm);
 
+	// The profiler is interested in the results even if the hook record
+	// was invalidated in the meantime.
+	if(profileFrameID != u64(-1)) {
+		transmitProfile(subm);
+	}
+
 	// In this case the hook was invalidated, no longer interested in results.
 	// Since we are the only submission left to the record, it can be
 	// destroyed.
@@ -104,7 +111,7 @@ void CommandHookSubmission::finish(Submission& subm) {
 	// === /debug ====
 
 	assertOwned(record->record->dev->mutex);
-	transmitTiming();
+	transmitTiming(subm);
 
 	// This usually is a sign of a problem somewhere inside the layer.
 	// Either we are not correctly clearing completed states from the gui
@@ -271,7 +278,42 @@ void CommandHookSubmission::finish(Submission& subm) {
 	dstCompleted->submissionID = subm.parent->globalSubmitID;
 }
 
-void CommandHookSubmission::transmitTiming() {
+void CommandHookSubmission::transmitProfile(Submission& subm) {
+	ZoneScoped;
+	dlg_assert(record->profile);
+
+	auto& dev = *record->record->dev;
+	auto& profiler = record->commandHook().profiler;
+	assertOwned(dev.mutex);
+
+	ThreadMemScope tms;
+	auto timestamps = tms.alloc<u64>(2 * record->profiledCommands.size());
+	if(!timestamps.empty()) {
+		dlg_assert(record->profileQueryPool);
+
+		// Since the submission finished, we can expect them to be available
+		// soon, so we wait for them.
+		auto res = dev.dispatch.GetQueryPoolResults(dev.handle,
+			record->profileQueryPool, 0, u32(timestamps.size()),
+			timestamps.size_bytes(), timestamps.data(), 8,
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		if(res != VK_SUCCESS) {
+			dlg_error("GetQueryPoolResults failed: {}", res);
+			timestamps = {};
+		}
+	}
+
+	// must always be called, even without results, to not leave
+	// the frame profile pending.
+	if(auto& tracyZones = record->commandHook().tracyGpuZones; tracyZones) {
+		tracyZones->zonesLocked(*subm.parent->queue, *record, timestamps);
+	}
+
+	profiler.addResultsLocked(profileFrameID, subm.parent->globalSubmitID,
+		*record, timestamps);
+}
+
+void CommandHookSubmission::transmitTiming(Submission& subm) {
 	ZoneScoped;
 	auto& dev = *record->record->dev;
 
@@ -302,6 +344,12 @@ void CommandHookSubmission::transmitTiming() {
 	auto diff = after - before;
 	record->state->neededTime = diff;
 
+	auto& tracyZones = record->commandHook().tracyGpuZones;
+	if(tracyZones && !record->hcommand.empty()) {
+		tracyZones->zoneLocked(*subm.parent->queue,
+			record->hcommand.back()->nameDesc(), before, after);
+	}
+
 	// debug timing
 #ifdef VIL_DEBUG
 	auto timingCounts = record->ownTimingNames.size();
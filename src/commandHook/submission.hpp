@@ -10,6 +10,9 @@ namespace vil {
 struct CommandHookSubmission {
 	CommandHookRecord* record {};
 	CommandDescriptorSnapshot descriptorSnapshot {};
+	// Frame this submission was profiled in, u64(-1) if it wasn't.
+	// See GpuProfiler.
+	u64 profileFrameID {u64(-1)};
 
 	CommandHookSubmission(CommandHookRecord&, Submission&,
 		CommandDescriptorSnapshot descriptors);
@@ -24,8 +27,9 @@ struct CommandHookSubmission {
 	// successfully completed execution on the device.
 	// Called while device mutex is locked.
 	void finish(Submission&);
-	void transmitTiming();
+	void transmitTiming(Submission&);
 	void transmitIndirect();
+	void transmitProfile(Submission&);
 
 	void finishAccelStructBuilds();
 };
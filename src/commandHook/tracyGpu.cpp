@@ -0,0 +1,342 @@
+#include <commandHook/tracyGpu.hpp>
+#include <commandHook/record.hpp>
+#include <command/commands.hpp>
+#include <command/record.hpp>
+#include <device.hpp>
+#include <queue.hpp>
+#include <handle.hpp>
+#include <threadContext.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+
+#ifdef TRACY_ENABLE
+	#include <tracy/client/TracyProfiler.hpp>
+#endif // TRACY_ENABLE
+
+#include <cstring>
+#include <ctime>
+
+namespace vil {
+
+#ifdef TRACY_ENABLE
+
+namespace {
+
+// We only publish the sections of a profiled frame, publishing
+// every single draw or dispatch would flood tracy.
+bool publishedSection(const Command& cmd) {
+	return cmd.type() == CommandType::beginDebugUtilsLabel ||
+		cmd.type() == CommandType::beginRenderPass ||
+		cmd.type() == CommandType::beginRendering;
+}
+
+constexpr auto calibrationInterval = i64(1000 * 1000 * 1000); // 1s in ns
+
+} // anon namespace
+
+std::unique_ptr<TracyGpuZones> TracyGpuZones::create(Device& dev) {
+#if !defined(_WIN32) && !(defined(__linux__) && defined(CLOCK_MONOTONIC_RAW))
+	// no host time domain we could calibrate against
+	(void) dev;
+	dlg_warn("Tracy gpu zones not supported on this platform");
+	return nullptr;
+#else // _WIN32 || CLOCK_MONOTONIC_RAW
+	if(!dev.calibratedTimestamps) {
+		return nullptr;
+	}
+
+	auto getDomains = dev.ini->dispatch.GetPhysicalDeviceCalibrateableTimeDomainsKHR;
+	if(!getDomains) {
+		getDomains = dev.ini->dispatch.GetPhysicalDeviceCalibrateableTimeDomainsEXT;
+	}
+
+	auto getTimestamps = dev.dispatch.GetCalibratedTimestampsKHR;
+	if(!getTimestamps) {
+		getTimestamps = dev.dispatch.GetCalibratedTimestampsEXT;
+	}
+
+	if(!getDomains || !getTimestamps) {
+		dlg_warn("Calibrated timestamps enabled but functions not loaded");
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	const auto hostDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_KHR;
+#else // _WIN32
+	const auto hostDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_KHR;
+#endif // _WIN32
+
+	u32 count {};
+	VK_CHECK(getDomains(dev.phdev, &count, nullptr));
+	std::vector<VkTimeDomainKHR> domains(count);
+	VK_CHECK(getDomains(dev.phdev, &count, domains.data()));
+
+	if(!contains(domains, hostDomain) ||
+			!contains(domains, VK_TIME_DOMAIN_DEVICE_KHR)) {
+		dlg_warn("Tracy gpu zones: device/host time domain not calibrateable");
+		return nullptr;
+	}
+
+	auto ret = std::unique_ptr<TracyGpuZones>(new TracyGpuZones());
+	ret->dev_ = &dev;
+	ret->getCalibratedTimestamps_ = getTimestamps;
+	ret->hostDomain_ = hostDomain;
+
+	// Same as tracy does it: accept calibrations that are at most
+	// a bit worse than the best one we get in a couple of tries.
+	VkCalibratedTimestampInfoKHR infos[2] {};
+	infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR;
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_KHR;
+	infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR;
+	infos[1].timeDomain = hostDomain;
+
+	u64 minDeviation = u64(-1);
+	for(auto i = 0u; i < 32u; ++i) {
+		u64 ts[2];
+		u64 deviation;
+		VK_CHECK(getTimestamps(dev.handle, 2u, infos, ts, &deviation));
+		minDeviation = std::min(minDeviation, deviation);
+	}
+
+	ret->maxDeviation_ = minDeviation * 3 / 2;
+
+#ifdef _WIN32
+	ret->qpcToNs_ = i64(1000000000. / tracy::GetFrequencyQpc());
+#endif // _WIN32
+
+	return ret;
+#endif // _WIN32 || CLOCK_MONOTONIC_RAW
+}
+
+TracyGpuZones::~TracyGpuZones() = default;
+
+bool TracyGpuZones::calibrate(i64& cpuTime, i64& gpuTime) {
+	VkCalibratedTimestampInfoKHR infos[2] {};
+	infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR;
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_KHR;
+	infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_KHR;
+	infos[1].timeDomain = hostDomain_;
+
+	// don't loop forever when the driver gives us worse results
+	// than at initialization for some reason.
+	for(auto i = 0u; i < 16u; ++i) {
+		u64 ts[2];
+		u64 deviation;
+		auto res = getCalibratedTimestamps_(dev_->handle, 2u, infos, ts, &deviation);
+		if(res != VK_SUCCESS) {
+			dlg_error("GetCalibratedTimestamps: {}", res);
+			return false;
+		}
+
+		if(deviation <= maxDeviation_) {
+			gpuTime = i64(ts[0]);
+			cpuTime = i64(ts[1]) * qpcToNs_;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+TracyGpuZones::Context& TracyGpuZones::contextLocked(Queue& queue) {
+	assertOwned(dev_->mutex);
+
+	for(auto& ctx : contexts_) {
+		if(ctx.queue == &queue) {
+			return ctx;
+		}
+	}
+
+	auto& ctx = contexts_.emplace_back();
+	ctx.queue = &queue;
+	ctx.id = tracy::GetGpuCtxCounter().fetch_add(1, std::memory_order_relaxed);
+
+	const auto validBits = dev_->queueFamilies[queue.family].props.timestampValidBits;
+	ctx.timestampMask = validBits >= 64u ? u64(-1) : (u64(1) << validBits) - 1;
+
+	i64 cpuTime {};
+	i64 gpuTime {};
+	u8 flags {};
+	if(calibrate(ctx.lastCalibration, gpuTime)) {
+		flags |= tracy::GpuContextCalibration;
+	}
+
+	gpuTime &= ctx.timestampMask;
+	cpuTime = tracy::Profiler::GetTime();
+
+	const float period = dev_->props.limits.timestampPeriod;
+	auto* item = tracy::Profiler::QueueSerial();
+	tracy::MemWrite(&item->hdr.type, tracy::QueueType::GpuNewContext);
+	tracy::MemWrite(&item->gpuNewContext.cpuTime, cpuTime);
+	tracy::MemWrite(&item->gpuNewContext.gpuTime, gpuTime);
+	std::memset(&item->gpuNewContext.thread, 0, sizeof(item->gpuNewContext.thread));
+	tracy::MemWrite(&item->gpuNewContext.period, period);
+	tracy::MemWrite(&item->gpuNewContext.context, ctx.id);
+	tracy::MemWrite(&item->gpuNewContext.flags, flags);
+	tracy::MemWrite(&item->gpuNewContext.type, tracy::GpuContextType::Vulkan);
+#ifdef TRACY_ON_DEMAND
+	tracy::GetProfiler().DeferItem(*item);
+#endif // TRACY_ON_DEMAND
+	tracy::Profiler::QueueSerialFinish();
+
+	auto label = dlg::format("vil: {}", name(queue));
+	auto* ptr = static_cast<char*>(tracy::tracy_malloc(label.size()));
+	std::memcpy(ptr, label.data(), label.size());
+
+	item = tracy::Profiler::QueueSerial();
+	tracy::MemWrite(&item->hdr.type, tracy::QueueType::GpuContextName);
+	tracy::MemWrite(&item->gpuContextNameFat.context, ctx.id);
+	tracy::MemWrite(&item->gpuContextNameFat.ptr, u64(ptr));
+	tracy::MemWrite(&item->gpuContextNameFat.size, u16(label.size()));
+#ifdef TRACY_ON_DEMAND
+	tracy::GetProfiler().DeferItem(*item);
+#endif // TRACY_ON_DEMAND
+	tracy::Profiler::QueueSerialFinish();
+
+	return ctx;
+}
+
+void TracyGpuZones::recalibrateLocked(Context& ctx) {
+	i64 cpuTime;
+	i64 gpuTime;
+	if(!calibrate(cpuTime, gpuTime)) {
+		return;
+	}
+
+	const auto delta = cpuTime - ctx.lastCalibration;
+	if(delta < calibrationInterval) {
+		return;
+	}
+
+	ctx.lastCalibration = cpuTime;
+
+	auto* item = tracy::Profiler::QueueSerial();
+	tracy::MemWrite(&item->hdr.type, tracy::QueueType::GpuCalibration);
+	tracy::MemWrite(&item->gpuCalibration.gpuTime, i64(u64(gpuTime) & ctx.timestampMask));
+	tracy::MemWrite(&item->gpuCalibration.cpuTime, tracy::Profiler::GetTime());
+	tracy::MemWrite(&item->gpuCalibration.cpuDelta, delta);
+	tracy::MemWrite(&item->gpuCalibration.context, ctx.id);
+	tracy::Profiler::QueueSerialFinish();
+}
+
+void TracyGpuZones::timeLocked(Context& ctx, u16 queryID, u64 gpuTime) {
+	auto* item = tracy::Profiler::QueueSerial();
+	tracy::MemWrite(&item->hdr.type, tracy::QueueType::GpuTime);
+	tracy::MemWrite(&item->gpuTime.gpuTime, i64(gpuTime & ctx.timestampMask));
+	tracy::MemWrite(&item->gpuTime.queryId, queryID);
+	tracy::MemWrite(&item->gpuTime.context, ctx.id);
+	tracy::Profiler::QueueSerialFinish();
+}
+
+void TracyGpuZones::beginLocked(Context& ctx, std::string_view name, u64 gpuTime) {
+	static constexpr std::string_view function = "vil::TracyGpuZones";
+	static constexpr std::string_view file = __FILE__;
+	const auto srcloc = tracy::Profiler::AllocSourceLocation(__LINE__,
+		file.data(), file.size(), function.data(), function.size(),
+		name.data(), name.size());
+
+	const auto queryID = nextQueryID_++;
+	auto* item = tracy::Profiler::QueueSerial();
+	tracy::MemWrite(&item->hdr.type, tracy::QueueType::GpuZoneBeginAllocSrcLocSerial);
+	tracy::MemWrite(&item->gpuZoneBegin.cpuTime, tracy::Profiler::GetTime());
+	tracy::MemWrite(&item->gpuZoneBegin.srcloc, srcloc);
+	tracy::MemWrite(&item->gpuZoneBegin.thread, tracy::GetThreadHandle());
+	tracy::MemWrite(&item->gpuZoneBegin.queryId, queryID);
+	tracy::MemWrite(&item->gpuZoneBegin.context, ctx.id);
+	tracy::Profiler::QueueSerialFinish();
+
+	timeLocked(ctx, queryID, gpuTime);
+}
+
+void TracyGpuZones::endLocked(Context& ctx, u64 gpuTime) {
+	const auto queryID = nextQueryID_++;
+	auto* item = tracy::Profiler::QueueSerial();
+	tracy::MemWrite(&item->hdr.type, tracy::QueueType::GpuZoneEndSerial);
+	tracy::MemWrite(&item->gpuZoneEnd.cpuTime, tracy::Profiler::GetTime());
+	tracy::MemWrite(&item->gpuZoneEnd.thread, tracy::GetThreadHandle());
+	tracy::MemWrite(&item->gpuZoneEnd.queryId, queryID);
+	tracy::MemWrite(&item->gpuZoneEnd.context, ctx.id);
+	tracy::Profiler::QueueSerialFinish();
+
+	timeLocked(ctx, queryID, gpuTime);
+}
+
+void TracyGpuZones::zoneLocked(Queue& queue, std::string_view name,
+		u64 begin, u64 end) {
+	ZoneScoped;
+	assertOwned(dev_->mutex);
+
+#ifdef TRACY_ON_DEMAND
+	if(!tracy::GetProfiler().IsConnected()) {
+		return;
+	}
+#endif // TRACY_ON_DEMAND
+
+	auto& ctx = contextLocked(queue);
+	recalibrateLocked(ctx);
+	beginLocked(ctx, name, begin);
+	endLocked(ctx, std::max(begin, end));
+}
+
+void TracyGpuZones::zonesLocked(Queue& queue, const CommandHookRecord& hookRecord,
+		span<const u64> timestamps) {
+	ZoneScoped;
+	assertOwned(dev_->mutex);
+
+#ifdef TRACY_ON_DEMAND
+	if(!tracy::GetProfiler().IsConnected()) {
+		return;
+	}
+#endif // TRACY_ON_DEMAND
+
+	auto& cmds = hookRecord.profiledCommands;
+	if(timestamps.empty()) {
+		return;
+	}
+
+	dlg_assert(timestamps.size() == 2 * cmds.size());
+
+	auto& ctx = contextLocked(queue);
+	recalibrateLocked(ctx);
+
+	// The profiled commands are stored in pre-order, so we can reconstruct
+	// the nesting with a simple stack of open zones. Sections only ever have
+	// sections as timed ancestors.
+	ThreadMemScope tms;
+	auto open = tms.alloc<u32>(cmds.size());
+	auto openCount = 0u;
+
+	for(auto [i, cmd] : enumerate(cmds)) {
+		if(!publishedSection(*cmd.command)) {
+			continue;
+		}
+
+		while(openCount > 0u && open[openCount - 1] != cmd.parent) {
+			auto id = open[--openCount];
+			endLocked(ctx, timestamps[2 * id + 1]);
+		}
+
+		beginLocked(ctx, cmd.command->nameDesc(), timestamps[2 * i]);
+		open[openCount++] = u32(i);
+	}
+
+	while(openCount > 0u) {
+		auto id = open[--openCount];
+		endLocked(ctx, timestamps[2 * id + 1]);
+	}
+}
+
+#else // TRACY_ENABLE
+
+std::unique_ptr<TracyGpuZones> TracyGpuZones::create(Device&) {
+	return nullptr;
+}
+
+TracyGpuZones::~TracyGpuZones() = default;
+
+void TracyGpuZones::zoneLocked(Queue&, std::string_view, u64, u64) {}
+void TracyGpuZones::zonesLocked(Queue&, const CommandHookRecord&, span<const u64>) {}
+
+#endif // TRACY_ENABLE
+
+} // namespace vil
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <nytl/span.hpp>
+#include <vk/vulkan.h>
+#include <string_view>
+#include <memory>
+#include <vector>
+
+namespace vil {
+
+// Publishes GPU timings gathered by the command hook as tracy GPU zones.
+// In contrast to the usual tracy vulkan integration, we never record any
+// commands ourselves here. We just forward timestamps that were already
+// retrieved: the timing of hooked commands and the label sections and
+// render passes of the frame profiler (GpuProfiler).
+// The timestamps are mapped to the tracy timeline via a calibrated host
+// time domain, therefore this requires VK_{KHR, EXT}_calibrated_timestamps.
+// Enabled via the VIL_TRACY_GPU_ZONES environment variable.
+// All functions must be called with the device mutex locked.
+class TracyGpuZones {
+public:
+	// Returns nullptr when not supported or tracy is disabled.
+	static std::unique_ptr<TracyGpuZones> create(Device& dev);
+	~TracyGpuZones();
+
+	// Publishes a single zone with the given raw timestamps.
+	void zoneLocked(Queue& queue, std::string_view name, u64 begin, u64 end);
+
+	// Publishes all label sections and render passes in the given
+	// profiled hook record. Timestamps are given as raw ticks,
+	// as passed to GpuProfiler::addResultsLocked.
+	void zonesLocked(Queue& queue, const CommandHookRecord&,
+		span<const u64> timestamps);
+
+private:
+	struct Context {
+		const Queue* queue {};
+		u8 id {};
+		u64 timestampMask {};
+		i64 lastCalibration {};
+	};
+
+	TracyGpuZones() = default;
+	Context& contextLocked(Queue& queue);
+	bool calibrate(i64& cpuTime, i64& gpuTime);
+	void recalibrateLocked(Context& ctx);
+	void beginLocked(Context& ctx, std::string_view name, u64 gpuTime);
+	void endLocked(Context& ctx, u64 gpuTime);
+	void timeLocked(Context& ctx, u16 queryID, u64 gpuTime);
+
+	Device* dev_ {};
+	PFN_vkGetCalibratedTimestampsKHR getCalibratedTimestamps_ {};
+	VkTimeDomainKHR hostDomain_ {};
+	u64 maxDeviation_ {};
+	i64 qpcToNs_ {1};
+
+	// Rotating query ids. Since we send the associated times right
+	// after the zone itself, wrapping around is not a problem.
+	u16 nextQueryID_ {};
+	std::vector<Context> contexts_;
+};
+
+} // namespace vil
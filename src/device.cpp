@@ -17,6 +17,7 @@
 #include <gencmd.hpp>
 #include <threadContext.hpp>
 #include <fault.hpp>
+#include <frameCapture.hpp>
 #include <exts.hpp>
 #include <util/util.hpp>
 #include <util/chain.hpp>
@@ -89,6 +90,13 @@ Device::Device() {
 }
 
 Device::~Device() {
+	// must be joined first, it accesses the pending submissions
+	submissionWaiter.reset();
+
+	// From here on, objects are destroyed inline again. Destruction
+	// order below matters, e.g. records reference the commandHook.
+	destroyQueue.stop();
+
 	// Vulkan spec requires that all pending submissions have finished.
 	while(!pending.empty()) {
 		// We don't have to lock the mutex at checkLocked here since
@@ -105,6 +113,9 @@ Device::~Device() {
 	this->keepAliveSamplers.clear();
 	this->keepAliveAccelStructs.clear();
 
+	// all command buffers were destroyed, they disconnect replaced records
+	dlg_assert(!this->replacedRecords.load());
+
 	// user must have erased all resources
 	dlg_assert(this->swapchains.empty());
 	dlg_assert(this->images.empty());
@@ -136,8 +147,12 @@ Device::~Device() {
 	// still be active and use e.g. commandHook resources.
 	window.reset();
 	gui_.reset();
+	frameCapture.reset();
 	commandHook.reset();
 
+	// all records are destroyed now, release the handles they used
+	reclaimer.releaseAll();
+
 	for(auto& fence : fencePool) {
 		dispatch.DestroyFence(handle, fence, nullptr);
 	}
@@ -786,6 +801,17 @@ VkResult doCreateDevice(
 
 	checkEnable(VK_AMD_SHADER_INFO_EXTENSION_NAME);
 
+	auto hasCalibratedTimestamps = false;
+#ifdef TRACY_ENABLE
+	// Needed to map hooked gpu timings into the tracy timeline,
+	// see TracyGpuZones.
+	if(checkEnvBinary("VIL_TRACY_GPU_ZONES", false)) {
+		hasCalibratedTimestamps =
+			checkEnable(VK_KHR_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) ||
+			checkEnable(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	}
+#endif // TRACY_ENABLE
+
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtProps {};
 	if(fpPhdevProps2) {
 		checkEnable(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
@@ -831,10 +857,13 @@ VkResult doCreateDevice(
 	dev.rtProps = rtProps;
 
 	dev.timelineSemaphores = hasTimelineSemaphores;
+	dev.timelineTracking = hasTimelineSemaphores &&
+		checkEnvBinary("VIL_TIMELINE_TRACKING", true);
 	dev.transformFeedback = hasTransformFeedback;
 	dev.nonSolidFill = pEnabledFeatures10->fillModeNonSolid;
 	dev.shaderStorageImageWriteWithoutFormat = pEnabledFeatures10->shaderStorageImageWriteWithoutFormat;
 	dev.extDeviceFault = hasDeviceFault;
+	dev.calibratedTimestamps = hasCalibratedTimestamps;
 	dev.storage8Bit = hasStorage8;
 	dev.storage16Bit = hasStorage16;
 	dev.shaderDrawParameters = hasDrawParams;
@@ -862,6 +891,11 @@ VkResult doCreateDevice(
 
 	dev.windowWaitForSurface = checkEnvBinary("VIL_WAIT_SURFACE", false);
 	dev.hookRecordOnEnd = checkEnvBinary("VIL_CB_TEST_HOOK", true);
+	dev.descriptorWritesOnly = checkEnvBinary("VIL_DESCRIPTOR_WRITES_ONLY", false);
+
+	if(checkEnvBinary("VIL_DESTROY_THREAD", true)) {
+		dev.destroyQueue.start();
+	}
 
 	layer_init_device_dispatch_table(dev.handle, &dev.dispatch, fpGetDeviceProcAddr);
 
@@ -1244,6 +1278,11 @@ VkResult doCreateDevice(
 
 	// init command hook
 	dev.commandHook = std::make_unique<CommandHook>(dev);
+	dev.frameCapture = FrameCapture::create(dev);
+
+	if(dev.timelineTracking && checkEnvBinary("VIL_SUBMISSION_WAITER", false)) {
+		dev.submissionWaiter = std::make_unique<SubmissionWaiter>(dev);
+	}
 
 #ifdef VIL_WITH_SWA
 	if(window) {
@@ -1313,13 +1352,7 @@ bool waitForSubmissionsUsingHandle(Device& dev, SubmissionBatch& batch, const Ha
 				dlg_info("Waiting for hooked submission using destroyed handle");
 
 				if(contains(cb.hook->record->usedHandles, &handle)) {
-					auto res = dev.dispatch.WaitForFences(dev.handle, 1u, &batch.ourFence, true, UINT64_MAX);
-					if(res != VK_SUCCESS) {
-						if(res == VK_ERROR_DEVICE_LOST) {
-							onDeviceLost(dev);
-						}
-					}
-
+					waitLocked(batch);
 					return true;
 				}
 			}
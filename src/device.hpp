@@ -7,6 +7,7 @@
 #include <util/syncedMap.hpp>
 #include <util/debugMutex.hpp>
 #include <util/profiling.hpp>
+#include <command/reclaim.hpp>
 #include <nytl/span.hpp>
 
 #include <vk/vulkan.h>
@@ -93,6 +94,9 @@ struct Device {
 
 	// supported features/extensions
 	bool timelineSemaphores {}; // whether we have timeline semaphores
+	// whether completion of submissions is tracked via the submission
+	// semaphores of the queues, see SubmissionBatch::lastSubmissionID.
+	bool timelineTracking {};
 	bool transformFeedback {}; // whether we have transformFeedback
 	bool nonSolidFill {}; // whether we have nonSolidFill mode
 	bool bufferDeviceAddress {}; // whether we have bufferDeviceAddress
@@ -101,6 +105,8 @@ struct Device {
 	bool shaderStorageImageWriteWithoutFormat {};
 	bool shaderDrawParameters {};
 	bool extDeviceFault {}; // whether EXT_device_fault was enabled
+	// whether {KHR, EXT}_calibrated_timestamps was enabled for tracy gpu zones
+	bool calibratedTimestamps {};
 
 	// Only valid when EXT_device_address_binding_report enabled.
 	std::unique_ptr<DeviceAddressMap> addressMap;
@@ -123,6 +129,14 @@ struct Device {
 	// Needed for Proton/DXVK, I don't know why.
 	bool windowWaitForSurface {false};
 
+	// Whether paged descriptor bindings only track which descriptors were
+	// written instead of storing them. See DescriptorPages.
+	bool descriptorWritesOnly {false};
+
+	// Incremented on every present, on any swapchain.
+	// Used for per-frame tracking.
+	std::atomic<u64> presentCounter {};
+
 	// Aside from properties, only the families used by device
 	// are initialized.
 	std::vector<QueueFamily> queueFamilies;
@@ -160,6 +174,12 @@ struct Device {
 	// Always valid, initialized on device creation.
 	std::unique_ptr<CommandHook> commandHook {};
 
+	// Only valid when enabled via VIL_FRAME_CAPTURE.
+	std::unique_ptr<FrameCapture> frameCapture {};
+
+	// Only valid when enabled via VIL_SUBMISSION_WAITER.
+	std::unique_ptr<SubmissionWaiter> submissionWaiter {};
+
 	std::vector<VkFence> fencePool; // currently unused fences
 
 	std::vector<VkSemaphore> semaphorePool; // currently used semaphores
@@ -176,6 +196,20 @@ struct Device {
 	// vilDefSharedMutex(mutex);
 	TracySharedLockable(DebugSharedMutex, mutex);
 
+	// Keeps destroyed handles alive while CommandRecords might still
+	// reference them. See HandleReclaimer.
+	HandleReclaimer reclaimer;
+
+	// Destroys CommandRecords and other expensive objects off the
+	// application threads. See DestroyQueue.
+	DestroyQueue destroyQueue;
+
+	// CommandRecords that were replaced as lastRecord_ of their command
+	// buffer without the device mutex, linked via
+	// CommandRecord::nextReplaced. See disconnectReplacedRecordsLocked.
+	std::atomic<CommandRecord*> replacedRecords {};
+	std::atomic<u32> replacedRecordCount {};
+
 	// Mutex that is locked *while* doing a submission. The general mutex
 	// won't be locked for that time. So when we want to do submissions
 	// ourselves from a different thread on from within another call,
@@ -259,6 +293,16 @@ struct Device {
 
 	// NOTE: when adding new maps: also add mutex initializer in CreateDevice
 
+	// Incremented (while the mutex is locked) whenever the debug name of
+	// a handle changes. Together with the versions of the maps, this allows
+	// checking whether a snapshot of handles and their names is outdated.
+	std::atomic<u64> nameVersion {};
+	// The latest renamed handles, keyed by nameVersion. Only allocated
+	// once needed by the gui. Must only be accessed while the mutex is
+	// locked. The handles are only valid while they are alive, they might
+	// have been destroyed since.
+	std::unique_ptr<ChangeJournal<Handle>> nameJournal;
+
 	// NOTE: keepAliveCount = 0 means it's disabled completely.
 	// TODO: documentation on keep alive.
 	// Note how we must only have the KeepAlive mechanism for handles
@@ -8,6 +8,9 @@
 #include <util/util.hpp>
 #include <util/chain.hpp>
 #include <util/profiling.hpp>
+#include <bitset>
+#include <cstring>
+#include <new>
 
 namespace vil {
 
@@ -64,6 +67,10 @@ std::byte* bindingData(const DescriptorSet& ds) {
 	return const_cast<std::byte*>(ptr) + sizeof(ds);
 }
 
+bool isPaged(DescriptorStateRef state, unsigned binding) {
+	return state.pages && binding + 1 == state.layout->bindings.size();
+}
+
 VkDescriptorType& mutableDescriptorType(DescriptorStateRef state, unsigned binding, unsigned elem) {
 	auto& layout = state.layout->bindings[binding];
 	dlg_assert(layout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT);
@@ -90,10 +97,18 @@ VkDescriptorType descriptorType(DescriptorStateRef state, unsigned binding, unsi
 template<typename F>
 void callForEachDescriptor(DescriptorStateRef state, F&& f) {
 	for(auto i = 0u; i < state.layout->bindings.size(); ++i) {
+		auto paged = isPaged(state, i);
 		for(auto j = 0u; j < descriptorCount(state, i); ++j) {
+			if(paged && !state.pages->find(j)) {
+				// skip the page, never written
+				auto perPage = state.pages->perPage;
+				j = (j / perPage + 1) * perPage - 1;
+				continue;
+			}
+
 			auto dsType = descriptorType(state, i, j);
 			if(dsType == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK) {
-				std::invoke(std::forward<F>(f), dsBufferView(state, i, j));
+				std::invoke(std::forward<F>(f), dsBufferViewWrite(state, i, j));
 				continue;
 			}
 
@@ -104,16 +119,16 @@ void callForEachDescriptor(DescriptorStateRef state, F&& f) {
 
 			switch(category(dsType)) {
 				case DescriptorCategory::accelStruct: {
-					std::invoke(std::forward<F>(f), dsAccelStruct(state, i, j));
+					std::invoke(std::forward<F>(f), dsAccelStructWrite(state, i, j));
 					break;
 				} case DescriptorCategory::buffer: {
-					std::invoke(std::forward<F>(f), dsBuffer(state, i, j));
+					std::invoke(std::forward<F>(f), dsBufferWrite(state, i, j));
 					break;
 				} case DescriptorCategory::image: {
-					std::invoke(std::forward<F>(f), dsImage(state, i, j));
+					std::invoke(std::forward<F>(f), dsImageWrite(state, i, j));
 					break;
 				} case DescriptorCategory::bufferView: {
-					std::invoke(std::forward<F>(f), dsBufferView(state, i, j));
+					std::invoke(std::forward<F>(f), dsBufferViewWrite(state, i, j));
 					break;
 				}
 				case DescriptorCategory::inlineUniformBlock:
@@ -126,13 +141,16 @@ void callForEachDescriptor(DescriptorStateRef state, F&& f) {
 }
 
 DescriptorStateRef::DescriptorStateRef(const DescriptorSet& ds) :
-	layout(ds.layout.get()), data(bindingData(ds)), variableDescriptorCount(ds.variableDescriptorCount) {
+	layout(ds.layout.get()), data(bindingData(ds)),
+	variableDescriptorCount(ds.variableDescriptorCount),
+	pages(ds.pages.get()) {
 }
 
 DescriptorStateRef::DescriptorStateRef(DescriptorStateCopy& ds) :
 	layout(ds.layout.get()),
 	data(reinterpret_cast<std::byte*>(&ds) + sizeof(DescriptorStateCopy)),
-	variableDescriptorCount(ds.variableDescriptorCount) {
+	variableDescriptorCount(ds.variableDescriptorCount),
+	pages(ds.pages.get()) {
 }
 
 template<typename T, typename O>
@@ -156,6 +174,159 @@ void debugStatSub(std::atomic<T>& dst, const O& val) {
 #endif // VIL_DEBUG_STATS
 }
 
+// DescriptorPages
+DescriptorPages::DescriptorPages(u32 xdescriptorSize, u32 xcount, bool xwritesOnly,
+		const std::atomic<u64>* xframeCounter) :
+			descriptorSize(xdescriptorSize),
+			perPage(pageSize / xdescriptorSize),
+			count(xcount),
+			writesOnly(xwritesOnly),
+			frameCounter(xframeCounter) {
+	dlg_assert(perPage > 0u);
+	pages = std::make_unique<Page[]>(pageCount());
+}
+
+DescriptorPages::~DescriptorPages() {
+	auto mem = u64(0u);
+	for(auto i = 0u; i < pageCount(); ++i) {
+		mem += pages[i].data ? perPage * descriptorSize : 0u;
+		mem += pages[i].written ? sizeof(u64) * ((perPage + 63u) / 64u) : 0u;
+	}
+
+	debugStatSub(DebugStats::get().descriptorPageMem, mem);
+}
+
+u64 DescriptorPages::currentFrame() const {
+	return frameCounter ? frameCounter->load(std::memory_order_relaxed) : 0u;
+}
+
+std::byte* DescriptorPages::find(u32 elem) const {
+	dlg_assert(elem < count);
+	auto& page = pages[elem / perPage];
+	if(!page.data) {
+		return nullptr;
+	}
+
+	return page.data.get() + (elem % perPage) * descriptorSize;
+}
+
+std::byte* DescriptorPages::get(u32 elem) {
+	dlg_assert(elem < count);
+	dlg_assert(!writesOnly);
+
+	auto& page = pages[elem / perPage];
+	if(!page.data) {
+		// zero-initialized, i.e. null descriptors
+		page.data = std::make_unique<std::byte[]>(perPage * descriptorSize);
+		debugStatAdd(DebugStats::get().descriptorPageMem, perPage * descriptorSize);
+	}
+
+	return page.data.get() + (elem % perPage) * descriptorSize;
+}
+
+void DescriptorPages::markWritten(u32 first, u32 writeCount) {
+	dlg_assert(u64(first) + writeCount <= count);
+
+	auto frame = currentFrame();
+	auto words = (perPage + 63u) / 64u;
+	auto end = first + writeCount;
+	for(auto elem = first; elem < end;) {
+		auto& page = pages[elem / perPage];
+		if(!page.written) {
+			page.written = std::make_unique<u64[]>(words);
+			page.frame = frame;
+			debugStatAdd(DebugStats::get().descriptorPageMem, sizeof(u64) * words);
+		} else if(page.frame != frame) {
+			std::fill_n(page.written.get(), words, u64(0u));
+			page.frame = frame;
+		}
+
+		auto pageEnd = std::min(end, (elem / perPage + 1) * perPage);
+		for(; elem < pageEnd; ++elem) {
+			auto bit = elem % perPage;
+			page.written[bit / 64u] |= u64(1u) << (bit % 64u);
+		}
+	}
+}
+
+bool DescriptorPages::writtenThisFrame(u32 elem) const {
+	dlg_assert(elem < count);
+	auto& page = pages[elem / perPage];
+	if(!page.written || page.frame != currentFrame()) {
+		return false;
+	}
+
+	auto bit = elem % perPage;
+	return page.written[bit / 64u] & (u64(1u) << (bit % 64u));
+}
+
+u32 DescriptorPages::writtenThisFrameCount() const {
+	auto frame = currentFrame();
+	auto words = (perPage + 63u) / 64u;
+	auto ret = 0u;
+	for(auto i = 0u; i < pageCount(); ++i) {
+		auto& page = pages[i];
+		if(!page.written || page.frame != frame) {
+			continue;
+		}
+
+		for(auto w = 0u; w < words; ++w) {
+			ret += u32(std::bitset<64>(page.written[w]).count());
+		}
+	}
+
+	return ret;
+}
+
+std::unique_ptr<DescriptorPages> DescriptorPages::clone() const {
+	ZoneScoped;
+
+	auto ret = std::make_unique<DescriptorPages>(descriptorSize, count,
+		writesOnly, frameCounter);
+	auto dataSize = perPage * descriptorSize;
+	auto words = (perPage + 63u) / 64u;
+	for(auto i = 0u; i < pageCount(); ++i) {
+		auto& src = pages[i];
+		auto& dst = ret->pages[i];
+		if(src.data) {
+			dst.data = std::make_unique<std::byte[]>(dataSize);
+			std::memcpy(dst.data.get(), src.data.get(), dataSize);
+			debugStatAdd(DebugStats::get().descriptorPageMem, dataSize);
+		}
+
+		if(src.written) {
+			dst.written = std::make_unique<u64[]>(words);
+			std::copy_n(src.written.get(), words, dst.written.get());
+			dst.frame = src.frame;
+			debugStatAdd(DebugStats::get().descriptorPageMem, sizeof(u64) * words);
+		}
+	}
+
+	return ret;
+}
+
+bool usesPages(const DescriptorSetLayout& layout, u32 variableDescriptorCount) {
+	if(layout.bindings.empty()) {
+		return false;
+	}
+
+	auto& last = layout.bindings.back();
+	if(!(last.flags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT)) {
+		return false;
+	}
+
+	// mutable descriptors and inline uniform blocks need additional
+	// per-binding data, immutable samplers are initialized up front.
+	// They are never paged.
+	if(last.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT ||
+			last.descriptorType == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK ||
+			last.immutableSamplers) {
+		return false;
+	}
+
+	return variableDescriptorCount >= DescriptorPages::minDescriptorCount;
+}
+
 size_t totalDescriptorMemSize(const DescriptorSetLayout& layout, u32 variableDescriptorCount) {
 	if(layout.bindings.empty()) {
 		return 0;
@@ -166,7 +337,9 @@ size_t totalDescriptorMemSize(const DescriptorSetLayout& layout, u32 variableDes
 	auto lastCount = last.descriptorCount;
 
 	if(last.flags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT) {
-		lastCount = variableDescriptorCount;
+		// paged bindings are stored separately
+		lastCount = usesPages(layout, variableDescriptorCount) ?
+			0u : variableDescriptorCount;
 	}
 
 	if(lastCount) {
@@ -283,7 +456,7 @@ void initImmutableSamplers(DescriptorStateRef state) {
 			dlg_assert(needsSampler(state.layout->bindings[b].descriptorType));
 
 			for(auto e = 0u; e < descriptorCount(state, b); ++e) {
-				auto& bind = dsImage(state, b, e);
+				auto& bind = dsImageWrite(state, b, e);
 				auto* sampler = state.layout->bindings[b].immutableSamplers[e].get();
 				dlg_assert(sampler);
 
@@ -324,6 +497,13 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 	// auto& srcLayout = src.layout->bindings[srcBindID];
 	auto& dstLayout = dst.layout->bindings[dstBindID];
 
+	if(isPaged(dst, dstBindID)) {
+		dst.pages->markWritten(dstElemID, 1u);
+		if(dst.pages->writesOnly) {
+			return;
+		}
+	}
+
 	VkDescriptorType srcType = descriptorType(src, srcBindID, srcElemID);
 	if (dstLayout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT) {
 		mutableDescriptorType(dst, dstBindID, dstElemID) = srcType;
@@ -335,7 +515,7 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 		case DescriptorCategory::image: {
 			auto immutSampler = !!dstLayout.immutableSamplers.get();
 			auto srcCopy = dsImage(src, srcBindID, srcElemID);
-			auto& dstBind = dsImage(dst, dstBindID, dstElemID);
+			auto& dstBind = dsImageWrite(dst, dstBindID, dstElemID);
 
 			if(refBindings) {
 				if(dstBind.sampler && !immutSampler) decRefCount(*dstBind.sampler);
@@ -354,7 +534,7 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			break;
 		} case DescriptorCategory::buffer: {
 			auto& srcBuf = dsBuffer(src, srcBindID, srcElemID);
-			auto& dstBuf = dsBuffer(dst, dstBindID, dstElemID);
+			auto& dstBuf = dsBufferWrite(dst, dstBindID, dstElemID);
 
 			if(refBindings) {
 				if(dstBuf.buffer) decRefCount(*dstBuf.buffer);
@@ -365,7 +545,7 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			break;
 		} case DescriptorCategory::bufferView: {
 			auto& srcBuf = dsBufferView(src, srcBindID, srcElemID);
-			auto& dstBuf = dsBufferView(dst, dstBindID, dstElemID);
+			auto& dstBuf = dsBufferViewWrite(dst, dstBindID, dstElemID);
 
 			if(refBindings) {
 				if(dstBuf.bufferView) decRefCount(*dstBuf.bufferView);
@@ -387,7 +567,7 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			break;
 		} case DescriptorCategory::accelStruct: {
 			auto& srcAS = dsAccelStruct(src, srcBindID, srcElemID);
-			auto& dstAS = dsAccelStruct(dst, dstBindID, dstElemID);
+			auto& dstAS = dsAccelStructWrite(dst, dstBindID, dstElemID);
 
 			if(refBindings) {
 				if(dstAS.accelStruct) decRefCount(*dstAS.accelStruct);
@@ -503,7 +683,9 @@ void unrefBindings(DescriptorStateRef state) {
 	callForEachDescriptor(state, visitor);
 }
 
-void DescriptorStateCopy::Deleter::operator()(DescriptorStateCopy* copy) const {
+static void destroyDescriptorStateCopy(void* ptr) {
+	auto* copy = static_cast<DescriptorStateCopy*>(ptr);
+
 	// we have a reference on the bindings in any case
 	unrefBindings(DescriptorStateRef(*copy));
 
@@ -517,9 +699,17 @@ void DescriptorStateCopy::Deleter::operator()(DescriptorStateCopy* copy) const {
 	// we allocated the memory as std::byte array, so we have to free
 	// it like that. We don't have to call any other destructors of
 	// Binding elements since they are all trivial
-	auto ptr = reinterpret_cast<std::byte*>(copy);
-	TracyFreeS(ptr, 8);
-	delete[] ptr;
+	auto mem = reinterpret_cast<std::byte*>(copy);
+	TracyFreeS(mem, 8);
+	delete[] mem;
+}
+
+void DescriptorStateCopy::Deleter::operator()(DescriptorStateCopy* copy) const {
+	// Releasing the references on the bindings (and freeing the memory)
+	// is deferred to the destroy thread.
+	copy->destroyNode.object = copy;
+	copy->destroyNode.destroy = destroyDescriptorStateCopy;
+	copy->layout->dev->destroyQueue.push(copy->destroyNode);
 }
 
 DescriptorStateCopyPtr DescriptorSet::copyLockedState() {
@@ -544,16 +734,23 @@ DescriptorStateCopyPtr DescriptorSet::copyLockedState() {
 
 	copy->variableDescriptorCount = this->variableDescriptorCount;
 	copy->layout = this->layout;
+	if(this->pages) {
+		copy->pages = this->pages->clone();
+	}
 
 	DescriptorStateRef srcRef(*this);
-	auto dstRef = srcRef;
-	dstRef.data = mem + sizeof(DescriptorStateCopy);
+	auto dstRef = DescriptorStateRef(*copy);
 
 	initDescriptorState(dstRef);
 	initImmutableSamplers(dstRef);
 
 	// copy descriptors
 	for(auto b = 0u; b < this->layout->bindings.size(); ++b) {
+		if(isPaged(srcRef, b)) {
+			// already cloned above
+			continue;
+		}
+
 		for(auto e = 0u; e < descriptorCount(srcRef, b); ++e) {
 			// with !refBindings, we "take ownership" of the increased
 			// reference count here
@@ -734,15 +931,24 @@ void destroy(DescriptorSet& ds, bool unlink) {
 	}
 }
 
+// Returns null for descriptors in a page of a paged binding that was
+// never written, unless 'write' is true.
 template<typename T>
-T& accessDescriptor(DescriptorStateRef state, unsigned binding, unsigned elem,
-		DescriptorCategory dsCat) {
+T* findDescriptor(DescriptorStateRef state, unsigned binding, unsigned elem,
+		DescriptorCategory dsCat, bool write) {
 
 	dlg_assert(binding < state.layout->bindings.size());
 
 	auto& layout = state.layout->bindings[binding];
 	dlg_assert(elem < descriptorCount(state, binding));
 
+	if(isPaged(state, binding)) {
+		dlg_assertm(category(layout.descriptorType) == dsCat,
+			"descriptorType {}, dsCat {}", layout.descriptorType, unsigned(dsCat));
+		auto* ptr = write ? state.pages->get(elem) : state.pages->find(elem);
+		return ptr ? std::launder(reinterpret_cast<T*>(ptr)) : nullptr;
+	}
+
 	auto offset = layout.offset;
 	if(layout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT) {
 		// should be set before accessing (updating) this
@@ -758,24 +964,56 @@ T& accessDescriptor(DescriptorStateRef state, unsigned binding, unsigned elem,
 	}
 
 	auto ptr = state.data + offset;
-	auto* d = std::launder(reinterpret_cast<T*>(ptr));
-	return *d;
+	return std::launder(reinterpret_cast<T*>(ptr));
 }
 
-BufferDescriptor& dsBuffer(DescriptorStateRef state, unsigned binding, unsigned elem) {
-	return accessDescriptor<BufferDescriptor>(state, binding, elem, DescriptorCategory::buffer);
+template<typename T>
+const T& readDescriptor(DescriptorStateRef state, unsigned binding,
+		unsigned elem, DescriptorCategory dsCat) {
+	// What descriptors in pages that were never written read as.
+	static const T nullDescriptor {};
+	auto* ptr = findDescriptor<T>(state, binding, elem, dsCat, false);
+	return ptr ? *ptr : nullDescriptor;
+}
+
+template<typename T>
+T& writeDescriptor(DescriptorStateRef state, unsigned binding,
+		unsigned elem, DescriptorCategory dsCat) {
+	auto* ptr = findDescriptor<T>(state, binding, elem, dsCat, true);
+	dlg_assert(ptr);
+	return *ptr;
+}
+
+const BufferDescriptor& dsBuffer(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return readDescriptor<BufferDescriptor>(state, binding, elem, DescriptorCategory::buffer);
+}
+
+const ImageDescriptor& dsImage(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return readDescriptor<ImageDescriptor>(state, binding, elem, DescriptorCategory::image);
+}
+
+const BufferViewDescriptor& dsBufferView(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return readDescriptor<BufferViewDescriptor>(state, binding, elem, DescriptorCategory::bufferView);
+}
+
+const AccelStructDescriptor& dsAccelStruct(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return readDescriptor<AccelStructDescriptor>(state, binding, elem, DescriptorCategory::accelStruct);
+}
+
+BufferDescriptor& dsBufferWrite(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return writeDescriptor<BufferDescriptor>(state, binding, elem, DescriptorCategory::buffer);
 }
 
-ImageDescriptor& dsImage(DescriptorStateRef state, unsigned binding, unsigned elem) {
-	return accessDescriptor<ImageDescriptor>(state, binding, elem, DescriptorCategory::image);
+ImageDescriptor& dsImageWrite(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return writeDescriptor<ImageDescriptor>(state, binding, elem, DescriptorCategory::image);
 }
 
-BufferViewDescriptor& dsBufferView(DescriptorStateRef state, unsigned binding, unsigned elem) {
-	return accessDescriptor<BufferViewDescriptor>(state, binding, elem, DescriptorCategory::bufferView);
+BufferViewDescriptor& dsBufferViewWrite(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return writeDescriptor<BufferViewDescriptor>(state, binding, elem, DescriptorCategory::bufferView);
 }
 
-AccelStructDescriptor& dsAccelStruct(DescriptorStateRef state, unsigned binding, unsigned elem) {
-	return accessDescriptor<AccelStructDescriptor>(state, binding, elem, DescriptorCategory::accelStruct);
+AccelStructDescriptor& dsAccelStructWrite(DescriptorStateRef state, unsigned binding, unsigned elem) {
+	return writeDescriptor<AccelStructDescriptor>(state, binding, elem, DescriptorCategory::accelStruct);
 }
 
 span<std::byte> inlineUniformBlock(DescriptorStateRef state, unsigned binding) {
@@ -904,6 +1142,18 @@ bool needsDynamicOffset(VkDescriptorType type) {
 	}
 }
 
+bool isStorage(VkDescriptorType type) {
+	switch(type) {
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			return true;
+		default:
+			return false;
+	}
+}
+
 // dsLayout
 VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorSetLayout(
 		VkDevice                                    device,
@@ -1332,6 +1582,16 @@ VkResult initDescriptorSet(Device& dev, DescriptorPool& pool, VkDescriptorSet& h
 	ds.id = ++pool.lastID;
 	setEntry->set = &ds;
 
+	if(usesPages(*ds.layout, varCount)) {
+		auto& last = ds.layout->bindings.back();
+		// Storage descriptors are always stored, we need them to know
+		// which resources a submission might write. See resolveWritesLocked.
+		auto writesOnly = dev.descriptorWritesOnly && !isStorage(last.descriptorType);
+		ds.pages = std::make_unique<DescriptorPages>(
+			u32(descriptorSize(last.descriptorType)), varCount,
+			writesOnly, &dev.presentCounter);
+	}
+
 	initDescriptorState(ds);
 	handle = castDispatch<VkDescriptorSet>(ds);
 
@@ -1451,37 +1711,35 @@ VKAPI_ATTR VkResult VKAPI_CALL FreeDescriptorSets(
 	}
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
-		VkBufferView& handle) {
-	auto& binding = dsBufferView(state, bind, elem);
-
+// The updateDescriptor functions unwrap the handles in the given info,
+// so it can be forwarded, and store them in 'dst'. When 'dst' is null
+// (see DescriptorPages::writesOnly), the handles are only unwrapped.
+void updateDescriptor(Device& dev, BufferViewDescriptor* dst, VkBufferView& handle) {
 	BufferView* newView {};
 	if(handle) VIL_LIKELY {
-		newView = &get(*state.layout->dev, handle);
+		newView = &get(dev, handle);
 		handle = newView->handle;
 	}
 
+	if(!dst) {
+		return;
+	}
+
 	if(refBindings) {
-		if(binding.bufferView) {
-			decRefCount(*binding.bufferView);
+		if(dst->bufferView) {
+			decRefCount(*dst->bufferView);
 		}
 		if(newView) {
 			incRefCount(*newView);
 		}
 	}
 
-	binding.bufferView = newView;
+	dst->bufferView = newView;
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
-		VkDescriptorImageInfo& img, VkDescriptorType dsType) {
-	auto& dev = *state.layout->dev;
-
-	auto& binding = dsImage(state, bind, elem);
-	binding.layout = img.imageLayout;
-
-	auto& layout = state.layout->bindings[bind];
-
+void updateDescriptor(Device& dev, ImageDescriptor* dst,
+		VkDescriptorImageInfo& img, VkDescriptorType dsType,
+		const IntrusivePtr<Sampler>* immutableSampler) {
 	// update imageView, if needed
 	if(needsImageView(dsType)) {
 		ImageView* newView {};
@@ -1490,25 +1748,27 @@ void update(DescriptorSet& state, unsigned bind, unsigned elem,
 			img.imageView = newView->handle;
 		}
 
-		if(refBindings) {
-			if(binding.imageView) {
-				decRefCount(*binding.imageView);
-			}
-			if(newView) {
-				incRefCount(*newView);
+		if(dst) {
+			if(refBindings) {
+				if(dst->imageView) {
+					decRefCount(*dst->imageView);
+				}
+				if(newView) {
+					incRefCount(*newView);
+				}
 			}
-		}
 
-		binding.imageView = newView;
+			dst->imageView = newView;
+		}
 	}
 
 	// update sampler, if needed
 	if(needsSampler(dsType)) {
-		if(layout.immutableSamplers) {
+		if(immutableSampler) {
 			// immutable samplers are initialized at the beginning and
 			// never unset.
-			dlg_assert(binding.sampler);
-			dlg_assert(binding.sampler == layout.immutableSamplers[elem].get());
+			dlg_assert(!dst || dst->sampler);
+			dlg_assert(!dst || dst->sampler == immutableSampler->get());
 		} else {
 			Sampler* newSampler {};
 			if(img.sampler) VIL_LIKELY { // can be VK_NULL_HANDLE
@@ -1516,69 +1776,180 @@ void update(DescriptorSet& state, unsigned bind, unsigned elem,
 				img.sampler = newSampler->handle;
 			}
 
-			if(refBindings) {
-				if(binding.sampler) {
-					decRefCount(*binding.sampler);
-				}
-				if(newSampler) {
-					incRefCount(*newSampler);
+			if(dst) {
+				if(refBindings) {
+					if(dst->sampler) {
+						decRefCount(*dst->sampler);
+					}
+					if(newSampler) {
+						incRefCount(*newSampler);
+					}
 				}
-			}
 
-			binding.sampler = newSampler;
+				dst->sampler = newSampler;
+			}
 		}
 	}
+
+	if(dst) {
+		dst->layout = img.imageLayout;
+	}
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
+void updateDescriptor(Device& dev, BufferDescriptor* dst,
 		VkDescriptorBufferInfo& info) {
-	auto& binding = dsBuffer(state, bind, elem);
 	Buffer* newBuffer {};
-
 	if(info.buffer) VIL_LIKELY { // can be VK_NULL_HANDLE
-		newBuffer = &get(*state.layout->dev, info.buffer);
+		newBuffer = &get(dev, info.buffer);
 		info.buffer = newBuffer->handle;
 	}
 
+	if(!dst) {
+		return;
+	}
+
 	if(refBindings) {
-		if(binding.buffer) {
-			decRefCount(*binding.buffer);
+		if(dst->buffer) {
+			decRefCount(*dst->buffer);
 		}
 		if(newBuffer) {
 			incRefCount(*newBuffer);
 		}
 	}
 
-	binding.buffer = newBuffer;
-	binding.offset = info.offset;
+	dst->buffer = newBuffer;
+	dst->offset = info.offset;
 
-	if(binding.buffer) {
-		binding.range = evalRange(binding.buffer->ci.size, info.offset, info.range);
+	if(dst->buffer) {
+		dst->range = evalRange(dst->buffer->ci.size, info.offset, info.range);
 	} else {
-		binding.range = info.range;
+		dst->range = info.range;
 	}
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
+void updateDescriptor(Device& dev, AccelStructDescriptor* dst,
 		VkAccelerationStructureKHR& handle) {
-	auto& binding = dsAccelStruct(state, bind, elem);
 	AccelStruct* newAS {};
-
 	if(handle) VIL_LIKELY { // can be VK_NULL_HANDLE
-		newAS = &get(*state.layout->dev, handle);
+		newAS = &get(dev, handle);
 		handle = newAS->handle;
 	}
 
+	if(!dst) {
+		return;
+	}
+
 	if(refBindings) {
-		if(binding.accelStruct) {
-			decRefCount(*binding.accelStruct);
+		if(dst->accelStruct) {
+			decRefCount(*dst->accelStruct);
 		}
 		if(newAS) {
 			incRefCount(*newAS);
 		}
 	}
 
-	binding.accelStruct = newAS;
+	dst->accelStruct = newAS;
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkBufferView& handle) {
+	auto& binding = dsBufferViewWrite(state, bind, elem);
+	updateDescriptor(*state.layout->dev, &binding, handle);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkDescriptorImageInfo& img, VkDescriptorType dsType) {
+	auto& binding = dsImageWrite(state, bind, elem);
+	auto& layout = state.layout->bindings[bind];
+	auto* immutableSampler = layout.immutableSamplers ?
+		&layout.immutableSamplers[elem] : nullptr;
+	updateDescriptor(*state.layout->dev, &binding, img, dsType, immutableSampler);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkDescriptorBufferInfo& info) {
+	auto& binding = dsBufferWrite(state, bind, elem);
+	updateDescriptor(*state.layout->dev, &binding, info);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkAccelerationStructureKHR& handle) {
+	auto& binding = dsAccelStructWrite(state, bind, elem);
+	updateDescriptor(*state.layout->dev, &binding, handle);
+}
+
+// Applies 'count' contiguous writes, starting at element 'first', to
+// the paged binding of the given set. Calls apply(D* dst, u32 j) for
+// each write 'j', with a null 'dst' in writes-only mode.
+// Works page-by-page so that the page lookup is only done once per page.
+template<typename D, typename F>
+void updatePagedRange(DescriptorSet& ds, u32 first, u32 count, F&& apply) {
+	auto& pages = *ds.pages;
+	pages.markWritten(first, count);
+
+	if(pages.writesOnly) {
+		for(auto j = 0u; j < count; ++j) {
+			apply(static_cast<D*>(nullptr), j);
+		}
+		return;
+	}
+
+	for(auto j = 0u; j < count;) {
+		auto elem = first + j;
+		auto end = std::min(count, j + (pages.perPage - elem % pages.perPage));
+		auto* dst = std::launder(reinterpret_cast<D*>(pages.get(elem)));
+		for(; j < end; ++j, ++dst) {
+			apply(dst, j);
+		}
+	}
+}
+
+// Batched version of 'update' for contiguous writes into the paged
+// binding of a descriptor set. Since all written descriptors are part
+// of the same binding, the descriptor type only has to be validated
+// once. 'infos' is the array of the write infos (e.g.
+// VkDescriptorImageInfo) matching the descriptor type, 'stride' the
+// distance between them in bytes. The infos are unwrapped in-place.
+void updatePaged(DescriptorSet& ds, VkDescriptorType dsType,
+		u32 first, u32 count, std::byte* infos, std::size_t stride) {
+	ZoneScoped;
+
+	dlg_assert(ds.pages);
+	dlg_assert(dsType == ds.layout->bindings.back().descriptorType);
+	dlg_assert(u64(first) + count <= ds.variableDescriptorCount);
+
+	auto& dev = *ds.layout->dev;
+	auto at = [&](u32 j) { return infos + j * stride; };
+
+	switch(category(dsType)) {
+		case DescriptorCategory::image:
+			updatePagedRange<ImageDescriptor>(ds, first, count, [&](auto* dst, u32 j) {
+				auto& img = *reinterpret_cast<VkDescriptorImageInfo*>(at(j));
+				updateDescriptor(dev, dst, img, dsType, nullptr);
+			});
+			break;
+		case DescriptorCategory::buffer:
+			updatePagedRange<BufferDescriptor>(ds, first, count, [&](auto* dst, u32 j) {
+				auto& buf = *reinterpret_cast<VkDescriptorBufferInfo*>(at(j));
+				updateDescriptor(dev, dst, buf);
+			});
+			break;
+		case DescriptorCategory::bufferView:
+			updatePagedRange<BufferViewDescriptor>(ds, first, count, [&](auto* dst, u32 j) {
+				auto& bufView = *reinterpret_cast<VkBufferView*>(at(j));
+				updateDescriptor(dev, dst, bufView);
+			});
+			break;
+		case DescriptorCategory::accelStruct:
+			updatePagedRange<AccelStructDescriptor>(ds, first, count, [&](auto* dst, u32 j) {
+				auto& accelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(at(j));
+				updateDescriptor(dev, dst, accelStruct);
+			});
+			break;
+		default:
+			dlg_error("unreachable: invalid paged descriptor type");
+			break;
+	}
 }
 
 void update(DescriptorSet& state, unsigned bind, unsigned offset,
@@ -1665,9 +2036,63 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 		// access the maps.
 		auto lock = ds.checkResolveCow();
 
+		// Fast path for large bindless-style bindings, see DescriptorPages.
+		// The paged binding is always the last one, so once a write reaches
+		// it (possibly rolling over from a previous binding), all its
+		// remaining descriptors land in it.
+		auto updateRestPaged = [&](u32 j) {
+			auto count = write.descriptorCount - j;
+			auto off = writeOff + j;
+			std::byte* infos {};
+			std::size_t stride {};
+			switch(category(write.descriptorType)) {
+				case DescriptorCategory::image: {
+					dlg_assert(write.pImageInfo);
+					auto* dst = imageInfos.data() + off;
+					std::copy_n(write.pImageInfo + j, count, dst);
+					infos = reinterpret_cast<std::byte*>(dst);
+					stride = sizeof(*dst);
+					break;
+				} case DescriptorCategory::buffer: {
+					dlg_assert(write.pBufferInfo);
+					auto* dst = bufferInfos.data() + off;
+					std::copy_n(write.pBufferInfo + j, count, dst);
+					infos = reinterpret_cast<std::byte*>(dst);
+					stride = sizeof(*dst);
+					break;
+				} case DescriptorCategory::bufferView: {
+					dlg_assert(write.pTexelBufferView);
+					auto* dst = bufferViews.data() + off;
+					std::copy_n(write.pTexelBufferView + j, count, dst);
+					infos = reinterpret_cast<std::byte*>(dst);
+					stride = sizeof(*dst);
+					break;
+				} case DescriptorCategory::accelStruct: {
+					dlg_assert(accelStructWrite);
+					dlg_assert(write.descriptorCount <= accelStructWrite->accelerationStructureCount);
+					auto* dst = accelStructs.data() + off;
+					std::copy_n(accelStructWrite->pAccelerationStructures + j, count, dst);
+					infos = reinterpret_cast<std::byte*>(dst);
+					stride = sizeof(*dst);
+					break;
+				} default:
+					dlg_error("unreachable: invalid paged descriptor type");
+					break;
+			}
+
+			if(infos) {
+				updatePaged(ds, write.descriptorType, dstElem, count, infos, stride);
+			}
+		};
+
 		for(auto j = 0u; j < write.descriptorCount; ++j, ++dstElem) {
 			advanceUntilValid(ds, dstBinding, dstElem);
 			dlg_assert(dstBinding < ds.layout->bindings.size());
+			if(isPaged(ds, dstBinding)) {
+				updateRestPaged(j);
+				break;
+			}
+
 			auto& layout = ds.layout->bindings[dstBinding];
 
 			if(layout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT) {
@@ -1803,6 +2228,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorUpdateTemplate(
 		pCreateInfo->pDescriptorUpdateEntries,
 		pCreateInfo->pDescriptorUpdateEntries + pCreateInfo->descriptorUpdateEntryCount
 	};
+	compileUpdateTemplate(dut);
 
 	*pDescriptorUpdateTemplate = castDispatch<VkDescriptorUpdateTemplate>(dut);
 	dev.dsuTemplates.mustEmplace(*pDescriptorUpdateTemplate, std::move(dutPtr));
@@ -1819,13 +2245,253 @@ VKAPI_ATTR void VKAPI_CALL DestroyDescriptorUpdateTemplate(
 	}
 
 	auto& dev = getDevice(device);
-	dev.dsuTemplates.mustErase(descriptorUpdateTemplate);
+	retire(dev, dev.dsuTemplates.mustMove(descriptorUpdateTemplate));
 
 	// Don't destroy it here, handle has shared ownership, see e.g.
 	// the dsuTemplates hash map in Device for justification
 	(void) pAllocator;
 }
 
+// Applies a single descriptor of an update template.
+void updateFromTemplateData(DescriptorSet& ds, unsigned binding, unsigned elem,
+		VkDescriptorType dsType, std::byte* data) {
+	auto& layout = ds.layout->bindings[binding];
+	if(layout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT) {
+		mutableDescriptorType(ds, binding, elem) = dsType;
+	} else {
+		dlg_assert(dsType == layout.descriptorType);
+	}
+
+	// TODO: the reinterpret_cast here is UB in C++ I guess.
+	// Assuming the caller did it correctly (really creating
+	// the objects e.g. via placement new) we could probably also
+	// do it correctly by using placement new (copy) into 'fwdData'
+	// instead of the memcpy in UpdateDescriptorSetWithTemplate.
+	switch(category(dsType)) {
+		case DescriptorCategory::image: {
+			auto& img = *reinterpret_cast<VkDescriptorImageInfo*>(data);
+			update(ds, binding, elem, img, dsType);
+			break;
+		} case DescriptorCategory::buffer: {
+			auto& buf = *reinterpret_cast<VkDescriptorBufferInfo*>(data);
+			update(ds, binding, elem, buf);
+			break;
+		} case DescriptorCategory::bufferView: {
+			auto& bufView = *reinterpret_cast<VkBufferView*>(data);
+			update(ds, binding, elem, bufView);
+			break;
+		} case DescriptorCategory::accelStruct: {
+			auto& accelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(data);
+			update(ds, binding, elem, accelStruct);
+			break;
+		} case DescriptorCategory::inlineUniformBlock: {
+			update(ds, binding, elem, *data);
+			break;
+		} case DescriptorCategory::none:
+			dlg_error("Invalid/unknown descriptor type");
+			break;
+	}
+}
+
+void interpretUpdateTemplate(DescriptorSet& ds, const DescriptorUpdateTemplate& dut,
+		std::byte* ptr) {
+	ZoneScoped;
+
+	for(auto& entry : dut.entries) {
+		auto dstBinding = entry.dstBinding;
+		auto dstElem = entry.dstArrayElement;
+		auto dsType = entry.descriptorType;
+
+		// see totalUpdateDataSize
+		auto stride = entry.stride;
+		if(category(dsType) == DescriptorCategory::inlineUniformBlock) {
+			stride = 1u;
+		}
+
+		for(auto j = 0u; j < entry.descriptorCount; ++j, ++dstElem) {
+			advanceUntilValid(ds, dstBinding, dstElem);
+			dlg_assert(dstBinding < ds.layout->bindings.size());
+			auto* data = ptr + (entry.offset + j * stride);
+
+			// The entry might start in or roll over into the paged last
+			// binding, the rest of it goes there. See DescriptorPages.
+			if(isPaged(ds, dstBinding)) {
+				updatePaged(ds, dsType, dstElem, entry.descriptorCount - j,
+					data, stride);
+				break;
+			}
+
+			updateFromTemplateData(ds, dstBinding, dstElem, dsType, data);
+		}
+	}
+}
+
+// Returns whether ops compiled against layout b can be applied to
+// descriptor sets of layout a, see compileUpdateTemplate.
+bool sameUpdateLayout(const DescriptorSetLayout& a, const DescriptorSetLayout& b) {
+	if(&a == &b) {
+		return true;
+	}
+
+	if(!compatible(a, b, false)) {
+		return false;
+	}
+
+	// the ops also depend on the binding offsets and the variable count flag
+	for(auto i = 0u; i < a.bindings.size(); ++i) {
+		if(a.bindings[i].offset != b.bindings[i].offset ||
+				a.bindings[i].flags != b.bindings[i].flags) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void applyUpdateTemplate(DescriptorSet& ds, const DescriptorUpdateTemplate& dut,
+		std::byte* ptr) {
+	ZoneScoped;
+
+	// The ops were compiled against the layout of the template. The spec
+	// requires the layout of the set to be defined the same way but we
+	// don't want to corrupt our state when an application gets it wrong.
+	if(!sameUpdateLayout(*ds.layout, *dut.dsLayout)) {
+		static std::atomic<bool> warned {};
+		if(!warned.exchange(true)) {
+			dlg_warn("Descriptor set layout doesn't match update template");
+		}
+
+		interpretUpdateTemplate(ds, dut, ptr);
+		return;
+	}
+
+	auto& dev = *ds.layout->dev;
+	auto* base = bindingData(ds);
+
+	for(auto& op : dut.ops) {
+		auto* src = ptr + op.srcOffset;
+		auto srcAt = [&](u32 j) { return src + j * op.srcStride; };
+
+		if(op.generic) {
+			for(auto j = 0u; j < op.count; ++j) {
+				updateFromTemplateData(ds, op.binding, op.dstElem + j, op.type, srcAt(j));
+			}
+			continue;
+		}
+
+		if(isPaged(ds, op.binding)) {
+			updatePaged(ds, op.type, op.dstElem, op.count, src, op.srcStride);
+			continue;
+		}
+
+		dlg_assert(op.dstElem + op.count <= descriptorCount(ds, op.binding));
+		auto* dst = base + op.dstOffset;
+
+		switch(category(op.type)) {
+			case DescriptorCategory::image: {
+				auto& layout = ds.layout->bindings[op.binding];
+				auto* immutableSamplers = layout.immutableSamplers ?
+					&layout.immutableSamplers[op.dstElem] : nullptr;
+				auto* descs = std::launder(reinterpret_cast<ImageDescriptor*>(dst));
+				for(auto j = 0u; j < op.count; ++j) {
+					auto& img = *reinterpret_cast<VkDescriptorImageInfo*>(srcAt(j));
+					updateDescriptor(dev, &descs[j], img, op.type,
+						immutableSamplers ? &immutableSamplers[j] : nullptr);
+				}
+				break;
+			} case DescriptorCategory::buffer: {
+				auto* descs = std::launder(reinterpret_cast<BufferDescriptor*>(dst));
+				for(auto j = 0u; j < op.count; ++j) {
+					auto& buf = *reinterpret_cast<VkDescriptorBufferInfo*>(srcAt(j));
+					updateDescriptor(dev, &descs[j], buf);
+				}
+				break;
+			} case DescriptorCategory::bufferView: {
+				auto* descs = std::launder(reinterpret_cast<BufferViewDescriptor*>(dst));
+				for(auto j = 0u; j < op.count; ++j) {
+					auto& bufView = *reinterpret_cast<VkBufferView*>(srcAt(j));
+					updateDescriptor(dev, &descs[j], bufView);
+				}
+				break;
+			} case DescriptorCategory::accelStruct: {
+				auto* descs = std::launder(reinterpret_cast<AccelStructDescriptor*>(dst));
+				for(auto j = 0u; j < op.count; ++j) {
+					auto& accelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(srcAt(j));
+					updateDescriptor(dev, &descs[j], accelStruct);
+				}
+				break;
+			} case DescriptorCategory::inlineUniformBlock:
+				// raw data, no handles
+				std::memcpy(dst, src, op.count);
+				break;
+			case DescriptorCategory::none:
+				dlg_error("Invalid/unknown descriptor type");
+				break;
+		}
+	}
+}
+
+void compileUpdateTemplate(DescriptorUpdateTemplate& dut) {
+	ZoneScoped;
+
+	auto& bindings = dut.dsLayout->bindings;
+	auto isVariable = [&](u32 b) {
+		return bool(bindings[b].flags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT);
+	};
+
+	dut.ops.clear();
+	for(auto& entry : dut.entries) {
+		auto binding = entry.dstBinding;
+		auto elem = entry.dstArrayElement;
+		auto remaining = entry.descriptorCount;
+		auto srcOffset = u32(entry.offset);
+
+		// see totalUpdateDataSize
+		auto inlineBlock = category(entry.descriptorType) ==
+			DescriptorCategory::inlineUniformBlock;
+		auto stride = inlineBlock ? 1u : u32(entry.stride);
+
+		while(remaining > 0u) {
+			// Like advanceUntilValid. The descriptor count of the variable
+			// count binding isn't known yet but it's always the last one,
+			// updates never continue after it.
+			while(binding < bindings.size() && !isVariable(binding) &&
+					elem >= bindings[binding].descriptorCount) {
+				++binding;
+				elem = 0u;
+			}
+
+			dlg_assert_or(binding < bindings.size(), break);
+			auto& layout = bindings[binding];
+
+			auto count = remaining;
+			if(!isVariable(binding)) {
+				count = std::min(count, layout.descriptorCount - elem);
+			}
+
+			auto& op = dut.ops.emplace_back();
+			op.binding = binding;
+			op.dstElem = elem;
+			op.count = count;
+			op.srcOffset = srcOffset;
+			op.srcStride = stride;
+			op.type = entry.descriptorType;
+			op.generic = (layout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT);
+
+			if(!op.generic) {
+				dlg_assert(layout.descriptorType == entry.descriptorType);
+				op.dstOffset = u32(layout.offset + elem * descriptorSize(layout.descriptorType));
+			}
+
+			remaining -= count;
+			elem += count;
+			srcOffset += count * stride;
+		}
+	}
+
+	dut.dataSize = totalUpdateDataSize(dut);
+}
+
 VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSetWithTemplate(
 		VkDevice                                    device,
 		VkDescriptorSet                             descriptorSet,
@@ -1862,70 +2528,15 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSetWithTemplate(
 	// hard to imagine such an update logic tbh.
 	constexpr auto modify = false;
 	if(!modify) {
-		auto totalSize = totalUpdateDataSize(dut);
-		auto fwdData = memScope.allocUndef<std::byte>(totalSize);
-		std::memcpy(fwdData.data(), pData, totalSize);
+		auto fwdData = memScope.allocUndef<std::byte>(dut.dataSize);
+		std::memcpy(fwdData.data(), pData, dut.dataSize);
 		ptr = fwdData.data();
 	} else {
 		// UNHOLY
 		ptr = (std::byte*) pData;
 	}
 
-	for(auto& entry : dut.entries) {
-		auto dstBinding = entry.dstBinding;
-		auto dstElem = entry.dstArrayElement;
-		auto dsType = entry.descriptorType;
-
-		for(auto j = 0u; j < entry.descriptorCount; ++j, ++dstElem) {
-			// PERF Could we maybe determine this statically
-			// in CreateDescriptorUpdateTemplate?
-			advanceUntilValid(ds, dstBinding, dstElem);
-
-			auto& layout = ds.layout->bindings[dstBinding];
-			if(layout.descriptorType == VK_DESCRIPTOR_TYPE_MUTABLE_EXT) {
-				mutableDescriptorType(ds, dstBinding, dstElem) = dsType;
-			} else {
-				dlg_assert(dsType == layout.descriptorType);
-			}
-
-			// TODO: such an assertion here would be nice. Track used
-			// layout in update?
-			// dlg_assert(write.descriptorType == type);
-
-			auto* data = ptr + (entry.offset + j * entry.stride);
-
-			// TODO: the reinterpret_cast here is UB in C++ I guess.
-			// Assuming the caller did it correctly (really creating
-			// the objects e.g. via placement new) we could probably also
-			// do it correctly by using placement new (copy) into 'fwdData'
-			// instead of the memcpy above.
-			switch(category(dsType)) {
-				case DescriptorCategory::image: {
-					auto& img = *reinterpret_cast<VkDescriptorImageInfo*>(data);
-					update(ds, dstBinding, dstElem, img, dsType);
-					break;
-				} case DescriptorCategory::buffer: {
-					auto& buf = *reinterpret_cast<VkDescriptorBufferInfo*>(data);
-					update(ds, dstBinding, dstElem, buf);
-					break;
-				} case DescriptorCategory::bufferView: {
-					auto& bufView = *reinterpret_cast<VkBufferView*>(data);
-					update(ds, dstBinding, dstElem, bufView);
-					break;
-				} case DescriptorCategory::accelStruct: {
-					auto& accelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(data);
-					update(ds, dstBinding, dstElem, accelStruct);
-					break;
-				} case DescriptorCategory::inlineUniformBlock: {
-					auto ptr = reinterpret_cast<const std::byte*>(data);
-					update(ds, dstBinding, dstElem, *ptr);
-					break;
-				} case DescriptorCategory::none:
-					dlg_error("Invalid/unknown descriptor type");
-					break;
-			}
-		}
-	}
+	applyUpdateTemplate(ds, dut, ptr);
 
 	{
 		ZoneScopedN("dispatchUpdateDescriptorSetWithTemplate");
@@ -5,6 +5,7 @@
 #include <util/intrusive.hpp>
 #include <util/debugMutex.hpp>
 #include <util/profiling.hpp>
+#include <command/reclaim.hpp>
 #include <nytl/span.hpp>
 #include <vk/vulkan.h>
 
@@ -35,6 +36,8 @@ bool needsBoundSampler(const DescriptorSetLayout&, unsigned binding);
 bool needsImageView(VkDescriptorType);
 bool needsImageLayout(VkDescriptorType);
 bool needsDynamicOffset(VkDescriptorType);
+// Returns whether descriptors of the given type can be written by shaders.
+bool isStorage(VkDescriptorType);
 
 // Lifetime of these objects bound to lifetime of their DescriptorPool.
 // Pool mutex is locked when offset/size/set members are modified.
@@ -138,9 +141,73 @@ bool compatible(const DescriptorSetLayout&, const DescriptorSetLayout& b,
 
 // Returns the total raw memory size needed by descriptor state of
 // the given layout, with the given variable descriptor count.
+// Does not include the memory of a paged binding, see DescriptorPages.
 size_t totalDescriptorMemSize(const DescriptorSetLayout& layout,
 	u32 variableDescriptorCount);
 
+// Sparse storage for the descriptors of a large variable-count binding,
+// as used by bindless renderers. Instead of reserving memory for the
+// full variable count up front, descriptors are stored in fixed-size
+// pages that are allocated on first write. Descriptors in pages that
+// were never written read as null descriptors.
+// Also tracks which descriptors were written in the current frame,
+// see Device::presentCounter.
+struct DescriptorPages {
+	// Size of the descriptor data of a single page, in bytes.
+	static constexpr auto pageSize = 16 * 1024u;
+	// Variable-count bindings with at least this many descriptors are paged.
+	static constexpr auto minDescriptorCount = 4 * 1024u;
+
+	struct Page {
+		std::unique_ptr<std::byte[]> data;
+		// Bitmask of the descriptors written in 'frame'.
+		std::unique_ptr<u64[]> written;
+		u64 frame {};
+	};
+
+	u32 descriptorSize {};
+	u32 perPage {};
+	u32 count {};
+	// When set, only writes are tracked and no descriptors are stored.
+	// Never set for storage descriptors.
+	// See VIL_DESCRIPTOR_WRITES_ONLY in docs/env.md.
+	bool writesOnly {};
+	const std::atomic<u64>* frameCounter {};
+	std::unique_ptr<Page[]> pages;
+
+	DescriptorPages(u32 descriptorSize, u32 count, bool writesOnly,
+		const std::atomic<u64>* frameCounter);
+	~DescriptorPages();
+
+	DescriptorPages(const DescriptorPages&) = delete;
+	DescriptorPages& operator=(const DescriptorPages&) = delete;
+
+	u32 pageCount() const { return (count + perPage - 1) / perPage; }
+
+	// Returns the storage of the given descriptor. Returns null if it's
+	// part of a page that was never written.
+	std::byte* find(u32 elem) const;
+
+	// Returns the storage of the given descriptor, allocating its page
+	// if needed. Descriptors in the same page are stored contiguously.
+	std::byte* get(u32 elem);
+
+	// Marks the given range of descriptors as written in the current frame.
+	void markWritten(u32 first, u32 count);
+	bool writtenThisFrame(u32 elem) const;
+	u32 writtenThisFrameCount() const;
+
+	// Copies all allocated pages.
+	std::unique_ptr<DescriptorPages> clone() const;
+
+private:
+	u64 currentFrame() const;
+};
+
+// Returns whether the variable-count binding of the given layout is
+// stored in DescriptorPages for the given variable descriptor count.
+bool usesPages(const DescriptorSetLayout&, u32 variableDescriptorCount);
+
 // Returns whether the two given DescriptorSetLayouts have bindings that
 // conflict with each other. Each layout can have bindings that the other
 // set does not have, as long as their common bindings have the same
@@ -195,6 +262,8 @@ struct DescriptorStateRef {
 	DescriptorSetLayout* layout {};
 	std::byte* data {};
 	u32 variableDescriptorCount {};
+	// Storage of the variable-count binding, if it's paged.
+	DescriptorPages* pages {};
 
 	DescriptorStateRef() = default;
 	DescriptorStateRef(const DescriptorSet&);
@@ -219,10 +288,19 @@ VkDescriptorType descriptorType(DescriptorStateRef state, unsigned binding, unsi
 // span<AccelStructDescriptor> accelStructs(DescriptorStateRef, unsigned binding);
 span<std::byte> inlineUniformBlock(DescriptorStateRef, unsigned binding);
 
-BufferDescriptor& dsBuffer(DescriptorStateRef, unsigned binding, unsigned elem);
-ImageDescriptor& dsImage(DescriptorStateRef, unsigned binding, unsigned elem);
-BufferViewDescriptor& dsBufferView(DescriptorStateRef, unsigned binding, unsigned elem);
-AccelStructDescriptor& dsAccelStruct(DescriptorStateRef, unsigned binding, unsigned elem);
+// Descriptors in a page of a paged binding that was never written read
+// as a shared, immutable null descriptor. See DescriptorPages.
+const BufferDescriptor& dsBuffer(DescriptorStateRef, unsigned binding, unsigned elem);
+const ImageDescriptor& dsImage(DescriptorStateRef, unsigned binding, unsigned elem);
+const BufferViewDescriptor& dsBufferView(DescriptorStateRef, unsigned binding, unsigned elem);
+const AccelStructDescriptor& dsAccelStruct(DescriptorStateRef, unsigned binding, unsigned elem);
+
+// Like dsBuffer, dsImage etc. but allocates the storage of paged
+// descriptors. Must be used when modifying descriptors.
+BufferDescriptor& dsBufferWrite(DescriptorStateRef, unsigned binding, unsigned elem);
+ImageDescriptor& dsImageWrite(DescriptorStateRef, unsigned binding, unsigned elem);
+BufferViewDescriptor& dsBufferViewWrite(DescriptorStateRef, unsigned binding, unsigned elem);
+AccelStructDescriptor& dsAccelStructWrite(DescriptorStateRef, unsigned binding, unsigned elem);
 
 // Returns whether the given descriptor state has the given handle bound.
 // For Buffers and Images, also returns true when one of their bufferViews/
@@ -237,6 +315,8 @@ struct DescriptorStateCopy {
 	IntrusivePtr<DescriptorSetLayout> layout {};
 	u32 variableDescriptorCount {};
 	u32 _pad {};
+	std::unique_ptr<DescriptorPages> pages {};
+	DestroyNode destroyNode {}; // see Deleter
 
 	// std::byte data[]; // following this in memory
 };
@@ -263,6 +343,10 @@ public:
 	u32 id {};
 	u32 variableDescriptorCount {};
 
+	// Storage of the variable-count binding, if it's paged.
+	// Protected by pool->mutex
+	std::unique_ptr<DescriptorPages> pages {};
+
 public:
 	Device& dev() const { return *pool->dev; }
 
@@ -319,8 +403,27 @@ std::pair<DescriptorStateRef, std::unique_lock<DebugMutex>> access(DescriptorSet
 struct DescriptorUpdateTemplate : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE;
 
+	// A contiguous range of descriptors in a single binding updated
+	// by a template. Compiled from the entries on creation so that
+	// applying a template doesn't have to resolve bindings and
+	// descriptor types per descriptor.
+	struct Op {
+		u32 binding {};
+		u32 dstElem {}; // first descriptor; byte offset for inline uniform blocks
+		u32 count {};
+		u32 dstOffset {}; // offset of the first descriptor in the binding data
+		u32 srcOffset {}; // offset of the first info in the update data
+		u32 srcStride {};
+		VkDescriptorType type {};
+		// Whether the op can't be applied directly to the binding data,
+		// e.g. for mutable descriptors. Uses the generic update path.
+		bool generic {};
+	};
+
 	VkDescriptorUpdateTemplate handle {};
 	std::vector<VkDescriptorUpdateTemplateEntry> entries;
+	std::vector<Op> ops;
+	u32 dataSize {}; // see totalUpdateDataSize
 
 	VkPipelineBindPoint bindPoint {};
 	IntrusivePtr<DescriptorSetLayout> dsLayout;
@@ -334,6 +437,17 @@ struct DescriptorUpdateTemplate : SharedDeviceHandle {
 // with the given template must have.
 u32 totalUpdateDataSize(const DescriptorUpdateTemplate&);
 
+// Compiles the entries of the given template into ops, see
+// DescriptorUpdateTemplate::Op.
+void compileUpdateTemplate(DescriptorUpdateTemplate&);
+
+// Applies the given update template to the descriptor set. Uses the
+// compiled ops when the layout of the set is defined like the one of the
+// template, otherwise interprets the entries against the layout of the set.
+// Unwraps the handles in the given data in-place so it can be forwarded.
+// Expects the descriptor set to be locked, see UpdateDescriptorSetWithTemplate.
+void applyUpdateTemplate(DescriptorSet&, const DescriptorUpdateTemplate&, std::byte* data);
+
 // API
 VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorSetLayout(
     VkDevice                                    device,
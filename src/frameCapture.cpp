@@ -0,0 +1,261 @@
+#include <frameCapture.hpp>
+#include <device.hpp>
+#include <queue.hpp>
+#include <command/record.hpp>
+#include <serialize/serialize.hpp>
+#include <serialize/bufs.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+#include <tracy/common/tracy_lz4.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace vil {
+
+namespace {
+
+const auto captureFolder = fs::path(".vil/capture/");
+
+fs::path buildCapturePath(u32 slot) {
+	return captureFolder / dlg::format("frame_{}.bin", slot);
+}
+
+} // anon namespace
+
+std::unique_ptr<FrameCapture> FrameCapture::create(Device& dev) {
+	(void) dev;
+
+	if(!checkEnvBinary("VIL_FRAME_CAPTURE", false)) {
+		return nullptr;
+	}
+
+	auto ret = std::unique_ptr<FrameCapture>(new FrameCapture());
+
+	// frame time threshold in ms, 0 to only capture via hotkey
+	if(auto env = std::getenv("VIL_FRAME_CAPTURE_THRESHOLD"); env) {
+		u32 ms {};
+		if(stoi(env, ms)) {
+			ret->threshold_ = std::chrono::milliseconds(ms);
+		} else {
+			dlg_warn("Bad parameter for VIL_FRAME_CAPTURE_THRESHOLD");
+		}
+	}
+
+	ret->ringSize_ = 16u;
+	if(auto env = std::getenv("VIL_FRAME_CAPTURE_COUNT"); env) {
+		u32 count {};
+		if(stoi(env, count) && count > 0u) {
+			ret->ringSize_ = count;
+		} else {
+			dlg_warn("Bad parameter for VIL_FRAME_CAPTURE_COUNT");
+		}
+	}
+
+	ret->thread_ = std::thread([ptr = ret.get()]{ ptr->run(); });
+	return ret;
+}
+
+FrameCapture::~FrameCapture() {
+	{
+		std::lock_guard lock(mutex_);
+		run_ = false;
+	}
+
+	cv_.notify_one();
+	if(thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void FrameCapture::trigger() {
+	triggered_.store(true);
+}
+
+void FrameCapture::presentLocked(const FrameSubmissions& frame,
+		std::chrono::nanoseconds frameTime) {
+	// fast path, this is called for every frame
+	auto triggered = threshold_.count() > 0 && frameTime > threshold_;
+	if(triggered_.load(std::memory_order_relaxed)) {
+		triggered |= triggered_.exchange(false);
+	}
+
+	if(!triggered) {
+		return;
+	}
+
+	ZoneScoped;
+
+	{
+		std::lock_guard lock(mutex_);
+		if(pending_.size() >= maxPending) {
+			dlg_warn("Dropping frame capture {}, too many pending", frame.presentID);
+			return;
+		}
+
+		// NOTE: the records are immutable, we only copy the references.
+		// The background thread releases them, without the device mutex.
+		auto& pending = pending_.emplace_back();
+		pending.presentID = frame.presentID;
+		pending.frameTime = frameTime;
+		pending.batches = frame.batches;
+	}
+
+	cv_.notify_one();
+}
+
+void FrameCapture::run() {
+	while(true) {
+		Pending pending;
+
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{ return !run_ || !pending_.empty(); });
+
+			// we still write all pending frames before exiting
+			if(pending_.empty()) {
+				return;
+			}
+
+			pending = std::move(pending_.front());
+			pending_.pop_front();
+		}
+
+		write(pending);
+	}
+}
+
+void FrameCapture::write(const Pending& pending) {
+	ZoneScoped;
+
+	auto saverPtr = createStateSaver();
+	auto& saver = *saverPtr;
+
+	// Same layout as CommandRecordGui::save, just without any
+	// selected or opened commands.
+	SaveBuf selection;
+	vil::write<u64>(selection, pending.batches.size());
+	for(auto& subm : pending.batches) {
+		vil::write(selection, subm.submissionID);
+		vil::write<u64>(selection, subm.submissions.size());
+		for(auto& rec : subm.submissions) {
+			vil::write<u64>(selection, add(saver, *rec));
+		}
+	}
+
+	vil::write<u32>(selection, u32(-1)); // submission
+	vil::write<u64>(selection, u64(-1)); // record
+	vil::write<u64>(selection, 0u); // command hierarchy
+	vil::write<u64>(selection, 0u); // opened submissions
+	vil::write<u64>(selection, 0u); // opened records
+	vil::write<u64>(selection, 0u); // opened sections
+
+	SaveBuf loaderData;
+	vil::write(saver, [&](ReadBuf data) {
+		vil::write(loaderData, data);
+	});
+
+	SaveBuf data;
+	vil::write(data, serializeMagicValue);
+	vil::write<u32>(data, loaderData.size());
+	vil::write(data, ReadBuf(loaderData));
+	vil::write(data, ReadBuf(selection));
+
+	// compress
+	std::vector<std::byte> compressed;
+	{
+		ZoneScopedN("compress");
+		auto bound = tracy::LZ4_compressBound(int(data.size()));
+		compressed.resize(std::max(bound, 0));
+		auto size = tracy::LZ4_compress_default(
+			reinterpret_cast<const char*>(data.data()),
+			reinterpret_cast<char*>(compressed.data()),
+			int(data.size()), int(compressed.size()));
+		if(size <= 0) {
+			dlg_error("LZ4 compression of frame {} failed", pending.presentID);
+			return;
+		}
+
+		compressed.resize(size);
+	}
+
+	SaveBuf header;
+	vil::write(header, frameCaptureMagicValue);
+	vil::write<u64>(header, pending.presentID);
+	vil::write<u64>(header, pending.frameTime.count());
+	vil::write<u32>(header, data.size());
+	vil::write<u32>(header, compressed.size());
+
+	// write to a temporary file first so we never leave a partially
+	// written capture behind
+	std::error_code ec;
+	fs::create_directories(captureFolder, ec);
+
+	auto path = buildCapturePath(nextSlot_);
+	auto tmpPath = path;
+	tmpPath += ".tmp";
+
+	errno = 0;
+	auto* f = std::fopen(tmpPath.string().c_str(), "wb");
+	if(!f) {
+		dlg_error("Could not open '{}' for writing: {}", tmpPath, std::strerror(errno));
+		return;
+	}
+
+	auto ok = std::fwrite(header.data(), 1u, header.size(), f) == header.size();
+	ok &= std::fwrite(compressed.data(), 1u, compressed.size(), f) == compressed.size();
+	ok &= (std::fclose(f) == 0);
+
+	if(!ok) {
+		dlg_error("Writing frame capture '{}' failed", tmpPath);
+		return;
+	}
+
+	fs::rename(tmpPath, path, ec);
+	if(ec) {
+		dlg_error("Moving frame capture to '{}' failed: {}", path, ec.message());
+		return;
+	}
+
+	nextSlot_ = (nextSlot_ + 1) % ringSize_;
+	dlg_trace("captured frame {} ({} ms) to '{}': {} -> {} bytes",
+		pending.presentID, pending.frameTime.count() / 1000000.f, path,
+		data.size(), compressed.size());
+}
+
+bool decompressFrameCapture(span<const std::byte> file,
+		std::vector<std::byte>& dst) {
+	auto buf = file;
+	constexpr auto headerSize = 3 * sizeof(u64) + 2 * sizeof(u32);
+	if(buf.size() < headerSize || read<u64>(buf) != frameCaptureMagicValue) {
+		return false;
+	}
+
+	auto presentID = read<u64>(buf);
+	(void) read<u64>(buf); // frame time
+	auto size = read<u32>(buf);
+	auto compressedSize = read<u32>(buf);
+	if(compressedSize != buf.size()) {
+		dlg_error("Frame capture {}: invalid size", presentID);
+		return false;
+	}
+
+	dst.resize(size);
+	auto res = tracy::LZ4_decompress_safe(
+		reinterpret_cast<const char*>(buf.data()),
+		reinterpret_cast<char*>(dst.data()),
+		int(compressedSize), int(size));
+	if(res < 0 || u32(res) != size) {
+		dlg_error("Frame capture {}: decompression failed", presentID);
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace vil
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <frame.hpp>
+#include <nytl/span.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vil {
+
+// Frame capture files start with this value, followed by the u64 presentID,
+// the u64 frame time in ns, the u32 uncompressed and the u32 compressed size.
+// The rest of the file is the LZ4-compressed serialized state, in the same
+// format as serialized selections (see CommandRecordGui::saveSelection).
+constexpr auto frameCaptureMagicValue = u64(0x411005314A7102BD);
+
+// Continuous capture of presented frames to disk, to investigate rare
+// hitches after the fact. When triggered (by a frame exceeding the
+// frame time threshold or via the capture hotkey), the submissions of
+// the just presented frame are serialized and LZ4-compressed on a
+// background thread, into a bounded ring of files in '.vil/capture/'.
+// The presenting thread only copies the references to the (immutable)
+// records of the frame.
+// Enabled via VIL_FRAME_CAPTURE, see docs/env.md for the configuration.
+class FrameCapture {
+public:
+	// Maximum number of frames waiting to be written. Further triggered
+	// frames are dropped until the background thread catches up.
+	static constexpr auto maxPending = 4u;
+
+	// Returns nullptr when not enabled.
+	static std::unique_ptr<FrameCapture> create(Device& dev);
+	~FrameCapture();
+
+	// Requests capturing the next presented frame.
+	// Can be called from any thread.
+	void trigger();
+
+	// Called for every present with the frame that was just completed.
+	// Must be called while the device mutex is locked.
+	void presentLocked(const FrameSubmissions& frame,
+		std::chrono::nanoseconds frameTime);
+
+private:
+	struct Pending {
+		u64 presentID {};
+		std::chrono::nanoseconds frameTime {};
+		std::vector<FrameSubmission> batches;
+	};
+
+	FrameCapture() = default;
+	void run();
+	void write(const Pending& pending);
+
+	std::chrono::nanoseconds threshold_ {};
+	u32 ringSize_ {};
+	u32 nextSlot_ {}; // only accessed by the background thread
+	std::atomic<bool> triggered_ {};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<Pending> pending_; // protected by mutex_
+	bool run_ {true}; // protected by mutex_
+	std::thread thread_;
+};
+
+// Decompresses a frame capture file (as written by FrameCapture) into
+// the format of serialized selections.
+// Returns false if the given data isn't a valid frame capture.
+bool decompressFrameCapture(span<const std::byte> file,
+	std::vector<std::byte>& dst);
+
+} // namespace vil
@@ -124,6 +124,8 @@ enum class SubmissionType : u8;
 struct DisplayWindow;
 struct Platform;
 struct Overlay;
+class FrameCapture;
+class SubmissionWaiter;
 struct Draw;
 
 struct ThreadMemScope;
@@ -157,7 +159,14 @@ template<typename T> struct WrappedHandle;
 template<typename T, typename H> class HandledPtr;
 template<typename T, typename Deleter = std::default_delete<T>> struct RefCountHandler;
 
-template<typename T, typename D = std::default_delete<T>>
+// Called by IntrusivePtr when the last reference is dropped.
+// Specialized for objects whose destruction is deferred, see DestroyQueue.
+template<typename T> struct IntrusiveDeleter : std::default_delete<T> {};
+template<> struct IntrusiveDeleter<CommandRecord> {
+	void operator()(CommandRecord* rec) const;
+};
+
+template<typename T, typename D = IntrusiveDeleter<T>>
 using IntrusivePtr = HandledPtr<T, RefCountHandler<T, D>>;
 
 using CommandBufferPtr = IntrusiveWrappedPtr<CommandBuffer>;
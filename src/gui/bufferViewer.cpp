@@ -1,7 +1,9 @@
 #include <gui/bufferViewer.hpp>
 #include <gui/gui.hpp>
 #include <util/buffmt.hpp>
-#include <threadContext.hpp>
+#include <util/profiling.hpp>
+#include <algorithm>
+#include <chrono>
 
 namespace vil {
 
@@ -17,52 +19,73 @@ void BufferViewer::init(Gui& gui) {
 	textedit.SetTabSize(4);
 }
 
-void BufferViewer::display(ReadBuf data) {
-	auto layoutText = textedit.GetText();
+void BufferViewer::updateLayout(std::string text) {
+	if(pending_.valid() &&
+			pending_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		layout_ = pending_.get();
 
-	// NOTE: textedit seems to always append '\n' leading to issues
-	// with the error marker (they may be reported in the non-existent
-	// last line).
-	if(layoutText.back() == '\n') {
-		layoutText.pop_back();
-	}
+		igt::TextEditor::ErrorMarkers markers;
+		if(layout_->result.error) {
+			auto& err = *layout_->result.error;
 
-	ThreadMemScope tms;
-	auto parseRes = parseType(layoutText, tms.customUse());
+			auto msg = err.message;
+			msg += "\n";
 
-	igt::TextEditor::ErrorMarkers markers;
-	if(parseRes.error) {
-		auto& err = *parseRes.error;
+			// TODO: make it work with tabs
+			auto& line = err.loc.lineContent;
+			auto tabCount = std::count(line.begin(), line.end(), '\t');
+			msg += line;
+			msg += "\n";
 
-		auto msg = err.message;
-		msg += "\n";
+			// hard to say what tab size is... eh. Maybe just replace it?
+			auto col = err.loc.col + tabCount * (4 - 1);
+			for(auto i = 1u; i < col; ++i) {
+				msg += " ";
+			}
 
-		// TODO: make it work with tabs
-		auto& line = err.loc.lineContent;
-		auto tabCount = std::count(line.begin(), line.end(), '\t');
-		msg += line;
-		msg += "\n";
+			msg += "^\n";
 
-		// hard to say what tab size is... eh. Maybe just replace it?
-		auto col = err.loc.col + tabCount * (4 - 1);
-		for(auto i = 1u; i < col; ++i) {
-			msg += " ";
+			// dlg_error("{}:{}: {}", err.loc.line, err.loc.col, msg);
+			// dlg_error("input: '{}'", layoutText);
+			markers.insert({err.loc.line, msg});
 		}
 
-		msg += "^\n";
+		textedit.SetErrorMarkers(markers);
+	}
+
+	// Only one job at a time. When the text changed in the meantime,
+	// we start a new one after the current one finished.
+	if(pending_.valid() || text == requestedText_) {
+		return;
+	}
 
-		// dlg_error("{}:{}: {}", err.loc.line, err.loc.col, msg);
-		// dlg_error("input: '{}'", layoutText);
-		markers.insert({err.loc.line, msg});
+	requestedText_ = text;
+	pending_ = std::async(std::launch::async, [text = std::move(text)]{
+		ZoneScopedN("parseLayout");
+		auto ret = std::make_unique<ParsedLayout>();
+		ret->text = std::move(text);
+		ret->result = parseType(ret->text, ret->alloc);
+		return ret;
+	});
+}
+
+void BufferViewer::display(ReadBuf data) {
+	auto layoutText = textedit.GetText();
+
+	// NOTE: textedit seems to always append '\n' leading to issues
+	// with the error marker (they may be reported in the non-existent
+	// last line).
+	if(layoutText.back() == '\n') {
+		layoutText.pop_back();
 	}
 
-	textedit.SetErrorMarkers(markers);
+	updateLayout(std::move(layoutText));
 
 	ImGui::PushFont(gui->monoFont);
 	textedit.Render("Layout", {0, 200});
 	ImGui::PopFont();
 
-	auto type = parseRes.type;
+	auto type = layout_ ? layout_->result.type : nullptr;
 	if(type && !type->members.empty()) {
 		displayTable("Content", *type, data);
 	}
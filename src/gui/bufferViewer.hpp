@@ -3,6 +3,11 @@
 #include <fwd.hpp>
 #include <imgui/textedit.h>
 #include <nytl/bytes.hpp>
+#include <util/buffmt.hpp>
+#include <util/linalloc.hpp>
+#include <future>
+#include <memory>
+#include <string>
 
 namespace vil {
 
@@ -12,8 +17,26 @@ struct BufferViewer {
 
 	void init(Gui& gui);
 	void display(ReadBuf data);
+
+private:
+	// A parsed layout. The type and the error location reference
+	// memory owned by this object.
+	struct ParsedLayout {
+		std::string text;
+		LinAllocator alloc;
+		ParseTypeResult result;
+	};
+
+	// Starts parsing the layout on a worker thread when it changed and
+	// consumes the result when it's ready.
+	void updateLayout(std::string text);
+
+	// The last parsed layout. Displayed until parsing a changed
+	// layout has finished.
+	std::unique_ptr<ParsedLayout> layout_;
+	std::future<std::unique_ptr<ParsedLayout>> pending_;
+	std::string requestedText_;
 };
 
 } // namespace vil
 
-
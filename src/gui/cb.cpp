@@ -286,9 +286,8 @@ void CommandRecordGui::draw(Draw& draw) {
 	updateMode = selector_.updateMode();
 	if(updateMode == UpdateMode::swapchain && !selector_.freezeState && doUpdate) {
 		FrameSubmissions lastFrame;
-		{
-			std::lock_guard lock(dev.mutex);
-			lastFrame = swapchain->frameSubmissions[0];
+		if(auto frames = swapchain->frames(); !frames->empty()) {
+			lastFrame = *frames->front();
 		}
 
 		auto lastPresent = lastFrame.presentID;
@@ -478,14 +477,11 @@ void CommandRecordGui::select(IntrusivePtr<CommandRecord> record, CommandBufferP
 }
 
 void CommandRecordGui::showSwapchainSubmissions(Swapchain& swapchain, bool initial) {
-	auto& dev = gui_->dev();
-	assertNotOwned(dev.mutex);
+	assertNotOwned(gui_->dev().mutex);
 
 	std::vector<FrameSubmission> lastFrame;
-
-	{
-		std::lock_guard lock(dev.mutex);
-		lastFrame = swapchain.frameSubmissions[0].batches;
+	if(auto frames = swapchain.frames(); !frames->empty()) {
+		lastFrame = frames->front()->batches;
 	}
 
 	clearSelection(true);
@@ -709,9 +705,9 @@ void CommandRecordGui::displayBatch(FrameSubmission& batch, u32 batchID) {
 void CommandRecordGui::displayFrameCommands(Swapchain& swapchain) {
 	(void) swapchain;
 	/*
-	if(frame_.empty() && swapchain.frameSubmissions[0].batches.empty()) {
+	if(frame_.empty() && swapchain.frames()->front()->batches.empty()) {
 		dlg_warn("how did this happen?");
-		frame_ = swapchain.frameSubmissions[0].batches;
+		frame_ = swapchain.frames()->front()->batches;
 	}
 	*/
 
@@ -1127,7 +1123,6 @@ void CommandRecordGui::updateFromSelector() {
 const auto serializeFolder = fs::path(".vil/");
 constexpr auto serializeFilePrefix = std::string_view("cmdsel_");
 constexpr auto serializeDefaultName = std::string_view("_default");
-constexpr auto serializeMagicValue = u64(0x411005314A7102BC);
 
 fs::path buildSerializePath(std::string_view name) {
 	return serializeFolder / (std::string(serializeFilePrefix).append(name).append(".bin"));
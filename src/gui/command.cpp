@@ -1748,6 +1748,7 @@ void CommandViewer::updateHook() {
 			ops.vertexCmd = vertexViewer_.selectedCommand();
 			if(viewData_.mesh.output) {
 				ops.copyXfb = true;
+				ops.xfbPage = vertexViewer_.xfbPage();
 
 				if(vertexViewer_.showAll()) {
 					ops.vertexCmd = u32(-1);
@@ -1800,8 +1801,11 @@ void CommandViewer::displayImage(Draw& draw, const CopiedImage& img) {
 	//   copy op). But not 100% what's better for gui, a level/layer
 	//   slider beginning at a number that isn't 0 might be confusing.
 	auto range = img.subresRange();
+	// The hook state (and therefore the copied image) only changes
+	// when a new capture arrives, so the statistics can be reused until then.
 	imageViewer_.select(img.image, img.extent, minImageType(img.extent),
-		img.format, range, imgLayout, imgLayout, img.samples, flags);
+		img.format, range, imgLayout, imgLayout, img.samples, flags,
+		hookState->id);
 	imageViewer_.display(draw);
 }
 
@@ -70,23 +70,25 @@ bool CommandSelection::update() {
 	ThreadMemScope tms;
 	u32 bestPresentID = {};
 
+	// The frames are an immutable snapshot, they stay valid as long
+	// as we hold the history.
 	auto swapchain = dev.swapchain();
+	auto frames = swapchain ? swapchain->frames() : nullptr;
 
-	auto frameForSubmissionLocked = [&](u32 submissionID) -> const FrameSubmissions* {
-		assertOwned(dev.mutex);
-		if(!swapchain) {
+	auto frameForSubmission = [&](u64 submissionID) -> const FrameSubmissions* {
+		if(!frames) {
 			dlg_warn("lost swapchain");
 			return nullptr;
 		}
 
 		u64 minID = u64(-1);
 		u64 maxID = 0u;
-		for(auto& frame : swapchain->frameSubmissions) {
-			minID = std::min(minID, frame.submissionStart);
-			maxID = std::max(maxID, frame.submissionEnd);
-			if(submissionID >= frame.submissionStart &&
-					submissionID <= frame.submissionEnd) {
-				return &frame;
+		for(auto& frame : *frames) {
+			minID = std::min(minID, frame->submissionStart);
+			maxID = std::max(maxID, frame->submissionEnd);
+			if(submissionID >= frame->submissionStart &&
+					submissionID <= frame->submissionEnd) {
+				return frame.get();
 			}
 		}
 
@@ -105,9 +107,8 @@ bool CommandSelection::update() {
 			auto id1 = completed[completed.size() - 1].submissionID;
 			auto id2 = completed[completed.size() - 2].submissionID;
 
-			std::lock_guard lock(dev.mutex);
-			auto* frame1 = frameForSubmissionLocked(id1);
-			auto* frame2 = frameForSubmissionLocked(id2);
+			auto* frame1 = frameForSubmission(id1);
+			auto* frame2 = frameForSubmission(id2);
 			multipleMatchesInLastFrame = frame1 && (frame1 == frame2);
 		}
 
@@ -132,17 +133,13 @@ bool CommandSelection::update() {
 				selType == SelectionType::record ||
 				selType == SelectionType::submission);
 
-			{
-				std::lock_guard lock(dev.mutex);
-				auto* frame = frameForSubmissionLocked(res.submissionID);
-				if(!frame) {
-					continue;
-				}
-
-				bestBatches = frame->batches;
-				bestPresentID = frame->presentID;
+			auto* frame = frameForSubmission(res.submissionID);
+			if(!frame) {
+				continue;
 			}
 
+			bestBatches = frame->batches;
+			bestPresentID = frame->presentID;
 		}
 
 		best = &res;
@@ -7,6 +7,7 @@
 #include <gui/render.hpp>
 #include <gui/resources.hpp>
 #include <gui/cb.hpp>
+#include <gui/profiler.hpp>
 #include <gui/fonts.hpp>
 #include <gui/fontAwesome.hpp>
 #include <commandHook/hook.hpp>
@@ -35,6 +36,7 @@
 #include <vkutil/enumString.hpp>
 #include <vk/format_utils.h>
 
+#include <algorithm>
 #include <set>
 #include <map>
 #include <fstream>
@@ -85,6 +87,13 @@ Gui::Gui(Device& dev, VkFormat colorFormat) {
 	VK_CHECK(dev.dispatch.CreateCommandPool(dev.handle, &cpci, nullptr, &commandPool_));
 	nameHandle(dev, commandPool_, "Gui");
 
+	// staging ring for per-frame data
+	auto stagingUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	staging_.init(dev, stagingRingSize, stagingUsage);
+
 	// init render stuff
 	// descriptor set layout
 	auto imguiBindings = std::array {
@@ -140,9 +149,11 @@ Gui::Gui(Device& dev, VkFormat colorFormat) {
 	// TODO: use RAII for init
 	tabs_.resources = std::make_unique<ResourceGui>();
 	tabs_.cb = std::make_unique<CommandRecordGui>();
+	tabs_.profiler = std::make_unique<ProfilerGui>();
 
 	tabs_.resources->init(*this);
 	tabs_.cb->init(*this);
+	tabs_.profiler->init(*this);
 }
 
 void Gui::destroyRenderStuff() {
@@ -159,6 +170,7 @@ void Gui::destroyRenderStuff() {
 		dev_->dispatch.DestroyPipeline(vkDev, pipes_.readTex[i], nullptr);
 		dev_->dispatch.DestroyPipeline(vkDev, pipes_.minMaxTex[i], nullptr);
 		dev_->dispatch.DestroyPipeline(vkDev, pipes_.histogramTex[i], nullptr);
+		dev_->dispatch.DestroyPipeline(vkDev, pipes_.imageStatsTex[i], nullptr);
 	}
 
 	dev_->dispatch.DestroyRenderPass(vkDev, rp_, nullptr);
@@ -546,23 +558,23 @@ void Gui::ensureFontAtlas(VkCommandBuffer cb) {
 
 void Gui::uploadDraw(Draw& draw, const ImDrawData& drawData) {
 	ZoneScoped;
-	auto& dev = *this->dev_;
+
+	// The draw is not in use, so the gpu is done with its last frame.
+	// It might not have been released if the draw was never submitted.
+	staging_.release(draw.stagingFrame);
+	draw.stagingFrame = 0u;
+
 	if(drawData.TotalIdxCount == 0) {
 		return;
 	}
 
-	// make sure buffers are large enough
-	auto vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
 	auto vertexSize = drawData.TotalVtxCount * sizeof(ImDrawVert);
-	draw.vertexBuffer.ensure(dev, vertexSize, vertexUsage);
-
-	auto indexUsage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
 	auto indexSize = drawData.TotalIdxCount * sizeof(ImDrawIdx);
-	draw.indexBuffer.ensure(dev, indexSize, indexUsage);
+	draw.vertices = staging_.alloc(vertexSize, sizeof(ImDrawVert));
+	draw.indices = staging_.alloc(indexSize, sizeof(ImDrawIdx));
 
-	// map
-	ImDrawVert* verts = reinterpret_cast<ImDrawVert*>(draw.vertexBuffer.map);
-	ImDrawIdx* inds = reinterpret_cast<ImDrawIdx*>(draw.indexBuffer.map);
+	ImDrawVert* verts = reinterpret_cast<ImDrawVert*>(draw.vertices.data);
+	ImDrawIdx* inds = reinterpret_cast<ImDrawIdx*>(draw.indices.data);
 
 	for(auto i = 0; i < drawData.CmdListsCount; ++i) {
 		auto& cmds = *drawData.CmdLists[i];
@@ -572,8 +584,7 @@ void Gui::uploadDraw(Draw& draw, const ImDrawData& drawData) {
 		inds += cmds.IdxBuffer.Size;
 	}
 
-	draw.indexBuffer.flushMap();
-	draw.vertexBuffer.flushMap();
+	draw.stagingFrame = staging_.endFrame();
 }
 
 void Gui::recordDraw(Draw& draw, VkExtent2D extent, VkFramebuffer,
@@ -593,9 +604,10 @@ void Gui::recordDraw(Draw& draw, VkExtent2D extent, VkFramebuffer,
 		viewport.maxDepth = 1.f;
 		dev.dispatch.CmdSetViewport(draw.cb, 0, 1, &viewport);
 
-		VkDeviceSize off0 = 0u;
-		dev.dispatch.CmdBindVertexBuffers(draw.cb, 0, 1, &draw.vertexBuffer.buf, &off0);
-		dev.dispatch.CmdBindIndexBuffer(draw.cb, draw.indexBuffer.buf, 0, VK_INDEX_TYPE_UINT16);
+		dev.dispatch.CmdBindVertexBuffers(draw.cb, 0, 1, &draw.vertices.buf,
+			&draw.vertices.offset);
+		dev.dispatch.CmdBindIndexBuffer(draw.cb, draw.indices.buf,
+			draw.indices.offset, VK_INDEX_TYPE_UINT16);
 
 		float pcr[4];
 		// scale
@@ -629,8 +641,10 @@ void Gui::recordDraw(Draw& draw, VkExtent2D extent, VkFramebuffer,
 					dev.dispatch.CmdPushConstants(draw.cb, imguiPipeLayout_.vkHandle(),
 						pcrStages, 0, sizeof(pcr), pcr);
 					dev.dispatch.CmdSetViewport(draw.cb, 0, 1, &viewport);
-					dev.dispatch.CmdBindVertexBuffers(draw.cb, 0, 1, &draw.vertexBuffer.buf, &off0);
-					dev.dispatch.CmdBindIndexBuffer(draw.cb, draw.indexBuffer.buf, 0, VK_INDEX_TYPE_UINT16);
+					dev.dispatch.CmdBindVertexBuffers(draw.cb, 0, 1,
+						&draw.vertices.buf, &draw.vertices.offset);
+					dev.dispatch.CmdBindIndexBuffer(draw.cb, draw.indices.buf,
+						draw.indices.offset, VK_INDEX_TYPE_UINT16);
 					dev.dispatch.CmdPushConstants(draw.cb, imguiPipeLayout_.vkHandle(),
 						pcrStages, 0, sizeof(pcr), pcr);
 				}
@@ -1076,6 +1090,11 @@ void Gui::drawOverviewUI(Draw& draw) {
 	if(checkEnvBinary("VIL_DEBUG", true)) {
 		auto& stats = DebugStats::get();
 		imGuiText("alive records: {}", stats.aliveRecords);
+		imGuiText("retired handles: {}", stats.retiredHandles);
+		imGuiText("destroy queue: {} (latency {} ms, max {} ms)",
+			stats.destroyQueueDepth,
+			stats.destroyQueueLatency / (1000.f * 1000.f),
+			stats.destroyQueueMaxLatency / (1000.f * 1000.f));
 		imGuiText("alive descriptor sets: {}", stats.aliveDescriptorSets);
 		imGuiText("alive descriptor copies: {}", stats.aliveDescriptorCopies);
 		imGuiText("alive buffers: {}", stats.aliveBuffers);
@@ -1084,6 +1103,7 @@ void Gui::drawOverviewUI(Draw& draw) {
 		imGuiText("command memory: {} MB", stats.commandMem / (1024.f * 1024.f));
 		imGuiText("ds copy memory: {} MB", stats.descriptorCopyMem / (1024.f * 1024.f));
 		imGuiText("ds pool memory: {} MB", stats.descriptorPoolMem / (1024.f * 1024.f));
+		imGuiText("ds page memory: {} MB", stats.descriptorPageMem / (1024.f * 1024.f));
 		imGuiText("alive hook records: {}", stats.aliveHookRecords);
 		imGuiText("alive hook states: {}", stats.aliveHookStates);
 		imGuiText("layer buffer memory: {} MB", stats.ownBufferMem / (1024.f * 1024.f));
@@ -1145,12 +1165,16 @@ void Gui::drawMemoryUI(Draw&) {
 	// - show the biggest actual allocations; some more statistics in general
 
 	// accumulate allocation sizes per heap
-	// TODO: cache this.
+	// The size of a memory object never changes, we only have to do
+	// this (and lock the device mutex) when memory was allocated or freed.
 	auto& memProps = dev().memProps;
-	VkDeviceSize heapAlloc[VK_MAX_MEMORY_HEAPS] {};
+	auto& heapAlloc = heapAlloc_.alloc;
+	auto memVersion = dev().deviceMemories.version.load(std::memory_order_acquire);
+	if(memVersion != heapAlloc_.version) {
+		std::fill(std::begin(heapAlloc), std::end(heapAlloc), VkDeviceSize(0u));
 
-	{
 		std::lock_guard lock(dev().mutex);
+		heapAlloc_.version = dev().deviceMemories.version.load(std::memory_order_relaxed);
 		for(auto& [_, mem] : dev().deviceMemories.inner) {
 			auto heap = memProps.memoryTypes[mem->typeIndex].heapIndex;
 			heapAlloc[heap] += mem->size;
@@ -1405,6 +1429,7 @@ void Gui::draw(Draw& draw, bool fullscreen) {
 			tabItem(ICON_FA_IMAGES " Resources", Tab::resources);
 			tabItem(ICON_FA_MEMORY " Memory", Tab::memory);
 			tabItem(ICON_FA_LIST " Commands", Tab::commandBuffer);
+			tabItem(ICON_FA_STOPWATCH " Profiler", Tab::profiler);
 
 			ImGui::SameLine();
 			const auto start = ImGui::GetCursorScreenPos();
@@ -1434,6 +1459,7 @@ void Gui::draw(Draw& draw, bool fullscreen) {
 				case Tab::memory: drawMemoryUI(draw); break;
 				case Tab::commandBuffer: tabs_.cb->draw(draw); break;
 				case Tab::resources: tabs_.resources->draw(draw); break;
+				case Tab::profiler: tabs_.profiler->draw(draw); break;
 				default: break;
 			}
 			ImGui::EndChild();
@@ -2312,14 +2338,28 @@ void Gui::addFullSync(Draw& draw, VkSubmitInfo& submitInfo) {
 	submitInfo.pWaitSemaphores = waitSemaphores_.data();
 }
 
-void Gui::waitForDraws() {
-	std::vector<VkFence> fences;
+void Gui::waitForDraws(u32 keepPending) {
+	std::vector<Draw*> pending;
 	for(auto& draw : draws_) {
 		if(draw->inUse) {
-			fences.push_back(draw->fence);
+			pending.push_back(draw.get());
 		}
 	}
 
+	if(pending.size() <= keepPending) {
+		return;
+	}
+
+	// oldest first
+	std::sort(pending.begin(), pending.end(), [](auto* a, auto* b) {
+		return a->lastUsed < b->lastUsed;
+	});
+
+	std::vector<VkFence> fences;
+	for(auto i = 0u; i < pending.size() - keepPending; ++i) {
+		fences.push_back(pending[i]->fence);
+	}
+
 	if(!fences.empty()) {
 		VK_CHECK_DEV(dev().dispatch.WaitForFences(dev().handle,
 			u32(fences.size()), fences.data(), true, UINT64_MAX), dev());
@@ -2372,6 +2412,9 @@ void Gui::finishedLocked(Draw& draw) {
 	draw.usedBuffers.clear();
 	draw.usedHookState.reset();
 
+	staging_.release(draw.stagingFrame);
+	draw.stagingFrame = 0u;
+
 	VK_CHECK_DEV(dev().dispatch.ResetFences(dev().handle, 1, &draw.fence), dev());
 
 	draw.inUse = false;
@@ -17,6 +17,7 @@ namespace vil {
 
 class ResourceGui;
 class CommandRecordGui;
+class ProfilerGui;
 class ImageViewer;
 struct Serializer;
 
@@ -32,6 +33,7 @@ public:
 		resources,
 		commandBuffer,
 		memory,
+		profiler,
 	};
 
 	struct Event {
@@ -74,6 +76,9 @@ public:
 		std::array<VkPipeline, ShaderImageType::count> readTex {};
 		std::array<VkPipeline, ShaderImageType::count> minMaxTex {};
 		std::array<VkPipeline, ShaderImageType::count> histogramTex {};
+		// Fused min/max, NaN/Inf and mean kernel. Null when it wasn't
+		// compiled in, see pipes.cpp.
+		std::array<VkPipeline, ShaderImageType::count> imageStatsTex {};
 
 		VkPipeline histogramPrepare {};
 		VkPipeline histogramMax {};
@@ -113,11 +118,12 @@ public:
 	void apiHandleDestroyed(const Handle& handle, VkObjectType type);
 	void memoryResourceInvalidated(const MemoryResource&);
 
-	// Blocks until all pending draws have finished execution.
+	// Blocks until all pending draws have finished execution, except
+	// for the keepPending most recently submitted ones.
 	// Does not modify any internal state.
 	// Must only be called when it is guaranteed that no other thread
 	// is drawing at the same time (externally synchronized).
-	void waitForDraws();
+	void waitForDraws(u32 keepPending = 0u);
 
 	// Returns the latest pending Draw that needs to be synchronized
 	// with the given submission batch. In case there is no such Draw,
@@ -215,6 +221,11 @@ private:
 	Tab activeTab_ {};
 	u32 activateTabCounter_ {};
 
+	// Serves the per-frame data of all draws, see uploadDraw.
+	// Must outlive draws_.
+	static constexpr auto stagingRingSize = VkDeviceSize(1024 * 1024);
+	StagingRing staging_;
+
 	std::vector<std::unique_ptr<Draw>> draws_;
 	Draw* lastDraw_ {};
 
@@ -249,6 +260,7 @@ private:
 	struct {
 		std::unique_ptr<ResourceGui> resources;
 		std::unique_ptr<CommandRecordGui> cb;
+		std::unique_ptr<ProfilerGui> profiler;
 
 		// For image-only mode
 		std::unique_ptr<ImageViewer> imageViewer;
@@ -272,6 +284,13 @@ private:
 	float dt_ {};
 	u64 drawCounter_ {};
 
+	// Allocated memory per heap, shown in drawMemoryUI. Only recomputed
+	// when the version of Device::deviceMemories changed.
+	struct {
+		u64 version {u64(-1)};
+		VkDeviceSize alloc[VK_MAX_MEMORY_HEAPS] {};
+	} heapAlloc_;
+
 	GuiBlur blur_ {};
 	VkSwapchainKHR blurSwapchain_ {};
 	ImVec2 windowPos_ {};
@@ -3,8 +3,11 @@
 #include <gui/util.hpp>
 #include <util/util.hpp>
 #include <util/fmt.hpp>
+#include <util/profiling.hpp>
+#include <util/allocation.hpp>
 #include <nytl/vecOps.hpp>
 #include <device.hpp>
+#include <layer.hpp>
 #include <queue.hpp>
 #include <nytl/bytes.hpp>
 #include <imgui/imgui.h>
@@ -15,6 +18,9 @@
 #include <vkutil/cmd.hpp>
 #include <imgio/image.hpp>
 #include <gui/fontAwesome.hpp>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
 
 namespace vil {
 
@@ -34,6 +40,29 @@ struct HistMetadata {
 const u32 flagHasNan = 1u;
 const u32 flagHasInf = 2u;
 
+// see imageStats.comp
+struct ImageStats {
+	static constexpr auto numGroups = 64u;
+
+	Vec4u32 texMin;
+	Vec4u32 texMax;
+	u32 flags;
+	u32 doneGroups;
+	u32 pad[2];
+	Vec4u32 nanCount;
+	Vec4u32 infCount;
+	Vec4u32 finiteCount;
+	Vec4f mean;
+	Vec4f partialSum[numGroups];
+	Vec4u32 partialCount[numGroups];
+};
+
+// Only the part before the per-group partial results has to be
+// initialized before the shader runs and read back.
+constexpr auto imageStatsHeaderSize = offsetof(ImageStats, partialSum);
+// The prefix shared with HistMetadata
+constexpr auto imageStatsMinMaxSize = offsetof(ImageStats, doneGroups);
+
 float uintOrderedToFloat(u32 val) {
 	if((val & (1u << 31)) == 0) {
 		// original float must have been negative
@@ -536,13 +565,47 @@ void ImageViewer::drawImageArea(Draw& draw) {
 	auto endX = bgW / float(regW);
 	auto endY = bgH / float(regH);
 	auto uv1 = ImVec2((endX - offset_.x) / scale_, (endY - offset_.y) / scale_);
-	ImGui::Image((void*) &imageDraw_, {bgW, bgH}, uv0, uv1);
+
+	// When the image is minified, draw it from the pyramid so that the
+	// cost depends on the size of the canvas, not of the image.
+	auto* drawImage = &imageDraw_;
+	auto texelsPerPixel = width / (regW * scale_);
+	if(texelsPerPixel >= 2.f && pyramidSupported()) {
+		// The image can be reused for new contents (e.g. in live mode,
+		// where every frame has a new capture) as long as it would look
+		// the same.
+		auto layer = u32(imageDraw_.layer);
+		auto pyramidW = std::max(extent_.width >> level, 1u) / 2u;
+		auto pyramidH = std::max(extent_.height >> level, 1u) / 2u;
+		if(!pyramid_ || pyramid_->level != level || pyramid_->layer != layer ||
+				pyramid_->format != format_ ||
+				pyramid_->image.extent.width != pyramidW ||
+				pyramid_->image.extent.height != pyramidH) {
+			createPyramid(level, layer);
+		}
+
+		if(pyramid_) {
+			// pyramid level i has 2^(i + 1) times less texels per side
+			auto maxLevel = float(pyramid_->image.levelCount - 1);
+			pyramidDraw_ = imageDraw_;
+			pyramidDraw_.ds = pyramid_->ds.vkHandle();
+			pyramidDraw_.layer = 0.f;
+			pyramidDraw_.level = std::clamp(
+				std::floor(std::log2(texelsPerPixel)) - 1.f, 0.f, maxLevel);
+			drawImage = &pyramidDraw_;
+		}
+	}
+
+	ImGui::Image((void*) drawImage, {bgW, bgH}, uv0, uv1);
 	ImGui::PopClipRect();
 
 	// make sure the view & descriptor we used for drawing stay alive until the
 	// draw submission finishes. We do so by pushing an IntrusivePtr to the
 	// draw state into the draw, to be reset in onFinish
-	auto owner = [drawData = data_](Draw&, bool) mutable { drawData.reset(); };
+	auto owner = [drawData = data_, pyramid = pyramid_](Draw&, bool) mutable {
+		drawData.reset();
+		pyramid.reset();
+	};
 	draw.onFinish.emplace_back(std::move(owner));
 
 	// logic
@@ -637,7 +700,22 @@ void ImageViewer::drawImageArea(Draw& draw) {
 			imGuiText("| Min: {}, Max: {}", min, max);
 			*/
 
-			if(minMax.flags != 0u) {
+			if(rb.hasStats) {
+				auto statsData = rb.own.data();
+				skip(statsData, 100u + statsOffset());
+				auto stats = read<ImageStats>(statsData);
+
+				ImGui::SameLine();
+				imGuiText("| Mean: {}", format(format_, aspect_, Vec4d(stats.mean)));
+				if(stats.flags & flagHasInf) {
+					ImGui::SameLine();
+					imGuiText("| Inf: {}", stats.infCount);
+				}
+				if(stats.flags & flagHasNan) {
+					ImGui::SameLine();
+					imGuiText("| NaN: {}", stats.nanCount);
+				}
+			} else if(minMax.flags != 0u) {
 				if(minMax.flags & flagHasInf) {
 					minMax.flags &= ~flagHasInf;
 					ImGui::SameLine();
@@ -717,7 +795,7 @@ void ImageViewer::display(Draw& draw) {
 	if(!readback) {
 		readback = &readbacks_.emplace_back();
 
-		auto maxBufSize = 100 + histogramBufSize();
+		auto maxBufSize = 100 + statsOffset() + sizeof(ImageStats);
 		readback->own.ensure(dev, maxBufSize,
 			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
 			VK_BUFFER_USAGE_TRANSFER_DST_BIT, {}, "ImageViewer:readback");
@@ -809,6 +887,10 @@ void ImageViewer::recordPreImage(Draw& draw, Readback& rb) {
 		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, initialImageLayout_);
 	srcState.range = subresRange_;
 
+	if(pyramid_ && pyramid_->builtContent != contentID_) {
+		buildPyramid(draw, srcState);
+	}
+
 	vku::LocalBufferState histBufState{data_->histogram.asSpan()};
 	computeHistogram(draw, srcState, histBufState, rb);
 
@@ -1043,6 +1125,52 @@ void ImageViewer::computeHistogram(Draw& draw, vku::LocalImageState& srcState,
 	auto& dev = gui_->dev();
 	DebugLabel cblbl(dev, draw.cb, "vil:ImageViewer:computeHistogram");
 
+	auto w = std::max(extent_.width >> u32(imageDraw_.level), 1u);
+	auto h = std::max(extent_.height >> u32(imageDraw_.level), 1u);
+	auto d = std::max(extent_.depth >> u32(imageDraw_.level), 1u);
+
+	auto layer = imageDraw_.layer;
+	if(imgType_ == VK_IMAGE_TYPE_3D) {
+		if(histogram3DCurrentSlice) {
+			// use current slice, just that
+			d = 1u;
+		} else {
+			// ignore selected slice
+			layer = 0u;
+		}
+	}
+
+	auto computeMinMax = !histogram_.fixedRange;
+	auto fixedBounds = histogram_.fixedRange || !computeMinMax_;
+	auto statsPipe = gui_->pipes().imageStatsTex[imageDraw_.type];
+	rb.hasMinMax = computeMinMax;
+	rb.hasStats = (statsPipe != VK_NULL_HANDLE);
+
+	StatsKey key;
+	key.contentID = contentID_;
+	key.level = u32(imageDraw_.level);
+	key.layer = u32(layer);
+	key.depth = d;
+	key.texelSkip = histogram_.texelSkip;
+	key.computeMinMax = computeMinMax && computeMinMax_;
+	key.fixedRange = histogram_.fixedRange;
+	if(fixedBounds) {
+		key.begin = histogram_.begin;
+		key.end = histogram_.end;
+	}
+
+	// When the contents didn't change, the statistics from a previous
+	// frame are still valid. We only have to read them back again.
+	// The frame that computed them already made them visible for
+	// shader and transfer reads.
+	if(contentID_ && data_->stats == key) {
+		vku::cmdCopyBuffer(dev, draw.cb,
+			data_->histogram.asSpan(),
+			rb.own.asSpan(100u));
+		return;
+	}
+
+	data_->stats = key;
 	srcState.transition(dev, draw.cb, vku::SyncScope::computeRead());
 
 	// clear hist buffer
@@ -1054,7 +1182,7 @@ void ImageViewer::computeHistogram(Draw& draw, vku::LocalImageState& srcState,
 	data.texMin = {minVal, minVal, minVal, minVal};
 	data.texMax = {maxVal, maxVal, maxVal, maxVal};
 
-	if(histogram_.fixedRange || !computeMinMax_) {
+	if(fixedBounds) {
 		data.begin = histogram_.begin;
 		data.end = histogram_.end;
 	}
@@ -1063,60 +1191,94 @@ void ImageViewer::computeHistogram(Draw& draw, vku::LocalImageState& srcState,
 		0u, sizeof(data), &data);
 	// make sure to clear the histogram buckets to 0
 	dev.dispatch.CmdFillBuffer(draw.cb, data_->histogram.buf,
-		sizeof(data), VK_WHOLE_SIZE, 0u);
+		sizeof(data), histogramBufSize() - sizeof(data), 0u);
+
+	if(statsPipe) {
+		ImageStats stats {};
+		stats.texMin = data.texMin;
+		stats.texMax = data.texMax;
+		dev.dispatch.CmdUpdateBuffer(draw.cb, data_->histogram.buf,
+			statsOffset(), imageStatsHeaderSize, &stats);
+	}
 
 	histBufState.transition(dev, draw.cb, vku::SyncScope::computeReadWrite());
 
-	// skip computeMinMax and Prepare pass and simple CmdUpdateBuffer
-	//   in fixed case. Makes histogramPrepare shader and pcr simpler
-
-	auto w = std::max(extent_.width >> u32(imageDraw_.level), 1u);
-	auto h = std::max(extent_.height >> u32(imageDraw_.level), 1u);
-	auto d = std::max(extent_.depth >> u32(imageDraw_.level), 1u);
-
-	auto layer = imageDraw_.layer;
-	if(imgType_ == VK_IMAGE_TYPE_3D) {
-		if(histogram3DCurrentSlice) {
-			// use current slice, just that
-			d = 1u;
-		} else {
-			// ignore selected slice
-			layer = 0u;
-		}
-	}
-
-	auto computeMinMax = !histogram_.fixedRange;
-	rb.hasMinMax = computeMinMax;
-	if(computeMinMax && computeMinMax_) {
-		// compute minMax
-		DebugLabel cblbl(dev, draw.cb, "vil:ImageViewer:computeMinMax");
+	// Fused statistics: min/max, NaN/Inf counts and mean in one pass.
+	// Computed even for a fixed histogram range, the counts and the
+	// mean are shown independently.
+	if(statsPipe) {
+		DebugLabel cblbl(dev, draw.cb, "vil:ImageViewer:computeStats");
 
 		auto pipeLayout = gui_->imgOpPipeLayout().vkHandle();
-		auto pipe = gui_->pipes().minMaxTex[imageDraw_.type];
-
-		dev.dispatch.CmdBindPipeline(draw.cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipe);
+		dev.dispatch.CmdBindPipeline(draw.cb, VK_PIPELINE_BIND_POINT_COMPUTE, statsPipe);
 		dev.dispatch.CmdBindDescriptorSets(draw.cb,
 			VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout,
-			0u, 1u, &data_->imgOpDs.vkHandle(), 0u, nullptr);
+			0u, 1u, &data_->statsDs.vkHandle(), 0u, nullptr);
 
 		int pcr[] = {
 			int(imageDraw_.level),
 			int(layer),
 			int(histogram_.texelSkip),
+			int(w),
+			int(h),
+			int(d),
 		};
 		dev.dispatch.CmdPushConstants(draw.cb, pipeLayout,
 			VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pcr), pcr);
 
-		dev.dispatch.CmdDispatch(draw.cb,
-			ceilDivide(w, 8u * histogram_.texelSkip),
-			ceilDivide(h, 8u * histogram_.texelSkip),
-			ceilDivide(d, 1u * histogram_.texelSkip));
+		// the shader loops over the texels with a fixed number of groups
+		dev.dispatch.CmdDispatch(draw.cb, ImageStats::numGroups, 1u, 1u);
+
+		if(key.computeMinMax) {
+			// histogramPrepare reads min/max from the HistMetadata
+			histBufState.transition(dev, draw.cb,
+				vku::SyncScope::transferRead() | vku::SyncScope::transferWrite());
+
+			VkBufferCopy copy {};
+			copy.srcOffset = statsOffset();
+			copy.dstOffset = 0u;
+			copy.size = imageStatsMinMaxSize;
+			dev.dispatch.CmdCopyBuffer(draw.cb, data_->histogram.buf,
+				data_->histogram.buf, 1u, &copy);
+		}
 
 		histBufState.transition(dev, draw.cb, vku::SyncScope::computeReadWrite());
+	}
+
+	// skip computeMinMax and Prepare pass and simple CmdUpdateBuffer
+	//   in fixed case. Makes histogramPrepare shader and pcr simpler
+	if(key.computeMinMax) {
+		// compute minMax, unless the fused pass already did
+		if(!statsPipe) {
+			DebugLabel cblbl(dev, draw.cb, "vil:ImageViewer:computeMinMax");
+
+			auto pipeLayout = gui_->imgOpPipeLayout().vkHandle();
+			auto pipe = gui_->pipes().minMaxTex[imageDraw_.type];
+
+			dev.dispatch.CmdBindPipeline(draw.cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipe);
+			dev.dispatch.CmdBindDescriptorSets(draw.cb,
+				VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout,
+				0u, 1u, &data_->imgOpDs.vkHandle(), 0u, nullptr);
+
+			int pcr[] = {
+				int(imageDraw_.level),
+				int(layer),
+				int(histogram_.texelSkip),
+			};
+			dev.dispatch.CmdPushConstants(draw.cb, pipeLayout,
+				VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pcr), pcr);
+
+			dev.dispatch.CmdDispatch(draw.cb,
+				ceilDivide(w, 8u * histogram_.texelSkip),
+				ceilDivide(h, 8u * histogram_.texelSkip),
+				ceilDivide(d, 1u * histogram_.texelSkip));
+
+			histBufState.transition(dev, draw.cb, vku::SyncScope::computeReadWrite());
+		}
 
 		// prepare histogram
-		pipeLayout = gui_->histogramPipeLayout().vkHandle();
-		pipe = gui_->pipes().histogramPrepare;
+		auto pipeLayout = gui_->histogramPipeLayout().vkHandle();
+		auto pipe = gui_->pipes().histogramPrepare;
 
 		struct {
 			u32 channelMask;
@@ -1223,8 +1385,19 @@ VkImageAspectFlagBits defaultAspect(VkImageAspectFlags flags) {
 void ImageViewer::select(VkImage src, VkExtent3D extent, VkImageType imgType,
 		VkFormat format, const VkImageSubresourceRange& subresRange,
 		VkImageLayout initialLayout, VkImageLayout finalLayout,
-		VkSampleCountFlagBits samples, u32 /*Flags*/ flags) {
+		VkSampleCountFlagBits samples, u32 /*Flags*/ flags, u64 contentID) {
+	// When the same contents are selected again (e.g. every frame for
+	// a frozen capture), we can keep the view and the statistics.
+	auto sameContent = data_ && contentID != 0u &&
+		contentID == contentID_ &&
+		src == src_ &&
+		format == format_ &&
+		imgType == imgType_ &&
+		std::memcmp(&subresRange, &subresRange_, sizeof(subresRange)) == 0;
+	auto oldAspect = aspect_;
+
 	src_ = src;
+	contentID_ = contentID;
 	extent_ = extent;
 	imgType_ = imgType;
 	format_ = format;
@@ -1233,6 +1406,7 @@ void ImageViewer::select(VkImage src, VkExtent3D extent, VkImageType imgType,
 	finalImageLayout_ = finalLayout;
 	samples_ = samples;
 	copyTexel_ = useSamplingCopy || (flags & supportsTransferSrc);
+	transferSrc_ = (flags & supportsTransferSrc);
 
 	draw_ = {};
 
@@ -1316,7 +1490,9 @@ void ImageViewer::select(VkImage src, VkExtent3D extent, VkImageType imgType,
 		"imgType {}, format {}, samples {}",
 		vk::name(imgType_), vk::name(format_), vk::name(samples));
 
-	createData();
+	if(!sameContent || aspect_ != oldAspect) {
+		createData();
+	}
 }
 
 void ImageViewer::reset(bool resetZoomPanSelection) {
@@ -1336,6 +1512,7 @@ void ImageViewer::unselect() {
 	src_ = {};
 	draw_ = {};
 	lastReadback_ = {};
+	pyramid_ = {};
 }
 
 void ImageViewer::createData() {
@@ -1344,6 +1521,9 @@ void ImageViewer::createData() {
 	data_.reset(new DrawData());
 	data_->gui = gui_;
 
+	// The pyramid is kept, drawImageArea checks whether it still fits
+	pyramidFailed_ = false;
+
 	VkImageViewCreateInfo ivi {};
 	ivi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	ivi.image = src_;
@@ -1360,23 +1540,181 @@ void ImageViewer::createData() {
 	vku::DescriptorUpdate(data_->drawDs)
 		(data_->view.vkHandle(), dev.nearestSampler);
 
-	data_->histogram.ensure(dev, histogramBufSize(),
+	data_->histogram.ensure(dev, statsOffset() + sizeof(ImageStats),
 		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, {}, "ImageViewer:hist",
 		OwnBuffer::Type::deviceLocal);
+
+	// histogram.comp derives the number of buckets from the bound range
+	auto histSpan = data_->histogram.asSpan(0u, histogramBufSize());
 	data_->imgOpDs = gui_->allocDs(gui_->imgOpDsLayout(), "ImageViewer:histImgOp");
 	vku::DescriptorUpdate(data_->imgOpDs)
-		(data_->histogram.asSpan())
+		(histSpan)
 		(data_->view.vkHandle(), dev.nearestSampler);
 
 	data_->histDs = gui_->allocDs(gui_->histogramDsLayout(), "ImageViewer:hist");
 	vku::DescriptorUpdate(data_->histDs)
-		(data_->histogram.asSpan());
+		(histSpan);
+
+	data_->statsDs = gui_->allocDs(gui_->imgOpDsLayout(), "ImageViewer:stats");
+	vku::DescriptorUpdate(data_->statsDs)
+		(data_->histogram.asSpan(statsOffset(), sizeof(ImageStats)))
+		(data_->view.vkHandle(), dev.nearestSampler);
 
 	imageDraw_.ds = data_->drawDs.vkHandle();
 }
 
+bool ImageViewer::pyramidSupported() const {
+	// Without stable contents we would have to rebuild it every frame,
+	// that would cost more than sampling the source directly.
+	if(!contentID_ || !transferSrc_ || pyramidFailed_) {
+		return false;
+	}
+
+	// Keep it simple, only what blits can downsample with a linear filter.
+	if(imgType_ != VK_IMAGE_TYPE_2D || samples_ != VK_SAMPLE_COUNT_1_BIT ||
+			aspect_ != VK_IMAGE_ASPECT_COLOR_BIT ||
+			!FormatIsSampledFloat(format_)) {
+		return false;
+	}
+
+	auto& dev = gui_->dev();
+	VkFormatProperties formatProps {};
+	dev.ini->dispatch.GetPhysicalDeviceFormatProperties(dev.phdev,
+		format_, &formatProps);
+	auto needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+		VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (formatProps.optimalTilingFeatures & needed) == needed;
+}
+
+void ImageViewer::createPyramid(u32 level, u32 layer) {
+	ZoneScoped;
+
+	auto& dev = gui_->dev();
+	pyramid_ = {};
+
+	auto w = std::max(extent_.width >> level, 1u);
+	auto h = std::max(extent_.height >> level, 1u);
+	if(w < 4u || h < 4u) {
+		// no 1D pyramids, would need a different image type
+		return;
+	}
+
+	VkExtent3D extent {w / 2u, h / 2u, 1u};
+	auto levels = 1u;
+	while((std::max(extent.width, extent.height) >> levels) > 0u) {
+		++levels;
+	}
+
+	IntrusivePtr<Pyramid> pyramid(new Pyramid());
+	pyramid->format = format_;
+	pyramid->level = level;
+	pyramid->layer = layer;
+	if(!pyramid->image.init(dev, format_, extent, 1u, levels,
+			VK_IMAGE_ASPECT_COLOR_BIT, gui_->usedQueue().family,
+			VK_SAMPLE_COUNT_1_BIT)) {
+		// don't try again every frame
+		pyramidFailed_ = true;
+		return;
+	}
+
+	VkImageViewCreateInfo ivi {};
+	ivi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ivi.image = pyramid->image.image;
+	ivi.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	ivi.format = format_;
+	ivi.subresourceRange = pyramid->image.subresRange();
+	pyramid->view = {dev, ivi, "ImageViewer:pyramidView"};
+
+	// Linear filtering inside a level, the level itself is chosen
+	// by us to be at most two times minified.
+	pyramid->ds = gui_->allocDs(gui_->imguiDsLayout(), "ImageViewer:pyramid");
+	vku::DescriptorUpdate(pyramid->ds)
+		(pyramid->view.vkHandle(), dev.linearSampler);
+
+	pyramid_ = std::move(pyramid);
+}
+
+void ImageViewer::buildPyramid(Draw& draw, vku::LocalImageState& srcState) {
+	ZoneScoped;
+
+	auto& dev = gui_->dev();
+	DebugLabel cblbl(dev, draw.cb, "vil:ImageViewer:buildPyramid");
+
+	dlg_assert(pyramid_ && pyramid_->builtContent != contentID_);
+	auto& pyr = *pyramid_;
+	auto dst = pyr.image.image;
+
+	srcState.transition(dev, draw.cb, vku::SyncScope::transferRead());
+
+	// When rebuilding, draws of previous frames might still sample it.
+	// They were submitted earlier to the same queue.
+	auto range = pyr.image.subresRange();
+	auto discardStage = pyr.builtContent ?
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT :
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	vku::cmdBarrier(dev, draw.cb, dst, vku::SyncScope::discard(discardStage),
+		vku::SyncScope::transferWrite(), range);
+
+	// Every level is blitted from the previous one, the first one
+	// from the viewed level of the source.
+	auto blitSrc = src_;
+	auto srcSubres = VkImageSubresourceLayers {VK_IMAGE_ASPECT_COLOR_BIT,
+		pyr.level, pyr.layer, 1u};
+	auto srcW = std::max(extent_.width >> pyr.level, 1u);
+	auto srcH = std::max(extent_.height >> pyr.level, 1u);
+
+	for(auto i = 0u; i < pyr.image.levelCount; ++i) {
+		auto dstW = std::max(pyr.image.extent.width >> i, 1u);
+		auto dstH = std::max(pyr.image.extent.height >> i, 1u);
+
+		VkImageBlit blit {};
+		blit.srcSubresource = srcSubres;
+		blit.srcOffsets[1] = {int(srcW), int(srcH), 1};
+		blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0u, 1u};
+		blit.dstOffsets[1] = {int(dstW), int(dstH), 1};
+
+		dev.dispatch.CmdBlitImage(draw.cb,
+			blitSrc, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1u, &blit, VK_FILTER_LINEAR);
+
+		if(i + 1 < pyr.image.levelCount) {
+			auto levelRange = VkImageSubresourceRange {
+				VK_IMAGE_ASPECT_COLOR_BIT, i, 1u, 0u, 1u};
+			vku::cmdBarrier(dev, draw.cb, dst, vku::SyncScope::transferWrite(),
+				vku::SyncScope::transferRead(), levelRange);
+		}
+
+		blitSrc = dst;
+		srcSubres = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0u, 1u};
+		srcW = dstW;
+		srcH = dstH;
+	}
+
+	// All levels but the last one were blit sources
+	auto last = pyr.image.levelCount - 1;
+	vku::ImageBarrier barriers[2];
+	barriers[0].image = dst;
+	barriers[0].src = vku::SyncScope::transferWrite();
+	barriers[0].dst = vku::SyncScope::fragmentRead();
+	barriers[0].subres = {VK_IMAGE_ASPECT_COLOR_BIT, last, 1u, 0u, 1u};
+
+	auto barrierCount = 1u;
+	if(last > 0u) {
+		barriers[1].image = dst;
+		barriers[1].src = vku::SyncScope::transferRead();
+		barriers[1].dst = vku::SyncScope::fragmentRead();
+		barriers[1].subres = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, last, 0u, 1u};
+		++barrierCount;
+	}
+
+	vku::cmdBarrier(dev, draw.cb, {barriers, barrierCount});
+	pyr.builtContent = contentID_;
+}
+
 void ImageViewer::validateClampCoords(Vec3i& coords, u32& layer, u32& level) {
 	// things here shouldn't go wrong (but often did end up to somehow
 	// in the past) and assertions should be fixed.
@@ -1403,6 +1741,12 @@ u32 ImageViewer::histogramBufSize() {
 	return sizeof(HistMetadata) + sizeof(Vec4u32) * histogramSections;
 }
 
+u32 ImageViewer::statsOffset() {
+	// must be usable as storage buffer offset, 256 is the maximum
+	// minStorageBufferOffsetAlignment allowed by the spec.
+	return align(histogramBufSize(), 256u);
+}
+
 void ImageViewer::saveToFile() {
 	// TODO:
 	// - make async? just integrate into frame submission?
@@ -3,6 +3,7 @@
 #include <fwd.hpp>
 #include <nytl/vec.hpp>
 #include <gui/render.hpp>
+#include <commandHook/state.hpp>
 #include <vkutil/dynds.hpp>
 #include <optional>
 
@@ -36,10 +37,16 @@ public:
 	// - finalLayout: the layout the image should have afterwards
 	// - tryPreserveSelected: Whether the old selection (zoom/pan, aspect,
 	//   min/max/layer) should be preserved, if possible.
+	// - contentID: identifies the contents of the image. When non-zero and
+	//   equal to the contentID of the previous selection of the same
+	//   image, the contents are assumed to be unchanged and the image
+	//   view and computed statistics (min/max, histogram) are reused.
+	//   Zero means the contents might change at any time, e.g. for
+	//   images of the application.
 	void select(VkImage, VkExtent3D, VkImageType, VkFormat,
 		const VkImageSubresourceRange&, VkImageLayout initialLayout,
 		VkImageLayout finalLayout, VkSampleCountFlagBits samples,
-		u32 /*Flags*/ flags);
+		u32 /*Flags*/ flags, u64 contentID = 0u);
 
 	void reset(bool resetZoomPanSelection);
 	void unselect();
@@ -53,6 +60,7 @@ private:
 		Draw* pending {};
 
 		bool hasMinMax {};
+		bool hasStats {}; // whether the ImageStats were computed
 		bool valid {};
 		VkOffset2D texel {};
 		float layer {};
@@ -62,6 +70,30 @@ private:
 		vku::DynDs opDS {};
 	};
 
+	// The parameters the statistics in DrawData::histogram were computed
+	// with. As long as they don't change, we don't have to dispatch
+	// the minmax/histogram passes again.
+	struct StatsKey {
+		u64 contentID {};
+		u32 level {};
+		u32 layer {};
+		u32 depth {}; // number of 3D slices
+		u32 texelSkip {};
+		bool computeMinMax {};
+		bool fixedRange {};
+		float begin {};
+		float end {};
+
+		bool operator==(const StatsKey& o) const {
+			return contentID == o.contentID && level == o.level &&
+				layer == o.layer && depth == o.depth &&
+				texelSkip == o.texelSkip &&
+				computeMinMax == o.computeMinMax &&
+				fixedRange == o.fixedRange &&
+				begin == o.begin && end == o.end;
+		}
+	};
+
 	// Called during recording before the image is rendered via imgui.
 	// Will perform transitions, if needed, and draw the display area background.
 	void recordPreImage(Draw& draw, Readback& rb);
@@ -84,6 +116,13 @@ private:
 
 	void createData();
 
+	// Whether the current image can be shown through a downsampled pyramid.
+	bool pyramidSupported() const;
+	// Creates (but doesn't record the building of) the pyramid for the
+	// given level/layer of src_. Leaves pyramid_ empty on failure.
+	void createPyramid(u32 level, u32 layer);
+	void buildPyramid(Draw& draw, vku::LocalImageState& srcState);
+
 	void drawImageArea(Draw& draw);
 
 	void drawImageInfoTable(Draw& draw);
@@ -92,6 +131,7 @@ private:
 
 	void validateClampCoords(Vec3i& coords, u32& layer, u32& level);
 	static u32 histogramBufSize();
+	static u32 statsOffset();
 
 	void saveToFile();
 
@@ -121,9 +161,11 @@ private:
 	float scale_ {1.f};
 
 	VkImage src_ {};
+	u64 contentID_ {};
 	VkImageLayout initialImageLayout_ {};
 	VkImageLayout finalImageLayout_ {};
 	bool copyTexel_ {true};
+	bool transferSrc_ {};
 
 	// drawing data
 	// reference-counted image view and descriptor set because we need
@@ -135,6 +177,7 @@ private:
 		vku::DynDs drawDs {}; // for drawing the image
 		vku::DynDs imgOpDs {}; // for computing histogram
 		vku::DynDs histDs {}; // operations on the histogram
+		vku::DynDs statsDs {}; // for computing the ImageStats
 		std::atomic<u32> refCount {};
 
 		// layout:
@@ -145,11 +188,39 @@ private:
 		// - float end
 		// - uint maxHist (written by histogramMax.comp)
 		// - uvec4 hist[numBins] (written by histogram.comp)
+		// - ImageStats at statsOffset() (written by imageStats.comp)
 		OwnBuffer histogram;
+		// Set when histogram holds valid statistics.
+		// Only accessed while recording.
+		std::optional<StatsKey> stats;
 	};
 
 	IntrusivePtr<DrawData> data_;
 
+	// Downsampled copy of one level/layer of the viewed image, used to draw
+	// it when it's minified. Sampling the full-resolution level then
+	// would alias and cost bandwidth proportional to the source size.
+	// Built via a blit chain whenever the viewed content changes, see
+	// contentID in select. Level 0 has half the size of the viewed level.
+	// Reference-counted like DrawData.
+	struct Pyramid {
+		CopiedImage image;
+		vku::ImageView view {};
+		vku::DynDs ds {};
+		VkFormat format {};
+		u32 level {}; // level of src_ this was built from
+		u32 layer {}; // layer of src_ this was built from
+		// The contentID of src_ the building was last recorded for.
+		// Zero if it was never built. When only the contents change, the
+		// image is kept and just the blits are recorded again.
+		u64 builtContent {};
+		std::atomic<u32> refCount {};
+	};
+
+	IntrusivePtr<Pyramid> pyramid_;
+	bool pyramidFailed_ {}; // reset on new content
+	DrawGuiImage pyramidDraw_ {};
+
 	struct {
 		Vec2f offset {};
 		Vec2f size {};
@@ -62,6 +62,24 @@
 #include <histogram.comp.u3D.spv.h>
 #include <histogram.comp.i3D.spv.h>
 
+// The fused statistics shader has no prebuilt version yet. Without
+// glslang, the image viewer falls back to the separate minmax pass.
+#if __has_include(<imageStats.comp.2DArray.spv.h>)
+	#define VIL_IMAGE_STATS_SHADER
+	#include <imageStats.comp.1DArray.spv.h>
+	#include <imageStats.comp.u1DArray.spv.h>
+	#include <imageStats.comp.i1DArray.spv.h>
+	#include <imageStats.comp.2DArray.spv.h>
+	#include <imageStats.comp.u2DArray.spv.h>
+	#include <imageStats.comp.i2DArray.spv.h>
+	#include <imageStats.comp.2DMSArray.spv.h>
+	#include <imageStats.comp.u2DMSArray.spv.h>
+	#include <imageStats.comp.i2DMSArray.spv.h>
+	#include <imageStats.comp.3D.spv.h>
+	#include <imageStats.comp.u3D.spv.h>
+	#include <imageStats.comp.i3D.spv.h>
+#endif // __has_include
+
 #include <histogramMax.comp.spv.h>
 #include <histogramPost.comp.spv.h>
 #include <histogramPrepare.comp.spv.h>
@@ -420,7 +438,7 @@ void initPipes(Device& dev,
 		},
 	};
 
-	for(auto& creation : creations) {
+	auto createPipes = [&](const PipeCreation& creation) {
 		for(auto& spv : creation.spvs) {
 			dlg_assert(!creation.spvs.empty());
 			addCpi(creation.layout, spv);
@@ -429,8 +447,31 @@ void initPipes(Device& dev,
 		VK_CHECK(dev.dispatch.CreateComputePipelines(dev.handle, VK_NULL_HANDLE,
 			u32(cpis.size()), cpis.data(), nullptr, creation.dst.data()));
 		cpis.clear();
+	};
+
+	for(auto& creation : creations) {
+		createPipes(creation);
 	}
 
+#ifdef VIL_IMAGE_STATS_SHADER
+	createPipes(PipeCreation {
+		dstPipes.imageStatsTex, imgOpPipeLayout, {
+			imageStats_comp_u1DArray_spv_data,
+			imageStats_comp_u2DArray_spv_data,
+			imageStats_comp_u2DMSArray_spv_data,
+			imageStats_comp_u3D_spv_data,
+			imageStats_comp_i1DArray_spv_data,
+			imageStats_comp_i2DArray_spv_data,
+			imageStats_comp_i2DMSArray_spv_data,
+			imageStats_comp_i3D_spv_data,
+			imageStats_comp_1DArray_spv_data,
+			imageStats_comp_2DArray_spv_data,
+			imageStats_comp_2DMSArray_spv_data,
+			imageStats_comp_3D_spv_data,
+		}
+	});
+#endif // VIL_IMAGE_STATS_SHADER
+
 	// histogram pipes
 	{
 		addCpi(histogramPipeLayout, histogramPrepare_comp_spv_data);
@@ -0,0 +1,450 @@
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+	#define IMGUI_DEFINE_MATH_OPERATORS
+#endif // IMGUI_DEFINE_MATH_OPERATORS
+
+#include <gui/profiler.hpp>
+#include <gui/gui.hpp>
+#include <gui/util.hpp>
+#include <commandHook/hook.hpp>
+#include <command/commands.hpp>
+#include <device.hpp>
+#include <pipe.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+#include <util/lockProfiler.hpp>
+#include <imgui/imgui.h>
+#include <imgui/imgui_internal.h>
+#include <unordered_map>
+
+namespace vil {
+
+namespace {
+
+float toMs(u64 ns) {
+	return ns / (1000.f * 1000.f);
+}
+
+float toUs(u64 ns) {
+	return ns / 1000.f;
+}
+
+std::string_view fileName(std::string_view path) {
+	auto pos = path.find_last_of("/\\");
+	return pos == path.npos ? path : path.substr(pos + 1);
+}
+
+// Whether the lock was taken by the gui itself. All other sites are
+// either api calls of the application or layer-internal threads.
+bool isGuiSite(const LockSite& site) {
+	std::string_view file = site.file ? site.file : "";
+	return file.find("/gui/") != file.npos || file.find("\\gui\\") != file.npos;
+}
+
+bool isSection(const Command& cmd) {
+	return cmd.type() == CommandType::beginDebugUtilsLabel ||
+		cmd.type() == CommandType::beginRenderPass ||
+		cmd.type() == CommandType::beginRendering;
+}
+
+ImU32 timelineColor(const Command& cmd) {
+	switch(cmd.category()) {
+		case CommandCategory::draw: return IM_COL32(70, 110, 190, 255);
+		case CommandCategory::dispatch: return IM_COL32(200, 120, 50, 255);
+		case CommandCategory::traceRays: return IM_COL32(150, 80, 180, 255);
+		case CommandCategory::transfer: return IM_COL32(70, 160, 90, 255);
+		case CommandCategory::buildAccelStruct: return IM_COL32(170, 160, 60, 255);
+		default: return IM_COL32(90, 90, 90, 255);
+	}
+}
+
+} // anon namespace
+
+ProfilerGui::~ProfilerGui() = default;
+
+void ProfilerGui::init(Gui& gui) {
+	gui_ = &gui;
+}
+
+void ProfilerGui::draw(Draw&) {
+	ZoneScoped;
+
+	if(ImGui::BeginTabBar("ProfilerKind")) {
+		if(ImGui::BeginTabItem("GPU Frame")) {
+			drawGpu();
+			ImGui::EndTabItem();
+		}
+
+		if(ImGui::BeginTabItem("Locks")) {
+			drawLocks();
+			ImGui::EndTabItem();
+		}
+
+		ImGui::EndTabBar();
+	}
+}
+
+void ProfilerGui::drawGpu() {
+	auto& profiler = gui_->dev().commandHook->profiler;
+
+	auto interval = profiler.sampleInterval.load();
+	auto enabled = interval != 0u;
+	if(ImGui::Checkbox("Enable", &enabled)) {
+		interval = enabled ? 1u : 0u;
+		profiler.sampleInterval = interval;
+	}
+
+	if(gui_->showHelp && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Re-records all submitted command buffers of the "
+			"sampled frames with timestamps around each command.\n"
+			"This has an overhead for the sampled frames.");
+	}
+
+	if(enabled) {
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(150.f);
+		int sliderInterval = int(interval);
+		if(ImGui::SliderInt("Sample Interval", &sliderInterval, 1, 120)) {
+			profiler.sampleInterval = u32(std::max(sliderInterval, 1));
+		}
+
+		if(gui_->showHelp && ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Only every n-th frame is profiled");
+		}
+	}
+
+	ImGui::SameLine();
+	ImGui::Checkbox("Freeze", &freeze_);
+
+	// Always retrieve the completed profiles, even when frozen.
+	// Destroying them here (outside of the device mutex) is intended.
+	auto profiles = profiler.moveCompleted();
+	if(!freeze_ && !profiles.empty()) {
+		profile_ = std::move(profiles.back());
+		updateAggregates();
+	}
+
+	if(profile_.records.empty()) {
+		ImGui::Text("No profiled frame available");
+		return;
+	}
+
+	imGuiText("Frame {}: {} records, {} commands, {} ms on the GPU",
+		profile_.frameID, profile_.records.size(),
+		profile_.commands.size(), toMs(profile_.end - profile_.start));
+
+	if(ImGui::BeginTabBar("ProfilerTabs")) {
+		if(ImGui::BeginTabItem("Timeline")) {
+			drawTimeline();
+			ImGui::EndTabItem();
+		}
+
+		if(ImGui::BeginTabItem("Sections")) {
+			drawSections();
+			ImGui::EndTabItem();
+		}
+
+		if(ImGui::BeginTabItem("Pipelines")) {
+			drawPipelines();
+			ImGui::EndTabItem();
+		}
+
+		ImGui::EndTabBar();
+	}
+}
+
+void ProfilerGui::updateAggregates() {
+	ZoneScoped;
+
+	sections_.clear();
+	pipelines_.clear();
+
+	std::unordered_map<std::string, u32> sectionIDs;
+	std::unordered_map<const Pipeline*, u32> pipeIDs;
+
+	auto add = [](Aggregate& agg, const ProfiledCommand& cmd) {
+		auto duration = cmd.end - cmd.begin;
+		++agg.count;
+		agg.total += duration;
+		agg.max = std::max(agg.max, duration);
+	};
+
+	for(auto& cmd : profile_.commands) {
+		dlg_assert(cmd.command);
+
+		if(isSection(*cmd.command)) {
+			// the path of all profiled ancestors identifies the section
+			std::string path(cmd.command->nameDesc());
+			for(auto parent = cmd.parent; parent != u32(-1);) {
+				auto& pcmd = profile_.commands[parent];
+				path = dlg::format("{} / {}", pcmd.command->nameDesc(), path);
+				parent = pcmd.parent;
+			}
+
+			auto [it, emplaced] = sectionIDs.try_emplace(path, u32(sections_.size()));
+			if(emplaced) {
+				sections_.emplace_back().name = std::move(path);
+			}
+
+			add(sections_[it->second], cmd);
+		} else if(isStateCmd(*cmd.command)) {
+			auto& scmd = static_cast<const StateCmdBase&>(*cmd.command);
+			auto* pipe = scmd.boundPipe();
+
+			auto [it, emplaced] = pipeIDs.try_emplace(pipe, u32(pipelines_.size()));
+			if(emplaced) {
+				pipelines_.emplace_back().name = pipe ? name(*pipe) : "<no pipeline>";
+			}
+
+			add(pipelines_[it->second], cmd);
+		}
+	}
+
+	auto cmp = [](const Aggregate& a, const Aggregate& b) {
+		return a.total > b.total;
+	};
+
+	std::sort(sections_.begin(), sections_.end(), cmp);
+	std::sort(pipelines_.begin(), pipelines_.end(), cmp);
+}
+
+void ProfilerGui::drawTimeline() {
+	ImGui::SetNextItemWidth(150.f);
+	ImGui::SliderFloat("Zoom", &zoom_, 1.f, 64.f, "%.1f",
+		ImGuiSliderFlags_Logarithmic);
+
+	const auto duration = std::max<u64>(profile_.end - profile_.start, 1u);
+	const auto rowHeight = ImGui::GetTextLineHeightWithSpacing();
+	const auto textCol = ImGui::GetColorU32(ImGuiCol_Text);
+	const auto sepCol = ImGui::GetColorU32(ImGuiCol_Separator);
+
+	ImGui::BeginChild("Timeline", ImVec2(0, 0), true,
+		ImGuiWindowFlags_HorizontalScrollbar);
+
+	auto& dl = *ImGui::GetWindowDrawList();
+	const auto width = ImGui::GetContentRegionAvail().x * zoom_;
+	const auto start = ImGui::GetCursorScreenPos();
+	const auto mouse = ImGui::GetIO().MousePos;
+
+	const ProfiledCommand* hovered {};
+	const ProfiledRecord* hoveredRecord {};
+	auto y = start.y;
+
+	for(auto& rec : profile_.records) {
+		auto maxDepth = 0u;
+		auto cmds = span<const ProfiledCommand>(profile_.commands).subspan(
+			rec.firstCommand, rec.commandCount);
+		for(auto& cmd : cmds) {
+			maxDepth = std::max(maxDepth, cmd.depth);
+
+			auto x0 = start.x + float(width * (double(cmd.begin) / duration));
+			auto x1 = start.x + float(width * (double(cmd.end) / duration));
+			x1 = std::max(x1, x0 + 1.f);
+
+			auto y0 = y + cmd.depth * rowHeight;
+			auto y1 = y0 + rowHeight - 1.f;
+
+			dl.AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1),
+				timelineColor(*cmd.command));
+
+			// only draw the name if there is enough space for a couple
+			// of characters
+			if(x1 - x0 > 20.f) {
+				auto label = cmd.command->nameDesc();
+				dl.PushClipRect(ImVec2(x0, y0), ImVec2(x1, y1), true);
+				dl.AddText(ImVec2(x0 + 2.f, y0), textCol,
+					label.data(), label.data() + label.size());
+				dl.PopClipRect();
+			}
+
+			if(mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1) {
+				hovered = &cmd;
+				hoveredRecord = &rec;
+			}
+		}
+
+		y += (maxDepth + 1) * rowHeight + 2.f;
+		dl.AddLine(ImVec2(start.x, y), ImVec2(start.x + width, y), sepCol);
+		y += 2.f;
+	}
+
+	ImGui::Dummy(ImVec2(width, y - start.y));
+
+	if(hovered && ImGui::IsWindowHovered()) {
+		ImGui::BeginTooltip();
+		imGuiText("{}", hovered->command->toString());
+		imGuiText("Time: {} ms", toMs(hovered->end - hovered->begin));
+		imGuiText("Start: {} ms", toMs(hovered->begin));
+
+		dlg_assert(hoveredRecord);
+		auto& rec = *hoveredRecord->record;
+		imGuiText("Record: {}", rec.cbName ? rec.cbName : "<unnamed>");
+		imGuiText("Submission: {}", hoveredRecord->submissionID);
+		ImGui::EndTooltip();
+	}
+
+	ImGui::EndChild();
+}
+
+void ProfilerGui::drawSections() {
+	auto flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders |
+		ImGuiTableFlags_ScrollY;
+	if(!ImGui::BeginTable("Sections", 5, flags)) {
+		return;
+	}
+
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableSetupColumn("Section");
+	ImGui::TableSetupColumn("Count");
+	ImGui::TableSetupColumn("Total");
+	ImGui::TableSetupColumn("Average");
+	ImGui::TableSetupColumn("Max");
+	ImGui::TableHeadersRow();
+
+	for(auto& section : sections_) {
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		imGuiText("{}", section.name);
+		ImGui::TableNextColumn();
+		imGuiText("{}", section.count);
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(section.total));
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(section.total / section.count));
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(section.max));
+	}
+
+	ImGui::EndTable();
+}
+
+void ProfilerGui::drawPipelines() {
+	auto flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders |
+		ImGuiTableFlags_ScrollY;
+	if(!ImGui::BeginTable("Pipelines", 5, flags)) {
+		return;
+	}
+
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableSetupColumn("Pipeline");
+	ImGui::TableSetupColumn("Commands");
+	ImGui::TableSetupColumn("Total");
+	ImGui::TableSetupColumn("Average");
+	ImGui::TableSetupColumn("Max");
+	ImGui::TableHeadersRow();
+
+	for(auto& pipe : pipelines_) {
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		imGuiText("{}", pipe.name);
+		ImGui::TableNextColumn();
+		imGuiText("{}", pipe.count);
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(pipe.total));
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(pipe.total / pipe.count));
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(pipe.max));
+	}
+
+	ImGui::EndTable();
+}
+
+void ProfilerGui::drawLocks() {
+	auto enabled = lockProfilerEnabled.load();
+	if(ImGui::Checkbox("Enable", &enabled)) {
+		lockProfilerEnabled.store(enabled);
+	}
+
+	if(gui_->showHelp && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Records acquisition count, contention and wait/hold\n"
+			"times for all layer mutexes, per call site.\n"
+			"Has a small overhead for every lock while enabled.");
+	}
+
+	ImGui::SameLine();
+	ImGui::Checkbox("Freeze", &freezeLocks_);
+
+	ImGui::SameLine();
+	if(ImGui::Button("Reset")) {
+		resetLockProfiler();
+	}
+
+	if(!freezeLocks_) {
+		lockStats_ = lockProfilerStats();
+	}
+
+	if(lockStats_.empty()) {
+		ImGui::Text("No lock statistics available");
+		return;
+	}
+
+	// How long the gui held locks vs how long everyone else had to wait.
+	// The waits of application threads are the stalls the gui (and the
+	// rest of the layer) causes.
+	auto guiHold = u64(0u);
+	auto guiHoldMax = u64(0u);
+	auto otherWait = u64(0u);
+	auto otherWaitMax = u64(0u);
+	for(auto& stats : lockStats_) {
+		if(isGuiSite(stats.site)) {
+			guiHold += stats.holdTotal;
+			guiHoldMax = std::max(guiHoldMax, stats.holdMax);
+		} else {
+			otherWait += stats.waitTotal;
+			otherWaitMax = std::max(otherWaitMax, stats.waitMax);
+		}
+	}
+
+	imGuiText("Gui holding locks: {} ms (max {} us)", toMs(guiHold), toUs(guiHoldMax));
+	imGuiText("Other threads waiting: {} ms (max {} us)", toMs(otherWait), toUs(otherWaitMax));
+	if(gui_->showHelp && ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Total time spent waiting for locks at sites outside\n"
+			"the gui, e.g. application threads stalled in api calls.");
+	}
+
+	auto flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders |
+		ImGuiTableFlags_ScrollY;
+	if(!ImGui::BeginTable("Locks", 8, flags)) {
+		return;
+	}
+
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableSetupColumn("Site");
+	ImGui::TableSetupColumn("Mode");
+	ImGui::TableSetupColumn("Count");
+	ImGui::TableSetupColumn("Contended");
+	ImGui::TableSetupColumn("Wait Total");
+	ImGui::TableSetupColumn("Wait Max");
+	ImGui::TableSetupColumn("Hold Total");
+	ImGui::TableSetupColumn("Hold Max");
+	ImGui::TableHeadersRow();
+
+	for(auto& stats : lockStats_) {
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		imGuiText("{}:{}", fileName(stats.site.file), stats.site.line);
+		if(ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("%s\n%s:%u", stats.site.function,
+				stats.site.file, stats.site.line);
+		}
+
+		ImGui::TableNextColumn();
+		imGuiText("{}", stats.shared ? "shared" : "exclusive");
+		ImGui::TableNextColumn();
+		imGuiText("{}", stats.acquisitions);
+		ImGui::TableNextColumn();
+		imGuiText("{}", stats.contended);
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(stats.waitTotal));
+		ImGui::TableNextColumn();
+		imGuiText("{} us", toUs(stats.waitMax));
+		ImGui::TableNextColumn();
+		imGuiText("{} ms", toMs(stats.holdTotal));
+		ImGui::TableNextColumn();
+		imGuiText("{} us", toUs(stats.holdMax));
+	}
+
+	ImGui::EndTable();
+}
+
+} // namespace vil
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <commandHook/profiler.hpp>
+#include <util/lockProfiler.hpp>
+#include <string>
+#include <vector>
+
+namespace vil {
+
+// Displays the results of the whole-frame GpuProfiler and the
+// lock contention profiler.
+class ProfilerGui {
+public:
+	ProfilerGui() = default;
+	~ProfilerGui();
+
+	void init(Gui& gui);
+	void draw(Draw& draw);
+
+private:
+	void drawGpu();
+	void drawLocks();
+	void updateAggregates();
+	void drawTimeline();
+	void drawSections();
+	void drawPipelines();
+
+private:
+	// Time spent in a label section, render pass or pipeline, summed
+	// over all its occurrences in the profiled frame.
+	struct Aggregate {
+		std::string name;
+		u32 count {};
+		u64 total {}; // ns
+		u64 max {}; // ns
+	};
+
+	Gui* gui_ {};
+	FrameProfile profile_;
+	bool freeze_ {};
+	float zoom_ {1.f};
+
+	std::vector<Aggregate> sections_;
+	std::vector<Aggregate> pipelines_;
+
+	std::vector<LockSiteStats> lockStats_;
+	bool freezeLocks_ {};
+};
+
+} // namespace vil
@@ -1,11 +1,14 @@
 #include <gui/render.hpp>
 #include <gui/gui.hpp>
 #include <util/util.hpp>
+#include <util/allocation.hpp>
+#include <util/profiling.hpp>
 #include <device.hpp>
 #include <queue.hpp>
 #include <imgui/imgui.h>
 #include <vk/format_utils.h>
 #include <commandHook/state.hpp>
+#include <optional>
 
 namespace vil {
 
@@ -78,6 +81,109 @@ Draw::~Draw() {
 	// dev->dispatch.FreeCommandBuffers(dev->handle, commandPool, ...)
 }
 
+// StagingRing
+void StagingRing::init(Device& dev, VkDeviceSize size, VkBufferUsageFlags usage) {
+	dev_ = &dev;
+	usage_ = usage;
+	grow(size);
+}
+
+StagingRing::Alloc StagingRing::alloc(VkDeviceSize size, VkDeviceSize alignment) {
+	ZoneScoped;
+	dlg_assert(dev_);
+
+	std::lock_guard lock(mutex_);
+
+	auto tryAlloc = [&]() -> std::optional<VkDeviceSize> {
+		auto pos = head_ % buf_.size;
+		auto start = align(pos, alignment);
+		auto newHead = head_ + (start - pos);
+		if(start + size > buf_.size) {
+			// skip the rest of the buffer, wrap around
+			newHead = head_ + (buf_.size - pos);
+			start = 0u;
+		}
+
+		newHead += size;
+		if(newHead - tail_ > buf_.size) {
+			return std::nullopt;
+		}
+
+		head_ = newHead;
+		return start;
+	};
+
+	auto offset = tryAlloc();
+	if(!offset) {
+		grow(size + alignment);
+		offset = tryAlloc();
+		dlg_assert(offset);
+	}
+
+	return {buf_.buf, *offset, buf_.map + *offset};
+}
+
+u64 StagingRing::endFrame() {
+	std::lock_guard lock(mutex_);
+
+	auto id = ++frameCounter_;
+	frames_.push_back({id, gen_, head_, false});
+
+	buf_.flushMap();
+	for(auto& retired : retired_) {
+		if(retired.lastFrame == id) {
+			retired.buf.flushMap();
+		}
+	}
+
+	return id;
+}
+
+void StagingRing::release(u64 frameID) {
+	if(frameID == 0u) {
+		return;
+	}
+
+	std::lock_guard lock(mutex_);
+
+	auto it = std::find_if(frames_.begin(), frames_.end(),
+		[&](auto& frame) { return frame.id == frameID; });
+	dlg_assert_or(it != frames_.end(), return);
+	dlg_assert(!it->released);
+	it->released = true;
+
+	// Frames are usually released in order but we can't rely on it
+	while(!frames_.empty() && frames_.front().released) {
+		auto& front = frames_.front();
+		if(front.gen == gen_) {
+			tail_ = front.end;
+		}
+
+		frames_.pop_front();
+	}
+
+	auto firstUsed = frames_.empty() ? frameCounter_ + 1 : frames_.front().id;
+	auto newEnd = std::remove_if(retired_.begin(), retired_.end(),
+		[&](auto& retired) { return retired.lastFrame < firstUsed; });
+	retired_.erase(newEnd, retired_.end());
+}
+
+void StagingRing::grow(VkDeviceSize minSize) {
+	auto newSize = std::max(2 * buf_.size, minSize);
+	dlg_debug("StagingRing: growing to {} bytes", newSize);
+
+	if(buf_.buf) {
+		// The current frame might already use the buffer
+		retired_.push_back({std::move(buf_), frameCounter_ + 1});
+	}
+
+	buf_ = {};
+	buf_.ensure(*dev_, newSize, usage_, {}, "StagingRing");
+	++gen_;
+	head_ = 0u;
+	tail_ = 0u;
+}
+
 // RenderBuffer
 void RenderBuffer::init(Device& dev, VkImage img, VkFormat format,
 		VkExtent2D extent, VkRenderPass rp, VkImageView depthView) {
@@ -7,15 +7,80 @@
 #include <vk/vulkan.h>
 #include <imgui/imgui.h>
 #include <vector>
+#include <deque>
+#include <mutex>
 
 namespace vil {
 
+// Persistently mapped, host-visible ring buffer for data the gui writes
+// each frame, e.g. the ImGui geometry. Allocations are grouped into frames
+// that are released together once the gpu is done with them, so at steady
+// state no memory is allocated.
+// When an allocation does not fit anymore, a larger buffer is created.
+// The old one is kept alive until all frames that used it were released.
+// Internally synchronized, frames might be released from any thread,
+// see Gui::finishedLocked.
+struct StagingRing {
+	struct Alloc {
+		VkBuffer buf {};
+		VkDeviceSize offset {};
+		std::byte* data {};
+	};
+
+	void init(Device& dev, VkDeviceSize size, VkBufferUsageFlags usage);
+
+	// Allocates the given number of bytes for the current frame.
+	// The returned memory can be written until endFrame is called.
+	Alloc alloc(VkDeviceSize size, VkDeviceSize alignment);
+
+	// Flushes the allocations of the current frame and finishes it.
+	// Returns the id of the frame, to be passed to release once the
+	// gpu does not access its allocations anymore.
+	u64 endFrame();
+
+	// Makes the memory of the given frame available again.
+	// Does nothing for frame id 0.
+	void release(u64 frameID);
+
+private:
+	struct Frame {
+		u64 id;
+		u64 gen; // value of gen_ when the frame ended
+		VkDeviceSize end; // value of head_ when the frame ended
+		bool released;
+	};
+
+	struct Retired {
+		OwnBuffer buf;
+		u64 lastFrame; // id of the last frame that might use it
+	};
+
+	void grow(VkDeviceSize minSize);
+
+	Device* dev_ {};
+	VkBufferUsageFlags usage_ {};
+
+	std::mutex mutex_;
+	OwnBuffer buf_;
+	u64 gen_ {}; // incremented when buf_ is recreated
+	// Monotonically increasing offsets, modulo buf_.size.
+	// [tail_, head_) is potentially in use.
+	VkDeviceSize head_ {};
+	VkDeviceSize tail_ {};
+	u64 frameCounter_ {};
+	std::deque<Frame> frames_; // ended, in order
+	std::vector<Retired> retired_;
+};
+
 // Represents all information associated with the rendering of a single
 // gui frame.
 struct Draw {
 	Device* dev {};
-	OwnBuffer vertexBuffer {};
-	OwnBuffer indexBuffer {};
+
+	// ImGui geometry, allocated from Gui's StagingRing.
+	StagingRing::Alloc vertices {};
+	StagingRing::Alloc indices {};
+	u64 stagingFrame {}; // id of the StagingRing frame used by this draw
 
 	// Main command buffer in which all the gui rendering commands are recorded.
 	// Recording of this cb will happen outside of a critical section.
@@ -32,6 +32,7 @@
 #include <vkutil/enumString.hpp>
 #include <vk/format_utils.h>
 #include <spirv_cross.hpp>
+#include <algorithm>
 #include <map>
 
 #ifdef VIL_WITH_SPIRV_TOOLS
@@ -622,7 +623,34 @@ void ResourceGui::drawDesc(Draw&, DescriptorSet& ds) {
 		};
 
 		auto elemCount = descriptorCount(ds, b);
-		if(elemCount > 1) {
+		auto* pages = (b + 1 == ds.layout->bindings.size()) ? state.pages : nullptr;
+		if(pages) {
+			// bindless-style binding, see DescriptorPages.
+			// Only show the descriptors in allocated pages.
+			auto label = dlg::format("{}: {}[{}], {} written this frame", b,
+				vk::name(layout.descriptorType), elemCount,
+				pages->writtenThisFrameCount());
+			if(ImGui::TreeNode(label.c_str())) {
+				if(pages->writesOnly) {
+					imGuiText("Only tracking writes, see VIL_DESCRIPTOR_WRITES_ONLY");
+				}
+
+				for(auto e = 0u; e < elemCount; ++e) {
+					if(!pages->find(e)) {
+						e = (e / pages->perPage + 1) * pages->perPage - 1;
+						continue;
+					}
+
+					ImGui::Bullet();
+					imGuiText("{}: ", e);
+					ImGui::SameLine();
+
+					print(b, e);
+				}
+
+				ImGui::TreePop();
+			}
+		} else if(elemCount > 1) {
 			auto label = dlg::format("{}: {}[{}]", b,
 				vk::name(layout.descriptorType), elemCount);
 			if(ImGui::TreeNode(label.c_str())) {
@@ -1584,7 +1612,30 @@ void ResourceGui::drawDesc(Draw&, IndirectCommandsLayout&) {
 	imGuiText("TODO");
 }
 
-void ResourceGui::clearHandles() {
+namespace {
+
+// Applications streaming in resources might create and destroy handles
+// every frame, the resource list doesn't have to keep up with that.
+constexpr auto listRefreshInterval = std::chrono::milliseconds(200);
+
+// Keeps the handle alive while it's in the resource list.
+// Must be called while the device mutex is locked.
+void refListHandle(const ObjectTypeHandler& typeHandler, Handle& handle) {
+	auto incRefCountVisitor = TemplateResourceVisitor([&](auto& res) {
+		using HT = std::remove_reference_t<decltype(res)>;
+		[[maybe_unused]] constexpr auto noop =
+			std::is_same_v<HT, DescriptorSet> ||
+			std::is_same_v<HT, Queue>;
+		if constexpr(!noop) {
+			incRefCount(res);
+		}
+	});
+
+	typeHandler.visit(incRefCountVisitor, handle);
+}
+
+// Releases the reference added for the resource list.
+void unrefListHandle(const ObjectTypeHandler& typeHandler, Handle& handle) {
 	auto decRefCountVisitor = TemplateResourceVisitor([&](auto& res) {
 		using HT = std::remove_reference_t<decltype(res)>;
 		[[maybe_unused]] constexpr auto noop =
@@ -1605,43 +1656,47 @@ void ResourceGui::clearHandles() {
 		}
 	});
 
+	typeHandler.visit(decRefCountVisitor, handle);
+}
+
+} // anon namespace
+
+void ResourceGui::clearHandles() {
 	// clear selection
 	auto typeHandler = ObjectTypeHandler::handler(filter_);
 	if (typeHandler) {
-		for(auto& handle : handles_) {
-			typeHandler->visit(decRefCountVisitor, *handle);
+		for(auto& entry : handles_) {
+			if(entry.handle) {
+				unrefListHandle(*typeHandler, *entry.handle);
+			}
 		}
 	}
 
 	handles_.clear();
+	freeSlots_.clear();
+	destroyedSelected_ = {};
+	handleIDs_.clear();
+	searchIndex_.clear();
+	matches_.clear();
 	ds_.pools.clear();
 	ds_.entries.clear();
 }
 
 void ResourceGui::updateResourceList() {
+	ZoneScoped;
 	auto& dev = gui_->dev();
 
-	auto incRefCountVisitor = TemplateResourceVisitor([&](auto& res) {
-		using HT = std::remove_reference_t<decltype(res)>;
-		[[maybe_unused]] constexpr auto noop =
-			std::is_same_v<HT, DescriptorSet> ||
-			std::is_same_v<HT, Queue>;
-		if constexpr(!noop) {
-			incRefCount(res);
-		}
-	});
-
 	clearHandles();
 
 	// find new handler
 	filter_ = newFilter_;
 
 	auto typeHandler = ObjectTypeHandler::handler(filter_);
-	std::lock_guard lock(gui_->dev().mutex);
 
 	// find new handles
 	auto foundSelected = false;
 	if(filter_ == VK_OBJECT_TYPE_DESCRIPTOR_SET) {
+		std::lock_guard lock(dev.mutex);
 		for(auto& dsPool : dev.dsPools.inner) {
 			ds_.pools.push_back(dsPool.second);
 
@@ -1661,14 +1716,42 @@ void ResourceGui::updateResourceList() {
 			}
 		}
 	} else if(typeHandler) {
-		handles_ = typeHandler->resources(dev, search_);
+		// Only capture the handles (and what we need to display them)
+		// while the mutex is locked. The application can't create or
+		// destroy any resources in the meantime, so keep this short.
+		// Indexing is done on the snapshot afterwards.
+		std::vector<IndexText> texts;
+		{
+			std::lock_guard lock(dev.mutex);
+			// From now on, refreshResourceList can use the recorded changes.
+			typeHandler->trackChanges(dev);
+			if(!dev.nameJournal) {
+				dev.nameJournal = std::make_unique<ChangeJournal<Handle>>(
+					dev.nameVersion.load(std::memory_order_relaxed));
+			}
 
-		for(auto& handle : handles_) {
-			typeHandler->visit(incRefCountVisitor, *handle);
-			if(handle == handle_) {
-				foundSelected = true;
+			handlesVersion_ = typeHandler->version(dev);
+			namesVersion_ = dev.nameVersion.load(std::memory_order_relaxed);
+
+			auto handles = typeHandler->resources(dev);
+			std::sort(handles.begin(), handles.end());
+
+			handles_.reserve(handles.size());
+			texts.reserve(handles.size());
+			for(auto* handle : handles) {
+				texts.push_back(addEntryLocked(*typeHandler, *handle));
+				if(handle == handle_) {
+					foundSelected = true;
+				}
 			}
 		}
+
+		lastRefresh_ = std::chrono::steady_clock::now();
+		for(auto& [id, text] : texts) {
+			searchIndex_.insert(id, text);
+		}
+
+		updateMatches();
 	}
 
 	// we updated the list and our selection wasn't in there anymore
@@ -1677,6 +1760,224 @@ void ResourceGui::updateResourceList() {
 	}
 }
 
+ResourceGui::IndexText ResourceGui::addEntryLocked(
+		const ObjectTypeHandler& typeHandler, Handle& handle) {
+	refListHandle(typeHandler, handle);
+
+	u32 id;
+	if(!freeSlots_.empty()) {
+		id = freeSlots_.back();
+		freeSlots_.pop_back();
+	} else {
+		id = u32(handles_.size());
+		handles_.emplace_back();
+	}
+
+	auto& entry = handles_[id];
+	entry.handle = &handle;
+	entry.name = handle.name;
+	entry.label = name(handle, filter_, false, true);
+	entry.destroyed = false;
+	handleIDs_.emplace(&handle, id);
+
+	// The search matches the type name as well
+	return {id, name(handle, filter_)};
+}
+
+void ResourceGui::removeEntry(u32 id, std::vector<Handle*>& released) {
+	auto& entry = handles_[id];
+	dlg_assert(entry.handle);
+
+	handleIDs_.erase(entry.handle);
+	searchIndex_.erase(id);
+	released.push_back(entry.handle);
+
+	entry = {};
+	freeSlots_.push_back(id);
+}
+
+void ResourceGui::refreshResourceList() {
+	if(filter_ == VK_OBJECT_TYPE_DESCRIPTOR_SET) {
+		return;
+	}
+
+	auto* typeHandler = ObjectTypeHandler::handler(filter_);
+	dlg_assert(typeHandler);
+
+	// Destroyed handles are only kept while selected, see below.
+	std::vector<Handle*> released;
+	if(destroyedSelected_ && handles_[*destroyedSelected_].handle != handle_) {
+		removeEntry(*destroyedSelected_, released);
+		destroyedSelected_ = {};
+	}
+
+	// Checking the versions does not need the mutex. In the common case
+	// of no handles being created, destroyed or renamed, we don't lock at all.
+	auto& dev = gui_->dev();
+	auto upToDate = typeHandler->version(dev) == handlesVersion_ &&
+		dev.nameVersion.load(std::memory_order_acquire) == namesVersion_;
+
+	auto now = std::chrono::steady_clock::now();
+	if(upToDate || now - lastRefresh_ < listRefreshInterval) {
+		for(auto* handle : released) {
+			unrefListHandle(*typeHandler, *handle);
+		}
+
+		if(!released.empty()) {
+			updateMatches();
+		}
+
+		return;
+	}
+
+	ZoneScoped;
+	lastRefresh_ = now;
+
+	// Handles in our list are kept alive, so their address can't be
+	// reused for new handles while they are in handleIDs_.
+	// Must not access the handle, it might not be alive anymore.
+	auto destroyed = [&](Handle* handle) {
+		auto it = handleIDs_.find(handle);
+		if(it == handleIDs_.end()) {
+			return;
+		}
+
+		if(handle == handle_) {
+			// we explicitly allow inspecting the selected handle after
+			// it was destroyed. Released once it isn't selected anymore.
+			handles_[it->second].destroyed = true;
+			destroyedSelected_ = it->second;
+			return;
+		}
+
+		removeEntry(it->second, released);
+	};
+
+	// (re-)indexed texts
+	std::vector<IndexText> texts;
+	{
+		std::lock_guard lock(dev.mutex);
+
+		auto handlesVersion = typeHandler->version(dev);
+		if(handlesVersion != handlesVersion_) {
+			// Usually, we only have to look at the handles created and
+			// destroyed since the last refresh.
+			std::vector<ObjectTypeHandler::HandleChange> changes;
+			if(typeHandler->changes(dev, handlesVersion_, changes)) {
+				// Only the last change of a handle matters. A handle might
+				// be created and destroyed (and even its address reused) in
+				// between, it's only alive if its last change is a creation.
+				std::unordered_map<Handle*, bool> last;
+				for(auto& change : changes) {
+					last[change.handle] = change.created;
+				}
+
+				for(auto& [handle, created] : last) {
+					if(!created) {
+						destroyed(handle);
+					}
+				}
+
+				for(auto& [handle, created] : last) {
+					if(created && !handleIDs_.count(handle)) {
+						texts.push_back(addEntryLocked(*typeHandler, *handle));
+					}
+				}
+			} else {
+				// Fallback, have to compare against all handles.
+				auto handles = typeHandler->resources(dev);
+				std::unordered_set<Handle*> alive(handles.begin(), handles.end());
+
+				std::vector<Handle*> vanished;
+				for(auto& [handle, id] : handleIDs_) {
+					if(!alive.count(handle)) {
+						vanished.push_back(handle);
+					}
+				}
+
+				for(auto* handle : vanished) {
+					destroyed(handle);
+				}
+
+				for(auto* handle : handles) {
+					if(!handleIDs_.count(handle)) {
+						texts.push_back(addEntryLocked(*typeHandler, *handle));
+					}
+				}
+			}
+
+			handlesVersion_ = handlesVersion;
+		}
+
+		auto namesVersion = dev.nameVersion.load(std::memory_order_relaxed);
+		if(namesVersion != namesVersion_) {
+			auto rename = [&](Handle* handle) {
+				// Only access handles we keep alive, the others might have
+				// been destroyed.
+				auto it = handleIDs_.find(handle);
+				if(it == handleIDs_.end()) {
+					return;
+				}
+
+				auto& entry = handles_[it->second];
+				if(entry.name == handle->name) {
+					return;
+				}
+
+				entry.name = handle->name;
+				entry.label = name(*handle, filter_, false, true);
+				texts.push_back({it->second, name(*handle, filter_)});
+			};
+
+			dlg_assert(dev.nameJournal);
+			auto known = dev.nameJournal->forEachSince(namesVersion_, namesVersion,
+				[&](Handle* handle, bool) { rename(handle); });
+			if(!known) {
+				// we don't know which handles were renamed, but comparing
+				// the names of all handles is cheap
+				for(auto& entry : handles_) {
+					if(entry.handle) {
+						rename(entry.handle);
+					}
+				}
+			}
+
+			namesVersion_ = namesVersion;
+		}
+	}
+
+	// Releasing might destroy the handles, must not happen while the
+	// device mutex is locked.
+	for(auto* handle : released) {
+		unrefListHandle(*typeHandler, *handle);
+	}
+
+	if(texts.empty() && released.empty()) {
+		return;
+	}
+
+	for(auto& [id, text] : texts) {
+		if(searchIndex_.contains(id)) {
+			searchIndex_.erase(id);
+		}
+
+		searchIndex_.insert(id, text);
+	}
+
+	updateMatches();
+}
+
+void ResourceGui::updateMatches() {
+	ZoneScoped;
+
+	// The index returns them in insertion order, renamed handles
+	// are re-inserted at the end.
+	matches_ = searchIndex_.query(search_);
+	if(!std::is_sorted(matches_.begin(), matches_.end())) {
+		std::sort(matches_.begin(), matches_.end());
+	}
+}
+
 void ResourceGui::clearSelection() {
 	handle_ = nullptr;
 	ds_.selected = {};
@@ -1730,34 +2031,22 @@ void ResourceGui::draw(Draw& draw) {
 	}
 
 	// text search
-	if(imGuiTextInput(ICON_FA_SEARCH, search_)) {
-		update = true;
-	}
+	// only done on the snapshot, via the index
+	auto searchChanged = imGuiTextInput(ICON_FA_SEARCH, search_);
 
 	if(update) {
 		updateResourceList();
+	} else {
+		refreshResourceList();
+		if(searchChanged) {
+			updateMatches();
+		}
 	}
 
 	ImGui::Separator();
 
 	// resource list
-	const auto* typeHandler = ObjectTypeHandler::handler(filter_);
-	dlg_assert(typeHandler);
-
-	bool isDestroyed {};
-	auto isDestroyedVisitor = TemplateResourceVisitor([&](auto& res) {
-		using HT = std::remove_reference_t<decltype(res)>;
-		if constexpr(std::is_same_v<HT, Queue>) {
-			return;
-		} else if constexpr(std::is_same_v<HT, DescriptorSet>) {
-			dlg_error("unreachable");
-			return;
-		} else {
-			// lock mutex due to access to res.handle
-			std::lock_guard lock(gui_->dev().mutex);
-			isDestroyed = (res.handle == VK_NULL_HANDLE);
-		}
-	});
+	dlg_assert(ObjectTypeHandler::handler(filter_));
 
 	ImGui::BeginChild("Resource List", {0.f, 0.f}, false);
 
@@ -1768,7 +2057,7 @@ void ResourceGui::draw(Draw& draw) {
 		dlg_assert(handle_ == nullptr);
 		clipper.Begin(int(ds_.entries.size()));
 	} else {
-		clipper.Begin(int(handles_.size()));
+		clipper.Begin(int(matches_.size()));
 	}
 
 	ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, gui_->uiScale() * ImVec2(2.f, 3.f));
@@ -1787,6 +2076,7 @@ void ResourceGui::draw(Draw& draw) {
 
 				isSelected = (entry.entry == ds_.selected.entry);
 
+				bool isDestroyed;
 				{
 					std::lock_guard lock(entry.pool->mutex);
 					isDestroyed = !entry.entry->set ||
@@ -1807,19 +2097,19 @@ void ResourceGui::draw(Draw& draw) {
 					}
 				}
 			} else {
-				handle = handles_[i];
-				ImGui::PushID(&handle);
+				// only uses the snapshot, see refreshResourceList
+				auto& entry = handles_[matches_[i]];
+				handle = entry.handle;
+				ImGui::PushID(handle);
 
 				isSelected = (handle == handle_);
-				typeHandler->visit(isDestroyedVisitor, *handle);
-
-				if(isDestroyed) {
+				if(entry.destroyed) {
 					label += "[Destroyed] ";
 				}
 
 				// we explicitly allow selecting destroyed handles
 				disable = false;
-				label += name(*handle, filter_, false, true);
+				label += entry.label;
 			}
 
 			auto flags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_Bullet |
@@ -7,10 +7,14 @@
 #include <ds.hpp>
 #include <vk/vulkan.h>
 #include <imgui/textedit.h>
+#include <util/trigram.hpp>
 #include <variant>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 #include <string>
+#include <chrono>
+#include <optional>
 
 namespace vil {
 
@@ -68,6 +72,22 @@ private:
 	void clearHandles();
 	// Will also apply newFilter
 	void updateResourceList();
+	// Incrementally updates the handle snapshot (new handles, destroyed
+	// handles, names) when the device versions have changed.
+	void refreshResourceList();
+	// Updates the displayed handles for the current search, does
+	// not need the device mutex.
+	void updateMatches();
+
+	// id in handles_ and search text of a handle, to be indexed
+	using IndexText = std::pair<u32, std::string>;
+	// Adds the given handle to the snapshot, keeping it alive.
+	// Must be called while the device mutex is locked.
+	IndexText addEntryLocked(const ObjectTypeHandler&, Handle&);
+	// Removes the given handle from the snapshot and the search index.
+	// The handle is appended to 'released', the caller has to release
+	// the reference kept by the list once the device mutex is unlocked.
+	void removeEntry(u32 id, std::vector<Handle*>& released);
 	void clearSelection();
 
 private:
@@ -77,8 +97,36 @@ private:
 	VkObjectType filter_ {VK_OBJECT_TYPE_IMAGE};
 	VkObjectType newFilter_ {VK_OBJECT_TYPE_IMAGE};
 
-	// The list of currently displayed handles
-	std::vector<Handle*> handles_;
+	// Snapshot of all handles of the current filter type. Captured while
+	// the device mutex is locked, searching and drawing the list only
+	// use the snapshot.
+	struct HandleEntry {
+		// Null for unused slots, see freeSlots_.
+		Handle* handle {};
+		std::string label;
+		// copy of handle->name, to detect renames
+		std::string name;
+		// Destroyed handles are only kept while selected.
+		bool destroyed {};
+	};
+
+	std::vector<HandleEntry> handles_;
+	// Indices of unused entries in handles_, reused for new handles.
+	std::vector<u32> freeSlots_;
+	// Index of the selected, destroyed handle. Released once the
+	// selection changes.
+	std::optional<u32> destroyedSelected_;
+	std::unordered_map<const Handle*, u32> handleIDs_; // index in handles_
+	// Search texts of handles_, the ids are the indices into handles_.
+	TrigramIndex searchIndex_;
+	// Indices of the handles matching search_, sorted. The displayed list.
+	std::vector<u32> matches_;
+
+	// Versions of the device state the snapshot was captured from.
+	// See ObjectTypeHandler::version and Device::nameVersion.
+	u64 handlesVersion_ {};
+	u64 namesVersion_ {};
+	std::chrono::steady_clock::time_point lastRefresh_ {};
 
 	Handle* handle_ {};
 	bool editName_ {false};
@@ -1284,38 +1284,6 @@ bool VertexViewer::displayInput(Draw& draw, const DrawCmdBase& cmd,
 	return updateHook;
 }
 
-u32 topologyOutputCount(VkPrimitiveTopology topo, i32 in) {
-	switch(topo) {
-		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
-		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
-		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST:
-			return u32(in);
-
-		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
-			return u32(2 * std::max(0, in - 1));
-
-		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
-			return u32(in / 2);
-		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
-			return u32(2 * std::max(0, in - 3));
-
-		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
-		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN:
-			return u32(3 * std::max(0, in - 2));
-
-		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY:
-			return u32(in / 2);
-		case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP_WITH_ADJACENCY:
-		case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
-			dlg_warn("Not implemeneted"); // ugh, no idea
-			return 0u;
-
-		default:
-			dlg_error("Invalid topology {}", u32(topo));
-			return 0u;
-	}
-}
-
 const char* name(spv11::BuiltIn builtin) {
 	switch(builtin) {
 		case spv11::BuiltIn::Position: return "Position";
@@ -1409,10 +1377,68 @@ bool VertexViewer::displayOutput(Draw& draw, const DrawCmdBase& cmd,
 		}
 	};
 
+	// For direct and multi draws, only a window of the draw is captured.
+	// See splitDraw. The counts are computed in output vertices directly.
+	auto topology = pipe.inputAssemblyState.topology;
+	auto& split = state.xfbSplit;
+	auto paged = false;
+	auto idOffset = 0u; // id of the first captured vertex in the draw
+	auto displayPageSlider = [&]{
+		paged = true;
+		auto lbl = dlg::format("Pages: {}", split.pageCount);
+		if(optSliderRange(lbl.c_str(), xfbPage_, split.pageCount)) {
+			updateHook = true;
+		}
+
+		if(split.pageCount > 1u) {
+			auto unit = split.byDraw ? "draws" :
+				split.byInstance ? "instances" : "vertices";
+			imGuiText("Showing {} {}..{} of {}", unit,
+				split.begin, split.end, split.total);
+		}
+	};
+
+	auto directPageCounts = [&](u32 count) {
+		if(split.byInstance) {
+			auto perInstance = topologyOutputCount(topology, count);
+			vertexCount = (split.end - split.begin) * perInstance;
+			idOffset = split.begin * perInstance;
+		} else {
+			vertexCount = topologyOutputCount(topology,
+				split.end - split.begin + split.overlap);
+			idOffset = topologyOutputCount(topology, split.begin + split.overlap);
+		}
+
+		totalCount = vertexCount;
+	};
+
+	auto multiPageCounts = [&](auto infos, u32 instanceCount, auto getCount) {
+		for(auto i = 0u; i < std::min<u32>(infos.size(), split.end); ++i) {
+			auto count = topologyOutputCount(topology, getCount(infos[i]));
+			if(i < split.begin) {
+				idOffset += count * instanceCount;
+			} else {
+				vertexCount += count * instanceCount;
+			}
+		}
+
+		totalCount = vertexCount;
+	};
+
 	if(auto* dcmd = commandCast<const DrawCmd*>(&cmd); dcmd) {
-		vertexCount = dcmd->vertexCount * dcmd->instanceCount;
+		displayPageSlider();
+		directPageCounts(dcmd->vertexCount);
 	} else if(auto* dcmd = commandCast<const DrawIndexedCmd*>(&cmd); dcmd) {
-		vertexCount = dcmd->indexCount * dcmd->instanceCount;
+		displayPageSlider();
+		directPageCounts(dcmd->indexCount);
+	} else if(auto* dcmd = commandCast<const DrawMultiCmd*>(&cmd); dcmd) {
+		displayPageSlider();
+		multiPageCounts(dcmd->vertexInfos, dcmd->instanceCount,
+			[](auto& info) { return info.vertexCount; });
+	} else if(auto* dcmd = commandCast<const DrawMultiIndexedCmd*>(&cmd); dcmd) {
+		displayPageSlider();
+		multiPageCounts(dcmd->indexInfos, dcmd->instanceCount,
+			[](auto& info) { return info.indexCount; });
 	} else if(auto* dcmd = commandCast<const DrawIndirectCmd*>(&cmd); dcmd) {
 		displayCmdSlider(dcmd->indexed, dcmd->stride);
 		if(selectedCommand_ == u32(-1)) {
@@ -1428,8 +1454,10 @@ bool VertexViewer::displayOutput(Draw& draw, const DrawCmdBase& cmd,
 		return false;
 	}
 
-	vertexCount = topologyOutputCount(pipe.inputAssemblyState.topology, vertexCount);
-	vertexOffset = topologyOutputCount(pipe.inputAssemblyState.topology, vertexOffset);
+	if(!paged) {
+		vertexCount = topologyOutputCount(topology, vertexCount);
+		vertexOffset = topologyOutputCount(topology, vertexOffset);
+	}
 
 	auto capturedCount = state.transformFeedback.size / xfbPatch.stride;
 	if(vertexOffset + vertexCount > capturedCount) {
@@ -1510,7 +1538,6 @@ bool VertexViewer::displayOutput(Draw& draw, const DrawCmdBase& cmd,
 				auto xfbData = state.transformFeedback.data();
 				xfbData = xfbData.subspan(vertexOffset * xfbPatch.stride);
 
-				// TODO: show pages
 				ImGuiListClipper clipper;
 				clipper.Begin(vertexCount);
 				while(clipper.Step()) {
@@ -1520,7 +1547,7 @@ bool VertexViewer::displayOutput(Draw& draw, const DrawCmdBase& cmd,
 						auto buf = xfbData.subspan(i * xfbPatch.stride, xfbPatch.stride);
 
 						ImGui::TableNextColumn();
-						displayVertexID(i);
+						displayVertexID(i, idOffset);
 
 						// TODO: display debug popup
 						// But how to know at this point what the source vertex was?
@@ -1901,8 +1928,8 @@ bool VertexViewer::showSettings(bool allowShowAll) {
 	return changed;
 }
 
-void VertexViewer::displayVertexID(u32 i) {
-	auto str = dlg::format("{}", i);
+void VertexViewer::displayVertexID(u32 i, u32 idOffset) {
+	auto str = dlg::format("{}", i + idOffset);
 	auto spacingY = ImGui::GetCurrentContext()->Style.ItemSpacing.y;
 	ImGui::GetCurrentContext()->Style.ItemSpacing.y = 0.f;
 	if(ImGui::Selectable(str.c_str(), i == selectedVertex_,
@@ -54,6 +54,7 @@ public:
 
 	u32 selectedCommand() const { return selectedCommand_; }
 	bool showAll() const { return showAll_; }
+	u32 xfbPage() const { return xfbPage_; }
 
 private:
 	void centerCamOnBounds(const AABB3f& bounds);
@@ -104,7 +105,9 @@ private:
 	// Uses the current imgui context.
 	void imGuiDraw(const DrawData& data);
 	bool showSettings(bool allowShowAll = false);
-	void displayVertexID(u32 id);
+	// Displays a selectable row for the vertex i. The shown id is offset
+	// by idOffset, e.g. for the captured page of a split draw.
+	void displayVertexID(u32 i, u32 idOffset = 0u);
 	void displayDebugPopup(u32 vertexID, CommandViewer& viewer,
 		const DrawCmdBase& cmd);
 
@@ -156,6 +159,10 @@ private:
 	u32 selectedCommand_ {};
 	std::vector<DrawData> drawDatas_;
 
+	// For direct draws, the page of the (split up) draw to capture
+	// via transform feedback, see CommandHookOps::xfbPage.
+	u32 xfbPage_ {};
+
 	u32 precision_ {5u};
 	bool doClear_ {false};
 	bool flipY_ {};
@@ -25,12 +25,16 @@ void drawWeight(ImDrawList* dl, ImVec2 pos, ImVec2 size, double weight) {
 	drawTexCentered(dl, tp, 0xFF000000, textStr.c_str());
 }
 
+constexpr auto width = 12u;
+constexpr auto height = 7u;
+
 void VizLCS::draw() {
-	auto width = algo_.width();
-	auto height = algo_.height();
+	auto matcher = [this](u32 x, u32 y) {
+		return weights_[width * y + x];
+	};
 
 	if(ImGui::Button("Step")) {
-		algo_.step();
+		algo_.step(matcher);
 	}
 
 	auto* dl = ImGui::GetWindowDrawList();
@@ -79,7 +83,7 @@ void VizLCS::draw() {
 
 	// if done: viz results
 	if(algo_.empty()) {
-		auto res = algo_.run(); // collect
+		auto res = algo_.run(matcher); // collect
 
 		for(auto m : res.matches) {
 			ImVec2 pos = spos + ImVec2(m.i, m.j) * (pad + size);
@@ -89,11 +93,7 @@ void VizLCS::draw() {
 	}
 }
 
-constexpr auto width = 12u;
-constexpr auto height = 7u;
-
-VizLCS::VizLCS() : algo_(width, height, alloc_,
-		[this](u32 x, u32 y){ return weights_[width * y + x]; }) {
+VizLCS::VizLCS() : algo_(width, height, alloc_) {
 	weights_ = std::make_unique<float[]>(width * height);
 
 	// semi random weights
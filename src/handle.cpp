@@ -88,52 +88,26 @@ std::string name(const Handle& handle, VkObjectType objectType, bool addType, bo
 	return name;
 }
 
-// case insensitive substring find
 // type handlers
-bool matchesSearch(Handle& handle, VkObjectType objectType, std::string_view search) {
-	if(search.empty()) {
-		return true;
-	}
-
-	// case-insensitive search
-	// TODO: only works on ascii atm, convert to utf32 first?
-	// or write method that works on utf8
-	auto label = name(handle, objectType);
-
-	return findSubstrCI(label, search) != -1;
-}
-
 template<typename... Args>
-std::vector<Handle*> findHandles(const std::unordered_map<Args...>& map,
-		std::string_view search) {
+std::vector<Handle*> findHandles(const std::unordered_map<Args...>& map) {
 	std::vector<Handle*> ret;
+	ret.reserve(map.size());
 	for(auto& entry : map) {
-		auto& handle = *entry.second;
-		if(!matchesSearch(handle, handle.objectType, search)) {
-			continue;
-		}
-
-		ret.push_back(&handle);
+		ret.push_back(&*entry.second);
 	}
 
-	std::sort(ret.begin(), ret.end());
 	return ret;
 }
 
 template<typename... Args>
-std::vector<Handle*> findHandles(const std::unordered_set<Args...>& set,
-		std::string_view search) {
+std::vector<Handle*> findHandles(const std::unordered_set<Args...>& set) {
 	std::vector<Handle*> ret;
+	ret.reserve(set.size());
 	for(auto& entry : set) {
-		auto& handle = *entry;
-		if(!matchesSearch(handle, handle.objectType, search)) {
-			continue;
-		}
-
-		ret.push_back(&handle);
+		ret.push_back(&*entry);
 	}
 
-	std::sort(ret.begin(), ret.end());
 	return ret;
 }
 
@@ -163,8 +137,27 @@ struct ObjectTypeMapImpl : ObjectTypeHandler {
 
 		return &handle;
 	}
-	std::vector<Handle*> resources(Device& dev, std::string_view search) const override {
-		return findHandles((dev.*DevMapPtr).inner, search);
+	std::vector<Handle*> resources(Device& dev) const override {
+		assertOwnedOrShared(dev.mutex);
+		return findHandles((dev.*DevMapPtr).inner);
+	}
+	u64 version(Device& dev) const override {
+		return (dev.*DevMapPtr).version.load(std::memory_order_acquire);
+	}
+	void trackChanges(Device& dev) const override {
+		(dev.*DevMapPtr).enableJournalLocked();
+	}
+	bool changes(Device& dev, u64 since, std::vector<HandleChange>& out) const override {
+		assertOwnedOrShared(dev.mutex);
+		auto& map = dev.*DevMapPtr;
+		if(!map.journal) {
+			return false;
+		}
+
+		auto current = map.version.load(std::memory_order_relaxed);
+		return map.journal->forEachSince(since, current, [&](auto* handle, bool created) {
+			out.push_back({handle, created});
+		});
 	}
 	void visit(ResourceVisitor& visitor, Handle& handle) const override {
 		return visitor.visit(static_cast<HT&>(handle));
@@ -191,12 +184,25 @@ struct DescriptorSetTypeImpl : ObjectTypeHandler {
 
 		return &handle;
 	}
-	std::vector<Handle*> resources(Device& dev, std::string_view search) const override {
+	std::vector<Handle*> resources(Device& dev) const override {
 		(void) dev;
-		(void) search;
 		dlg_error("Enumerating DescriptorSets not supported, should not be called");
 		return {};
 	}
+	u64 version(Device& dev) const override {
+		(void) dev;
+		dlg_error("Enumerating DescriptorSets not supported, should not be called");
+		return 0u;
+	}
+	void trackChanges(Device& dev) const override {
+		(void) dev;
+		dlg_error("Enumerating DescriptorSets not supported, should not be called");
+	}
+	bool changes(Device& dev, u64, std::vector<HandleChange>&) const override {
+		(void) dev;
+		dlg_error("Enumerating DescriptorSets not supported, should not be called");
+		return false;
+	}
 	void visit(ResourceVisitor& visitor, Handle& handle) const override {
 		return visitor.visit(static_cast<Queue&>(handle));
 	}
@@ -218,12 +224,12 @@ struct QueueTypeImpl : ObjectTypeHandler {
 
 		return nullptr;
 	}
-	std::vector<Handle*> resources(Device& dev, std::string_view search) const override {
+	std::vector<Handle*> resources(Device& dev) const override {
 		std::vector<Handle*> ret;
 		for(auto& queue : dev.queues) {
 			// We never return queues created by us, they don't count as
 			// resources.
-			if(queue->createdByUs || !matchesSearch(*queue, objectType(), search)) {
+			if(queue->createdByUs) {
 				continue;
 			}
 
@@ -232,6 +238,19 @@ struct QueueTypeImpl : ObjectTypeHandler {
 
 		return ret;
 	}
+	u64 version(Device& dev) const override {
+		// queues are only created on device creation
+		(void) dev;
+		return 0u;
+	}
+	void trackChanges(Device& dev) const override {
+		(void) dev;
+	}
+	bool changes(Device& dev, u64, std::vector<HandleChange>&) const override {
+		// there never are any
+		(void) dev;
+		return true;
+	}
 	void visit(ResourceVisitor& visitor, Handle& handle) const override {
 		return visitor.visit(static_cast<Queue&>(handle));
 	}
@@ -348,6 +367,10 @@ VKAPI_ATTR VkResult VKAPI_CALL SetDebugUtilsObjectNameEXT(
 			pNameInfo->objectHandle, fwd.objectHandle);
 		if(handle) {
 			handle->name = pNameInfo->pObjectName;
+			auto v = devd.nameVersion.fetch_add(1u, std::memory_order_release) + 1;
+			if(devd.nameJournal) {
+				devd.nameJournal->record(v, handle, true);
+			}
 		}
 	}
 
@@ -123,8 +123,36 @@ struct ObjectTypeHandler {
 
 	// The following functions may use the device maps directly and
 	// can expect the device mutex to be locked.
+	// Returns all handles of this type, in no particular order.
+	// Does as little work as possible, filtering and sorting should be
+	// done by the caller after unlocking the mutex.
 	// NOTE: not implemented for the DescriptorSet ObjectTypeHandler
-	virtual std::vector<Handle*> resources(Device& dev, std::string_view search) const = 0;
+	virtual std::vector<Handle*> resources(Device& dev) const = 0;
+
+	// Returns a counter that is incremented whenever a handle of this
+	// type is created or destroyed. Does not require the device mutex.
+	// NOTE: not implemented for the DescriptorSet ObjectTypeHandler
+	virtual u64 version(Device& dev) const = 0;
+
+	struct HandleChange {
+		Handle* handle;
+		bool created; // false: destroyed
+	};
+
+	// Starts recording the handles of this type that are created and
+	// destroyed, for 'changes'. Expects the device mutex to be locked.
+	// NOTE: not implemented for the DescriptorSet ObjectTypeHandler
+	virtual void trackChanges(Device& dev) const = 0;
+
+	// Appends all handles of this type created or destroyed after the
+	// given version (see 'version') to 'out', in order.
+	// Destroyed handles must not be accessed, they might not be alive anymore.
+	// Returns false when they aren't known, e.g. when there were too many
+	// changes or trackChanges wasn't called before the given version.
+	// The caller has to use 'resources' then.
+	// Expects the device mutex to be locked.
+	// NOTE: not implemented for the DescriptorSet ObjectTypeHandler
+	virtual bool changes(Device& dev, u64 since, std::vector<HandleChange>& out) const = 0;
 
 	// Expects device mutex to be locked.
 	// NOTE: even though this is called 'find' expects 'handleToFind' to
@@ -9,29 +9,29 @@ float maxPossibleScore(float score, u32 width, u32 height, u32 i, u32 j) {
 
 // LazyMatrixMarch
 LazyMatrixMarch::LazyMatrixMarch(u32 width, u32 height, LinAllocator& alloc,
-	Matcher matcher, float branchThreshold) :
-		alloc_(alloc), width_(width), height_(height), matcher_(std::move(matcher)),
-		branchThreshold_(branchThreshold), candidates_(HeapCandCompare{*this}, alloc) {
+	float branchThreshold) :
+		alloc_(alloc), width_(width), height_(height),
+		branchThreshold_(branchThreshold), candidates_(alloc) {
 
 	dlg_assert(width > 0);
 	dlg_assert(height > 0);
-	// if we ever exceed this, just use 32-bit integers for HeapCand.
-	// Not that big of a loss, 16-bit was done because of performance
-	// and memory concerns. Who matches such HUGE sequences?!
-	dlg_assert(width < 1024 * 64);
-	dlg_assert(height < 1024 * 64);
-	dlg_assert(matcher_);
 
-	matchMatrix_ = alloc.allocNonTrivial<EvalMatch>(width * height);
-
-	for(auto& m : matchMatrix_) {
-		m.candidate = candidates_.end();
+	// For similar sequences, we visit roughly 3 fields per element.
+	// The grid is kept at most half full.
+	auto expected = std::min(u64(width) * height, 3 * (u64(width) + height));
+	auto gridSize = u64(8u);
+	while(gridSize < 2 * expected) {
+		gridSize *= 2;
 	}
 
+	grid_ = alloc_.alloc<Field*>(gridSize);
+	candidates_.reserve(64u);
+
 	// insert first candidate
-	auto it = candidates_.insert({0, 0, 0.f}).first;
-	match(0, 0).best = 0.f;
-	match(0, 0).candidate = it;
+	auto& first = field(0, 0);
+	first.best = 0.f;
+	first.candidate = 0u;
+	candidates_.push_back({0, 0, 0.f, &first});
 }
 
 void LazyMatrixMarch::addCandidate(float score, u32 i, u32 j, u32 addI, u32 addJ) {
@@ -41,6 +41,7 @@ void LazyMatrixMarch::addCandidate(float score, u32 i, u32 j, u32 addI, u32 addJ
 		// we have a finished run.
 		if(score > bestMatch_) {
 			bestMatch_ = score;
+			minScore_ = std::max(minScore_, score);
 			dlg_assert(i < width());
 			dlg_assert(j < height());
 			bestRes_ = {i, j};
@@ -50,57 +51,48 @@ void LazyMatrixMarch::addCandidate(float score, u32 i, u32 j, u32 addI, u32 addJ
 	}
 
 	auto maxPossible = maxPossibleScore(score, i + addI, j + addJ);
-	if(maxPossible > bestMatch_) {
+	if(maxPossible > bestMatch_ && maxPossible >= minScore_) {
 		// NOTE: retrieving this here kinda costly and redundant to the
 		// check in step(). But it's an early out that cuts down
 		// the number of steps/candidates a lot so probably worth doing
 		// (we otherwise early-out in step() often).
-		auto& m = match(i + addI, j + addJ);
+		auto& m = field(i + addI, j + addJ);
 		if(m.best < score) {
-			if(m.candidate != candidates_.end()) {
-				candidates_.erase(m.candidate);
-			}
-
-			auto [it, succ] = candidates_.insert({u16(i + addI), u16(j + addJ), score});
-			dlg_assert(succ);
-			m.candidate = it;
 			m.best = score;
+
+			// the score can only increase, moving the candidate up
+			if(m.candidate != noCandidate) {
+				dlg_assert(candidates_[m.candidate].field == &m);
+				candidates_[m.candidate].score = score;
+				siftUp(m.candidate);
+			} else {
+				m.candidate = u32(candidates_.size());
+				candidates_.push_back({i + addI, j + addJ, score, &m});
+				siftUp(m.candidate);
+			}
 		}
 	}
 }
 
-bool LazyMatrixMarch::step() {
+void LazyMatrixMarch::advance(const HeapCand& cand) {
 	ExtZoneScoped;
 
-	if(empty()) {
-		return false;
-	}
-
 	++numSteps_;
-	auto cand = popCandidate();
 
 	// should be true due to pruning
 	dlg_assert(maxPossibleScore(cand) >= bestMatch_);
 
-	auto& m = this->match(cand.i, cand.j);
-	m.candidate = candidates_.end();
+	auto& m = *cand.field;
 
 	// this invariant follows from the way we insert new candidates
 	// there is always at most one candidate per field
 	dlg_assert(m.best == cand.score);
-
-	if(m.eval == -1.f) {
-		ExtZoneScopedN("eval");
-		m.eval = matcher_(cand.i, cand.j);
-		++numEvals_;
-	}
+	dlg_assert(m.eval != -1.f);
 
 	if(m.eval > 0.f) {
 		auto newScore = cand.score + m.eval;
+		minScore_ = std::max(minScore_, newScore);
 		addCandidate(newScore, cand.i, cand.j, 1, 1);
-
-		// throw out all candidates that can't even reach what we have
-		prune(newScore);
 	}
 
 	// NOTE: yeah with fuzzy matching we should always branch
@@ -115,16 +107,13 @@ bool LazyMatrixMarch::step() {
 		addCandidate(cand.score, cand.i, cand.j, 0, 1);
 	}
 
-	return true;
+	// throw out all candidates that can't even reach what we have
+	prune();
 }
 
-LazyMatrixMarch::Result LazyMatrixMarch::run() {
+LazyMatrixMarch::Result LazyMatrixMarch::gatherResult() {
 	ExtZoneScoped;
 
-	// run algorithm
-	while(step()) /*noop*/;
-
-	// gather results
 	Result res;
 	auto maxMatches = std::min(width(), height());
 	res.matches = alloc_.alloc<ResultMatch>(maxMatches);
@@ -134,28 +123,28 @@ LazyMatrixMarch::Result LazyMatrixMarch::run() {
 	dlg_assert(bestMatch_ >= 0.f);
 
 	auto [i, j] = bestRes_;
-	auto& lastMatch = match(i, j);
+	auto& lastMatch = matchData(i, j);
 	dlg_assert(std::abs(bestMatch_ - (lastMatch.best + lastMatch.eval)) < 0.0001);
 	if(lastMatch.eval > 0.f) {
-		res.matches[outID - 1] = {i, j, lastMatch.eval};
+		res.matches[outID - 1] = {i, j, lastMatch.eval, lastMatch.evalID};
 		--outID;
 	}
 
 	while(i > 0 && j > 0) {
-		auto& score = match(i, j);
-		auto& up = match(i, j - 1);
+		auto& score = matchData(i, j);
+		auto& up = matchData(i, j - 1);
 		if(up.best == score.best) {
 			--j;
 			continue;
 		}
 
-		auto& left = match(i - 1, j);
+		auto& left = matchData(i - 1, j);
 		if(left.best == score.best) {
 			--i;
 			continue;
 		}
 
-		auto& diag = match(i - 1, j - 1);
+		auto& diag = matchData(i - 1, j - 1);
 		dlg_assert(diag.best < score.best);
 		dlg_assertm(diag.eval > 0.f && diag.eval <= 1.f, "{}", diag.eval);
 		dlg_assertm(std::abs(diag.eval - (score.best - diag.best)) < 0.001,
@@ -166,7 +155,7 @@ LazyMatrixMarch::Result LazyMatrixMarch::run() {
 		--j;
 
 		dlg_assert(outID != 0);
-		res.matches[outID - 1] = {i, j, diag.eval};
+		res.matches[outID - 1] = {i, j, diag.eval, diag.evalID};
 		--outID;
 	}
 
@@ -178,44 +167,195 @@ float LazyMatrixMarch::maxPossibleScore(float score, u32 i, u32 j) const {
 	return vil::maxPossibleScore(score, width_, height_, i, j);
 }
 
+bool LazyMatrixMarch::less(const HeapCand& a, const HeapCand& b) const {
+	// for pruning to work correctly, it's important that maxPossibleScore
+	// is always the primary criterion
+	auto scA = maxPossibleScore(a);
+	auto scB = maxPossibleScore(b);
+
+	if(scA < scB) {
+		return true;
+	} else if(scB < scA) {
+		return false;
+	}
+
+	if(a.score < b.score) {
+		return true;
+	} else if(b.score < a.score) {
+		return false;
+	}
+
+	if(a.i < b.i) {
+		return true;
+	} else if(b.i < a.i) {
+		return false;
+	}
+
+	return a.j < b.j;
+}
+
+void LazyMatrixMarch::place(const HeapCand& cand, u32 id) {
+	candidates_[id] = cand;
+	cand.field->candidate = id;
+}
+
+void LazyMatrixMarch::siftUp(u32 id) {
+	auto cand = candidates_[id];
+	while(id > 0u) {
+		auto parent = (id - 1) / 2;
+		if(!less(candidates_[parent], cand)) {
+			break;
+		}
+
+		place(candidates_[parent], id);
+		id = parent;
+	}
+
+	place(cand, id);
+}
+
+void LazyMatrixMarch::siftDown(u32 id) {
+	auto cand = candidates_[id];
+	auto size = u32(candidates_.size());
+	while(true) {
+		auto child = 2 * id + 1;
+		if(child >= size) {
+			break;
+		}
+
+		if(child + 1 < size && less(candidates_[child], candidates_[child + 1])) {
+			++child;
+		}
+
+		if(!less(cand, candidates_[child])) {
+			break;
+		}
+
+		place(candidates_[child], id);
+		id = child;
+	}
+
+	place(cand, id);
+}
+
 LazyMatrixMarch::HeapCand LazyMatrixMarch::popCandidate() {
 	dlg_assert(!empty());
 
-	auto it = candidates_.end();
-	--it;
-	auto cand = *it;
-	candidates_.erase(it); // pop_back, basically
+	auto cand = candidates_.front();
+	cand.field->candidate = noCandidate;
+
+	auto last = candidates_.back();
+	candidates_.pop_back();
+	if(!candidates_.empty()) {
+		place(last, 0u);
+		siftDown(0u);
+	}
+
 	return cand;
 }
 
 LazyMatrixMarch::HeapCand LazyMatrixMarch::peekCandidate() const {
-	auto it = candidates_.end();
-	--it;
-	return *it;
+	dlg_assert(!empty());
+	return candidates_.front();
 }
 
-void LazyMatrixMarch::prune(float minScore) {
-	ExtZoneScoped;
+void LazyMatrixMarch::prune() {
+	// The candidate with the highest possible score is always on top.
+	// Once it can't reach the best score anymore, no candidate can.
+	// Candidates further down are left in the heap, they are never
+	// popped before that.
+	if(empty() || maxPossibleScore(candidates_.front()) >= minScore_) {
+		return;
+	}
 
-	// for this to work correctly, it's important that maxPossibleScore
-	// is always the primary criterion in the heap comparison function
+	for(auto& cand : candidates_) {
+		cand.field->candidate = noCandidate;
+	}
 
-	auto it = candidates_.begin();
-	for(; it != candidates_.end(); ++it) {
-		if(maxPossibleScore(*it) >= minScore) {
-			break;
+	candidates_.clear();
+}
+
+// hash grid
+namespace {
+
+u64 gridHash(u32 i, u32 j) {
+	// fibonacci hashing, the high bits are used
+	return ((u64(j) << 32u) | i) * 0x9E3779B97F4A7C15ull;
+}
+
+} // anon namespace
+
+const LazyMatrixMarch::Field* LazyMatrixMarch::findField(u32 i, u32 j) const {
+	dlg_assert(i < width() && j < height());
+
+	auto mask = grid_.size() - 1;
+	auto id = (gridHash(i, j) >> 32u) & mask;
+	while(grid_[id]) {
+		if(grid_[id]->i == i && grid_[id]->j == j) {
+			return grid_[id];
 		}
 
-		auto& m = match(it->i, it->j);
-		dlg_assert(m.candidate != candidates_.end());
-		m.candidate = candidates_.end();
+		id = (id + 1) & mask;
 	}
 
-	if(it != candidates_.begin()) {
-		candidates_.erase(candidates_.begin(), it);
+	return nullptr;
+}
+
+const LazyMatrixMarch::Field& LazyMatrixMarch::matchData(u32 i, u32 j) const {
+	static const Field unvisited {};
+	auto* found = findField(i, j);
+	return found ? *found : unvisited;
+}
+
+LazyMatrixMarch::Field& LazyMatrixMarch::field(u32 i, u32 j) {
+	dlg_assert(i < width() && j < height());
+
+	// keep load factor <= 0.5
+	if(2 * (gridCount_ + 1) > grid_.size()) {
+		growGrid();
 	}
 
-	return;
+	auto mask = grid_.size() - 1;
+	auto id = (gridHash(i, j) >> 32u) & mask;
+	while(grid_[id]) {
+		if(grid_[id]->i == i && grid_[id]->j == j) {
+			return *grid_[id];
+		}
+
+		id = (id + 1) & mask;
+	}
+
+	// fields are allocated separately so their address stays stable,
+	// HeapCand references them.
+	auto& field = alloc_.construct<Field>();
+	field.i = i;
+	field.j = j;
+	grid_[id] = &field;
+	++gridCount_;
+	return field;
+}
+
+void LazyMatrixMarch::growGrid() {
+	ExtZoneScoped;
+
+	// NOTE: the old grid isn't freed, but the sizes grow geometrically,
+	// the total waste is bounded by the size of the new grid.
+	auto old = grid_;
+	grid_ = alloc_.alloc<Field*>(2 * old.size());
+
+	auto mask = grid_.size() - 1;
+	for(auto* field : old) {
+		if(!field) {
+			continue;
+		}
+
+		auto id = (gridHash(field->i, field->j) >> 32u) & mask;
+		while(grid_[id]) {
+			id = (id + 1) & mask;
+		}
+
+		grid_[id] = field;
+	}
 }
 
 } // namespace vil
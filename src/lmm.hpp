@@ -1,9 +1,8 @@
 #pragma once
 
 #include <util/linalloc.hpp>
-#include <functional>
+#include <util/profiling.hpp>
 #include <utility>
-#include <set>
 
 namespace vil {
 
@@ -21,9 +20,9 @@ namespace vil {
 // of mostly similar sequences, it will be ~O(n).
 // The idea (and implementation) of the algorithm can be described
 // as a best-path finding through the lazily evaluated matching matrix.
-// Memory consumption is currently always O(n^2) since this was never
-// a big problem. It could be reduced, being ~O(n) for the well-matching
-// cases as well.
+// Only the visited fields of the matrix are stored (in a hash grid),
+// so memory consumption scales like the runtime, with the number of
+// differences between the sequences instead of their product.
 //
 // In vil, we need this for command hierachy matching, associating
 // commands between different frames and submissions.
@@ -44,6 +43,10 @@ struct LazyMatrixMarch {
 		u32 i;
 		u32 j;
 		float matchVal;
+		// The number of matcher calls before the one for this field.
+		// Allows callers to store additional data per evaluation in a
+		// flat array, see Field::evalID.
+		u32 evalID;
 	};
 
 	struct Result {
@@ -54,101 +57,89 @@ struct LazyMatrixMarch {
 		span<ResultMatch> matches;
 	};
 
-	struct HeapCand {
-		u16 i;
-		u16 j;
-		float score;
-	};
-
-	struct HeapCandCompare {
-		LazyMatrixMarch& parent;
-
-		bool operator()(const HeapCand& a, const HeapCand& b) const {
-			auto scA = parent.maxPossibleScore(a.score, a.i, a.j);
-			auto scB = parent.maxPossibleScore(b.score, b.i, b.j);
-
-			if(scA < scB) {
-				return true;
-			} else if(scB < scA) {
-				return false;
-			}
-
-			if(a.score < b.score) {
-				return true;
-			} else if(b.score < a.score) {
-				return false;
-			}
-
-			if(a.i < b.i) {
-				return true;
-			} else if(b.i < a.i) {
-				return false;
-			}
-
-			return a.j < b.j;
-		}
-	};
-
-	template<typename T>
-	struct MyAlloc : LinearUnscopedAllocator<T> {
-		using typename LinearUnscopedAllocator<T>::is_always_equal;
-		using typename LinearUnscopedAllocator<T>::value_type;
-		using LinearUnscopedAllocator<T>::LinearUnscopedAllocator;
-		using LinearUnscopedAllocator<T>::allocate;
+	static constexpr auto noCandidate = u32(-1);
+	static constexpr auto notEvaluated = u32(-1);
 
-		void deallocate(T*, size_t) const noexcept {
-			// TODO: use free-list
-			// dlg_error(":(");
-		}
-	};
-
-	using QSet = std::set<HeapCand, HeapCandCompare, MyAlloc<HeapCand>>;
-
-	struct EvalMatch {
+	// A visited field of the matrix.
+	struct Field {
 		// The result of the matcher function at this position.
 		// Lazily evaluated, -1.f if it never was called
 		float eval {-1.f};
 		// The best path found so far to this position
 		// -1.f when we never had a path here
 		float best {-1.f};
-		// current candidate, if any.
-		// with this we can make sure there is never more than one
-		// candidate per field
-		QSet::const_iterator candidate; // candidates_.end() when there is none
+		// Index of the current candidate for this field in the heap,
+		// noCandidate if there is none. With this we can make sure there
+		// is never more than one candidate per field.
+		u32 candidate {noCandidate};
+		// Number of matcher calls before the one for this field,
+		// notEvaluated if it was never evaluated.
+		u32 evalID {notEvaluated};
+		// position of the field, key in the hash grid
+		u32 i {};
+		u32 j {};
 	};
 
-	// The function evaluating the match between the ith element in the
-	// first sequence with the jth element in the second sequence.
-	// Note how the LazyMatrixMarch algorithm itself never sees the sequences
-	// itself, does not care about their types of properties.
-	// Expected to return a matching value in range [0, 1] where 0
-	// means no match and a value >0 means there's a match, returning
-	// it's weight/value/importance/quality.
-	// Guaranteed to be called at most once per run for each (i, j)
-	// combinations so don't bother caching results.
-	using Matcher = std::function<float(u32 i, u32 j)>;
+	struct HeapCand {
+		u32 i;
+		u32 j;
+		float score;
+		Field* field;
+	};
 
 	// width: length of the first sequence
 	// height: length of the second sequence
 	// alloc: an allocator guaranteed to outlive this
-	// matcher: the matching functions holding information about the sequences
 	LazyMatrixMarch(u32 width, u32 height, LinAllocator& alloc,
-		Matcher matcher, float branchThreshold = 0.95);
+		float branchThreshold = 0.95);
 
 	// Runs the algorithm to completion (can also be called if 'step' was
 	// called before) and returns the best path and its matches.
-	Result run();
+	// The matcher evaluates the match between the ith element in the
+	// first sequence with the jth element in the second sequence:
+	// 	float matcher(u32 i, u32 j);
+	// Note how the LazyMatrixMarch algorithm itself never sees the sequences
+	// itself, does not care about their types of properties.
+	// Expected to return a matching value in range [0, 1] where 0
+	// means no match and a value >0 means there's a match, returning
+	// it's weight/value/importance/quality.
+	// Guaranteed to be called at most once per run for each (i, j)
+	// combinations so don't bother caching results.
+	template<typename Matcher>
+	Result run(Matcher&& matcher) {
+		ExtZoneScoped;
+
+		while(step(matcher)) /*noop*/;
+		return gatherResult();
+	}
 
 	// Returns false if there's nothing to do anymore.
-	bool step();
+	template<typename Matcher>
+	bool step(Matcher&& matcher) {
+		if(empty()) {
+			return false;
+		}
+
+		auto cand = popCandidate();
+		auto& m = *cand.field;
+		if(m.eval == -1.f) {
+			ExtZoneScopedN("eval");
+			m.evalID = numEvals_;
+			m.eval = matcher(cand.i, cand.j);
+			++numEvals_;
+		}
+
+		advance(cand);
+		return true;
+	}
 
 	// inspection
 	HeapCand peekCandidate() const;
-	const auto& candidates() const { return candidates_; }
-	bool empty() const { return candidates_.empty(); }
-	const EvalMatch& matchData(u32 i, u32 j) const {
-		return matchMatrix_[width() * j + i];
+	span<const HeapCand> candidates() const {
+		return {candidates_.data(), candidates_.size()};
 	}
+	bool empty() const { return candidates_.empty(); }
+	const Field& matchData(u32 i, u32 j) const;
 
 	u32 width() const { return width_; }
 	u32 height() const { return height_; }
@@ -156,19 +147,28 @@ struct LazyMatrixMarch {
 	// debug information
 	u32 numEvals() const { return numEvals_; }
 	u32 numSteps() const { return numSteps_; }
+	u32 numFields() const { return gridCount_; }
 
 private:
+	void advance(const HeapCand& cand);
+	Result gatherResult();
 	void addCandidate(float score, u32 i, u32 j, u32 addI, u32 addJ);
 
 	HeapCand popCandidate();
-	void prune(float minScore);
-	EvalMatch& match(u32 i, u32 j) {
-		return matchMatrix_[width() * j + i];
-	}
+	void prune();
+	void siftUp(u32 id);
+	void siftDown(u32 id);
+	bool less(const HeapCand& a, const HeapCand& b) const;
+	void place(const HeapCand& cand, u32 id);
+
+	// Returns the field, inserting it when it wasn't visited yet.
+	Field& field(u32 i, u32 j);
+	const Field* findField(u32 i, u32 j) const;
+	void growGrid();
 
 	// util
 	float maxPossibleScore(float score, u32 i, u32 j) const;
-	float maxPossibleScore(const HeapCand& c) {
+	float maxPossibleScore(const HeapCand& c) const {
 		return maxPossibleScore(c.score, c.i, c.j);
 	}
 
@@ -176,20 +176,25 @@ private:
 	LinAllocator& alloc_;
 	u32 width_;
 	u32 height_;
-	Matcher matcher_;
-	// lazily evaluated matrix
-	// NOTE: need unique span since the iterator type might be
-	// non-trivially-destructible (e.g. the case for stdc++ debug mode)
-	UniqueSpan<EvalMatch> matchMatrix_;
 	float bestMatch_ {-1.f};
 	std::pair<u32, u32> bestRes_ {};
 	float branchThreshold_;
+	// The best score of any path found so far, finished or not. Since
+	// scores never decrease, no candidate that can't reach it
+	// has to be considered.
+	float minScore_ {0.f};
+
+	// visited fields of the lazily evaluated matrix, open addressing.
+	// Null for empty entries.
+	span<Field*> grid_;
+	u32 gridCount_ {};
 
 	// debug functionality
 	u32 numEvals_ {};
 	u32 numSteps_ {};
 
-	QSet candidates_;
+	// binary max-heap, ordered by maxPossibleScore
+	LinAllocVector<HeapCand> candidates_;
 };
 
 float maxPossibleScore(float score, u32 width, u32 height, u32 i, u32 j);
@@ -455,20 +455,21 @@ VKAPI_ATTR void VKAPI_CALL DestroyPipeline(
 
 	// Pipeline destructor isn't virtual so we release the IntrusivePtr<Pipeline>
 	// and construct an IntrusivePtr temporary with the correct type.
-	// That will decrease the refCount (and potentially delete the object)
-	// since its immediately destroyed again.
+	// That is retired (records might still use the pipeline) and then
+	// decreases the refCount (potentially deleting the object) since its
+	// immediately destroyed again.
 	switch(pipe->type) {
 		case VK_PIPELINE_BIND_POINT_GRAPHICS:
-			IntrusivePtr<GraphicsPipeline>(acquireOwnership,
-				static_cast<GraphicsPipeline*>(pipe.release()));
+			retire(dev, IntrusivePtr<GraphicsPipeline>(acquireOwnership,
+				static_cast<GraphicsPipeline*>(pipe.release())));
 			break;
 		case VK_PIPELINE_BIND_POINT_COMPUTE:
-			IntrusivePtr<ComputePipeline>(acquireOwnership,
-				static_cast<ComputePipeline*>(pipe.release()));
+			retire(dev, IntrusivePtr<ComputePipeline>(acquireOwnership,
+				static_cast<ComputePipeline*>(pipe.release())));
 			break;
 		case VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR:
-			IntrusivePtr<RayTracingPipeline>(acquireOwnership,
-				static_cast<RayTracingPipeline*>(pipe.release()));
+			retire(dev, IntrusivePtr<RayTracingPipeline>(acquireOwnership,
+				static_cast<RayTracingPipeline*>(pipe.release())));
 			break;
 		default:
 			dlg_error("unreachable");
@@ -536,7 +537,7 @@ VKAPI_ATTR void VKAPI_CALL DestroyPipelineLayout(
 	}
 
 	auto& dev = getDevice(device);
-	dev.pipeLayouts.mustErase(pipelineLayout);
+	retire(dev, dev.pipeLayouts.mustMove(pipelineLayout));
 
 	// NOTE: We intenntionally don't destruct the handle here, handle might
 	// need to be kept alive, they have shared ownership. Destroyed
@@ -674,6 +675,9 @@ std::unique_ptr<spc::Compiler> copySpecializeSpirv(const PipelineShaderStage& st
 		stage.entryPoint, execModel);
 }
 
+Pipeline::Pipeline() : id(nextUniqueID<Pipeline>()) {
+}
+
 GraphicsPipeline::~GraphicsPipeline() = default;
 
 void fixPointers(GraphicsPipeline& pipe) {
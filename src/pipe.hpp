@@ -57,10 +57,14 @@ struct Pipeline : SharedDeviceHandle {
 	// handle alive here either, should be cheap.
 	IntrusivePtr<PipelineLayout> layout {};
 
+	// Pipelines are immutable, so matching results between two of them
+	// are cached by this id, see command/match.cpp.
+	const u64 id;
+
 protected:
 	// Make sure Pipeline objects are not created.
 	// Should always be GraphicsPipeline or ComputePipeline
-	Pipeline() = default;
+	Pipeline();
 	~Pipeline() = default;
 };
 
@@ -31,6 +31,17 @@ Platform::Platform() {
 		// none by default, rarely needed feature
 		focusKey_ = VilKeyNone;
 	}
+
+	// triggers a frame capture, see FrameCapture
+	auto captureKeyString = std::getenv("VIL_CAPTURE_KEY");
+	if(captureKeyString) {
+		captureKey_ = (enum VilKey) swa_key_from_name(captureKeyString);
+		if(captureKey_ == VilKeyNone) {
+			dlg_error("Invalid key name: {}", captureKeyString);
+		}
+	} else {
+		captureKey_ = VilKeyNone;
+	}
 }
 
 // api
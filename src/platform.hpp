@@ -31,6 +31,7 @@ struct Platform {
 	// They are read via environment variables
 	int toggleKey_ {0};
 	int focusKey_ {0};
+	int captureKey_ {0};
 };
 
 VKAPI_ATTR void VKAPI_CALL DestroySurfaceKHR(
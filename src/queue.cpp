@@ -42,6 +42,7 @@ void finish(SubmissionBatch& batch) {
 				auto it2 = std::find(scb.cb->pending.begin(), scb.cb->pending.end(), &sub);
 				dlg_assert(it2 != scb.cb->pending.end());
 				scb.cb->pending.erase(it2);
+				scb.cb->pendingCount.store(u32(scb.cb->pending.size()), std::memory_order_release);
 			}
 		}
 
@@ -112,7 +113,33 @@ void finish(SubmissionBatch& batch) {
 	}
 }
 
-std::optional<SubmIterator> checkLocked(SubmissionBatch& batch) {
+// Updates queue.completedSubmissionID from the submission semaphore.
+void updateCompletedLocked(Queue& queue) {
+	auto& dev = *queue.dev;
+	assertOwned(dev.mutex);
+	dlg_assert(dev.timelineTracking);
+
+	if(queue.completedSubmissionID >= queue.submissionCounter) {
+		return;
+	}
+
+	u64 value {};
+	auto res = dev.dispatch.GetSemaphoreCounterValue(dev.handle,
+		queue.submissionSemaphore, &value);
+	if(res != VK_SUCCESS) {
+		if(res == VK_ERROR_DEVICE_LOST) {
+			onDeviceLost(dev);
+		}
+
+		return;
+	}
+
+	queue.completedSubmissionID = std::max(queue.completedSubmissionID, value);
+}
+
+// When 'updateCounter' is false, batches tracked via timeline semaphore
+// are only checked against the last known counter of their queue.
+std::optional<SubmIterator> checkLocked(SubmissionBatch& batch, bool updateCounter) {
 	ZoneScoped;
 
 	auto& dev = *batch.queue->dev;
@@ -128,7 +155,20 @@ std::optional<SubmIterator> checkLocked(SubmissionBatch& batch) {
 		}
 	}
 
-	if(batch.appFence) {
+	if(batch.lastSubmissionID) {
+		auto& queue = *batch.queue;
+		if(updateCounter && queue.completedSubmissionID < batch.lastSubmissionID) {
+			updateCompletedLocked(queue);
+		}
+
+		// Explicit checks (e.g. after the application waited for its fence)
+		// don't rely on the ordering of the semaphore and fence signals.
+		auto checkFence = updateCounter && batch.appFence;
+		if(queue.completedSubmissionID < batch.lastSubmissionID && (!checkFence ||
+				dev.dispatch.GetFenceStatus(dev.handle, batch.appFence->handle) != VK_SUCCESS)) {
+			return std::nullopt;
+		}
+	} else if(batch.appFence) {
 		auto res = dev.dispatch.GetFenceStatus(dev.handle, batch.appFence->handle);
 		if(res != VK_SUCCESS) {
 			if(res == VK_ERROR_DEVICE_LOST) {
@@ -168,15 +208,55 @@ std::optional<SubmIterator> checkLocked(SubmissionBatch& batch) {
 	return dev.pending.erase(it);
 }
 
+std::optional<SubmIterator> checkLocked(SubmissionBatch& batch) {
+	return checkLocked(batch, true);
+}
+
+VkResult waitLocked(SubmissionBatch& batch) {
+	ZoneScoped;
+
+	auto& dev = *batch.queue->dev;
+	assertOwned(dev.mutex);
+
+	VkResult res;
+	if(batch.lastSubmissionID) {
+		VkSemaphoreWaitInfo wi {};
+		wi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wi.semaphoreCount = 1u;
+		wi.pSemaphores = &batch.queue->submissionSemaphore;
+		wi.pValues = &batch.lastSubmissionID;
+		res = dev.dispatch.WaitSemaphores(dev.handle, &wi, UINT64_MAX);
+	} else {
+		auto fence = batch.appFence ? batch.appFence->handle : batch.ourFence;
+		dlg_assert(fence);
+		res = dev.dispatch.WaitForFences(dev.handle, 1u, &fence, true, UINT64_MAX);
+	}
+
+	if(res == VK_ERROR_DEVICE_LOST) {
+		onDeviceLost(dev);
+	}
+
+	return res;
+}
+
 SubmittedCommandBuffer::SubmittedCommandBuffer() = default;
 SubmittedCommandBuffer::~SubmittedCommandBuffer() = default;
 
 void checkPendingSubmissionsLocked(Device& dev) {
+	ZoneScoped;
 	assertOwned(dev.mutex);
 
+	// Only query the counter of each queue once instead of checking
+	// every pending batch individually.
+	if(dev.timelineTracking) {
+		for(auto& queue : dev.queues) {
+			updateCompletedLocked(*queue);
+		}
+	}
+
 	for(auto it = dev.pending.begin(); it != dev.pending.end();) {
 		auto& subm = *it;
-		auto nit = checkLocked(*subm);
+		auto nit = checkLocked(*subm, false);
 		if(nit) {
 			it = *nit;
 			continue;
@@ -200,6 +280,10 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 
 	VkResult res;
 
+	// Records replaced by recording threads, disconnected while we hold
+	// the device mutex anyways. Destroyed outside the critical section.
+	std::vector<IntrusivePtr<CommandRecord>> replacedRecords;
+
 	// Lock order is important here, lock dev mutex before queue mutex.
 	// We lock the dev mutex to sync with gui.
 	{
@@ -209,6 +293,7 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 		// Maybe we can handle this with a separate gui/submission sync mutex?
 		std::lock_guard devLock(dev.mutex);
 
+		disconnectReplacedRecordsLocked(dev, replacedRecords);
 		addSubmissionSyncLocked(submitter);
 		if(dev.doFullSync) {
 			addFullSyncLocked(submitter);
@@ -253,6 +338,10 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 		dev.pending.push_back(std::move(submitter.dstBatch));
 	}
 
+	if(dev.submissionWaiter) {
+		dev.submissionWaiter->notify();
+	}
+
 	return res;
 }
 
@@ -379,6 +468,10 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 
 	VkResult res;
 
+	// Records replaced by recording threads, disconnected while we hold
+	// the device mutex anyways. Destroyed outside the critical section.
+	std::vector<IntrusivePtr<CommandRecord>> replacedRecords;
+
 	// Lock order is important here, lock dev mutex before queue mutex.
 	// We lock the dev mutex to sync with gui.
 	{
@@ -388,6 +481,7 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 		// Maybe we can handle this with a separate gui/submission sync mutex?
 		std::lock_guard devLock(dev.mutex);
 
+		disconnectReplacedRecordsLocked(dev, replacedRecords);
 		addSubmissionSyncLocked(submitter);
 		if(dev.doFullSync) {
 			addFullSyncLocked(submitter);
@@ -689,4 +783,101 @@ bool checkActivateLocked(Submission& subm) {
 BindSparseSubmission::BindSparseSubmission() = default;
 BindSparseSubmission::~BindSparseSubmission() = default;
 
+// SubmissionWaiter
+SubmissionWaiter::SubmissionWaiter(Device& dev) : dev_(dev) {
+	dlg_assert(dev.timelineTracking);
+	thread_ = std::thread([this]{ run(); });
+}
+
+SubmissionWaiter::~SubmissionWaiter() {
+	{
+		std::lock_guard lock(mutex_);
+		run_ = false;
+	}
+
+	cv_.notify_one();
+	if(thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void SubmissionWaiter::notify() {
+	{
+		std::lock_guard lock(mutex_);
+		notified_ = true;
+	}
+
+	cv_.notify_one();
+}
+
+void SubmissionWaiter::run() {
+	// Waiting is interrupted regularly to notice new submissions to
+	// other queues and destruction.
+	constexpr auto waitTimeout = u64(10'000'000u); // 10ms
+
+	std::vector<Queue*> queues;
+	std::vector<VkSemaphore> semaphores;
+	std::vector<u64> values;
+
+	while(true) {
+		queues.clear();
+		semaphores.clear();
+		values.clear();
+
+		{
+			std::lock_guard lock(dev_.mutex);
+			checkPendingSubmissionsLocked(dev_);
+
+			// Wait for the oldest pending batch of each queue. Batches
+			// that aren't active yet can't be retired, we would just
+			// spin. Following batches of that queue can't complete first.
+			for(auto& batch : dev_.pending) {
+				if(contains(queues, batch->queue)) {
+					continue;
+				}
+
+				queues.push_back(batch->queue);
+				auto active = std::all_of(batch->submissions.begin(),
+					batch->submissions.end(), [](auto& sub) { return sub.active; });
+				if(!batch->lastSubmissionID || !active) {
+					continue;
+				}
+
+				semaphores.push_back(batch->queue->submissionSemaphore);
+				values.push_back(batch->lastSubmissionID);
+			}
+		}
+
+		if(semaphores.empty()) {
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{ return !run_ || notified_; });
+			notified_ = false;
+			if(!run_) {
+				break;
+			}
+
+			continue;
+		}
+
+		VkSemaphoreWaitInfo wi {};
+		wi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wi.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+		wi.semaphoreCount = u32(semaphores.size());
+		wi.pSemaphores = semaphores.data();
+		wi.pValues = values.data();
+
+		auto res = dev_.dispatch.WaitSemaphores(dev_.handle, &wi, waitTimeout);
+		if(res == VK_ERROR_DEVICE_LOST) {
+			onDeviceLost(dev_);
+			break;
+		}
+
+		std::lock_guard lock(mutex_);
+		notified_ = false;
+		if(!run_) {
+			break;
+		}
+	}
+}
+
 } // namespace vil
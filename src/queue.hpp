@@ -10,6 +10,9 @@
 #include <memory>
 #include <atomic>
 #include <variant>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace vil {
 
@@ -42,6 +45,12 @@ struct Queue : Handle {
 	// never decreases even for out-of-order overlapping of bind/submit).
 	VkSemaphore submissionSemaphore {};
 
+	// Only valid with Device::timelineTracking. The last known value
+	// of submissionSemaphore, i.e. all submissions to this queue with
+	// a submissionID up to this have completed.
+	// Synchronized via device mutex.
+	u64 completedSubmissionID {};
+
 	// Only valid when using timeline semaphores, used for full-sync.
 	// The submissionID of the last submission where the layer inserted
 	// commands, e.g. for gui rendering or via a CommandHook.
@@ -164,6 +173,7 @@ VkResult submitSemaphore(Queue&, VkSemaphore, bool timeline = false);
 VkSemaphore getSemaphoreFromPool(Device& dev);
 VkSemaphore getSemaphoreFromPoolLocked(Device& dev);
 VkFence getFenceFromPool(Device& dev);
+VkFence getFenceFromPoolLocked(Device& dev);
 
 // Batch of Submissions, represents and tracks one vkQueueSubmit call.
 // Immutable after creation.
@@ -178,9 +188,17 @@ struct SubmissionBatch {
 	Fence* appFence {};
 
 	// When the caller didn't add a fence, we added this one from the fence pool.
-	// When appFence is not null, this is null.
+	// When appFence is not null or the batch is tracked via
+	// lastSubmissionID, this is null.
 	VkFence ourFence {};
 
+	// With Device::timelineTracking, the value the submissionSemaphore of
+	// the queue is set to when this batch has completed. Completion is
+	// then tracked via the semaphore instead of a fence.
+	// Zero for batches tracked via fence, e.g. sparse bindings or empty
+	// submissions that don't signal the semaphore.
+	u64 lastSubmissionID {};
+
 	// Device pool semaphores that should be re-added to the pool after this.
 	// Only currently used when timeline semaphores aren't available.
 	std::vector<VkSemaphore> poolSemaphores {};
@@ -193,6 +211,34 @@ struct SubmissionBatch {
 using SubmIterator = std::vector<std::unique_ptr<SubmissionBatch>>::iterator;
 std::optional<SubmIterator> checkLocked(SubmissionBatch& subm);
 
+// Expects dev.mutex to be locked.
+// Blocks until the given batch has completed. Does not retire it.
+VkResult waitLocked(SubmissionBatch& subm);
+
+// Optional thread that blocks on the submissionSemaphores of the queues
+// and retires completed submissions (finishing their hooks) as soon as
+// they complete, instead of on the next submission or wait call.
+// Only used with Device::timelineTracking, see VIL_SUBMISSION_WAITER.
+class SubmissionWaiter {
+public:
+	explicit SubmissionWaiter(Device& dev);
+	~SubmissionWaiter();
+
+	// Wakes up the thread when it's idle, to be called after new
+	// submissions. Must not be called while the device mutex is locked.
+	void notify();
+
+private:
+	void run();
+
+	Device& dev_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool run_ {true}; // protected by mutex_
+	bool notified_ {}; // protected by mutex_
+	std::thread thread_;
+};
+
 VkResult waitIdleImpl(Device& dev);
 VkResult doSubmit(Queue& qd, span<const VkSubmitInfo2> submits,
 	VkFence fence, bool legacy);
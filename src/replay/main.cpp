@@ -0,0 +1,11 @@
+#if defined(_WIN32) || defined(__CYGWIN__)
+	#define VIL_IMPORT __declspec(dllimport)
+#else
+	#define VIL_IMPORT
+#endif
+
+extern "C" VIL_IMPORT int vil_runReplay(int argc, const char** argv);
+
+int main(int argc, const char** argv) {
+	return vil_runReplay(argc, argv);
+}
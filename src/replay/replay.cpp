@@ -0,0 +1,422 @@
+// Headless replay benchmark over serialized command selections, as saved
+// by the command viewer (see CommandRecordGui::saveSelection).
+// Loads the captures without any vulkan device and runs the matching,
+// hook target search and record traversal paths in a loop, reporting
+// timings and memory. See src/replay/main.cpp for the executable.
+
+#include <serialize/serialize.hpp>
+#include <serialize/util.hpp>
+#include <command/commands.hpp>
+#include <command/record.hpp>
+#include <command/match.hpp>
+#include <commandHook/hook.hpp>
+#include <frame.hpp>
+#include <frameCapture.hpp>
+#include <stats.hpp>
+#include <threadContext.hpp>
+#include <util/export.hpp>
+#include <util/util.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+	#include <sys/resource.h>
+#endif // _WIN32
+
+namespace vil {
+namespace {
+
+struct Capture {
+	std::string path;
+	std::vector<std::byte> data;
+	StateLoaderPtr loader;
+
+	// The selection state, see CommandRecordGui::load
+	std::vector<FrameSubmission> frame;
+	u32 submissionID {u32(-1)};
+	IntrusivePtr<CommandRecord> record;
+	std::vector<const Command*> command;
+};
+
+struct ReplayOptions {
+	u32 iterations {100u};
+	MatchType matchType {MatchType::deep};
+};
+
+bool readFile(const char* path, std::vector<std::byte>& data) {
+	auto* f = std::fopen(path, "rb");
+	if(!f) {
+		dlg_error("Could not open '{}': {}", path, std::strerror(errno));
+		return false;
+	}
+
+	std::fseek(f, 0, SEEK_END);
+	auto size = std::ftell(f);
+	std::fseek(f, 0, SEEK_SET);
+
+	data.resize(size_t(std::max<long>(size, 0)));
+	auto read = std::fread(data.data(), 1u, data.size(), f);
+	std::fclose(f);
+
+	return read == data.size();
+}
+
+bool loadCapture(Capture& capture) {
+	if(!readFile(capture.path.c_str(), capture.data)) {
+		return false;
+	}
+
+	// frame captures (see FrameCapture) are compressed
+	auto fileMagic = u64 {};
+	if(capture.data.size() >= sizeof(fileMagic)) {
+		std::memcpy(&fileMagic, capture.data.data(), sizeof(fileMagic));
+	}
+
+	if(fileMagic == frameCaptureMagicValue) {
+		std::vector<std::byte> data;
+		if(!decompressFrameCapture(capture.data, data)) {
+			dlg_error("'{}': invalid frame capture", capture.path);
+			return false;
+		}
+
+		capture.data = std::move(data);
+	}
+
+	auto buf = LoadBuf{ReadBuf(capture.data)};
+	if(buf.buf.size() < sizeof(u64) + sizeof(u32)) {
+		dlg_error("'{}': file too small", capture.path);
+		return false;
+	}
+
+	auto magic = read<u64>(buf);
+	if(magic != serializeMagicValue) {
+		dlg_error("'{}': invalid magic value {}", capture.path, magic);
+		return false;
+	}
+
+	auto loaderSize = read<u32>(buf);
+	if(loaderSize >= buf.buf.size()) {
+		dlg_error("'{}': invalid state size", capture.path);
+		return false;
+	}
+
+	auto loaderBuf = buf.buf.subspan(0, loaderSize);
+	auto selBuf = LoadBuf{buf.buf.subspan(loaderSize)};
+
+	try {
+		capture.loader = createStateLoader(loaderBuf);
+		auto& loader = *capture.loader;
+
+		auto submCount = read<u64>(selBuf);
+		for(auto i = 0u; i < submCount; ++i) {
+			auto& subm = capture.frame.emplace_back();
+			read(selBuf, subm.submissionID);
+
+			auto recCount = read<u64>(selBuf);
+			for(auto j = 0u; j < recCount; ++j) {
+				auto id = read<u64>(selBuf);
+				subm.submissions.push_back(getRecord(loader, id));
+			}
+		}
+
+		capture.submissionID = read<u32>(selBuf);
+		auto recID = read<u64>(selBuf);
+		if(recID != u64(-1)) {
+			capture.record = getRecord(loader, recID);
+		}
+
+		auto cmdCount = read<u64>(selBuf);
+		for(auto i = 0u; i < cmdCount; ++i) {
+			auto* cmd = getCommand(loader, read<u64>(selBuf));
+			if(!cmd) {
+				dlg_error("'{}': invalid command id", capture.path);
+				return false;
+			}
+
+			capture.command.push_back(cmd);
+		}
+
+		// we ignore the rest of the gui state (opened sections etc)
+	} catch(const std::exception& err) {
+		dlg_error("'{}': {}", capture.path, err.what());
+		return false;
+	}
+
+	if(capture.submissionID != u32(-1) &&
+			capture.submissionID >= capture.frame.size()) {
+		dlg_error("'{}': invalid submission id", capture.path);
+		return false;
+	}
+
+	return true;
+}
+
+struct Timing {
+	double min {1e30};
+	double max {};
+	double total {};
+	u32 count {};
+};
+
+template<typename F>
+Timing bench(u32 iterations, F&& func) {
+	using Clock = std::chrono::steady_clock;
+	using MS = std::chrono::duration<double, std::ratio<1, 1000>>;
+
+	Timing ret;
+	for(auto i = 0u; i < iterations; ++i) {
+		auto start = Clock::now();
+		func();
+		auto time = std::chrono::duration_cast<MS>(Clock::now() - start).count();
+
+		ret.min = std::min(ret.min, time);
+		ret.max = std::max(ret.max, time);
+		ret.total += time;
+		++ret.count;
+	}
+
+	return ret;
+}
+
+void print(std::string_view name, const Timing& timing) {
+	if(!timing.count) {
+		return;
+	}
+
+	std::printf("  %-24.*s avg %9.4f ms  min %9.4f ms  max %9.4f ms\n",
+		int(name.size()), name.data(), timing.total / timing.count,
+		timing.min, timing.max);
+}
+
+// Full traversal of all commands, touching what the gui and hook touch
+// on every command.
+u64 traverse(const Command* cmd) {
+	u64 count = 0u;
+	for(; cmd; cmd = cmd->next) {
+		++count;
+		(void) cmd->nameDesc();
+		(void) cmd->category();
+		if(auto* children = cmd->children(); children) {
+			count += traverse(children);
+		}
+	}
+
+	return count;
+}
+
+u64 countCommands(span<const FrameSubmission> frame) {
+	u64 ret = 0u;
+	for(auto& subm : frame) {
+		for(auto& rec : subm.submissions) {
+			ret += traverse(rec->commands);
+		}
+	}
+
+	return ret;
+}
+
+// Mirrors the target search in CommandHook::hook for an inFrame target.
+// Returns whether the target was found.
+bool searchHookTarget(LinAllocator& matchAlloc, MatchType matchType,
+		Capture& src, const Capture& dst, float& dstMatch) {
+	LinAllocScope localMatchMem(matchAlloc);
+	ThreadMemScope tms;
+	auto frameMatch = match(localMatchMem, tms, matchType, src.frame, dst.frame);
+
+	for(auto& submMatch : frameMatch.matches) {
+		if(submMatch.a != &src.frame[src.submissionID]) {
+			continue;
+		}
+
+		for(auto& recMatch : submMatch.matches) {
+			if(recMatch.a != src.record.get()) {
+				continue;
+			}
+
+			auto hierarchy = findHookTarget(matchType, *recMatch.b,
+				src.command, {}, recMatch.matches, dstMatch);
+			return !hierarchy.empty();
+		}
+
+		break;
+	}
+
+	return false;
+}
+
+// Runs all benchmarks for matching 'src' (the target) against 'dst'.
+// Returns the number of failed checks.
+int replay(const ReplayOptions& opts, Capture& src, const Capture& dst) {
+	auto errors = 0;
+	const auto selfMatch = (&src == &dst);
+
+	LinAllocator matchAlloc;
+	auto it = opts.iterations;
+
+	// frame matching
+	float frameMatchVal {};
+	auto frameTiming = bench(it, [&]{
+		LinAllocScope localMatchMem(matchAlloc);
+		ThreadMemScope tms;
+		auto res = match(localMatchMem, tms, opts.matchType, src.frame, dst.frame);
+		frameMatchVal = eval(res.match);
+	});
+
+	print("frame match", frameTiming);
+	std::printf("  %-24s %.4f\n", "frame match value", frameMatchVal);
+
+	if(selfMatch && frameMatchVal < 1.f) {
+		dlg_error("Frame does not fully match itself: {}", frameMatchVal);
+		++errors;
+	}
+
+	// 'find' of the selected command in all records of the frame
+	if(!src.command.empty()) {
+		auto found = 0u;
+		auto findTiming = bench(it, [&]{
+			found = 0u;
+			for(auto& subm : dst.frame) {
+				for(auto& rec : subm.submissions) {
+					auto res = find(opts.matchType, *rec->commands, src.command, {});
+					found += !res.hierarchy.empty();
+				}
+			}
+		});
+
+		print("find", findTiming);
+		std::printf("  %-24s %u\n", "records with target", found);
+
+		if(selfMatch && found == 0u) {
+			dlg_error("Selected command not found in its own frame");
+			++errors;
+		}
+	}
+
+	// hook target search
+	if(src.record && src.submissionID != u32(-1)) {
+		auto found = false;
+		float dstMatch {};
+		auto hookTiming = bench(it, [&]{
+			found = searchHookTarget(matchAlloc, opts.matchType, src, dst, dstMatch);
+		});
+
+		print("hook target search", hookTiming);
+		std::printf("  %-24s %s (match %.4f)\n", "hook target",
+			found ? "found" : "not found", dstMatch);
+
+		if(selfMatch && !found) {
+			dlg_error("Hook target not found in its own frame");
+			++errors;
+		}
+	}
+
+	// record traversal
+	u64 commandCount {};
+	auto traverseTiming = bench(it, [&]{
+		commandCount = countCommands(dst.frame);
+	});
+
+	print("traversal", traverseTiming);
+	std::printf("  %-24s %llu\n", "commands",
+		static_cast<unsigned long long>(commandCount));
+
+	return errors;
+}
+
+void printMemory() {
+	auto& stats = DebugStats::get();
+	std::printf("memory:\n");
+	std::printf("  %-24s %.3f MB\n", "command memory",
+		stats.commandMem.load() / (1024.f * 1024.f));
+	std::printf("  %-24s %.3f MB\n", "thread context memory",
+		stats.threadContextMem.load() / (1024.f * 1024.f));
+	std::printf("  %-24s %u\n", "alive records", stats.aliveRecords.load());
+	std::printf("  %-24s %u\n", "retired handles", stats.retiredHandles.load());
+
+#ifndef _WIN32
+	rusage usage {};
+	if(getrusage(RUSAGE_SELF, &usage) == 0) {
+		std::printf("  %-24s %.3f MB\n", "peak rss",
+			usage.ru_maxrss / 1024.f);
+	}
+#endif // _WIN32
+}
+
+void printUsage() {
+	std::printf("Usage: vilreplay [--iterations N] [--match identity|mixed|deep] "
+		"capture.bin [capture2.bin ...]\n"
+		"Captures are saved by the command viewer (.vil/cmdsel_*.bin)\n"
+		"or by the frame capture (.vil/capture/frame_*.bin).\n"
+		"Each capture is matched against itself, consecutive captures\n"
+		"against each other. Returns the number of failed checks.\n");
+}
+
+} // anon namespace
+} // namespace vil
+
+// Exported entry point for the replay tool.
+// See replay/main.cpp for the executable
+extern "C" VIL_EXPORT int vil_runReplay(int argc, const char** argv) {
+	using namespace vil;
+
+	ReplayOptions opts;
+	std::vector<Capture> captures;
+
+	for(auto i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+		if(arg == "--iterations" && i + 1 < argc) {
+			opts.iterations = u32(std::max(std::atoi(argv[++i]), 1));
+		} else if(arg == "--match" && i + 1 < argc) {
+			auto type = std::string_view(argv[++i]);
+			if(type == "identity") {
+				opts.matchType = MatchType::identity;
+			} else if(type == "mixed") {
+				opts.matchType = MatchType::mixed;
+			} else if(type == "deep") {
+				opts.matchType = MatchType::deep;
+			} else {
+				printUsage();
+				return -1;
+			}
+		} else if(arg == "--help" || arg == "-h") {
+			printUsage();
+			return 0;
+		} else {
+			captures.emplace_back().path = std::string(arg);
+		}
+	}
+
+	if(captures.empty()) {
+		printUsage();
+		return -1;
+	}
+
+	auto errors = 0;
+	for(auto& capture : captures) {
+		if(!loadCapture(capture)) {
+			return -1;
+		}
+	}
+
+	for(auto i = 0u; i < captures.size(); ++i) {
+		auto& capture = captures[i];
+		std::printf("%s (%zu submissions, %zu bytes):\n", capture.path.c_str(),
+			capture.frame.size(), capture.data.size());
+		errors += replay(opts, capture, capture);
+
+		if(i + 1 < captures.size()) {
+			auto& next = captures[i + 1];
+			std::printf("%s -> %s:\n", capture.path.c_str(), next.path.c_str());
+			errors += replay(opts, capture, next);
+		}
+	}
+
+	printMemory();
+	return errors;
+}
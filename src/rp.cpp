@@ -810,6 +810,8 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateRenderPass(
 		}
 	}
 
+	rp.desc.matchHash = computeMatchHash(rp.desc);
+
 	*pRenderPass = castDispatch<VkRenderPass>(rp);
 	dev.renderPasses.mustEmplace(*pRenderPass, std::move(rpPtr));
 
@@ -892,6 +894,8 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateRenderPass2(
 		}
 	}
 
+	rp.desc.matchHash = computeMatchHash(rp.desc);
+
 	*pRenderPass = castDispatch<VkRenderPass>(rp);
 	dev.renderPasses.mustEmplace(*pRenderPass, std::move(rpPtr));
 
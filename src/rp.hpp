@@ -22,8 +22,20 @@ struct RenderPassDesc {
 	// main pNext chain
 	const void* pNext {};
 	VkRenderPassCreateFlags flags {};
+
+	// Hash over everything compared when matching render passes,
+	// computed at creation. Zero when not computed.
+	u64 matchHash {};
 };
 
+// Computes RenderPassDesc::matchHash. Render passes with different
+// hashes are never equal for matching. See command/match.cpp.
+u64 computeMatchHash(const RenderPassDesc&);
+
+// Whether the two render passes are equal for matching.
+// Uses matchHash as early-out when it was computed for both.
+bool equal(const RenderPassDesc& a, const RenderPassDesc& b);
+
 struct RenderPass : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_RENDER_PASS;
 
@@ -56,6 +56,11 @@ u64 add(StateSaver& saver, const H& handle) {
 void write(StateSaver&, std::function<void(ReadBuf)>);
 
 
+// Serialized state files (see CommandRecordGui::saveSelection) start with
+// this value, followed by the u32 size of the data written by the StateSaver,
+// the data itself and the user-defined data (e.g. the gui selection).
+constexpr auto serializeMagicValue = u64(0x411005314A7102BC);
+
 // = Loading =
 using StateLoaderPtr = std::unique_ptr<StateLoader, SerializerDeleter>;
 
@@ -12,11 +12,16 @@
 #include <util/dl.hpp>
 #include <nytl/bytes.hpp>
 #include <vkutil/sync.hpp>
+#include <vkutil/handles.hpp>
 #include <gui/gui.hpp>
 #include <swa/swa.h>
 #include <imgio/image.hpp>
 #include <cstdlib>
 #include <csignal>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 using namespace vil;
 
@@ -83,42 +88,208 @@ VkBool32 VKAPI_PTR messengerCallback(
 	return false;
 }
 
-struct ViewedImage {
-	VkImage img;
-	VkDeviceMemory mem;
-	vil::Image* vilImg;
-};
+// Uploads an image level by level and layer by layer on a separate thread,
+// while it is already shown in the viewer. Only a bounded number of
+// staging buffers (each holding one layer of one level) is used, host
+// memory does not grow with the size of the image.
+// Level 0 is uploaded first since that's what the viewer initially shows,
+// the other levels and layers appear as they finish.
+class ImageLoader {
+public:
+	static constexpr auto slotCount = 3u;
+
+	ImageLoader(vil::Device& dev, Queue& queue, VkImage img, VkExtent3D extent,
+		std::unique_ptr<imgio::ImageProvider> provider);
+	~ImageLoader();
+
+	// Transitions the whole image into shaderReadOnly layout
+	// synchronously, then starts uploading the contents.
+	void start();
+	// Cancels the remaining uploads and waits for the pending ones.
+	void stop();
+
+private:
+	struct Slot {
+		vil::OwnBuffer buf;
+		VkCommandBuffer cb {};
+		vku::Fence fence;
+	};
+
+	void run();
+	Slot& nextSlot();
+	void submit(Slot& slot);
+
+private:
+	vil::Device& dev_;
+	Queue& queue_;
+	VkImage img_;
+	VkExtent3D extent_;
+	std::unique_ptr<imgio::ImageProvider> provider_;
 
-struct SizeAlign {
-	VkDeviceSize size;
-	VkDeviceSize align;
+	VkCommandPool cmdPool_ {};
+	std::array<Slot, slotCount> slots_;
+	u32 nextSlot_ {};
+
+	std::thread thread_;
+	std::atomic<bool> stop_ {};
 };
 
-SizeAlign neededUploadSizeAlign(const vil::Device& dev,
-		const imgio::ImageProvider& source) {
-	auto fmt = source.format();
+ImageLoader::ImageLoader(vil::Device& dev, Queue& queue, VkImage img,
+		VkExtent3D extent, std::unique_ptr<imgio::ImageProvider> provider) :
+			dev_(dev), queue_(queue), img_(img), extent_(extent),
+			provider_(std::move(provider)) {
+	VkCommandPoolCreateInfo cpci {};
+	cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	cpci.queueFamilyIndex = queue.family;
+	VK_CHECK(dev.dispatch.CreateCommandPool(dev.handle, &cpci, nullptr, &cmdPool_));
+	nameHandle(dev, cmdPool_, "imgUpload");
+
+	VkFenceCreateInfo fci {};
+	fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for(auto& slot : slots_) {
+		VkCommandBufferAllocateInfo cbai {};
+		cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbai.commandBufferCount = 1u;
+		cbai.commandPool = cmdPool_;
+		cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		VK_CHECK(dev.dispatch.AllocateCommandBuffers(dev.handle, &cbai, &slot.cb));
+		nameHandle(dev, slot.cb, "imgUpload");
+
+		slot.fence = vku::Fence(dev, fci);
+	}
+}
+
+ImageLoader::~ImageLoader() {
+	stop();
+	dev_.dispatch.DestroyCommandPool(dev_.handle, cmdPool_, nullptr);
+}
+
+ImageLoader::Slot& ImageLoader::nextSlot() {
+	auto& slot = slots_[nextSlot_];
+	nextSlot_ = (nextSlot_ + 1) % slotCount;
+
+	auto fence = slot.fence.vkHandle();
+	VK_CHECK(dev_.dispatch.WaitForFences(dev_.handle, 1u, &fence, true, UINT64_MAX));
+	VK_CHECK(dev_.dispatch.ResetFences(dev_.handle, 1u, &fence));
+
+	VkCommandBufferBeginInfo cbi {};
+	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK(dev_.dispatch.BeginCommandBuffer(slot.cb, &cbi));
+
+	return slot;
+}
+
+void ImageLoader::submit(Slot& slot) {
+	VK_CHECK(dev_.dispatch.EndCommandBuffer(slot.cb));
+
+	VkSubmitInfo si {};
+	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	si.commandBufferCount = 1u;
+	si.pCommandBuffers = &slot.cb;
+
+	// the gui submits to the same queue from the main thread
+	std::lock_guard lock(dev_.queueMutex);
+	VK_CHECK(dev_.dispatch.QueueSubmit(queue_.handle, 1u, &si,
+		slot.fence.vkHandle()));
+}
+
+void ImageLoader::start() {
+	auto& slot = nextSlot();
+	vku::cmdBarrier(dev_, slot.cb, img_, vku::SyncScope::discard(),
+		vku::SyncScope::allShaderRead());
+	submit(slot);
+
+	auto fence = slot.fence.vkHandle();
+	VK_CHECK(dev_.dispatch.WaitForFences(dev_.handle, 1u, &fence, true, UINT64_MAX));
+
+	thread_ = std::thread([this]{ run(); });
+}
+
+void ImageLoader::stop() {
+	stop_.store(true);
+	if(thread_.joinable()) {
+		thread_.join();
+	}
+
+	for(auto& slot : slots_) {
+		auto fence = slot.fence.vkHandle();
+		VK_CHECK(dev_.dispatch.WaitForFences(dev_.handle, 1u, &fence, true, UINT64_MAX));
+	}
+}
+
+void ImageLoader::run() {
+	auto fmt = provider_->format();
 	auto [bx, by, bz] = imgio::blockSize(fmt);
 	auto fmtSize = imgio::formatElementSize(fmt);
-	auto size = source.size();
-	auto numElements = ceilDivide(size.x, bx) * ceilDivide(size.y, by) * ceilDivide(size.z, bz);
-	auto layerCount = source.layers();
-	auto dataSize = layerCount * fmtSize * numElements;
-	auto fillLevelCount = source.mipLevels();
-
-	for(auto i = 1u; i < fillLevelCount; ++i) {
-		auto isize = size;
-		isize.x = std::max(size.x >> i, 1u);
-		isize.y = std::max(size.y >> i, 1u);
-		isize.z = std::max(size.z >> i, 1u);
-		auto numElements = ceilDivide(isize.x, bx) * ceilDivide(isize.y, by) * ceilDivide(isize.z, bz);
-		dataSize += layerCount * fmtSize * numElements;
+
+	for(auto m = 0u; m < provider_->mipLevels(); ++m) {
+		VkExtent3D ext = extent_;
+		ext.width = std::max(ext.width >> m, 1u);
+		ext.height = std::max(ext.height >> m, 1u);
+		ext.depth = std::max(ext.depth >> m, 1u);
+
+		auto numElements = ceilDivide(ext.width, bx) *
+			ceilDivide(ext.height, by) *
+			ceilDivide(ext.depth, bz);
+		auto layerSize = VkDeviceSize(fmtSize) * numElements;
+
+		for(auto l = 0u; l < provider_->layers(); ++l) {
+			if(stop_.load()) {
+				return;
+			}
+
+			auto& slot = nextSlot();
+			slot.buf.ensure(dev_, layerSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				{}, "imgUpload");
+
+			// read directly into the mapped staging memory
+			provider_->read(span<std::byte>(slot.buf.map, std::size_t(layerSize)), m, l);
+			slot.buf.flushMap();
+
+			VkImageSubresourceRange range {};
+			range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			range.baseMipLevel = m;
+			range.levelCount = 1u;
+			range.baseArrayLayer = l;
+			range.layerCount = 1u;
+
+			// The viewer might be reading the image concurrently
+			auto viewerAccess = vku::SyncScope::allAccess(
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			vku::cmdBarrier(dev_, slot.cb, img_, viewerAccess,
+				vku::SyncScope::transferWrite(), range);
+
+			VkBufferImageCopy copy {};
+			copy.imageExtent = ext;
+			copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.imageSubresource.baseArrayLayer = l;
+			copy.imageSubresource.layerCount = 1u;
+			copy.imageSubresource.mipLevel = m;
+			dev_.dispatch.CmdCopyBufferToImage(slot.cb, slot.buf.buf, img_,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &copy);
+
+			vku::cmdBarrier(dev_, slot.cb, img_, vku::SyncScope::transferWrite(),
+				vku::SyncScope::allShaderRead(), range);
+
+			submit(slot);
+		}
 	}
 
-	auto align = std::max<VkDeviceSize>(fmtSize,
-		dev.props.limits.optimalBufferCopyOffsetAlignment);
-	return {dataSize, align};
+	dlg_trace("finished uploading image");
 }
 
+struct ViewedImage {
+	VkImage img;
+	VkDeviceMemory mem;
+	vil::Image* vilImg;
+	std::unique_ptr<ImageLoader> loader;
+};
+
 ViewedImage loadImage(const char* path, VkDevice dev, vil::Device& vilDev, Gui& gui) {
 	// create image
 	auto provider = imgio::loadImage(path);
@@ -163,84 +334,12 @@ ViewedImage loadImage(const char* path, VkDevice dev, vil::Device& vilDev, Gui&
 	VK_CHECK(vil::BindImageMemory(dev, img, mem, 0u));
 	auto& vilImg = unwrap(img);
 
-	// = upload =
-	// alloc cb
-	// create staging buffer
-	// record cb while reading data into staging buffer
-	// submit & wait for cb
-
-	VkCommandPool cmdPool;
-	VkCommandPoolCreateInfo cpci {};
-	cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	cpci.queueFamilyIndex = gui.usedQueue().family;
-	VK_CHECK(vilDev.dispatch.CreateCommandPool(vilDev.handle, &cpci, nullptr, &cmdPool));
-	nameHandle(vilDev, cmdPool, "imgUpload");
-
-	VkCommandBufferAllocateInfo cbai {};
-	cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbai.commandBufferCount = 1u;
-	cbai.commandPool = cmdPool;
-	cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	VkCommandBuffer cb;
-	VK_CHECK(vilDev.dispatch.AllocateCommandBuffers(dev, &cbai, &cb));
-	nameHandle(vilDev, cb, "imgUpload");
-
-	auto needed = neededUploadSizeAlign(vilDev, *provider);
-	vil::OwnBuffer buf;
-	buf.ensure(vilDev, needed.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, {}, "imgUpload");
-
-	WriteBuf bufData{buf.map, buf.size};
-	VkCommandBufferBeginInfo cbi {};
-	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	vilDev.dispatch.BeginCommandBuffer(cb, &cbi);
-
-	vku::cmdBarrier(vilDev, cb, vilImg.handle, vku::SyncScope::discard(),
-		vku::SyncScope::transferWrite());
-
-	auto [bx, by, bz] = imgio::blockSize(provider->format());
-	auto fmtSize = imgio::formatElementSize(provider->format());
-	for(auto m = 0u; m < provider->mipLevels(); ++m) {
-		VkExtent3D ext = ici.extent;
-		ext.width = std::max(ext.width >> m, 1u);
-		ext.height = std::max(ext.height >> m, 1u);
-		ext.depth = std::max(ext.depth >> m, 1u);
-
-		auto numElements = ceilDivide(ext.width, bx) * ceilDivide(ext.height, by) * ceilDivide(ext.depth, bz);
-		auto layerSize = fmtSize * numElements;
-		auto off = bufData.data() - buf.map;
-		for(auto i = 0u; i < provider->layers(); ++i) {
-			provider->read(bufData.first(layerSize), m, i);
-			skip(bufData, layerSize);
-		}
-
-		VkBufferImageCopy copy {};
-		copy.imageExtent = ext;
-		copy.bufferOffset = off;
-		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copy.imageSubresource.baseArrayLayer = 0u;
-		copy.imageSubresource.layerCount = provider->layers();
-		copy.imageSubresource.mipLevel = m;
-		vilDev.dispatch.CmdCopyBufferToImage(cb, buf.buf, vilImg.handle,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &copy);
-	}
-
-	vku::cmdBarrier(vilDev, cb, vilImg.handle, vku::SyncScope::transferWrite(),
-		vku::SyncScope::fragmentRead());
-
-	vilDev.dispatch.EndCommandBuffer(cb);
-
-	// submit & wait for cb
-	VkSubmitInfo si {};
-	si.commandBufferCount = 1u;
-	si.pCommandBuffers = &cb;
-	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	vilDev.dispatch.QueueSubmit(gui.usedQueue().handle, 1u, &si, VK_NULL_HANDLE);
-	vilDev.dispatch.QueueWaitIdle(gui.usedQueue().handle);
-
-	vilDev.dispatch.DestroyCommandPool(dev, cmdPool, nullptr);
+	// The contents are uploaded while the viewer is already running.
+	auto loader = std::make_unique<ImageLoader>(vilDev, gui.usedQueue(),
+		vilImg.handle, ici.extent, std::move(provider));
+	loader->start();
 
-	return {img, mem, &vilImg};
+	return {img, mem, &vilImg, std::move(loader)};
 }
 
 extern "C" VIL_EXPORT int vil_showImageViewer(int argc, const char** argv) {
@@ -469,7 +568,7 @@ extern "C" VIL_EXPORT int vil_showImageViewer(int argc, const char** argv) {
 	}
 
 	auto* gui = vilDev->gui();
-	auto [img, mem, vilImg] = loadImage(name, dev, *vilDev, *gui);
+	auto [img, mem, vilImg, loader] = loadImage(name, dev, *vilDev, *gui);
 	if(img) {
 		if(gui) {
 			gui->mode_ = Gui::Mode::image;
@@ -489,10 +588,12 @@ extern "C" VIL_EXPORT int vil_showImageViewer(int argc, const char** argv) {
 
 		vilDev->window->allowClose = true;
 		vilDev->window->doMainLoop();
+		loader->stop();
 		vilDev->window->doCleanup();
 	}
 
 	// destroy image
+	loader.reset();
 	vil::DestroyImage(dev, img, nullptr);
 	vil::FreeMemory(dev, mem, nullptr);
 
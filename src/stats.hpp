@@ -15,11 +15,19 @@ struct DebugStats {
 	std::atomic<u32> aliveImagesViews {};
 	std::atomic<u32> aliveHookRecords {};
 	std::atomic<u32> aliveHookStates {};
+	std::atomic<u32> retiredHandles {}; // see HandleReclaimer
+	std::atomic<u32> destroyQueueDepth {}; // see DestroyQueue
+
+	// Time objects spent in the DestroyQueue, in ns.
+	// For the last destroyed batch and the maximum over all batches.
+	std::atomic<u64> destroyQueueLatency {};
+	std::atomic<u64> destroyQueueMaxLatency {};
 
 	std::atomic<u64> threadContextMem {};
 	std::atomic<u64> commandMem {};
 	std::atomic<u64> descriptorCopyMem {};
 	std::atomic<u64> descriptorPoolMem {};
+	std::atomic<u64> descriptorPageMem {}; // see DescriptorPages
 
 	std::atomic<u64> ownBufferMem {};
 	std::atomic<u64> copiedImageMem {};
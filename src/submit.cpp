@@ -24,6 +24,25 @@
 
 namespace vil {
 
+VkFence createFence(Device& dev) {
+	VkFence fence;
+	VkFenceCreateInfo fci {};
+	fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VK_CHECK(dev.dispatch.CreateFence(dev.handle, &fci, nullptr, &fence));
+	nameHandle(dev, fence, "Device:[pool fence]");
+	return fence;
+}
+
+VkFence getFenceFromPoolLocked(Device& dev) {
+	if(!dev.fencePool.empty()) {
+		auto ret = dev.fencePool.back();
+		dev.fencePool.pop_back();
+		return ret;
+	}
+
+	return createFence(dev);
+}
+
 VkFence getFenceFromPool(Device& dev) {
 	{
 		std::lock_guard lock(dev.mutex);
@@ -34,13 +53,7 @@ VkFence getFenceFromPool(Device& dev) {
 		}
 	}
 
-	// create new fence
-	VkFence fence;
-	VkFenceCreateInfo fci {};
-	fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	VK_CHECK(dev.dispatch.CreateFence(dev.handle, &fci, nullptr, &fence));
-	nameHandle(dev, fence, "Device:[pool fence]");
-	return fence;
+	return createFence(dev);
 }
 
 VkSemaphore createSemaphore(Device& dev) {
@@ -151,9 +164,9 @@ void init(QueueSubmitter& subm, Queue& queue, SubmissionType type,
 		dlg_assert(!batch.appFence->submission);
 		subm.submFence = fence;
 		batch.appFence->submission = &batch;
-	} else {
-		// PERF: when we have timeline semaphores we can simply use our
-		// added timeline semaphore to track this batch and don't need a fence at all.
+	} else if(!dev.timelineTracking || type != SubmissionType::command) {
+		// With timeline tracking, command batches are tracked via the
+		// submission semaphore of the queue, see addSubmissionSyncLocked.
 		batch.ourFence = getFenceFromPool(dev);
 		subm.submFence = batch.ourFence;
 	}
@@ -521,6 +534,19 @@ void addSubmissionSyncLocked(QueueSubmitter& subm) {
 		si.signalSemaphoreInfoCount = u32(signalOps.size());
 		si.pSignalSemaphoreInfos = signalOps.data();
 	}
+
+	auto& batch = *subm.dstBatch;
+	if(subm.dev->timelineTracking && batch.type == SubmissionType::command) {
+		if(!batch.submissions.empty()) {
+			// submissions complete in order, the last one signals the
+			// highest value
+			batch.lastSubmissionID = batch.submissions.back().queueSubmitID;
+		} else if(!batch.appFence) {
+			// nothing signals the semaphore, need a fence after all
+			batch.ourFence = getFenceFromPoolLocked(*subm.dev);
+			subm.submFence = batch.ourFence;
+		}
+	}
 }
 
 void cleanupOnErrorLocked(QueueSubmitter& subm) {
@@ -530,9 +556,10 @@ void cleanupOnErrorLocked(QueueSubmitter& subm) {
 
 	if(batch.ourFence) {
 		dev.fencePool.push_back(batch.ourFence);
-	} else {
-		dlg_assert(batch.appFence);
+	} else if(batch.appFence) {
 		batch.appFence->submission = nullptr;
+	} else {
+		dlg_assert(batch.lastSubmissionID);
 	}
 
 	// NOTE: this is potentially problematic in case we synced with the gfx
@@ -776,8 +803,12 @@ void postProcessLocked(QueueSubmitter& subm) {
 				//   on cb->pending to be activated, i.e. must never wait
 				//   on them in any way.
 				cb->pending.push_back(&sub);
+				cb->pendingCount.store(u32(cb->pending.size()), std::memory_order_release);
 				auto recPtr = cb->lastRecordPtrLocked();
 
+				// the descriptor sets are guaranteed to be valid now
+				resolveWritesLocked(*recPtr);
+
 				if(recordBatch) {
 					recordBatch->submissions.push_back(recPtr);
 				}
@@ -845,41 +876,16 @@ void postProcessLocked(QueueSubmitter& subm) {
 // Returns whether the given submission potentially writes the given
 // DeviceHandle (only makes sense for Image and Buffer objects)
 bool potentiallyWritesLocked(const Submission& subm, const Image* img, const Buffer* buf) {
-	// TODO PERF: consider more information, not every use is potentially writing
-
 	assertOwned(subm.parent->queue->dev->mutex);
 	dlg_assert(img || buf);
 
 	if(subm.parent->type == SubmissionType::command) {
+		const Handle& handle = img ? static_cast<const Handle&>(*img) : *buf;
 		auto& cmdSub = std::get<CommandSubmission>(subm.data);
 		for(auto& scb : cmdSub.cbs) {
-			auto& cb = scb.cb;
-			auto& rec = *cb->lastRecordLocked();
-
-			if(buf) {
-				auto it = find(rec.used.buffers, const_cast<Buffer&>(*buf));
-				if(it != rec.used.buffers.end()) {
-					return true;
-				}
-			} else if(img) {
-				auto it = find(rec.used.images, const_cast<Image&>(*img));
-				if(it != rec.used.images.end()) {
-					return true;
-				}
-			} else {
-				dlg_error("unreachable");
-			}
-
-			for(auto& uds : rec.used.descriptorSets) {
-				// in this case we know that the bound descriptor set must
-				// still be valid
-				auto& state = *static_cast<DescriptorSet*>(uds.ds);
-				// important that the ds mutex is locked mainly for
-				// update_unused_while_pending.
-				auto lock = state.lock();
-				if((img && hasBound(state, *img)) || (buf && hasBound(state, *buf))) {
-					return true;
-				}
+			auto& rec = *scb.cb->lastRecordLocked();
+			if(potentiallyWritesLocked(rec, handle)) {
+				return true;
 			}
 		}
 	} else {
@@ -911,6 +917,54 @@ bool potentiallyWritesLocked(const Submission& subm, const Image* img, const Buf
 	return false;
 }
 
+// Returns whether the given submission potentially uses the given image
+// in any way.
+bool potentiallyUsesLocked(const Submission& subm, const Image& img) {
+	assertOwned(subm.parent->queue->dev->mutex);
+
+	if(subm.parent->type == SubmissionType::command) {
+		auto& cmdSub = std::get<CommandSubmission>(subm.data);
+		for(auto& scb : cmdSub.cbs) {
+			auto& rec = *scb.cb->lastRecordLocked();
+			if(rec.used.images.contains(&img)) {
+				return true;
+			}
+
+			for(auto& uds : rec.used.descriptorSets) {
+				// in this case we know that the bound descriptor set must
+				// still be valid
+				auto& state = *static_cast<DescriptorSet*>(uds.ds);
+				// important that the ds mutex is locked mainly for
+				// update_unused_while_pending.
+				auto lock = state.lock();
+				if(hasBound(state, img)) {
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	return potentiallyWritesLocked(subm, &img, nullptr);
+}
+
+// Returns whether our draw changes the layout of the given image, i.e.
+// writes it.
+bool changesLayoutLocked(const Image& img, VkImageLayout targetLayout) {
+	if(targetLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+		return false;
+	}
+
+	for(auto& subres : img.pendingLayoutLocked()) {
+		if(subres.layout != targetLayout) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 std::vector<const Submission*> needsSyncLocked(const SubmissionBatch& pending, const Draw& draw) {
 	ZoneScoped;
 
@@ -922,8 +976,14 @@ std::vector<const Submission*> needsSyncLocked(const SubmissionBatch& pending, c
 	std::vector<const Submission*> subs;
 	for(auto& subm : pending.submissions) {
 		auto added = false;
-		for(auto [handle, _layout] : draw.usedImages) {
-			if(potentiallyWritesLocked(subm, handle, nullptr)) {
+		// We only read the images and buffers, so we only have to sync
+		// with submissions that write them. The exception are images
+		// we transition to another layout.
+		for(auto [handle, layout] : draw.usedImages) {
+			auto sync = changesLayoutLocked(*handle, layout) ?
+				potentiallyUsesLocked(subm, *handle) :
+				potentiallyWritesLocked(subm, handle, nullptr);
+			if(sync) {
 				subs.push_back(&subm);
 				added = true;
 				break;
@@ -3,6 +3,8 @@
 #include <util/util.hpp>
 #include <util/dlg.hpp>
 #include <gui/gui.hpp>
+#include <frameCapture.hpp>
+#include <device.hpp>
 
 // NOTE: we know event calls always happen in the same thread as rendering
 // so we don't need to use gui-internal even queue and can access imguiIO
@@ -175,6 +177,16 @@ Platform::State SwaPlatform::update(Gui& gui) {
 		}
 	}
 
+	if(captureKey_ != swa_key_none) {
+		bool capture = (status == State::focused) ?
+			swa_display_key_pressed(this->dpy, (swa_key) captureKey_) :
+			this->pressed(captureKey_);
+		auto* frameCapture = gui.dev().frameCapture.get();
+		if(updateEdge(capturePressed, capture) && frameCapture) {
+			frameCapture->trigger();
+		}
+	}
+
 	if(doGuiUnfocus) {
 		gui.unfocus = true;
 		doGuiUnfocus = false;
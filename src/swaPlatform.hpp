@@ -21,6 +21,7 @@ struct SwaPlatform : Platform {
 	State status {State::hidden};
 	bool togglePressed {}; // for toggle key
 	bool focusPressed {}; // for focus key
+	bool capturePressed {}; // for capture key
 
 	// for automatic activation/deactivation
 	bool doGuiUnfocus {};
@@ -7,6 +7,7 @@
 #include <queue.hpp>
 #include <platform.hpp>
 #include <overlay.hpp>
+#include <frameCapture.hpp>
 #include <command/record.hpp>
 #include <util/profiling.hpp>
 #include <vkutil/enumString.hpp>
@@ -41,7 +42,7 @@ void Swapchain::destroy() {
 		// TODO: call onApiDestroy? shouldn't be needed atm but might
 		// be in future. Not sure if expected, the api object
 		// was always of implicit nature.
-		dev->images.mustErase(handle);
+		retire(*dev, dev->images.mustMove(handle));
 	}
 
 	// TODO: not sure about this. We don't synchronize access to it
@@ -136,7 +137,8 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(
 		swapd.presentCounter = oldChain->presentCounter;
 		swapd.lastPresent = std::move(oldChain->lastPresent);
 		swapd.frameTimings = std::move(oldChain->frameTimings);
-		swapd.frameSubmissions = std::move(oldChain->frameSubmissions);
+		// the gui might still read the history of the old swapchain
+		swapd.frameHistory = oldChain->frames();
 		swapd.nextFrameSubmissions = std::move(oldChain->nextFrameSubmissions);
 	}
 
@@ -289,34 +291,49 @@ VKAPI_ATTR VkResult VKAPI_CALL AcquireNextImageKHR(
 
 void swapchainPresent(Swapchain& swapchain) {
 	// update swapchain data
-	FrameSubmissions keepAliveFrameSubmissions;
+	// The old history might hold the last reference to the records of
+	// the dropped frame, it must be released after unlocking.
+	std::shared_ptr<const Swapchain::FrameHistory> oldHistory;
 
 	auto lock = std::lock_guard(swapchain.dev->mutex);
 	++swapchain.presentCounter;
-	keepAliveFrameSubmissions = std::move(swapchain.frameSubmissions.back());
-
-	for(auto i = swapchain.frameSubmissions.size(); i >= 2u; --i) {
-		swapchain.frameSubmissions[i - 1] = std::move(swapchain.frameSubmissions[i - 2]);
-	}
-
-	swapchain.frameSubmissions[0] = std::move(swapchain.nextFrameSubmissions);
-	swapchain.frameSubmissions[0].presentID = swapchain.presentCounter;
-	swapchain.frameSubmissions[0].submissionEnd = swapchain.dev->submissionCounter;
+	++swapchain.dev->presentCounter;
+
+	auto frame = std::make_shared<FrameSubmissions>(
+		std::move(swapchain.nextFrameSubmissions));
+	frame->presentID = swapchain.presentCounter;
+	frame->submissionEnd = swapchain.dev->submissionCounter;
+
+	// Only the pointers are copied, frames are shared between histories
+	oldHistory = swapchain.frameHistory;
+	auto history = std::make_shared<Swapchain::FrameHistory>();
+	auto keep = std::min<std::size_t>(oldHistory->size(),
+		Swapchain::frameSubmissionCount - 1);
+	history->reserve(keep + 1);
+	history->push_back(frame);
+	history->insert(history->end(), oldHistory->begin(), oldHistory->begin() + keep);
+	std::atomic_store(&swapchain.frameHistory,
+		std::shared_ptr<const Swapchain::FrameHistory>(std::move(history)));
 
 	swapchain.nextFrameSubmissions = {};
 	swapchain.nextFrameSubmissions.submissionStart = swapchain.dev->submissionCounter + 1;
 
 	// timing
 	auto now = Swapchain::Clock::now();
+	auto timing = Swapchain::Clock::duration {};
 	if(swapchain.lastPresent) {
 		if(swapchain.frameTimings.size() == swapchain.maxFrameTimings) {
 			swapchain.frameTimings.erase(swapchain.frameTimings.begin());
 		}
 
-		auto timing = now - *swapchain.lastPresent;
+		timing = now - *swapchain.lastPresent;
 		swapchain.frameTimings.push_back(timing);
 	}
 	swapchain.lastPresent = now;
+
+	if(auto* capture = swapchain.dev->frameCapture.get(); capture) {
+		capture->presentLocked(*frame, timing);
+	}
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(
@@ -403,7 +420,7 @@ VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(
 			visible = swapchain.overlay->gui->visible();
 		}
 
-		// update tracked frameSubmissions and timings before drawing
+		// update tracked frameHistory and timings before drawing
 		// the potential overlay is important so that the new state
 		// can already be displayed.
 		swapchainPresent(swapchain);
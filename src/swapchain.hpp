@@ -7,7 +7,7 @@
 #include <vk/vulkan.h>
 #include <chrono>
 #include <optional>
-#include <array>
+#include <vector>
 #include <memory>
 
 namespace vil {
@@ -43,10 +43,14 @@ struct Swapchain : SharedDeviceHandle {
 	// swapchain is called. Not reset on swapchain recreation.
 	u64 presentCounter {};
 
-	// TODO: use vector instead? Cleared when matched?
+	// Submissions of the last presented frames, newest first, at most
+	// frameSubmissionCount entries. Never modified, a new history is
+	// published on each present (while the device mutex is locked).
+	// Use frames() to read it without locking the device mutex.
 	static constexpr auto frameSubmissionCount = 16u;
-	std::array<FrameSubmissions, frameSubmissionCount> frameSubmissions;
-	FrameSubmissions nextFrameSubmissions; // currently being built
+	using FrameHistory = std::vector<std::shared_ptr<const FrameSubmissions>>;
+	std::shared_ptr<const FrameHistory> frameHistory {std::make_shared<FrameHistory>()};
+	FrameSubmissions nextFrameSubmissions; // currently being built; device mutex
 
 	// Whether images from this swapchain support sampling.
 	// We will try to set this, if possible for overlay blur.
@@ -54,6 +58,12 @@ struct Swapchain : SharedDeviceHandle {
 
 	~Swapchain();
 	void destroy();
+
+	// Returns the current frameHistory, can be called without holding
+	// the device mutex. Never null.
+	std::shared_ptr<const FrameHistory> frames() const {
+		return std::atomic_load(&frameHistory);
+	}
 };
 
 // api
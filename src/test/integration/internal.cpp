@@ -16,9 +16,14 @@
 #include <cb.hpp>
 #include <ds.hpp>
 #include <rp.hpp>
+#include <stats.hpp>
 #include <vkutil/enumString.hpp>
 #include "./internal.hpp"
 #include "../data/simple.comp.spv.h" // see simple.comp; compiled manually
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 using namespace tut;
 
@@ -622,6 +627,64 @@ TEST(int_sample_copy_pipeline) {
 	DestroyCommandPool(stp.dev, cmdPool, nullptr);
 }
 
+TEST(int_state_sharing) {
+	auto& stp = gSetup;
+
+	VkCommandPool cmdPool = setupCommandPool();
+	VkCommandBuffer cb = allocCommandBuffer(cmdPool);
+
+	PipeSetup ps;
+	init(ps);
+
+	VkCommandBufferBeginInfo cbi {};
+	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	VK_CHECK(BeginCommandBuffer(cb, &cbi));
+
+	// multiple binds before the first dispatch modify the same state
+	CmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, ps.pipe);
+	CmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, ps.pipeLayout,
+		0u, 1u, &ps.ds, 0u, nullptr);
+	CmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, ps.pipeLayout,
+		0u, 1u, &ps.ds, 0u, nullptr);
+	CmdDispatch(cb, 1u, 1u, 1u);
+	CmdDispatch(cb, 1u, 1u, 1u);
+
+	// modifying the state after a dispatch must not change the
+	// state referenced by that dispatch
+	VkDescriptorSet nullSet {};
+	CmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, ps.pipeLayout,
+		0u, 1u, &nullSet, 0u, nullptr);
+	CmdDispatch(cb, 1u, 1u, 1u);
+
+	EndCommandBuffer(cb);
+
+	auto& rec = *unwrap(cb).lastRecordPtr();
+	std::vector<const DispatchCmd*> dispatches;
+	for(auto* cmd = rec.commands->children_; cmd; cmd = cmd->next) {
+		if(auto* dispatch = dynamic_cast<const DispatchCmd*>(cmd); dispatch) {
+			dispatches.push_back(dispatch);
+		}
+	}
+
+	dlg_assert(dispatches.size() == 3u);
+	dlg_assert(dispatches[0]->state == dispatches[1]->state);
+	dlg_assert(dispatches[1]->state != dispatches[2]->state);
+
+	auto& vilDs = unwrap(ps.ds);
+	auto& sets0 = dispatches[0]->state->descriptorSets;
+	dlg_assert(sets0.size() == 1u);
+	dlg_assert(sets0[0].dsID == vilDs.id);
+	dlg_assert(dispatches[0]->state->pipe == &unwrap(ps.pipe));
+
+	auto& sets2 = dispatches[2]->state->descriptorSets;
+	dlg_assert(sets2.size() == 1u);
+	dlg_assert(!sets2[0].dsPool);
+	dlg_assert(dispatches[2]->state->pipe == &unwrap(ps.pipe));
+
+	destroy(ps);
+	DestroyCommandPool(stp.dev, cmdPool, nullptr);
+}
+
 TEST(int_submission_activation_timeline_semaphore) {
 	auto& stp = gSetup;
 	if(!stp.vilDev->timelineSemaphores) {
@@ -767,6 +830,456 @@ TEST(int_submission_activation_timeline_semaphore) {
 	DestroySemaphore(stp.dev, semaphores[1], nullptr);
 }
 
+// Updates a set via the compiled ops of an update template and a set
+// with a differently defined layout, for which the template entries have
+// to be interpreted. Also logs the time of the two paths.
+TEST(int_update_template) {
+	using Clock = std::chrono::high_resolution_clock;
+	auto& stp = gSetup;
+
+	constexpr auto numBindings = 64u;
+	constexpr auto iterations = 10000u;
+
+	auto buf = tut::Buffer(stp, 256u, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	// layout
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	for(auto i = 0u; i < numBindings; ++i) {
+		bindings.push_back({i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1u, VK_SHADER_STAGE_ALL, nullptr});
+	}
+
+	VkDescriptorSetLayoutCreateInfo lci {};
+	lci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	lci.bindingCount = u32(bindings.size());
+	lci.pBindings = bindings.data();
+	VkDescriptorSetLayout dsLayout;
+	VK_CHECK(CreateDescriptorSetLayout(stp.dev, &lci, nullptr, &dsLayout));
+
+	// Invalid usage: two descriptors per binding, the compiled ops
+	// would write to the wrong offsets.
+	for(auto& binding : bindings) {
+		binding.descriptorCount = 2u;
+	}
+
+	VkDescriptorSetLayout otherLayout;
+	VK_CHECK(CreateDescriptorSetLayout(stp.dev, &lci, nullptr, &otherLayout));
+
+	// pool & sets
+	auto poolSize = VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * numBindings};
+	VkDescriptorPoolCreateInfo dci {};
+	dci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	dci.pPoolSizes = &poolSize;
+	dci.poolSizeCount = 1u;
+	dci.maxSets = 2u;
+	VkDescriptorPool dsPool;
+	VK_CHECK(CreateDescriptorPool(stp.dev, &dci, nullptr, &dsPool));
+
+	VkDescriptorSetLayout setLayouts[] = {dsLayout, otherLayout};
+	VkDescriptorSetAllocateInfo dsai {};
+	dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsai.descriptorPool = dsPool;
+	dsai.pSetLayouts = setLayouts;
+	dsai.descriptorSetCount = 2u;
+	VkDescriptorSet sets[2];
+	VK_CHECK(AllocateDescriptorSets(stp.dev, &dsai, sets));
+	auto ds = sets[0];
+	auto otherDs = sets[1];
+
+	// template, one entry per binding
+	std::vector<VkDescriptorBufferInfo> infos(numBindings);
+	std::vector<VkDescriptorUpdateTemplateEntry> entries(numBindings);
+	for(auto i = 0u; i < numBindings; ++i) {
+		infos[i].buffer = buf.buffer;
+		infos[i].offset = 4u * i;
+		infos[i].range = 4u;
+
+		entries[i].dstBinding = i;
+		entries[i].descriptorCount = 1u;
+		entries[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		entries[i].offset = i * sizeof(VkDescriptorBufferInfo);
+		entries[i].stride = sizeof(VkDescriptorBufferInfo);
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo tci {};
+	tci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	tci.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	tci.descriptorSetLayout = dsLayout;
+	tci.descriptorUpdateEntryCount = u32(entries.size());
+	tci.pDescriptorUpdateEntries = entries.data();
+	VkDescriptorUpdateTemplate dut;
+	VK_CHECK(CreateDescriptorUpdateTemplate(stp.dev, &tci, nullptr, &dut));
+
+	auto& vilDut = unwrap(dut);
+	auto& vilDs = unwrap(ds);
+	auto& vilOtherDs = unwrap(otherDs);
+	EXPECT(vilDut.ops.size(), std::size_t(numBindings));
+	EXPECT(vilDut.dataSize, u32(numBindings * sizeof(VkDescriptorBufferInfo)));
+
+	for(auto set : sets) {
+		UpdateDescriptorSetWithTemplate(stp.dev, set, dut, infos.data());
+		for(auto i = 0u; i < numBindings; ++i) {
+			auto& desc = dsBuffer(unwrap(set), i, 0u);
+			EXPECT(desc.buffer, &unwrap(buf.buffer));
+			EXPECT(desc.offset, 4u * i);
+			EXPECT(desc.range, 4u);
+		}
+	}
+
+	// the second descriptors weren't touched
+	for(auto i = 0u; i < numBindings; ++i) {
+		EXPECT(dsBuffer(vilOtherDs, i, 1u).buffer, nullptr);
+	}
+
+	// benchmark, without forwarding to the driver
+	std::vector<std::byte> data(vilDut.dataSize);
+	auto run = [&](DescriptorSet& set) {
+		auto lock = set.checkResolveCow();
+		auto before = Clock::now();
+		for(auto i = 0u; i < iterations; ++i) {
+			// handles are unwrapped in-place
+			std::memcpy(data.data(), infos.data(), data.size());
+			applyUpdateTemplate(set, vilDut, data.data());
+		}
+
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			Clock::now() - before).count();
+	};
+
+	auto timeInterpreted = run(vilOtherDs);
+	auto timeCompiled = run(vilDs);
+
+	dlg_trace("update template: {} entries, {} updates", numBindings, iterations);
+	dlg_trace("  interpreted: {} mus, compiled: {} mus", timeInterpreted, timeCompiled);
+
+	DestroyDescriptorUpdateTemplate(stp.dev, dut, nullptr);
+	DestroyDescriptorPool(stp.dev, dsPool, nullptr);
+	DestroyDescriptorSetLayout(stp.dev, otherLayout, nullptr);
+	DestroyDescriptorSetLayout(stp.dev, dsLayout, nullptr);
+}
+
+// Only the pages of a huge variable-count binding that are written to
+// are allocated, see DescriptorPages.
+TEST(int_bindless_pages) {
+	auto& stp = gSetup;
+	constexpr auto count = 1024u * 1024u;
+	constexpr auto numWrites = 16u;
+	constexpr auto writeStride = count / numWrites;
+
+	auto sci = linearSamplerCI();
+	VkSampler sampler;
+	VK_CHECK(CreateSampler(stp.dev, &sci, nullptr, &sampler));
+
+	// layout
+	auto binding = VkDescriptorSetLayoutBinding {0u, VK_DESCRIPTOR_TYPE_SAMPLER,
+		count, VK_SHADER_STAGE_ALL, nullptr};
+	VkDescriptorBindingFlags bindingFlags =
+		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT |
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsci {};
+	flagsci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsci.bindingCount = 1u;
+	flagsci.pBindingFlags = &bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo lci {};
+	lci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	lci.bindingCount = 1u;
+	lci.pBindings = &binding;
+	lci.pNext = &flagsci;
+	VkDescriptorSetLayout dsLayout;
+	VK_CHECK(CreateDescriptorSetLayout(stp.dev, &lci, nullptr, &dsLayout));
+
+	// pool & set
+	auto poolSize = VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_SAMPLER, count};
+	VkDescriptorPoolCreateInfo dci {};
+	dci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	dci.pPoolSizes = &poolSize;
+	dci.poolSizeCount = 1u;
+	dci.maxSets = 1u;
+	VkDescriptorPool dsPool;
+	VK_CHECK(CreateDescriptorPool(stp.dev, &dci, nullptr, &dsPool));
+
+	VkDescriptorSetVariableDescriptorCountAllocateInfo varci {};
+	varci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+	varci.descriptorSetCount = 1u;
+	varci.pDescriptorCounts = &count;
+
+	VkDescriptorSetAllocateInfo dsai {};
+	dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsai.descriptorPool = dsPool;
+	dsai.pSetLayouts = &dsLayout;
+	dsai.descriptorSetCount = 1u;
+	dsai.pNext = &varci;
+
+	auto& pageMem = DebugStats::get().descriptorPageMem;
+	auto memBefore = pageMem.load();
+
+	VkDescriptorSet ds;
+	VK_CHECK(AllocateDescriptorSets(stp.dev, &dsai, &ds));
+
+	auto& vilDs = unwrap(ds);
+	EXPECT(vilDs.pages != nullptr, true);
+	dlg_assert_or(vilDs.pages, return);
+	auto& pages = *vilDs.pages;
+	auto fullSize = u64(count) * pages.descriptorSize;
+
+	// nothing written yet
+	EXPECT(pageMem.load() - memBefore, 0u);
+
+	// sparse: a single descriptor in a few pages
+	VkDescriptorImageInfo info {};
+	info.sampler = sampler;
+	for(auto i = 0u; i < numWrites; ++i) {
+		VkWriteDescriptorSet write {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		write.dstSet = ds;
+		write.dstArrayElement = i * writeStride;
+		write.descriptorCount = 1u;
+		write.pImageInfo = &info;
+		UpdateDescriptorSets(stp.dev, 1u, &write, 0u, nullptr);
+	}
+
+	for(auto i = 0u; i < numWrites; ++i) {
+		EXPECT(pages.find(i * writeStride) != nullptr, true);
+		EXPECT(pages.find(i * writeStride + writeStride / 2) == nullptr, true);
+	}
+
+	// At most the written pages and their write tracking bits
+	auto words = (pages.perPage + 63u) / 64u;
+	auto perPageMem = u64(pages.perPage) * pages.descriptorSize + sizeof(u64) * words;
+	auto used = pageMem.load() - memBefore;
+	EXPECT(used <= numWrites * perPageMem, true);
+	EXPECT(used < fullSize / 16u, true);
+
+	DestroyDescriptorPool(stp.dev, dsPool, nullptr);
+	DestroyDescriptorSetLayout(stp.dev, dsLayout, nullptr);
+	DestroySampler(stp.dev, sampler, nullptr);
+}
+
+// Records command buffers from multiple threads in parallel. Begin and
+// end only synchronize via the per-cb mutex, so this should scale with
+// the number of threads.
+TEST(int_parallel_recording) {
+	using Clock = std::chrono::high_resolution_clock;
+	auto& stp = gSetup;
+
+	constexpr auto numThreads = 16u;
+	constexpr auto recordsPerThread = 500u;
+	constexpr auto dispatchesPerRecord = 16u;
+
+	PipeSetup ps;
+	init(ps);
+
+	std::vector<VkCommandPool> pools;
+	std::vector<VkCommandBuffer> cbs;
+	for(auto i = 0u; i < numThreads; ++i) {
+		pools.push_back(setupCommandPool());
+		cbs.push_back(allocCommandBuffer(pools.back()));
+	}
+
+	auto record = [&](VkCommandBuffer cb, u32 count) {
+		VkCommandBufferBeginInfo cbi {};
+		cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		for(auto r = 0u; r < count; ++r) {
+			VK_CHECK(BeginCommandBuffer(cb, &cbi));
+			CmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, ps.pipe);
+			CmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
+				ps.pipeLayout, 0u, 1u, &ps.ds, 0u, nullptr);
+			for(auto d = 0u; d < dispatchesPerRecord; ++d) {
+				CmdDispatch(cb, 1u, 1u, 1u);
+			}
+			VK_CHECK(EndCommandBuffer(cb));
+		}
+	};
+
+	auto run = [&](u32 count) {
+		auto before = Clock::now();
+		std::vector<std::thread> threads;
+		for(auto t = 0u; t < count; ++t) {
+			threads.emplace_back([&, t]{ record(cbs[t], recordsPerThread); });
+		}
+
+		for(auto& thread : threads) {
+			thread.join();
+		}
+
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			Clock::now() - before).count();
+	};
+
+	auto timeSingle = run(1u);
+	auto timeParallel = run(numThreads);
+
+	auto checkRecords = [&](u32 recordCount0, u32 recordCount) {
+		for(auto i = 0u; i < numThreads; ++i) {
+			auto& vilCB = unwrap(cbs[i]);
+			EXPECT(vilCB.state(), CommandBuffer::State::executable);
+			EXPECT(vilCB.recordCount(), i == 0u ? recordCount0 : recordCount);
+
+			auto rec = vilCB.lastRecordPtr();
+			EXPECT(bool(rec), true);
+			EXPECT(rec->finished.load(), true);
+			EXPECT(rec->cb, &vilCB);
+		}
+	};
+
+	checkRecords(2 * recordsPerThread, recordsPerThread);
+
+	auto speedup = float(numThreads * timeSingle) / std::max(timeParallel, decltype(timeParallel)(1));
+	dlg_info("parallel recording: {} threads, {} records each", numThreads, recordsPerThread);
+	dlg_info("  1 thread: {} mus, {} threads: {} mus, speedup {}",
+		timeSingle, numThreads, timeParallel, speedup);
+
+	// Begin and end must not need the device mutex as long as the cbs
+	// aren't pending. Recording must complete while we hold it.
+	// Only the disconnection of replaced records needs the mutex, stay
+	// below the threshold for it.
+	{
+		std::vector<IntrusivePtr<CommandRecord>> replaced;
+		std::lock_guard lock(stp.vilDev->mutex);
+		disconnectReplacedRecordsLocked(*stp.vilDev, replaced);
+	}
+
+	constexpr auto lockedRecords = 8u;
+	std::atomic<u32> finished {};
+	std::vector<std::thread> threads;
+	{
+		std::unique_lock devLock(stp.vilDev->mutex);
+		for(auto t = 0u; t < numThreads; ++t) {
+			threads.emplace_back([&, t]{
+				record(cbs[t], lockedRecords);
+				++finished;
+			});
+		}
+
+		auto end = Clock::now() + std::chrono::seconds(10);
+		while(finished.load() != numThreads && Clock::now() < end) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// release the mutex before checking so we can't deadlock
+		auto finishedLocked = finished.load();
+		devLock.unlock();
+		EXPECT(finishedLocked, numThreads);
+	}
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	checkRecords(2 * recordsPerThread + lockedRecords, recordsPerThread + lockedRecords);
+
+	for(auto pool : pools) {
+		DestroyCommandPool(stp.dev, pool, nullptr);
+	}
+
+	destroy(ps);
+}
+
+TEST(int_hook_find_cache) {
+	auto& stp = gSetup;
+	auto& vilDev = *stp.vilDev;
+
+	PipeSetup ps;
+	init(ps);
+
+	VkCommandPool cmdPool = setupCommandPool();
+	VkCommandBuffer cbs[2] = {
+		allocCommandBuffer(cmdPool),
+		allocCommandBuffer(cmdPool),
+	};
+
+	// cbs[0] dispatches, cbs[1] only binds state
+	VkCommandBufferBeginInfo cbi {};
+	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	for(auto i = 0u; i < 2u; ++i) {
+		VK_CHECK(BeginCommandBuffer(cbs[i], &cbi));
+		CmdBindPipeline(cbs[i], VK_PIPELINE_BIND_POINT_COMPUTE, ps.pipe);
+		CmdBindDescriptorSets(cbs[i], VK_PIPELINE_BIND_POINT_COMPUTE,
+			ps.pipeLayout, 0u, 1u, &ps.ds, 0u, nullptr);
+		if(i == 0u) {
+			CmdDispatch(cbs[i], 1u, 1u, 1u);
+		}
+		VK_CHECK(EndCommandBuffer(cbs[i]));
+	}
+
+	auto rec0 = unwrap(cbs[0]).lastRecordPtr();
+	auto rec1 = unwrap(cbs[1]).lastRecordPtr();
+	EXPECT(bool(rec0->categories & CommandCategory::dispatch), true);
+	EXPECT(bool(rec1->categories & CommandCategory::dispatch), false);
+
+	const Command* dispatch = rec0->commands->children_;
+	while(dispatch && dispatch->category() != CommandCategory::dispatch) {
+		dispatch = dispatch->next;
+	}
+	dlg_assert(dispatch);
+
+	CommandHookUpdate update {};
+	update.invalidate = true;
+	auto& ops = update.newOps.emplace();
+	ops.queryTime = true;
+
+	auto& target = update.newTarget.emplace();
+	target.type = CommandHookTargetType::all;
+	target.record = rec0;
+	target.command = {rec0->commands, dispatch};
+	vilDev.commandHook->updateHook(std::move(update));
+
+	VkSubmitInfo si {};
+	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	si.commandBufferCount = 2u;
+	si.pCommandBuffers = cbs;
+
+	VK_CHECK(QueueSubmit(stp.queue, 1u, &si, VK_NULL_HANDLE));
+	VK_CHECK(DeviceWaitIdle(stp.dev));
+
+	// rec1 can't contain the dispatch, it's never searched
+	u64 generation;
+	{
+		std::lock_guard lock(vilDev.mutex);
+		generation = rec0->hookFind.targetGeneration;
+		EXPECT(generation != 0u, true);
+		EXPECT(rec0->hookFind.hierarchy.size(), 2u);
+		EXPECT(rec0->hookFind.hierarchy.back(), dispatch);
+		EXPECT(rec1->hookFind.targetGeneration, u64(0u));
+	}
+
+	// resubmitting uses the cached result
+	VK_CHECK(QueueSubmit(stp.queue, 1u, &si, VK_NULL_HANDLE));
+	VK_CHECK(DeviceWaitIdle(stp.dev));
+
+	{
+		std::lock_guard lock(vilDev.mutex);
+		EXPECT(rec0->hookFind.targetGeneration, generation);
+		EXPECT(rec0->hookFind.hierarchy.back(), dispatch);
+	}
+
+	EXPECT(vilDev.commandHook->moveCompleted().empty(), false);
+
+	// without target, records are not searched at all
+	CommandHookUpdate reset {};
+	reset.invalidate = true;
+	reset.newTarget.emplace();
+	reset.newOps.emplace();
+	vilDev.commandHook->updateHook(std::move(reset));
+
+	VK_CHECK(QueueSubmit(stp.queue, 1u, &si, VK_NULL_HANDLE));
+	VK_CHECK(DeviceWaitIdle(stp.dev));
+
+	{
+		std::lock_guard lock(vilDev.mutex);
+		EXPECT(rec0->hookFind.targetGeneration, generation);
+	}
+
+	rec0.reset();
+	rec1.reset();
+	DestroyCommandPool(stp.dev, cmdPool, nullptr);
+	destroy(ps);
+}
+
 // TODO: write test where we record a command buffer that executes
 // each command once. Then hook each of those commands, separately.
 
@@ -215,6 +215,9 @@ int main() {
 	// timeline semaphore bug
 	// setenv("VIL_TIMELINE_SEMAPHORES", "0", 1);
 	setenv("VIL_DLG_HANDLER", "1", 1);
+	// the mock driver doesn't implement timeline semaphore counters,
+	// completion can only be tracked via fences.
+	setenv("VIL_TIMELINE_TRACKING", "0", 1);
 
 	// enumerate layers
 	{
@@ -377,6 +380,18 @@ int main() {
 		features12.timelineSemaphore = true;
 	}
 
+	auto descriptorIndexing =
+		sup12.runtimeDescriptorArray &&
+		sup12.descriptorBindingVariableDescriptorCount &&
+		sup12.descriptorBindingPartiallyBound &&
+		sup12.descriptorBindingSampledImageUpdateAfterBind;
+	if(descriptorIndexing) {
+		features12.runtimeDescriptorArray = true;
+		features12.descriptorBindingVariableDescriptorCount = true;
+		features12.descriptorBindingPartiallyBound = true;
+		features12.descriptorBindingSampledImageUpdateAfterBind = true;
+	}
+
 	const float prio1[] = {1.f, 1.f};
 	VkDeviceQueueCreateInfo qcis[2] {};
 	u32 qcCount = 1u;
@@ -428,6 +443,7 @@ int main() {
 	gSetup.qfam2 = qfamAsyncCompute;
 	gSetup.queue = queueGfx;
 	gSetup.queue2 = queueCompute;
+	gSetup.descriptorIndexing = descriptorIndexing;
 	layer_init_device_dispatch_table(gSetup.dev, &gSetup.dispatch, &vkGetDeviceProcAddr);
 
 	// run tests
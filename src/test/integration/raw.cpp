@@ -1,5 +1,8 @@
 #include "external.hpp"
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <vector>
 
 TEST(names) {
 	auto& setup = getSetup();
@@ -355,3 +358,126 @@ TEST(queryPool) {
 
 	vkDestroyQueryPool(stp.dev, qp, nullptr);
 }
+
+// Not a real test, mainly a benchmark for bindless-style descriptor sets
+// with a huge variable-count binding, see DescriptorPages in ds.hpp.
+// The memory used by the pages is checked in int_bindless_pages.
+TEST(bindless_descriptors) {
+	using Clock = std::chrono::high_resolution_clock;
+	auto& stp = getSetup();
+	if(!stp.descriptorIndexing) {
+		dlg_info("Descriptor indexing not supported, skipping");
+		return;
+	}
+
+	VkPhysicalDeviceVulkan12Properties props12 {};
+	props12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 props {};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &props12;
+	vkGetPhysicalDeviceProperties2(stp.phdev, &props);
+
+	auto count = 1024u * 1024u;
+	count = std::min(count, props12.maxDescriptorSetUpdateAfterBindSamplers);
+	count = std::min(count, props12.maxPerStageDescriptorUpdateAfterBindSamplers);
+	count = std::min(count, props12.maxUpdateAfterBindDescriptorsInAllPools);
+
+	auto sci = linearSamplerCI();
+	VkSampler sampler;
+	VK_CHECK(vkCreateSampler(stp.dev, &sci, nullptr, &sampler));
+
+	// layout
+	auto binding = VkDescriptorSetLayoutBinding {0u, VK_DESCRIPTOR_TYPE_SAMPLER,
+		count, VK_SHADER_STAGE_ALL, nullptr};
+	VkDescriptorBindingFlags bindingFlags =
+		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT |
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsci {};
+	flagsci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsci.bindingCount = 1u;
+	flagsci.pBindingFlags = &bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo lci {};
+	lci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	lci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	lci.bindingCount = 1u;
+	lci.pBindings = &binding;
+	lci.pNext = &flagsci;
+	VkDescriptorSetLayout dsLayout;
+	VK_CHECK(vkCreateDescriptorSetLayout(stp.dev, &lci, nullptr, &dsLayout));
+
+	// pool
+	auto poolSize = VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_SAMPLER, count};
+	VkDescriptorPoolCreateInfo dci {};
+	dci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	dci.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	dci.pPoolSizes = &poolSize;
+	dci.poolSizeCount = 1u;
+	dci.maxSets = 1u;
+	VkDescriptorPool dsPool;
+	VK_CHECK(vkCreateDescriptorPool(stp.dev, &dci, nullptr, &dsPool));
+
+	// set
+	VkDescriptorSetVariableDescriptorCountAllocateInfo varci {};
+	varci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+	varci.descriptorSetCount = 1u;
+	varci.pDescriptorCounts = &count;
+
+	VkDescriptorSet ds;
+	VkDescriptorSetAllocateInfo dsai {};
+	dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsai.descriptorPool = dsPool;
+	dsai.pSetLayouts = &dsLayout;
+	dsai.descriptorSetCount = 1u;
+	dsai.pNext = &varci;
+
+	auto before = Clock::now();
+	VK_CHECK(vkAllocateDescriptorSets(stp.dev, &dsai, &ds));
+	auto allocTime = Clock::now() - before;
+
+	// updates, in batches as done by bindless renderers
+	constexpr auto batchSize = 4096u;
+	std::vector<VkDescriptorImageInfo> infos(batchSize);
+	for(auto& info : infos) {
+		info.sampler = sampler;
+	}
+
+	auto update = [&](unsigned first, unsigned n) {
+		VkWriteDescriptorSet write {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		write.dstSet = ds;
+		write.dstArrayElement = first;
+		write.descriptorCount = n;
+		write.pImageInfo = infos.data();
+		vkUpdateDescriptorSets(stp.dev, 1u, &write, 0u, nullptr);
+	};
+
+	// sparse: only a few descriptors per page are written
+	before = Clock::now();
+	for(auto i = 0u; i < count; i += batchSize) {
+		update(i, 1u);
+	}
+	auto sparseTime = Clock::now() - before;
+
+	// full
+	before = Clock::now();
+	for(auto i = 0u; i < count; i += batchSize) {
+		update(i, std::min(batchSize, count - i));
+	}
+	auto fullTime = Clock::now() - before;
+
+	auto ms = [](auto dur) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(dur).count() / 1000.f;
+	};
+
+	dlg_info("bindless: {} descriptors", count);
+	dlg_info("  alloc: {} ms, sparse update: {} ms, full update: {} ms",
+		ms(allocTime), ms(sparseTime), ms(fullTime));
+
+	vkDestroyDescriptorPool(stp.dev, dsPool, nullptr);
+	vkDestroyDescriptorSetLayout(stp.dev, dsLayout, nullptr);
+	vkDestroySampler(stp.dev, sampler, nullptr);
+}
@@ -42,6 +42,10 @@ struct Setup {
 	u32 qfam;
 	u32 qfam2; // for queue2
 
+	// whether the descriptor indexing features needed for
+	// bindless-style descriptor sets were enabled
+	bool descriptorIndexing {};
+
 	VkLayerInstanceDispatchTable iniDispatch;
 	VkLayerDispatchTable dispatch;
 };
@@ -0,0 +1,158 @@
+#include "../bugged.hpp"
+#include <commandHook/record.hpp>
+
+using namespace vil;
+
+TEST(unit_drawSplit_vertices) {
+	constexpr auto maxVerts = 1000u;
+	constexpr auto topo = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// windows are aligned to primitives
+	auto split = splitDraw(topo, 3000u, 1u, 0u, maxVerts, true);
+	EXPECT(split.byInstance, false);
+	EXPECT(split.begin, 0u);
+	EXPECT(split.end, 999u);
+	EXPECT(split.total, 3000u);
+	EXPECT(split.pageCount, 4u);
+
+	split = splitDraw(topo, 3000u, 1u, 1u, maxVerts, true);
+	EXPECT(split.begin, 999u);
+	EXPECT(split.end, 1998u);
+
+	split = splitDraw(topo, 3000u, 1u, 3u, maxVerts, true);
+	EXPECT(split.begin, 2997u);
+	EXPECT(split.end, 3000u);
+
+	// out-of-range pages are clamped
+	split = splitDraw(topo, 3000u, 1u, 10u, maxVerts, true);
+	EXPECT(split.page, 3u);
+	EXPECT(split.begin, 2997u);
+
+	// small draws fit into a single page
+	split = splitDraw(topo, 300u, 1u, 0u, maxVerts, true);
+	EXPECT(split.pageCount, 1u);
+	EXPECT(split.begin, 0u);
+	EXPECT(split.end, 300u);
+}
+
+TEST(unit_drawSplit_instances) {
+	constexpr auto maxVerts = 1000u;
+
+	// instanced draws are always split along instances
+	auto split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		300u, 10u, 1u, maxVerts, true);
+	EXPECT(split.byInstance, true);
+	EXPECT(split.total, 10u);
+	EXPECT(split.pageCount, 4u);
+	EXPECT(split.begin, 3u);
+	EXPECT(split.end, 6u);
+
+	// fans can't be split along vertices
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN,
+		5000u, 1u, 0u, maxVerts, true);
+	EXPECT(split.byInstance, true);
+	EXPECT(split.pageCount, 1u);
+	EXPECT(split.begin, 0u);
+	EXPECT(split.end, 1u);
+
+	// neither can lists when the caller forbids it
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		5000u, 1u, 0u, maxVerts, false);
+	EXPECT(split.byInstance, true);
+	EXPECT(split.end, 1u);
+
+	// instances larger than a page get a page each
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		5000u, 3u, 2u, maxVerts, true);
+	EXPECT(split.pageCount, 3u);
+	EXPECT(split.begin, 2u);
+	EXPECT(split.end, 3u);
+
+	// empty draws
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		300u, 0u, 0u, maxVerts, true);
+	EXPECT(split.pageCount, 1u);
+	EXPECT(split.begin, 0u);
+	EXPECT(split.end, 0u);
+}
+
+TEST(unit_drawSplit_strips) {
+	constexpr auto maxVerts = 1000u;
+
+	// triangle strips are split along primitives, starting at even ones.
+	// 1000 / 3 vertices per triangle = 333, rounded down to 332.
+	auto split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+		5000u, 1u, 1u, maxVerts, true);
+	EXPECT(split.byInstance, false);
+	EXPECT(split.overlap, 2u);
+	EXPECT(split.total, 4998u);
+	EXPECT(split.begin, 332u);
+	EXPECT(split.end, 664u);
+	EXPECT(split.pageCount, 16u);
+	EXPECT(topologyOutputCount(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+		split.end - split.begin + split.overlap) <= maxVerts, true);
+
+	// the last part ends at the last vertex
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+		5000u, 1u, 15u, maxVerts, true);
+	EXPECT(split.end, 4998u);
+	EXPECT(split.end + split.overlap, 5000u);
+
+	// line strips share a single vertex, any start is fine
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_LINE_STRIP,
+		5000u, 1u, 1u, maxVerts, true);
+	EXPECT(split.overlap, 1u);
+	EXPECT(split.total, 4999u);
+	EXPECT(split.begin, 500u);
+	EXPECT(split.end, 1000u);
+
+	// degenerate strips
+	split = splitDraw(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+		2u, 1u, 0u, maxVerts, true);
+	EXPECT(split.pageCount, 1u);
+	EXPECT(split.total, 0u);
+	EXPECT(split.end, 0u);
+}
+
+TEST(unit_drawSplit_multi) {
+	constexpr auto maxVerts = 1000u;
+	constexpr auto topo = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// pages hold as many consecutive draws as fit
+	const u32 counts[] = {300u, 300u, 300u, 600u, 3000u, 30u};
+	auto split = splitMultiDraw(topo, counts, 1u, 0u, maxVerts, true);
+	EXPECT(split.byDraw, true);
+	EXPECT(split.total, 6u);
+	EXPECT(split.pageCount, 4u);
+	EXPECT(split.begin, 0u);
+	EXPECT(split.end, 3u);
+
+	split = splitMultiDraw(topo, counts, 1u, 1u, maxVerts, true);
+	EXPECT(split.begin, 3u);
+	EXPECT(split.end, 4u);
+
+	// draws larger than a page get their own page
+	split = splitMultiDraw(topo, counts, 1u, 2u, maxVerts, true);
+	EXPECT(split.begin, 4u);
+	EXPECT(split.end, 5u);
+
+	// out-of-range pages are clamped
+	split = splitMultiDraw(topo, counts, 1u, 10u, maxVerts, true);
+	EXPECT(split.page, 3u);
+	EXPECT(split.begin, 5u);
+	EXPECT(split.end, 6u);
+
+	// instances count for every draw
+	split = splitMultiDraw(topo, counts, 2u, 0u, maxVerts, true);
+	EXPECT(split.end, 1u);
+
+	// without splitting, everything is a single page
+	split = splitMultiDraw(topo, counts, 1u, 2u, maxVerts, false);
+	EXPECT(split.pageCount, 1u);
+	EXPECT(split.begin, 0u);
+	EXPECT(split.end, 6u);
+
+	split = splitMultiDraw(topo, span<const u32>{}, 1u, 0u, maxVerts, true);
+	EXPECT(split.pageCount, 1u);
+	EXPECT(split.end, 0u);
+}
@@ -4,6 +4,7 @@
 #include <random>
 #include <chrono>
 #include <unordered_set>
+#include <vector>
 #include <util/profiling.hpp>
 
 using namespace vil;
@@ -139,9 +140,9 @@ TEST(unit_identity_square) {
 	};
 
 	LinAllocator alloc;
-	LazyMatrixMarch lmm(32u, 32u, alloc, matcher);
+	LazyMatrixMarch lmm(32u, 32u, alloc);
 
-	auto res = lmm.run();
+	auto res = lmm.run(matcher);
 	EXPECT(res.totalMatch, approx(32 * 1.f));
 	EXPECT(res.matches.size(), 32u);
 
@@ -159,9 +160,9 @@ TEST(unit_identity_imperfect_rect) {
 	};
 
 	LinAllocator alloc;
-	LazyMatrixMarch lmm(17u, 64u, alloc, matcher);
+	LazyMatrixMarch lmm(17u, 64u, alloc);
 
-	auto res = lmm.run();
+	auto res = lmm.run(matcher);
 	EXPECT(res.totalMatch, approx(17.f * 0.4f, 0.001));
 	EXPECT(res.matches.size(), 17u);
 
@@ -236,10 +237,10 @@ TEST(unit_compare_trivial) {
 
 	using Clock = std::chrono::high_resolution_clock;
 	LinAllocator alloc;
-	LazyMatrixMarch llm(lenA, lenB, alloc, matcher, 1.f);
+	LazyMatrixMarch llm(lenA, lenB, alloc, 1.f);
 
 	auto before = Clock::now();
-	auto resLLM = llm.run();
+	auto resLLM = llm.run(matcher);
 	auto timeLLM = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - before).count();
 	dlg_trace("timeLLM: {} mus", timeLLM);
 
@@ -271,8 +272,8 @@ TEST(unit_lmm_strings) {
 		};
 
 		LinAllocator alloc;
-		LazyMatrixMarch llm(strA.size(), strB.size(), alloc, matcher, 1.f);
-		auto res = llm.run();
+		LazyMatrixMarch llm(strA.size(), strB.size(), alloc, 1.f);
+		auto res = llm.run(matcher);
 
 		std::unordered_set<u32> seenA;
 		std::unordered_set<u32> seenB;
@@ -305,3 +306,133 @@ TEST(unit_lmm_strings) {
 	checkMatch("dddda", "aaaad", 1);
 	checkMatch("a", "aaaadaaaa", 1);
 }
+
+namespace {
+
+// Returns a copy of 'seq' with 'numEdits' random insertions, deletions
+// and replacements.
+std::vector<u32> edit(std::vector<u32> seq, u32 numEdits, std::mt19937& rng) {
+	for(auto e = 0u; e < numEdits; ++e) {
+		auto pos = std::uniform_int_distribution<u32>(0u, seq.size() - 1)(rng);
+		switch(e % 3u) {
+			case 0u: seq.insert(seq.begin() + pos, u32(rng())); break;
+			case 1u: seq.erase(seq.begin() + pos); break;
+			case 2u: seq[pos] = u32(rng()); break;
+		}
+	}
+
+	return seq;
+}
+
+struct LargeRun {
+	LazyMatrixMarch::Result res;
+	u32 numFields;
+	u32 numEvals;
+	u64 timeMus;
+};
+
+LargeRun runLarge(LinAllocator& alloc, const std::vector<u32>& a,
+		const std::vector<u32>& b) {
+	using Clock = std::chrono::high_resolution_clock;
+	auto matcher = [&](u32 i, u32 j) -> float {
+		return a[i] == b[j] ? 1.f : 0.f;
+	};
+
+	auto before = Clock::now();
+	LazyMatrixMarch lmm(a.size(), b.size(), alloc, 1.f);
+	auto res = lmm.run(matcher);
+	auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+		Clock::now() - before).count();
+
+	return {res, lmm.numFields(), lmm.numEvals(), u64(time)};
+}
+
+} // anon namespace
+
+// Matching two sequences of 20k elements. A dense matrix would need
+// 400M fields here, we only visit the ones around the diagonal.
+TEST(unit_lmm_large_identical) {
+	constexpr auto n = 20000u;
+
+	std::size_t allocated {};
+	LinAllocator alloc([&](const std::byte*, u32 size) { allocated += size; },
+		[](const std::byte*, u32) {});
+
+	std::vector<u32> seq(n);
+	for(auto i = 0u; i < n; ++i) {
+		seq[i] = i;
+	}
+
+	auto run = runLarge(alloc, seq, seq);
+	EXPECT(run.res.totalMatch, approx(float(n)));
+	EXPECT(run.res.matches.size(), n);
+	EXPECT(run.numEvals, n);
+	EXPECT(run.numFields <= 2 * n, true);
+	EXPECT(allocated < 16 * 1024 * 1024, true);
+
+	dlg_info("lmm large identical: n = {}, {} mus, {} fields, {} KiB",
+		n, run.timeMus, run.numFields, allocated / 1024);
+}
+
+// Runtime and memory should scale with the number of differences.
+TEST(unit_lmm_large_edits) {
+	constexpr auto n = 20000u;
+	std::mt19937 rng(42u);
+
+	std::vector<u32> seqA(n);
+	for(auto& val : seqA) {
+		val = u32(rng());
+	}
+
+	for(auto numEdits : {10u, 100u, 200u}) {
+		auto seqB = edit(seqA, numEdits, rng);
+
+		std::size_t allocated {};
+		LinAllocator alloc([&](const std::byte*, u32 size) { allocated += size; },
+			[](const std::byte*, u32) {});
+		auto run = runLarge(alloc, seqA, seqB);
+
+		// every edit removes at most one element from the common subsequence
+		EXPECT(run.res.totalMatch >= float(n - numEdits), true);
+		EXPECT(run.res.matches.size(), u32(run.res.totalMatch));
+
+		auto lastI = -1;
+		auto lastJ = -1;
+		for(auto& m : run.res.matches) {
+			EXPECT(int(m.i) > lastI, true);
+			EXPECT(int(m.j) > lastJ, true);
+			EXPECT(seqA[m.i], seqB[m.j]);
+			lastI = m.i;
+			lastJ = m.j;
+		}
+
+		dlg_info("lmm large, {} edits: {} mus, {} fields, {} evals, {} KiB",
+			numEdits, run.timeMus, run.numFields, run.numEvals, allocated / 1024);
+	}
+}
+
+// The sparse implementation must still find the optimal path.
+TEST(unit_lmm_edits_compare_trivial) {
+	constexpr auto n = 500u;
+	std::mt19937 rng(7u);
+
+	std::vector<u32> seqA(n);
+	for(auto& val : seqA) {
+		val = u32(rng() % 16u);
+	}
+
+	auto seqB = edit(seqA, 50u, rng);
+	auto matcher = [&](u32 i, u32 j) -> float {
+		return seqA[i] == seqB[j] ? 1.f : 0.f;
+	};
+
+	LinAllocator alloc;
+	LazyMatrixMarch lmm(seqA.size(), seqB.size(), alloc, 1.f);
+	auto resLMM = lmm.run(matcher);
+	auto resRef = SlowAlignAlgo::run(alloc, seqA.size(), seqB.size(), matcher);
+
+	EXPECT(resLMM.totalMatch, approx(resRef.totalMatch, 0.001));
+	EXPECT(resLMM.matches.size(), resRef.matches.size());
+	dlg_info("lmm edits: {} fields visited, trivial: {}",
+		lmm.numFields(), seqA.size() * seqB.size());
+}
@@ -0,0 +1,320 @@
+#include "../bugged.hpp"
+#include <command/reclaim.hpp>
+#include <command/record.hpp>
+#include <util/intrusive.hpp>
+#include <stats.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+std::atomic<u32> aliveHandles {};
+
+struct TestHandle {
+	TestHandle() { ++aliveHandles; }
+	~TestHandle() { --aliveHandles; }
+
+	std::atomic<u32> refCount {};
+	u64 data {};
+};
+
+using TestHandlePtr = IntrusivePtr<TestHandle>;
+
+// Records are created without device, we register them manually.
+struct TestRecord {
+	HandleReclaimer& reclaimer;
+	IntrusivePtr<CommandRecord> rec;
+
+	explicit TestRecord(HandleReclaimer& r) : reclaimer(r) {
+		rec.reset(new CommandRecord(manualTag, nullptr));
+		reclaimer.registerRecord(*rec);
+	}
+
+	~TestRecord() {
+		reclaimer.unregisterRecord(*rec);
+	}
+
+	void use(const TestHandle& handle) {
+		rec->used.events.insert(&handle);
+	}
+
+	void finish() {
+		rec->used.compact();
+		rec->finished = true;
+	}
+};
+
+void retire(HandleReclaimer& reclaimer, TestHandlePtr ptr) {
+	std::vector<RetiredHandle> released;
+	reclaimer.retireLocked(ptr, released);
+}
+
+} // anon namespace
+
+TEST(unit_reclaim_generations) {
+	HandleReclaimer reclaimer;
+
+	// without records, handles are released immediately
+	retire(reclaimer, TestHandlePtr(new TestHandle()));
+	EXPECT(aliveHandles.load(), 0u);
+	EXPECT(reclaimer.retiredCount(), 0u);
+
+	{
+		auto a = std::make_unique<TestRecord>(reclaimer);
+		auto h1 = TestHandlePtr(new TestHandle());
+		auto h2 = TestHandlePtr(new TestHandle());
+		a->use(*h1);
+
+		retire(reclaimer, std::move(h1));
+		retire(reclaimer, std::move(h2));
+		EXPECT(aliveHandles.load(), 2u);
+		EXPECT(reclaimer.retiredCount(), 2u);
+
+		// b can't reference the retired handles, destroying it
+		// doesn't release anything
+		auto b = std::make_unique<TestRecord>(reclaimer);
+		auto h3 = TestHandlePtr(new TestHandle());
+		b->use(*h3);
+		retire(reclaimer, std::move(h3));
+		EXPECT(aliveHandles.load(), 3u);
+
+		a.reset();
+		EXPECT(aliveHandles.load(), 1u);
+		EXPECT(reclaimer.retiredCount(), 1u);
+
+		b.reset();
+		EXPECT(aliveHandles.load(), 0u);
+		EXPECT(reclaimer.retiredCount(), 0u);
+	}
+}
+
+TEST(unit_reclaim_sweep) {
+	HandleReclaimer reclaimer;
+
+	// a record that is kept alive forever
+	TestRecord old(reclaimer);
+	auto used = TestHandlePtr(new TestHandle());
+	old.use(*used);
+	old.finish();
+
+	auto usedRaw = used.get();
+	retire(reclaimer, std::move(used));
+
+	// retiring many unrelated handles eventually triggers a sweep
+	for(auto i = 0u; i < 4 * HandleReclaimer::minSweepCount; ++i) {
+		retire(reclaimer, TestHandlePtr(new TestHandle()));
+		EXPECT(reclaimer.retiredCount() <= 2 * HandleReclaimer::minSweepCount, true);
+	}
+
+	EXPECT(aliveHandles.load() < 2 * HandleReclaimer::minSweepCount, true);
+	EXPECT(old.rec->used.contains(usedRaw), true);
+
+	// unfinished records block the sweep, their used handles might change
+	{
+		TestRecord recording(reclaimer);
+		for(auto i = 0u; i < 4 * HandleReclaimer::minSweepCount; ++i) {
+			retire(reclaimer, TestHandlePtr(new TestHandle()));
+		}
+
+		EXPECT(reclaimer.retiredCount() >= 4 * HandleReclaimer::minSweepCount, true);
+	}
+
+	// the handle used by the old record is never released
+	EXPECT(reclaimer.retiredCount() >= 1u, true);
+	EXPECT(aliveHandles.load() >= 1u, true);
+}
+
+// Records registered lock-free on other threads while handles are retired.
+TEST(unit_reclaim_parallel) {
+	HandleReclaimer reclaimer;
+	std::atomic<bool> stop {};
+	std::vector<std::thread> threads;
+	for(auto t = 0u; t < 4u; ++t) {
+		threads.emplace_back([&]{
+			while(!stop.load()) {
+				TestRecord rec(reclaimer);
+				rec.finish();
+			}
+		});
+	}
+
+	for(auto i = 0u; i < 1000u; ++i) {
+		retire(reclaimer, TestHandlePtr(new TestHandle()));
+	}
+
+	stop = true;
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	// nothing can reference the handles anymore
+	EXPECT(reclaimer.retiredCount(), 0u);
+	EXPECT(aliveHandles.load(), 0u);
+}
+
+TEST(unit_destroy_queue) {
+	struct Destroyable {
+		DestroyNode node;
+		std::vector<u32>* order;
+		u32 id;
+	};
+
+	auto make = [](std::vector<u32>& order, u32 id) {
+		auto* obj = new Destroyable{{}, &order, id};
+		obj->node.object = obj;
+		obj->node.destroy = [](void* ptr) {
+			auto* obj = static_cast<Destroyable*>(ptr);
+			obj->order->push_back(obj->id);
+			delete obj;
+		};
+		return obj;
+	};
+
+	// not running, objects are destroyed inline
+	DestroyQueue queue;
+	std::vector<u32> order;
+	queue.push(make(order, 0u)->node);
+	EXPECT(order.size(), 1u);
+
+	// running, objects are destroyed in push order
+	queue.start();
+	constexpr auto count = 1000u;
+	for(auto i = 1u; i <= count; ++i) {
+		queue.push(make(order, i)->node);
+	}
+
+	queue.flush();
+	EXPECT(order.size(), count + 1u);
+	for(auto i = 0u; i < order.size(); ++i) {
+		EXPECT(order[i], i);
+	}
+
+	EXPECT(DebugStats::get().destroyQueueDepth.load(), 0u);
+
+	// boxed values, pushed from multiple threads
+	auto handle = TestHandlePtr(new TestHandle());
+	std::vector<std::thread> threads;
+	for(auto t = 0u; t < 4u; ++t) {
+		threads.emplace_back([&]{
+			for(auto i = 0u; i < count; ++i) {
+				queue.pushValue(std::vector<TestHandlePtr>{handle, handle});
+			}
+		});
+	}
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	queue.stop();
+	EXPECT(handle->refCount.load(), 1u);
+
+	// stopped, inline again
+	queue.push(make(order, count + 1u)->node);
+	EXPECT(order.size(), count + 2u);
+}
+
+// Pushes racing with stop must neither be lost nor destroyed twice.
+TEST(unit_destroy_queue_stop) {
+	constexpr auto numThreads = 4u;
+	constexpr auto count = 2000u;
+
+	for(auto round = 0u; round < 10u; ++round) {
+		auto handle = TestHandlePtr(new TestHandle());
+		DestroyQueue queue;
+		queue.start();
+
+		std::atomic<u32> started {};
+		std::vector<std::thread> threads;
+		for(auto t = 0u; t < numThreads; ++t) {
+			threads.emplace_back([&]{
+				++started;
+				for(auto i = 0u; i < count; ++i) {
+					queue.pushValue(handle);
+				}
+			});
+		}
+
+		while(started.load() != numThreads) {
+			std::this_thread::yield();
+		}
+
+		queue.stop();
+		EXPECT(queue.running(), false);
+
+		for(auto& thread : threads) {
+			thread.join();
+		}
+
+		EXPECT(handle->refCount.load(), 1u);
+		EXPECT(DebugStats::get().destroyQueueDepth.load(), 0u);
+	}
+}
+
+// Not a real test, just a microbenchmark comparing reference counting
+// of all handles used by a record with registering the record once.
+// Multiple threads record in parallel, all using the same hot handles.
+TEST(unit_reclaim_bench) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	constexpr auto numThreads = 8u;
+	constexpr auto recordsPerThread = 2000u;
+	constexpr auto usesPerRecord = 256u;
+
+	std::vector<TestHandlePtr> handles;
+	for(auto i = 0u; i < 32u; ++i) {
+		handles.emplace_back(new TestHandle());
+	}
+
+	auto run = [&](auto&& recordFn) {
+		auto before = Clock::now();
+		std::vector<std::thread> threads;
+		for(auto t = 0u; t < numThreads; ++t) {
+			threads.emplace_back([&]{
+				for(auto r = 0u; r < recordsPerThread; ++r) {
+					recordFn();
+				}
+			});
+		}
+
+		for(auto& thread : threads) {
+			thread.join();
+		}
+
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			Clock::now() - before).count();
+	};
+
+	// previous approach: every use increments the handles refCount,
+	// destroying the record decrements it again.
+	auto timeRefCount = run([&]{
+		IntrusivePtr<CommandRecord> rec(new CommandRecord(manualTag, nullptr));
+		std::vector<TestHandlePtr> refs;
+		refs.reserve(usesPerRecord);
+		for(auto i = 0u; i < usesPerRecord; ++i) {
+			refs.push_back(handles[i % handles.size()]);
+		}
+	});
+
+	HandleReclaimer reclaimer;
+	auto timeReclaim = run([&]{
+		TestRecord rec(reclaimer);
+		std::vector<const TestHandle*> refs;
+		refs.reserve(usesPerRecord);
+		for(auto i = 0u; i < usesPerRecord; ++i) {
+			refs.push_back(handles[i % handles.size()].get());
+		}
+	});
+
+	for(auto& handle : handles) {
+		EXPECT(handle->refCount.load(), 1u);
+	}
+
+	dlg_info("reclaim: {} threads, {} records each, {} uses per record",
+		numThreads, recordsPerThread, usesPerRecord);
+	dlg_info("  refCount: {} mus, reclaimer: {} mus", timeRefCount, timeReclaim);
+}
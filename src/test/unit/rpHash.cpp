@@ -0,0 +1,203 @@
+#include "../bugged.hpp"
+#include <rp.hpp>
+#include <nytl/span.hpp>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+void addHashAttachment(RenderPassDesc& desc,
+		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+		VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE) {
+	auto& att = desc.attachments.emplace_back();
+	att = {};
+	att.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+	att.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	att.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	att.format = format;
+	att.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	att.storeOp = storeOp;
+	att.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	att.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	att.samples = samples;
+}
+
+void addHashSubpass(RenderPassDesc& desc, span<const u32> colorAtts,
+		VkImageLayout layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+	auto& colorRefs = desc.attachmentRefs.emplace_back();
+	for(auto c : colorAtts) {
+		auto& ref = colorRefs.emplace_back();
+		ref = {};
+		ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+		ref.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		ref.attachment = c;
+		ref.layout = layout;
+	}
+
+	auto& subp = desc.subpasses.emplace_back();
+	subp = {};
+	subp.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+	subp.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subp.pColorAttachments = colorRefs.data();
+	subp.colorAttachmentCount = colorRefs.size();
+}
+
+// Compares without the hash early-out
+bool fullEqual(RenderPassDesc& a, RenderPassDesc& b) {
+	auto hashA = a.matchHash;
+	auto hashB = b.matchHash;
+	a.matchHash = 0u;
+	b.matchHash = 0u;
+	auto ret = equal(a, b);
+	a.matchHash = hashA;
+	b.matchHash = hashB;
+	return ret;
+}
+
+constexpr u32 atts01[] = {0u, 1u};
+constexpr u32 atts10[] = {1u, 0u};
+constexpr u32 atts0[] = {0u};
+constexpr u32 atts1[] = {1u};
+
+} // anon namespace
+
+TEST(unit_rp_hash_equal) {
+	std::vector<std::unique_ptr<RenderPassDesc>> descs;
+	auto add = [&]() -> RenderPassDesc& {
+		return *descs.emplace_back(std::make_unique<RenderPassDesc>());
+	};
+
+	// 0: base
+	auto& base = add();
+	addHashAttachment(base);
+	addHashAttachment(base);
+	addHashSubpass(base, atts01);
+
+	// 1: same as base, created separately
+	auto& same = add();
+	addHashAttachment(same);
+	addHashAttachment(same);
+	addHashSubpass(same, atts01);
+
+	// 2: reference layouts are not compared
+	auto& otherLayout = add();
+	addHashAttachment(otherLayout);
+	addHashAttachment(otherLayout);
+	addHashSubpass(otherLayout, atts01, VK_IMAGE_LAYOUT_GENERAL);
+
+	// 3..7: different for matching
+	auto& otherFormat = add();
+	addHashAttachment(otherFormat);
+	addHashAttachment(otherFormat, VK_FORMAT_R16G16B16A16_SFLOAT);
+	addHashSubpass(otherFormat, atts01);
+
+	auto& otherSamples = add();
+	addHashAttachment(otherSamples, VK_FORMAT_R8G8B8A8_UNORM, VK_SAMPLE_COUNT_4_BIT);
+	addHashAttachment(otherSamples);
+	addHashSubpass(otherSamples, atts01);
+
+	auto& otherStore = add();
+	addHashAttachment(otherStore);
+	addHashAttachment(otherStore, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_STORE_OP_DONT_CARE);
+	addHashSubpass(otherStore, atts01);
+
+	auto& swapped = add();
+	addHashAttachment(swapped);
+	addHashAttachment(swapped);
+	addHashSubpass(swapped, atts10);
+
+	auto& twoSubpasses = add();
+	addHashAttachment(twoSubpasses);
+	addHashAttachment(twoSubpasses);
+	addHashSubpass(twoSubpasses, atts0);
+	addHashSubpass(twoSubpasses, atts1);
+
+	for(auto& desc : descs) {
+		desc->matchHash = computeMatchHash(*desc);
+		EXPECT(desc->matchHash != 0u, true);
+	}
+
+	for(auto i = 0u; i < descs.size(); ++i) {
+		for(auto j = 0u; j < descs.size(); ++j) {
+			auto& a = *descs[i];
+			auto& b = *descs[j];
+			auto full = fullEqual(a, b);
+
+			// the early-out must never change the result
+			EXPECT(equal(a, b), full);
+			if(a.matchHash != b.matchHash) {
+				EXPECT(full, false);
+			}
+
+			// only the first three are equal
+			auto expected = (i == j) || (i < 3 && j < 3);
+			EXPECT(full, expected);
+		}
+	}
+
+	// The hash actually tells these apart, otherwise the early-out
+	// would be useless.
+	for(auto i = 3u; i < descs.size(); ++i) {
+		EXPECT(descs[i]->matchHash != base.matchHash, true);
+	}
+}
+
+// Compares render passes that only differ in their last subpass, the
+// worst case for the full comparison.
+TEST(unit_rp_hash_bench) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	constexpr auto numAtts = 8u;
+	constexpr auto numSubpasses = 8u;
+	constexpr auto iterations = 100'000u;
+
+	RenderPassDesc descs[2];
+	for(auto d = 0u; d < 2u; ++d) {
+		for(auto a = 0u; a < numAtts; ++a) {
+			addHashAttachment(descs[d]);
+		}
+
+		for(auto s = 0u; s < numSubpasses; ++s) {
+			auto last = (s + 1 == numSubpasses);
+			auto atts = (last && d == 1u) ? span<const u32>(atts10) : span<const u32>(atts01);
+			addHashSubpass(descs[d], atts);
+		}
+
+		descs[d].matchHash = computeMatchHash(descs[d]);
+	}
+
+	// The hashes differ, so equal() returns before walking the subpasses
+	EXPECT(descs[0].matchHash != descs[1].matchHash, true);
+	EXPECT(equal(descs[0], descs[1]), false);
+
+	auto run = [&]{
+		auto count = 0u;
+		auto before = Clock::now();
+		for(auto i = 0u; i < iterations; ++i) {
+			count += equal(descs[i % 2u], descs[1u - i % 2u]);
+		}
+
+		auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+			Clock::now() - before).count();
+		EXPECT(count, 0u);
+		return time;
+	};
+
+	auto timeHashed = run();
+
+	auto hashes = std::array{descs[0].matchHash, descs[1].matchHash};
+	descs[0].matchHash = 0u;
+	descs[1].matchHash = 0u;
+	auto timeFull = run();
+	descs[0].matchHash = hashes[0];
+	descs[1].matchHash = hashes[1];
+
+	dlg_trace("render pass equal: {} comparisons", iterations);
+	dlg_trace("  full: {} mus, hashed: {} mus", timeFull, timeHashed);
+}
@@ -0,0 +1,250 @@
+#include "../bugged.hpp"
+#include <gui/render.hpp>
+#include <device.hpp>
+#include <layer.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+// Fake host-visible memory, the handle is a pointer to it.
+struct FakeMemory {
+	std::vector<std::byte> data;
+	u32 flushes {};
+};
+
+u64 bufferCounter {};
+u32 aliveBuffers {};
+VkDeviceSize lastBufferSize {};
+std::vector<FakeMemory*> memories; // in allocation order
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeCreateBuffer(VkDevice,
+		const VkBufferCreateInfo* ci, const VkAllocationCallbacks*, VkBuffer* buf) {
+	*buf = VkBuffer(std::uintptr_t(++bufferCounter));
+	lastBufferSize = ci->size;
+	++aliveBuffers;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL fakeDestroyBuffer(VkDevice, VkBuffer buf,
+		const VkAllocationCallbacks*) {
+	if(buf) {
+		--aliveBuffers;
+	}
+}
+
+VKAPI_ATTR void VKAPI_CALL fakeGetBufferMemoryRequirements(VkDevice,
+		VkBuffer, VkMemoryRequirements* reqs) {
+	reqs->size = lastBufferSize;
+	reqs->alignment = 1u;
+	reqs->memoryTypeBits = 1u;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeAllocateMemory(VkDevice,
+		const VkMemoryAllocateInfo* ai, const VkAllocationCallbacks*,
+		VkDeviceMemory* mem) {
+	auto* fake = memories.emplace_back(new FakeMemory());
+	fake->data.resize(ai->allocationSize);
+	*mem = VkDeviceMemory(std::uintptr_t(fake));
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL fakeFreeMemory(VkDevice, VkDeviceMemory mem,
+		const VkAllocationCallbacks*) {
+	auto* fake = reinterpret_cast<FakeMemory*>(std::uintptr_t(mem));
+	auto it = std::find(memories.begin(), memories.end(), fake);
+	if(it != memories.end()) {
+		*it = nullptr;
+	}
+
+	delete fake;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeBindBufferMemory(VkDevice, VkBuffer,
+		VkDeviceMemory, VkDeviceSize) {
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeMapMemory(VkDevice, VkDeviceMemory mem,
+		VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** ppData) {
+	auto* fake = reinterpret_cast<FakeMemory*>(std::uintptr_t(mem));
+	*ppData = fake->data.data() + offset;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeFlushMappedMemoryRanges(VkDevice,
+		u32 count, const VkMappedMemoryRange* ranges) {
+	for(auto i = 0u; i < count; ++i) {
+		++reinterpret_cast<FakeMemory*>(std::uintptr_t(ranges[i].memory))->flushes;
+	}
+
+	return VK_SUCCESS;
+}
+
+// Only sets up what OwnBuffer needs
+void initStagingDevice(Device& dev, Instance& ini) {
+	bufferCounter = 0u;
+	aliveBuffers = 0u;
+	memories.clear();
+
+	dev.ini = &ini;
+	dev.hostVisibleMemTypeBits = 1u;
+	dev.props.limits.nonCoherentAtomSize = 64u;
+	dev.dispatch.CreateBuffer = fakeCreateBuffer;
+	dev.dispatch.DestroyBuffer = fakeDestroyBuffer;
+	dev.dispatch.GetBufferMemoryRequirements = fakeGetBufferMemoryRequirements;
+	dev.dispatch.AllocateMemory = fakeAllocateMemory;
+	dev.dispatch.FreeMemory = fakeFreeMemory;
+	dev.dispatch.BindBufferMemory = fakeBindBufferMemory;
+	dev.dispatch.MapMemory = fakeMapMemory;
+	dev.dispatch.FlushMappedMemoryRanges = fakeFlushMappedMemoryRanges;
+}
+
+constexpr auto stagingUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+
+} // anon namespace
+
+TEST(unit_staging_ring_wrap) {
+	Instance ini;
+	Device dev;
+	initStagingDevice(dev, ini);
+
+	StagingRing ring;
+	ring.init(dev, 256u, stagingUsage);
+
+	auto a = ring.alloc(100u, 1u);
+	EXPECT(a.offset, 0u);
+	auto f1 = ring.endFrame();
+
+	// aligned up
+	auto b = ring.alloc(100u, 64u);
+	EXPECT(b.buf, a.buf);
+	EXPECT(b.offset, 128u);
+	EXPECT(b.data - a.data, 128);
+	auto f2 = ring.endFrame();
+
+	// Doesn't fit behind b, wraps around into the space released by f1
+	ring.release(f1);
+	auto c = ring.alloc(64u, 64u);
+	EXPECT(c.buf, a.buf);
+	EXPECT(c.offset, 0u);
+	EXPECT(c.data, a.data);
+	auto f3 = ring.endFrame();
+
+	// The next aligned range [64, 128) would overlap b, still in use
+	// by f2. Must not be returned, the ring grows instead.
+	auto d = ring.alloc(64u, 64u);
+	EXPECT(d.buf != a.buf, true);
+	EXPECT(d.offset, 0u);
+	auto f4 = ring.endFrame();
+
+	ring.release(f2);
+	ring.release(f3);
+	EXPECT(aliveBuffers, 2u);
+	ring.release(f4);
+	EXPECT(aliveBuffers, 1u);
+}
+
+TEST(unit_staging_ring_release_order) {
+	Instance ini;
+	Device dev;
+	initStagingDevice(dev, ini);
+
+	StagingRing ring;
+	ring.init(dev, 256u, stagingUsage);
+
+	auto a = ring.alloc(128u, 64u);
+	auto f1 = ring.endFrame();
+	ring.alloc(128u, 64u);
+	auto f2 = ring.endFrame();
+
+	// f2 finished before f1. Its release must not make the space
+	// of f1 available, the ring is full until f1 is released.
+	ring.release(f2);
+	auto b = ring.alloc(64u, 64u);
+	EXPECT(b.buf != a.buf, true);
+	EXPECT(b.offset, 0u);
+	auto f3 = ring.endFrame();
+
+	// Fill the new buffer (512 bytes) completely
+	auto c = ring.alloc(192u, 64u);
+	EXPECT(c.buf, b.buf);
+	EXPECT(c.offset, 64u);
+	auto f4 = ring.endFrame();
+	auto d = ring.alloc(256u, 64u);
+	EXPECT(d.buf, b.buf);
+	EXPECT(d.offset, 256u);
+	auto f5 = ring.endFrame();
+
+	ring.release(f5);
+	ring.release(f4);
+
+	// Pops f1 and the already released f2. The old buffer might still
+	// be used by f3 since it was retired while f3 was recorded.
+	ring.release(f1);
+	EXPECT(aliveBuffers, 2u);
+
+	// Pops f3, f4 and f5, the whole buffer is available again
+	ring.release(f3);
+	EXPECT(aliveBuffers, 1u);
+
+	auto e = ring.alloc(512u, 64u);
+	EXPECT(e.buf, b.buf);
+	EXPECT(e.offset, 0u);
+	ring.release(ring.endFrame());
+}
+
+TEST(unit_staging_ring_grow) {
+	Instance ini;
+	Device dev;
+	initStagingDevice(dev, ini);
+
+	StagingRing ring;
+	ring.init(dev, 256u, stagingUsage);
+
+	auto a = ring.alloc(200u, 16u);
+
+	// Grows in the middle of the frame. 'a' is still written after
+	// this, the old buffer must stay alive and be flushed.
+	auto b = ring.alloc(200u, 16u);
+	EXPECT(b.buf != a.buf, true);
+	EXPECT(b.offset, 0u);
+	EXPECT(aliveBuffers, 2u);
+	EXPECT(memories.size(), 2u);
+
+	std::memset(a.data, 0xAB, 200u);
+	std::memset(b.data, 0xCD, 200u);
+
+	auto& oldMem = *memories[0];
+	auto& newMem = *memories[1];
+	EXPECT(oldMem.flushes, 0u);
+	EXPECT(newMem.flushes, 0u);
+
+	auto f1 = ring.endFrame();
+	EXPECT(oldMem.flushes, 1u);
+	EXPECT(newMem.flushes, 1u);
+	EXPECT(std::to_integer<u32>(oldMem.data[199]), 0xABu);
+	EXPECT(std::to_integer<u32>(newMem.data[199]), 0xCDu);
+
+	// later frames don't use the retired buffer anymore
+	auto f2 = ring.endFrame();
+	EXPECT(oldMem.flushes, 1u);
+	EXPECT(newMem.flushes, 2u);
+
+	ring.release(f1);
+	EXPECT(aliveBuffers, 1u);
+	EXPECT(memories[0], nullptr);
+	ring.release(f2);
+
+	// steady state: nothing is allocated anymore
+	auto count = bufferCounter;
+	for(auto i = 0u; i < 100u; ++i) {
+		ring.alloc(200u, 16u);
+		ring.release(ring.endFrame());
+	}
+
+	EXPECT(bufferCounter, count);
+}
@@ -0,0 +1,264 @@
+#include "../bugged.hpp"
+#include <device.hpp>
+#include <queue.hpp>
+#include <sync.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace vil;
+
+namespace {
+
+// Fake timeline semaphore, standing in for Queue::submissionSemaphore.
+std::atomic<u64> counterValue {};
+std::atomic<u32> counterQueries {};
+VkResult fenceStatus = VK_NOT_READY;
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeGetSemaphoreCounterValue(VkDevice,
+		VkSemaphore, uint64_t* pValue) {
+	++counterQueries;
+	*pValue = counterValue.load();
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeWaitSemaphores(VkDevice,
+		const VkSemaphoreWaitInfo* pWaitInfo, uint64_t timeout) {
+	// All semaphores are the same fake counter, so waiting for any
+	// of them is the same as waiting for the lowest value.
+	auto target = pWaitInfo->pValues[0];
+	for(auto i = 1u; i < pWaitInfo->semaphoreCount; ++i) {
+		if(pWaitInfo->flags & VK_SEMAPHORE_WAIT_ANY_BIT) {
+			target = std::min(target, pWaitInfo->pValues[i]);
+		} else {
+			target = std::max(target, pWaitInfo->pValues[i]);
+		}
+	}
+
+	// don't hang the tests forever when something is broken
+	using Clock = std::chrono::steady_clock;
+	auto ns = std::min<u64>(timeout, 1'000'000'000u);
+	auto end = Clock::now() + std::chrono::nanoseconds(ns);
+	while(counterValue.load() < target) {
+		if(Clock::now() >= end) {
+			return VK_TIMEOUT;
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeGetFenceStatus(VkDevice, VkFence) {
+	return fenceStatus;
+}
+
+VKAPI_ATTR void VKAPI_CALL fakeDestroySemaphore(VkDevice, VkSemaphore,
+		const VkAllocationCallbacks*) {
+}
+
+Queue& initTimelineDevice(Device& dev) {
+	counterValue = 0u;
+	counterQueries = 0u;
+	fenceStatus = VK_NOT_READY;
+
+	dev.timelineSemaphores = true;
+	dev.timelineTracking = true;
+	dev.dispatch.GetSemaphoreCounterValue = fakeGetSemaphoreCounterValue;
+	dev.dispatch.WaitSemaphores = fakeWaitSemaphores;
+	dev.dispatch.GetFenceStatus = fakeGetFenceStatus;
+	dev.dispatch.DestroySemaphore = fakeDestroySemaphore;
+
+	auto& queue = *dev.queues.emplace_back(std::make_unique<Queue>());
+	queue.dev = &dev;
+	queue.createdByUs = true;
+	queue.submissionSemaphore = VkSemaphore(std::uintptr_t(0x1234u));
+	return queue;
+}
+
+// Adds a batch with a single (empty) command submission that signals
+// the submission semaphore of the queue to the next submissionID.
+// Expects the device mutex to be locked.
+SubmissionBatch& addBatch(Queue& queue, bool active = true) {
+	auto& dev = *queue.dev;
+	auto& batch = *dev.pending.emplace_back(std::make_unique<SubmissionBatch>());
+	batch.queue = &queue;
+	batch.type = SubmissionType::command;
+
+	auto& sub = batch.submissions.emplace_back();
+	sub.parent = &batch;
+	sub.queueSubmitID = ++queue.submissionCounter;
+	sub.active = active;
+
+	batch.lastSubmissionID = sub.queueSubmitID;
+	return batch;
+}
+
+} // anon namespace
+
+TEST(unit_timeline_retire_in_order) {
+	Device dev;
+	auto& queue = initTimelineDevice(dev);
+
+	std::lock_guard lock(dev.mutex);
+	addBatch(queue);
+	addBatch(queue);
+	auto& last = addBatch(queue);
+	EXPECT(last.lastSubmissionID, 3u);
+
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(dev.pending.size(), 3u);
+	EXPECT(queue.completedSubmissionID, 0u);
+
+	counterValue = 2u;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(queue.completedSubmissionID, 2u);
+	EXPECT(dev.pending.size(), 1u);
+	EXPECT(dev.pending[0].get(), &last);
+
+	counterValue = 3u;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(queue.completedSubmissionID, 3u);
+	EXPECT(dev.pending.empty(), true);
+
+	// Once all submissions are known to be complete, the counter
+	// isn't queried anymore.
+	auto queries = counterQueries.load();
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(counterQueries.load(), queries);
+}
+
+TEST(unit_timeline_counter_never_decreases) {
+	Device dev;
+	auto& queue = initTimelineDevice(dev);
+
+	std::lock_guard lock(dev.mutex);
+	addBatch(queue);
+	addBatch(queue);
+
+	counterValue = 1u;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(queue.completedSubmissionID, 1u);
+	EXPECT(dev.pending.size(), 1u);
+
+	// A stale read must not move the known value backwards
+	counterValue = 0u;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(queue.completedSubmissionID, 1u);
+	EXPECT(dev.pending.size(), 1u);
+
+	counterValue = 2u;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(dev.pending.empty(), true);
+}
+
+TEST(unit_timeline_fence_fallback) {
+	Device dev;
+	auto& queue = initTimelineDevice(dev);
+
+	Fence fence;
+	fence.handle = VkFence(std::uintptr_t(0x5678u));
+
+	std::lock_guard lock(dev.mutex);
+	auto& batch = addBatch(queue);
+	batch.appFence = &fence;
+	fence.submission = &batch;
+
+	// counter and fence both pending
+	EXPECT(checkLocked(batch).has_value(), false);
+	EXPECT(dev.pending.size(), 1u);
+
+	// The application might have waited for its fence while the
+	// semaphore signal isn't visible yet. An explicit check must
+	// still retire the batch.
+	fenceStatus = VK_SUCCESS;
+	EXPECT(checkLocked(batch).has_value(), true);
+	EXPECT(dev.pending.empty(), true);
+	EXPECT(fence.submission, nullptr);
+	EXPECT(queue.completedSubmissionID, 0u);
+}
+
+TEST(unit_timeline_inactive) {
+	Device dev;
+	auto& queue = initTimelineDevice(dev);
+
+	std::lock_guard lock(dev.mutex);
+	auto& batch = addBatch(queue, false);
+
+	// Inactive submissions are never retired, even if the counter
+	// (e.g. on a misbehaving driver) claims they are complete.
+	counterValue = 1u;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(dev.pending.size(), 1u);
+
+	batch.submissions[0].active = true;
+	checkPendingSubmissionsLocked(dev);
+	EXPECT(dev.pending.empty(), true);
+}
+
+TEST(unit_timeline_wait) {
+	Device dev;
+	auto& queue = initTimelineDevice(dev);
+
+	std::lock_guard lock(dev.mutex);
+	auto& batch = addBatch(queue);
+	EXPECT(checkLocked(batch).has_value(), false);
+
+	// The "device" completes the submission while we are blocked
+	std::thread device([]{
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		counterValue = 1u;
+	});
+
+	auto res = waitLocked(batch);
+	device.join();
+
+	EXPECT(res, VK_SUCCESS);
+	EXPECT(checkLocked(batch).has_value(), true);
+	EXPECT(queue.completedSubmissionID, 1u);
+	EXPECT(dev.pending.empty(), true);
+}
+
+TEST(unit_timeline_submission_waiter) {
+	Device dev;
+	auto& queue = initTimelineDevice(dev);
+	dev.submissionWaiter = std::make_unique<SubmissionWaiter>(dev);
+
+	{
+		std::lock_guard lock(dev.mutex);
+		addBatch(queue);
+		addBatch(queue);
+	}
+
+	dev.submissionWaiter->notify();
+
+	auto pendingCount = [&]{
+		std::lock_guard lock(dev.mutex);
+		return dev.pending.size();
+	};
+
+	// Retires submissions once the counter advances, without any
+	// further call into the layer.
+	auto waitPending = [&](std::size_t count) {
+		using Clock = std::chrono::steady_clock;
+		auto end = Clock::now() + std::chrono::seconds(1);
+		while(pendingCount() != count && Clock::now() < end) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	};
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EXPECT(pendingCount(), 2u);
+
+	counterValue = 1u;
+	waitPending(1u);
+	EXPECT(pendingCount(), 1u);
+
+	counterValue = 2u;
+	waitPending(0u);
+	EXPECT(pendingCount(), 0u);
+
+	dev.submissionWaiter.reset();
+	EXPECT(queue.completedSubmissionID, 2u);
+}
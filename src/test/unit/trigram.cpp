@@ -0,0 +1,151 @@
+#include "../bugged.hpp"
+#include <util/trigram.hpp>
+#include <util/util.hpp>
+#include <util/dlg.hpp>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+using IDs = std::vector<u32>;
+
+std::vector<u32> bruteForce(const std::vector<std::string>& texts,
+		const std::vector<bool>& alive, std::string_view needle) {
+	std::vector<u32> ret;
+	for(auto i = 0u; i < texts.size(); ++i) {
+		if(alive[i] && findSubstrCI(texts[i], needle) != -1) {
+			ret.push_back(i);
+		}
+	}
+
+	return ret;
+}
+
+} // anon namespace
+
+TEST(unit_trigram_basic) {
+	TrigramIndex index;
+	index.insert(0u, "Shadow Map Cascade 0");
+	index.insert(1u, "gbuffer.albedo");
+	index.insert(2u, "GBuffer.Normal");
+	index.insert(3u, "R8G8B8A8_UNORM 1024x1024 Sampled");
+
+	EXPECT(index.query("").size(), 4u);
+	EXPECT(index.query("gbuffer") == IDs({1u, 2u}), true);
+	EXPECT(index.query("GBUF") == IDs({1u, 2u}), true);
+	EXPECT(index.query("normal") == IDs({2u}), true);
+	EXPECT(index.query("cascade 0") == IDs({0u}), true);
+	EXPECT(index.query("1024x1024") == IDs({3u}), true);
+	EXPECT(index.query("nothing").empty(), true);
+
+	// short needles can't use trigrams
+	EXPECT(index.query("a").size(), 4u);
+	EXPECT(index.query("0") == IDs({0u, 3u}), true);
+
+	// all trigrams present, but not consecutively
+	EXPECT(index.query("bufferr").empty(), true);
+
+	// rename
+	index.erase(1u);
+	index.insert(1u, "Albedo");
+	EXPECT(index.query("gbuffer") == IDs({2u}), true);
+	EXPECT(index.query("albedo") == IDs({1u}), true);
+	EXPECT(index.contains(1u), true);
+	EXPECT(index.size(), 4u);
+
+	index.erase(0u);
+	EXPECT(index.contains(0u), false);
+	EXPECT(index.query("shadow").empty(), true);
+	EXPECT(index.size(), 3u);
+
+	index.clear();
+	EXPECT(index.query("").empty(), true);
+}
+
+TEST(unit_trigram_random) {
+	std::mt19937 rng(42u);
+	auto words = std::vector<std::string>{"Image", "Buffer", "shadow", "GBuffer",
+		"albedo", "normal", "depth", "tile", "chunk", "LOD", "mip"};
+	std::uniform_int_distribution<u32> wordDist(0u, u32(words.size() - 1));
+	std::uniform_int_distribution<u32> numDist(0u, 999u);
+
+	auto makeName = [&]{
+		auto name = words[wordDist(rng)];
+		name += ' ';
+		name += words[wordDist(rng)];
+		name += std::to_string(numDist(rng));
+		return name;
+	};
+
+	// large enough to trigger compaction
+	constexpr auto count = 5000u;
+	std::vector<std::string> texts;
+	std::vector<bool> alive;
+	TrigramIndex index;
+	for(auto i = 0u; i < count; ++i) {
+		texts.push_back(makeName());
+		alive.push_back(true);
+		index.insert(i, texts.back());
+	}
+
+	std::uniform_int_distribution<u32> idDist(0u, count - 1);
+	for(auto i = 0u; i < 4000u; ++i) {
+		auto id = idDist(rng);
+		if(!alive[id]) {
+			continue;
+		}
+
+		index.erase(id);
+		if(i % 4 == 0u) {
+			// renamed instead of destroyed
+			texts[id] = makeName();
+			index.insert(id, texts[id]);
+		} else {
+			alive[id] = false;
+		}
+	}
+
+	auto needles = std::vector<std::string>{"", "a", "mi", "image", "BUFFER",
+		"shadow gbuffer", "tile1", "lod 9", "epth", "xyz", "chunk42", "normal depth"};
+	for(auto& needle : needles) {
+		auto got = index.query(needle);
+		std::sort(got.begin(), got.end());
+		auto expected = bruteForce(texts, alive, needle);
+		EXPECT(got == expected, true);
+	}
+}
+
+// Microbenchmark for a streaming-world sized list, compared against
+// the linear scan the resource gui did before.
+TEST(unit_trigram_bench) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	constexpr auto count = 200'000u;
+	constexpr auto needle = std::string_view("chunk 12345 ");
+	TrigramIndex index;
+	std::vector<std::string> texts;
+	std::vector<bool> alive(count, true);
+	for(auto i = 0u; i < count; ++i) {
+		auto& text = texts.emplace_back(dlg::format("terrain chunk {} lod {} albedo", i, i % 4));
+		index.insert(i, text);
+	}
+
+	auto before = Clock::now();
+	auto res = index.query(needle);
+	auto timeIndex = std::chrono::duration_cast<std::chrono::microseconds>(
+		Clock::now() - before).count();
+
+	before = Clock::now();
+	auto expected = bruteForce(texts, alive, needle);
+	auto timeScan = std::chrono::duration_cast<std::chrono::microseconds>(
+		Clock::now() - before).count();
+
+	EXPECT(res.size(), 1u);
+	EXPECT(res == expected, true);
+	dlg_trace("trigram: query over {} texts", count);
+	dlg_trace("  index: {} mus, scan: {} mus", timeIndex, timeScan);
+}
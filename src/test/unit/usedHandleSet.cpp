@@ -0,0 +1,220 @@
+#include "../bugged.hpp"
+#include <command/usedHandleSet.hpp>
+#include <command/record.hpp>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+u32 aliveEntries = 0u;
+
+struct TestEntry {
+	explicit TestEntry(LinAllocator&) { ++aliveEntries; }
+	~TestEntry() { --aliveEntries; }
+
+	const void* handle {};
+	u32 uses {};
+};
+
+struct DummyHandle {
+	alignas(8) u64 data;
+	std::atomic<u32> refCount {1u}; // owned by the "device"
+};
+
+// The used handle set as it was before FlatUsedSet: RefHandle held a
+// reference and lookups had to build a temporary one.
+struct OldRefHandle {
+	explicit OldRefHandle(LinAllocator&) noexcept {}
+	IntrusivePtr<DummyHandle> handle;
+};
+
+inline bool operator==(const OldRefHandle& a, const OldRefHandle& b) {
+	return a.handle == b.handle;
+}
+
+struct OldRefHandleHash {
+	size_t operator()(const OldRefHandle& x) const {
+		return std::hash<DummyHandle*>{}(x.handle.get());
+	}
+};
+
+using OldUsedHandleSet = CommandAllocHashSet<OldRefHandle, OldRefHandleHash>;
+
+auto oldFind(OldUsedHandleSet& used, LinAllocator& alloc, DummyHandle& elem) {
+	OldRefHandle rh(alloc);
+	rh.handle = IntrusivePtr<DummyHandle>(acquireOwnership, &elem);
+	auto it = used.find(rh);
+	(void) rh.handle.release();
+	return it;
+}
+
+// Simulates the handle usage of a recorded command stream: a small
+// number of handles (pipelines, layouts) used over and over, with
+// many more (buffers, images, descriptor sets) used a couple of times.
+std::vector<DummyHandle*> generateUses(span<DummyHandle> handles,
+		u32 count, u32 seed) {
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<u32> hotDist(0u, 7u);
+	std::uniform_int_distribution<u32> coldDist(0u, u32(handles.size() - 1));
+	std::uniform_int_distribution<u32> repeatDist(0u, 3u);
+
+	std::vector<DummyHandle*> ret;
+	ret.reserve(count);
+	while(ret.size() < count) {
+		auto hot = &handles[hotDist(rng)];
+		auto repeats = 1u + repeatDist(rng);
+		for(auto i = 0u; i < repeats && ret.size() < count; ++i) {
+			ret.push_back(hot);
+		}
+
+		ret.push_back(&handles[coldDist(rng)]);
+	}
+
+	return ret;
+}
+
+} // anon namespace
+
+TEST(unit_usedHandleSet_basic) {
+	std::vector<DummyHandle> handles(64u);
+
+	{
+		LinAllocator alloc;
+		FlatUsedSet<TestEntry> set(alloc);
+		EXPECT(set.empty(), true);
+		EXPECT(set.find(&handles[0]) == nullptr, true);
+
+		for(auto i = 0u; i < 3u; ++i) {
+			for(auto& h : handles) {
+				auto [entry, inserted] = set.insert(&h);
+				EXPECT(inserted, i == 0u);
+				if(inserted) {
+					entry->handle = &h;
+				}
+
+				++entry->uses;
+
+				// cached
+				EXPECT(set.insert(&h).first, entry);
+				EXPECT(set.insert(&h).second, false);
+			}
+		}
+
+		EXPECT(set.size(), handles.size());
+		EXPECT(aliveEntries, u32(handles.size()));
+
+		auto check = [&]{
+			for(auto& h : handles) {
+				auto* entry = set.find(&h);
+				EXPECT(entry != nullptr, true);
+				EXPECT(entry && entry->handle == &h, true);
+				EXPECT(entry && entry->uses == 3u, true);
+			}
+
+			DummyHandle other;
+			EXPECT(set.find(&other) == nullptr, true);
+			EXPECT(set.contains(&other), false);
+
+			auto count = 0u;
+			for(auto& entry : set) {
+				EXPECT(set.find(entry.handle), &entry);
+				++count;
+			}
+			EXPECT(count, u32(handles.size()));
+		};
+
+		check();
+
+		set.compact();
+		EXPECT(set.compacted(), true);
+		check();
+
+		// inserting into a compacted set is still supported
+		DummyHandle extra;
+		auto [entry, inserted] = set.insert(&extra);
+		EXPECT(inserted, true);
+		EXPECT(set.compacted(), false);
+		EXPECT(set.size(), handles.size() + 1);
+		entry->handle = &extra;
+		entry->uses = 3u;
+		check();
+	}
+
+	// all entries were destroyed
+	EXPECT(aliveEntries, 0u);
+}
+
+// Recording microbenchmark comparing the flat set with the previously
+// used node-based set of reference-counting RefHandles, used the way
+// useHandleImpl in cb.cpp did.
+TEST(unit_usedHandleSet_bench) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	constexpr auto numRecords = 200u;
+	constexpr auto usesPerRecord = 4000u;
+	constexpr auto queriesPerRecord = 1000u;
+
+	std::vector<DummyHandle> handles(2048u);
+	std::vector<std::vector<DummyHandle*>> uses;
+	for(auto i = 0u; i < numRecords; ++i) {
+		uses.push_back(generateUses(handles, usesPerRecord, i));
+	}
+
+	u64 sizeFlat {};
+	u64 sizeOld {};
+
+	// flat
+	auto before = Clock::now();
+	for(auto& recUses : uses) {
+		LinAllocator alloc;
+		FlatUsedSet<RefHandle<DummyHandle>> set(alloc);
+		for(auto* handle : recUses) {
+			auto [use, inserted] = set.insert(handle);
+			if(inserted) {
+				use->handle.reset(handle);
+			}
+		}
+
+		set.compact();
+		for(auto i = 0u; i < queriesPerRecord; ++i) {
+			sizeFlat += set.contains(&handles[i]);
+		}
+	}
+	auto timeFlat = std::chrono::duration_cast<std::chrono::microseconds>(
+		Clock::now() - before).count();
+
+	// previous implementation
+	before = Clock::now();
+	for(auto& recUses : uses) {
+		LinAllocator alloc;
+		OldUsedHandleSet set(alloc);
+		for(auto* handle : recUses) {
+			auto it = oldFind(set, alloc, *handle);
+			if(it == set.end()) {
+				OldRefHandle rh(alloc);
+				rh.handle.reset(handle);
+				set.insert(std::move(rh));
+			}
+		}
+
+		for(auto i = 0u; i < queriesPerRecord; ++i) {
+			sizeOld += (oldFind(set, alloc, handles[i]) != set.end());
+		}
+	}
+	auto timeOld = std::chrono::duration_cast<std::chrono::microseconds>(
+		Clock::now() - before).count();
+
+	EXPECT(sizeFlat, sizeOld);
+
+	// all references of the old sets were dropped again
+	for(auto& handle : handles) {
+		EXPECT(handle.refCount.load(), 1u);
+	}
+
+	dlg_trace("usedHandleSet: {} records, {} uses each", numRecords, usesPerRecord);
+	dlg_trace("  flat: {} mus, old RefHandle set: {} mus", timeFlat, timeOld);
+}
@@ -0,0 +1,65 @@
+#include "../bugged.hpp"
+#include <command/writeSet.hpp>
+#include <random>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+struct DummyHandle {
+	alignas(8) u64 data;
+};
+
+} // anon namespace
+
+TEST(unit_writeSet) {
+	std::vector<DummyHandle> handles(1024u);
+
+	WriteSet set;
+	EXPECT(set.empty(), true);
+	EXPECT(set.contains(&handles[0]), false);
+
+	// every fourth handle is written, some of them multiple times
+	std::vector<const void*> written;
+	for(auto i = 0u; i < handles.size(); i += 4u) {
+		written.push_back(&handles[i]);
+		if(i % 3u == 0u) {
+			written.push_back(&handles[i]);
+		}
+	}
+
+	std::shuffle(written.begin(), written.end(), std::mt19937(42u));
+	set.build(written);
+	EXPECT(set.size(), handles.size() / 4u);
+
+	auto falsePositives = 0u;
+	for(auto i = 0u; i < handles.size(); ++i) {
+		auto expected = (i % 4u == 0u);
+		EXPECT(set.contains(&handles[i]), expected);
+		if(expected) {
+			EXPECT(set.mayContain(&handles[i]), true);
+		} else if(set.mayContain(&handles[i])) {
+			++falsePositives;
+		}
+	}
+
+	dlg_info("writeSet: {} bloom false positives for {} queries",
+		falsePositives, handles.size() * 3u / 4u);
+
+	// small sets, the common case, are almost always answered by the filter
+	const void* few[] = {&handles[1], &handles[2], &handles[3]};
+	set.build(few);
+	EXPECT(set.size(), 3u);
+
+	falsePositives = 0u;
+	for(auto i = 4u; i < handles.size(); ++i) {
+		EXPECT(set.contains(&handles[i]), false);
+		falsePositives += set.mayContain(&handles[i]);
+	}
+	EXPECT(falsePositives < handles.size() / 16u, true);
+
+	set.build({});
+	EXPECT(set.empty(), true);
+	EXPECT(set.mayContain(&handles[1]), false);
+}
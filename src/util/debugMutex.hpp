@@ -7,36 +7,45 @@
 #include <mutex>
 #include <util/dlg.hpp>
 #include <util/profiling.hpp>
+#include <util/lockProfiler.hpp>
+#include <utility>
 
 namespace vil {
 
-#ifndef VIL_DEBUG_MUTEX
-
-using DebugSharedMutex = std::shared_mutex;
-using DebugMutex = std::mutex;
-
-#else // VIL_DEBUG_MUTEX
-
-// std::shared_mutex that knows whether it's locked.
+// Wrappers around std::shared_mutex and std::mutex that feed the
+// lock contention profiler (see util/lockProfiler.hpp).
+//
+// With VIL_DEBUG_MUTEX, they additionally know whether they are locked.
 // Using this information in actual code logic is a terrible idea but
 // it's useful to find issues (e.g. a mutex isn't locked when we expected
 // it to be) with the unfortunately at times complicated threading
 // assumptions/guarantees for vil functions.
 struct DebugSharedMutex {
 	std::shared_mutex mtx_;
+	LockHold hold_ {}; // profiler state of the exclusive owner
+
+#ifdef VIL_DEBUG_MUTEX
 	std::atomic<std::thread::id> owner_ {};
 	std::unordered_set<std::thread::id> shared_ {};
 	mutable std::mutex sharedMutex_ {};
+#endif // VIL_DEBUG_MUTEX
 
-	void lock() {
+	void lock(LockSite site = LockSite::current()) {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(!owned());
 		dlg_assert(!ownedShared());
-		mtx_.lock();
+#endif // VIL_DEBUG_MUTEX
+
+		profiledLock(mtx_, hold_, site);
+
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(owner_ == std::thread::id{});
 		owner_.store(std::this_thread::get_id());
+#endif // VIL_DEBUG_MUTEX
 	}
 
 	void unlock() {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(owned());
 
 		{
@@ -45,32 +54,50 @@ struct DebugSharedMutex {
 		}
 
 		owner_.store({});
+#endif // VIL_DEBUG_MUTEX
+
+		auto hold = std::exchange(hold_, {});
 		mtx_.unlock();
+		profiledUnlock(hold);
 	}
 
 	bool try_lock() {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(!owned());
 		dlg_assert(!ownedShared());
+#endif // VIL_DEBUG_MUTEX
+
 		auto ret = mtx_.try_lock();
+
+#ifdef VIL_DEBUG_MUTEX
 		if(ret) {
 			dlg_assert(shared_.empty());
 			dlg_assert(owner_ == std::thread::id{});
 			owner_ = std::this_thread::get_id();
 		}
+#endif // VIL_DEBUG_MUTEX
+
 		return ret;
 	}
 
-	void lock_shared() {
+	void lock_shared(LockSite site = LockSite::current()) {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(!owned());
 		dlg_assert(!ownedShared());
-		mtx_.lock_shared();
+#endif // VIL_DEBUG_MUTEX
+
+		profiledLockShared(mtx_, site);
+
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(owner_.load() == std::thread::id{});
 
 		std::lock_guard lock(sharedMutex_);
 		shared_.insert(std::this_thread::get_id());
+#endif // VIL_DEBUG_MUTEX
 	}
 
 	void unlock_shared() {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(ownedShared());
 		dlg_assert(owner_ == std::thread::id{});
 
@@ -78,22 +105,31 @@ struct DebugSharedMutex {
 			std::lock_guard lock(sharedMutex_);
 			shared_.erase(std::this_thread::get_id());
 		}
+#endif // VIL_DEBUG_MUTEX
 
-		mtx_.unlock_shared();
+		profiledUnlockShared(mtx_);
 	}
 
 	bool try_lock_shared() {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(!owned());
 		dlg_assert(!ownedShared());
+#endif // VIL_DEBUG_MUTEX
+
 		auto ret = mtx_.try_lock_shared();
+
+#ifdef VIL_DEBUG_MUTEX
 		if(ret) {
 			std::lock_guard lock(sharedMutex_);
 			dlg_assert(owner_.load() == std::thread::id{});
 			shared_.insert(std::this_thread::get_id());
 		}
+#endif // VIL_DEBUG_MUTEX
+
 		return ret;
 	}
 
+#ifdef VIL_DEBUG_MUTEX
 	bool owned() const {
 		return owner_.load() == std::this_thread::get_id();
 	}
@@ -102,40 +138,67 @@ struct DebugSharedMutex {
 		std::lock_guard lock(sharedMutex_);
 		return shared_.find(std::this_thread::get_id()) != shared_.end();
 	}
+#endif // VIL_DEBUG_MUTEX
 };
 
 struct DebugMutex {
 	std::mutex mtx_;
+	LockHold hold_ {}; // profiler state of the owner
+
+#ifdef VIL_DEBUG_MUTEX
 	std::atomic<std::thread::id> owner_ {};
+#endif // VIL_DEBUG_MUTEX
 
-	void lock() {
+	void lock(LockSite site = LockSite::current()) {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(!owned());
-		mtx_.lock();
+#endif // VIL_DEBUG_MUTEX
+
+		profiledLock(mtx_, hold_, site);
+
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(owner_ == std::thread::id{});
 		owner_.store(std::this_thread::get_id());
+#endif // VIL_DEBUG_MUTEX
 	}
 
 	void unlock() {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(owned());
 		owner_.store({});
+#endif // VIL_DEBUG_MUTEX
+
+		auto hold = std::exchange(hold_, {});
 		mtx_.unlock();
+		profiledUnlock(hold);
 	}
 
 	bool try_lock() {
+#ifdef VIL_DEBUG_MUTEX
 		dlg_assert(!owned());
+#endif // VIL_DEBUG_MUTEX
+
 		auto ret = mtx_.try_lock();
+
+#ifdef VIL_DEBUG_MUTEX
 		if(ret) {
 			dlg_assert(owner_ == std::thread::id{});
 			owner_ = std::this_thread::get_id();
 		}
+#endif // VIL_DEBUG_MUTEX
+
 		return ret;
 	}
 
+#ifdef VIL_DEBUG_MUTEX
 	bool owned() const {
 		return owner_.load() == std::this_thread::get_id();
 	}
+#endif // VIL_DEBUG_MUTEX
 };
 
+#ifdef VIL_DEBUG_MUTEX
+
 inline bool owned(const DebugMutex& m) { return m.owned(); }
 inline bool owned(const DebugSharedMutex& m) { return m.owned(); }
 inline bool ownedShared(const DebugSharedMutex& m) { return m.ownedShared(); }
@@ -176,3 +239,73 @@ inline bool ownedShared(const tracy::SharedLockable<DebugSharedMutex>& m) { retu
 #endif // VIL_DEBUG_MUTEX
 
 } // namespace vil
+
+// Specializations of std::lock_guard and std::shared_lock that pass the
+// location of the guard to the lock profiler. They are by far the most
+// common way we lock mutexes, the call sites are valuable for the profiler.
+// We only ever use std::shared_lock as scoped guard, so the specialization
+// doesn't support deferred locking, unlocking or moving.
+// Explicitly allowed by the standard since they depend on our types.
+namespace std {
+
+template<>
+class lock_guard<vil::DebugMutex> {
+public:
+	using mutex_type = vil::DebugMutex;
+
+	explicit lock_guard(mutex_type& m,
+			vil::LockSite site = vil::LockSite::current()) : mutex_(m) {
+		mutex_.lock(site);
+	}
+
+	lock_guard(mutex_type& m, adopt_lock_t) noexcept : mutex_(m) {}
+	~lock_guard() { mutex_.unlock(); }
+
+	lock_guard(const lock_guard&) = delete;
+	lock_guard& operator=(const lock_guard&) = delete;
+
+private:
+	mutex_type& mutex_;
+};
+
+template<>
+class lock_guard<vil::DebugSharedMutex> {
+public:
+	using mutex_type = vil::DebugSharedMutex;
+
+	explicit lock_guard(mutex_type& m,
+			vil::LockSite site = vil::LockSite::current()) : mutex_(m) {
+		mutex_.lock(site);
+	}
+
+	lock_guard(mutex_type& m, adopt_lock_t) noexcept : mutex_(m) {}
+	~lock_guard() { mutex_.unlock(); }
+
+	lock_guard(const lock_guard&) = delete;
+	lock_guard& operator=(const lock_guard&) = delete;
+
+private:
+	mutex_type& mutex_;
+};
+
+template<>
+class shared_lock<vil::DebugSharedMutex> {
+public:
+	using mutex_type = vil::DebugSharedMutex;
+
+	explicit shared_lock(mutex_type& m,
+			vil::LockSite site = vil::LockSite::current()) : mutex_(m) {
+		mutex_.lock_shared(site);
+	}
+
+	shared_lock(mutex_type& m, adopt_lock_t) noexcept : mutex_(m) {}
+	~shared_lock() { mutex_.unlock_shared(); }
+
+	shared_lock(const shared_lock&) = delete;
+	shared_lock& operator=(const shared_lock&) = delete;
+
+private:
+	mutex_type& mutex_;
+};
+
+} // namespace std
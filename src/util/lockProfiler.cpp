@@ -0,0 +1,278 @@
+#include <util/lockProfiler.hpp>
+#include <util/util.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <tuple>
+
+namespace vil {
+
+struct LockSiteBucket {
+	// Set last (with release semantics) when the bucket is claimed.
+	std::atomic<const char*> file {};
+	const char* function {};
+	u32 line {};
+	bool shared {};
+
+	// Buckets with an outdated epoch were reset and are lazily cleared
+	// by the owning thread.
+	std::atomic<u32> epoch {};
+	std::atomic<u64> acquisitions {};
+	std::atomic<u64> contended {};
+	std::atomic<u64> waitTotal {};
+	std::atomic<u64> waitMax {};
+	std::atomic<u64> holdTotal {};
+	std::atomic<u64> holdMax {};
+};
+
+namespace {
+
+// Only written by the owning thread, so we don't need atomic read-modify-write
+// operations, we just must not tear the values for readers.
+void add(std::atomic<u64>& dst, u64 val) {
+	dst.store(dst.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+}
+
+void max(std::atomic<u64>& dst, u64 val) {
+	if(val > dst.load(std::memory_order_relaxed)) {
+		dst.store(val, std::memory_order_relaxed);
+	}
+}
+
+struct LockProfilerThread {
+	// The last bucket is used for all sites that don't fit anymore.
+	static constexpr auto bucketCount = 256u;
+	static constexpr auto maxSharedHolds = 16u;
+
+	LockSiteBucket buckets[bucketCount];
+	std::atomic<bool> inUse {};
+	LockProfilerThread* next {};
+
+	// thread-local stack of shared holds, see pushSharedHold
+	struct SharedHold {
+		const void* mtx;
+		LockHold hold;
+	};
+
+	SharedHold sharedHolds[maxSharedHolds];
+	u32 sharedHoldCount {};
+};
+
+std::atomic<u32> epoch {1u};
+
+// The thread data is never freed, only re-used by new threads.
+// Therefore no statistics are lost when a thread exits.
+std::mutex registryMutex;
+LockProfilerThread* registry {};
+
+LockProfilerThread& claimThreadData() {
+	std::lock_guard lock(registryMutex);
+	for(auto* it = registry; it; it = it->next) {
+		if(!it->inUse.load()) {
+			it->inUse.store(true);
+			it->sharedHoldCount = 0u;
+			return *it;
+		}
+	}
+
+	auto* data = new LockProfilerThread();
+	data->inUse.store(true);
+	data->next = registry;
+	registry = data;
+	return *data;
+}
+
+// Trivially destructible, so they stay valid while other thread_local
+// objects are destroyed. Those might still take locks.
+thread_local LockProfilerThread* tlData {};
+thread_local bool tlExiting {};
+
+struct ThreadDataRelease {
+	~ThreadDataRelease() {
+		if(tlData) {
+			tlData->inUse.store(false);
+			tlData = nullptr;
+		}
+
+		tlExiting = true;
+	}
+};
+
+// Returns nullptr once the thread is exiting. Its data might already
+// have been claimed by another thread, we must not claim a new one
+// since nothing would release it anymore.
+LockProfilerThread* threadData() {
+	if(!tlData && !tlExiting) {
+		thread_local ThreadDataRelease release;
+		(void) release;
+		tlData = &claimThreadData();
+	}
+
+	return tlData;
+}
+
+void checkEpoch(LockSiteBucket& bucket) {
+	auto current = epoch.load(std::memory_order_relaxed);
+	if(bucket.epoch.load(std::memory_order_relaxed) == current) {
+		return;
+	}
+
+	bucket.acquisitions.store(0u, std::memory_order_relaxed);
+	bucket.contended.store(0u, std::memory_order_relaxed);
+	bucket.waitTotal.store(0u, std::memory_order_relaxed);
+	bucket.waitMax.store(0u, std::memory_order_relaxed);
+	bucket.holdTotal.store(0u, std::memory_order_relaxed);
+	bucket.holdMax.store(0u, std::memory_order_relaxed);
+	bucket.epoch.store(current, std::memory_order_release);
+}
+
+} // anon namespace
+
+std::atomic<bool> lockProfilerEnabled {checkEnvBinary("VIL_LOCK_PROFILER", false)};
+
+u64 lockProfilerTime() {
+	using namespace std::chrono;
+	auto now = steady_clock::now().time_since_epoch();
+	return u64(duration_cast<nanoseconds>(now).count());
+}
+
+LockSiteBucket* lockSiteBucket(const LockSite& site, bool shared) {
+	auto* pdata = threadData();
+	if(!pdata) {
+		return nullptr;
+	}
+
+	auto& data = *pdata;
+
+	constexpr auto probeCount = LockProfilerThread::bucketCount - 1;
+	auto hash = std::uintptr_t(site.file) ^ (std::uintptr_t(site.line) * 2654435761u);
+	hash ^= std::uintptr_t(shared);
+
+	for(auto i = 0u; i < probeCount; ++i) {
+		auto& bucket = data.buckets[(hash + i) % probeCount];
+		auto* file = bucket.file.load(std::memory_order_relaxed);
+		if(!file) {
+			bucket.function = site.function;
+			bucket.line = site.line;
+			bucket.shared = shared;
+			bucket.file.store(site.file, std::memory_order_release);
+			return &bucket;
+		}
+
+		if(file == site.file && bucket.line == site.line &&
+				bucket.shared == shared) {
+			return &bucket;
+		}
+	}
+
+	auto& overflow = data.buckets[probeCount];
+	if(!overflow.file.load(std::memory_order_relaxed)) {
+		overflow.function = "<other>";
+		overflow.file.store("<other>", std::memory_order_release);
+	}
+
+	return &overflow;
+}
+
+void lockAcquired(LockSiteBucket& bucket, bool contended, u64 waitNs) {
+	checkEpoch(bucket);
+	add(bucket.acquisitions, 1u);
+	if(contended) {
+		add(bucket.contended, 1u);
+		add(bucket.waitTotal, waitNs);
+		max(bucket.waitMax, waitNs);
+	}
+}
+
+void lockReleased(LockSiteBucket& bucket, u64 holdNs) {
+	// Acquired before the thread started exiting, the bucket might
+	// belong to another thread by now.
+	if(tlExiting) {
+		return;
+	}
+
+	checkEpoch(bucket);
+	add(bucket.holdTotal, holdNs);
+	max(bucket.holdMax, holdNs);
+}
+
+void pushSharedHold(const void* mtx, const LockHold& hold) {
+	auto* data = threadData();
+	if(data && data->sharedHoldCount < LockProfilerThread::maxSharedHolds) {
+		data->sharedHolds[data->sharedHoldCount++] = {mtx, hold};
+	}
+}
+
+LockHold popSharedHold(const void* mtx) {
+	auto* data = threadData();
+	if(!data) {
+		return {};
+	}
+
+	for(auto i = data->sharedHoldCount; i-- > 0u;) {
+		if(data->sharedHolds[i].mtx == mtx) {
+			auto ret = data->sharedHolds[i].hold;
+			data->sharedHolds[i] = data->sharedHolds[--data->sharedHoldCount];
+			return ret;
+		}
+	}
+
+	return {};
+}
+
+std::vector<LockSiteStats> lockProfilerStats() {
+	std::vector<LockSiteStats> ret;
+
+	// Merges the same site from multiple threads. Comparing the file
+	// names by value since the same literal might have multiple addresses.
+	auto find = [&](const LockSiteBucket& bucket, const char* file) -> LockSiteStats& {
+		for(auto& stats : ret) {
+			if(stats.site.line == bucket.line && stats.shared == bucket.shared &&
+					std::strcmp(stats.site.file, file) == 0) {
+				return stats;
+			}
+		}
+
+		auto& stats = ret.emplace_back();
+		stats.site = {file, bucket.function, bucket.line};
+		stats.shared = bucket.shared;
+		return stats;
+	};
+
+	const auto current = epoch.load();
+
+	std::lock_guard lock(registryMutex);
+	for(auto* data = registry; data; data = data->next) {
+		for(auto& bucket : data->buckets) {
+			auto* file = bucket.file.load(std::memory_order_acquire);
+			if(!file || bucket.epoch.load(std::memory_order_acquire) != current) {
+				continue;
+			}
+
+			auto& stats = find(bucket, file);
+			stats.acquisitions += bucket.acquisitions.load(std::memory_order_relaxed);
+			stats.contended += bucket.contended.load(std::memory_order_relaxed);
+			stats.waitTotal += bucket.waitTotal.load(std::memory_order_relaxed);
+			stats.waitMax = std::max(stats.waitMax,
+				bucket.waitMax.load(std::memory_order_relaxed));
+			stats.holdTotal += bucket.holdTotal.load(std::memory_order_relaxed);
+			stats.holdMax = std::max(stats.holdMax,
+				bucket.holdMax.load(std::memory_order_relaxed));
+		}
+	}
+
+	std::sort(ret.begin(), ret.end(), [](auto& a, auto& b) {
+		return std::tie(a.waitTotal, a.holdTotal) > std::tie(b.waitTotal, b.holdTotal);
+	});
+
+	return ret;
+}
+
+void resetLockProfiler() {
+	epoch.fetch_add(1u);
+}
+
+} // namespace vil
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <atomic>
+#include <vector>
+
+namespace vil {
+
+// Lightweight lock contention profiler, built into DebugMutex and
+// DebugSharedMutex. Records acquisition count, contention and wait/hold
+// times per call site into lock-free per-thread buckets.
+// In contrast to the tracy lock view, this scales to our number of locks
+// and is available in all builds. Disabled by default, can be enabled
+// at runtime (or via VIL_LOCK_PROFILER) and has almost no overhead
+// when disabled.
+//
+// Call sites are captured via default arguments. For std::lock_guard and
+// std::shared_lock, that is the location of the guard itself (see the
+// specializations in debugMutex.hpp), for all other lock types (e.g.
+// std::unique_lock) the location inside the standard library header.
+
+// Source location of a lock acquisition.
+struct LockSite {
+	const char* file {};
+	const char* function {};
+	u32 line {};
+
+	// Evaluated at the call site when used as default argument.
+	static constexpr LockSite current(
+			const char* file = __builtin_FILE(),
+			const char* function = __builtin_FUNCTION(),
+			u32 line = __builtin_LINE()) {
+		return {file, function, line};
+	}
+};
+
+// Aggregated statistics for a single lock site over all threads.
+struct LockSiteStats {
+	LockSite site;
+	bool shared {}; // whether the lock was acquired in shared mode
+	u64 acquisitions {};
+	u64 contended {}; // acquisitions that had to wait
+	u64 waitTotal {}; // ns
+	u64 waitMax {}; // ns
+	u64 holdTotal {}; // ns
+	u64 holdMax {}; // ns
+};
+
+// Per-thread, per-site counters. Only ever written by the owning thread.
+struct LockSiteBucket;
+
+// State of a single profiled lock acquisition, needed on release.
+struct LockHold {
+	LockSiteBucket* bucket {};
+	u64 start {}; // ns
+};
+
+extern std::atomic<bool> lockProfilerEnabled;
+
+// Returns the calling thread's bucket for the given site.
+// Returns nullptr when the thread is exiting, its locks aren't profiled
+// anymore then.
+LockSiteBucket* lockSiteBucket(const LockSite& site, bool shared);
+void lockAcquired(LockSiteBucket& bucket, bool contended, u64 waitNs);
+void lockReleased(LockSiteBucket& bucket, u64 holdNs);
+u64 lockProfilerTime(); // ns, steady clock
+
+// Hold state for shared acquisitions is kept in a small thread-local stack
+// since multiple threads can hold the same mutex.
+void pushSharedHold(const void* mtx, const LockHold& hold);
+LockHold popSharedHold(const void* mtx);
+
+// Aggregates the statistics over all threads, sorted by total wait time.
+// Can be called from any thread at any time.
+std::vector<LockSiteStats> lockProfilerStats();
+
+// Resets all statistics. Threads currently holding a lock might
+// still report their hold time afterwards.
+void resetLockProfiler();
+
+template<typename M>
+void profiledLock(M& mtx, LockHold& hold, const LockSite& site) {
+	auto* pbucket = lockProfilerEnabled.load(std::memory_order_relaxed) ?
+		lockSiteBucket(site, false) : nullptr;
+	if(!pbucket) {
+		mtx.lock();
+		return;
+	}
+
+	auto& bucket = *pbucket;
+	if(mtx.try_lock()) {
+		hold = {&bucket, lockProfilerTime()};
+		lockAcquired(bucket, false, 0u);
+		return;
+	}
+
+	auto waitStart = lockProfilerTime();
+	mtx.lock();
+	auto now = lockProfilerTime();
+	hold = {&bucket, now};
+	lockAcquired(bucket, true, now - waitStart);
+}
+
+template<typename M>
+void profiledLockShared(M& mtx, const LockSite& site) {
+	auto* pbucket = lockProfilerEnabled.load(std::memory_order_relaxed) ?
+		lockSiteBucket(site, true) : nullptr;
+	if(!pbucket) {
+		mtx.lock_shared();
+		return;
+	}
+
+	auto& bucket = *pbucket;
+	if(mtx.try_lock_shared()) {
+		pushSharedHold(&mtx, {&bucket, lockProfilerTime()});
+		lockAcquired(bucket, false, 0u);
+		return;
+	}
+
+	auto waitStart = lockProfilerTime();
+	mtx.lock_shared();
+	auto now = lockProfilerTime();
+	pushSharedHold(&mtx, {&bucket, now});
+	lockAcquired(bucket, true, now - waitStart);
+}
+
+// Must be called *after* the mutex was unlocked, with the hold state
+// retrieved before unlocking.
+inline void profiledUnlock(const LockHold& hold) {
+	if(hold.bucket) {
+		lockReleased(*hold.bucket, lockProfilerTime() - hold.start);
+	}
+}
+
+// When the profiler is disabled while a shared lock is held, its hold
+// state stays on the thread's stack. That only costs a slot and at worst
+// reports a wrong hold time once the profiler is enabled again.
+template<typename M>
+void profiledUnlockShared(M& mtx) {
+	if(!lockProfilerEnabled.load(std::memory_order_relaxed)) {
+		mtx.unlock_shared();
+		return;
+	}
+
+	auto hold = popSharedHold(&mtx);
+	mtx.unlock_shared();
+	profiledUnlock(hold);
+}
+
+} // namespace vil
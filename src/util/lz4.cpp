@@ -0,0 +1,20 @@
+// The LZ4 sources ship with tracy but are only compiled as part
+// of its client when tracy is enabled. See FrameCapture.
+#ifndef TRACY_ENABLE
+
+// don't export the symbols from the layer
+#define LZ4LIB_VISIBILITY
+
+#ifdef __GNUC__
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wunused-parameter"
+	#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#endif // __GNUC__
+
+#include <tracy/common/tracy_lz4.cpp>
+
+#ifdef __GNUC__
+	#pragma GCC diagnostic pop
+#endif // __GNUC__
+
+#endif // TRACY_ENABLE
@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <atomic>
 #include <cassert>
 #include <util/intrusive.hpp>
 #include <util/debugMutex.hpp>
@@ -95,6 +96,54 @@ struct UniqueWrappedPtr : std::unique_ptr<WrappedHandle<T>> {
 	}
 };
 
+// Bounded log of the latest changes to a set of objects, e.g. the elements
+// inserted into and erased from a synced map. Allows observers to update
+// a snapshot of it incrementally instead of iterating all elements.
+// Every change is identified by a version, versions of consecutive changes
+// are consecutive. Must be synchronized externally.
+template<typename T>
+class ChangeJournal {
+public:
+	struct Change {
+		T* ptr;
+		// e.g. inserted (true) or erased (false)
+		bool added;
+	};
+
+	// Number of changes kept. Observers that fall further behind have to
+	// rebuild their snapshot.
+	static constexpr auto capacity = 16 * 1024u;
+
+	// The journal only knows about changes with versions after 'start'.
+	explicit ChangeJournal(u64 start) :
+		changes_(std::make_unique<Change[]>(capacity)), start_(start) {}
+
+	void record(u64 version, T* ptr, bool added) {
+		changes_[version % capacity] = {ptr, added};
+	}
+
+	// Calls f(T*, bool added) for all changes with a version in (since, current],
+	// in order. Returns false without calling f when the journal
+	// doesn't have all of them.
+	template<typename F>
+	bool forEachSince(u64 since, u64 current, F&& f) const {
+		if(since < start_ || current - since > capacity) {
+			return false;
+		}
+
+		for(auto v = since + 1; v <= current; ++v) {
+			auto& change = changes_[v % capacity];
+			f(change.ptr, change.added);
+		}
+
+		return true;
+	}
+
+private:
+	std::unique_ptr<Change[]> changes_;
+	u64 start_ {};
+};
+
 // Synchronized unordered map.
 // Elements are stored in P<T>'s (where P should be a smart pointer type such
 // as unique_ptr or shared_ptr) making sure that as long as two
@@ -121,6 +170,11 @@ public:
 
 		auto ret = std::move(it->second);
 		inner.erase(it);
+		auto v = version.fetch_add(1u, std::memory_order_release) + 1;
+		if(journal) {
+			journal->record(v, &*ret, false);
+		}
+
 		return ret;
 	}
 
@@ -199,6 +253,12 @@ public:
 	std::pair<P<T>*, bool> emplace(Args&&... args) {
 		std::lock_guard lock(*mutex);
 		auto [it, success] = inner.emplace(std::forward<Args>(args)...);
+		if(success) {
+			auto v = version.fetch_add(1u, std::memory_order_release) + 1;
+			if(journal) {
+				journal->record(v, &*it->second, true);
+			}
+		}
 		return {&it->second, success};
 	}
 
@@ -259,6 +319,23 @@ public:
 	// Can also be used directly, but take care!
 	SharedLockableBase(DebugSharedMutex)* mutex;
 	UnorderedMap inner;
+
+	// Incremented (while the mutex is locked) whenever an element is
+	// inserted or erased. Can be read without the mutex to check whether
+	// a previously captured snapshot of the map is still up-to-date.
+	std::atomic<u64> version {};
+
+	// Records the latest insertions and erasures, keyed by 'version'.
+	// Null until enableJournal is called, nothing is recorded before.
+	// Must only be accessed while the mutex is locked.
+	std::unique_ptr<ChangeJournal<T>> journal;
+
+	void enableJournalLocked() {
+		assertOwned(*mutex);
+		if(!journal) {
+			journal = std::make_unique<ChangeJournal<T>>(version.load());
+		}
+	}
 };
 
 template<typename T, template<typename...> typename P>
@@ -288,6 +365,11 @@ public:
 
 		auto ret = std::move(*it);
 		inner.erase(it);
+		auto v = version.fetch_add(1u, std::memory_order_release) + 1;
+		if(journal) {
+			journal->record(v, &*ret, false);
+		}
+
 		return ret;
 	}
 
@@ -341,6 +423,12 @@ public:
 	std::pair<T*, bool> emplace(Args&&... args) {
 		std::lock_guard lock(*mutex);
 		auto [it, success] = inner.emplace(std::forward<Args>(args)...);
+		if(success) {
+			auto v = version.fetch_add(1u, std::memory_order_release) + 1;
+			if(journal) {
+				journal->record(v, &**it, true);
+			}
+		}
 		return {&**it, success};
 	}
 
@@ -382,6 +470,19 @@ public:
 	// Can also be used directly, but take care!
 	SharedLockableBase(DebugSharedMutex)* mutex;
 	UnorderedSet inner;
+
+	// See SyncedUnorderedMap::version
+	std::atomic<u64> version {};
+
+	// See SyncedUnorderedMap::journal
+	std::unique_ptr<ChangeJournal<T>> journal;
+
+	void enableJournalLocked() {
+		assertOwned(*mutex);
+		if(!journal) {
+			journal = std::make_unique<ChangeJournal<T>>(version.load());
+		}
+	}
 };
 
 template<typename T>
@@ -0,0 +1,137 @@
+#include <util/trigram.hpp>
+#include <util/profiling.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <cctype>
+
+namespace vil {
+
+namespace {
+
+std::string toLower(std::string_view str) {
+	std::string ret(str);
+	for(auto& c : ret) {
+		c = char(std::tolower((unsigned char) c));
+	}
+
+	return ret;
+}
+
+u32 trigram(const char* str) {
+	return (u32((unsigned char) str[0]) << 16u) |
+		(u32((unsigned char) str[1]) << 8u) |
+		u32((unsigned char) str[2]);
+}
+
+// We only compact when at least half of the texts (and at least this many)
+// are erased, so the amortized cost of erase stays constant.
+constexpr auto minCompactCount = 1024u;
+
+} // anon namespace
+
+void TrigramIndex::insert(u32 id, std::string_view text) {
+	dlg_assert(!contains(id));
+
+	auto pos = u32(texts_.size());
+	texts_.push_back({id, toLower(text), false});
+	positions_[id] = pos;
+	add(pos);
+}
+
+void TrigramIndex::add(u32 pos) {
+	auto& lower = texts_[pos].lower;
+	for(auto i = 0u; i + 2 < lower.size(); ++i) {
+		auto& posting = postings_[trigram(&lower[i])];
+		// a trigram might appear multiple times in the same text
+		if(posting.empty() || posting.back() != pos) {
+			posting.push_back(pos);
+		}
+	}
+}
+
+void TrigramIndex::erase(u32 id) {
+	auto it = positions_.find(id);
+	dlg_assert(it != positions_.end());
+
+	texts_[it->second].erased = true;
+	texts_[it->second].lower = {};
+	positions_.erase(it);
+	++erasedCount_;
+
+	if(erasedCount_ >= minCompactCount && 2 * erasedCount_ >= texts_.size()) {
+		compact();
+	}
+}
+
+void TrigramIndex::compact() {
+	ZoneScoped;
+
+	auto old = std::move(texts_);
+	texts_.clear();
+	postings_.clear();
+	positions_.clear();
+	erasedCount_ = 0u;
+
+	for(auto& text : old) {
+		if(text.erased) {
+			continue;
+		}
+
+		auto pos = u32(texts_.size());
+		positions_[text.id] = pos;
+		texts_.push_back(std::move(text));
+		add(pos);
+	}
+}
+
+std::vector<u32> TrigramIndex::query(std::string_view needle) const {
+	ZoneScoped;
+
+	auto lower = toLower(needle);
+	std::vector<u32> ret;
+
+	auto check = [&](const Text& text) {
+		if(!text.erased && text.lower.find(lower) != std::string::npos) {
+			ret.push_back(text.id);
+		}
+	};
+
+	// too short for trigrams, we have to look at every text.
+	if(lower.size() < 3) {
+		for(auto& text : texts_) {
+			check(text);
+		}
+
+		return ret;
+	}
+
+	// Every match has to contain all trigrams of the needle, so we only
+	// have to check the texts of the smallest posting list.
+	const std::vector<u32>* smallest {};
+	for(auto i = 0u; i + 2 < lower.size(); ++i) {
+		auto it = postings_.find(trigram(&lower[i]));
+		if(it == postings_.end()) {
+			return ret;
+		}
+
+		if(!smallest || it->second.size() < smallest->size()) {
+			smallest = &it->second;
+		}
+	}
+
+	dlg_assert(smallest);
+	for(auto pos : *smallest) {
+		check(texts_[pos]);
+	}
+
+	return ret;
+}
+
+void TrigramIndex::clear() {
+	texts_.clear();
+	postings_.clear();
+	positions_.clear();
+	erasedCount_ = 0u;
+}
+
+} // namespace vil
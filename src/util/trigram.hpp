@@ -0,0 +1,57 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace vil {
+
+// Case-insensitive substring index over a set of strings.
+// Every string is identified by an id chosen by the caller. For each
+// trigram (three consecutive characters) we store the strings containing
+// it. A query only has to look at the strings in the smallest posting list
+// of the trigrams of the needle instead of at all strings.
+// Used for searching through the names of (potentially hundreds of
+// thousands of) handles in the gui.
+// Like findSubstrCI, only ascii characters are case-folded.
+class TrigramIndex {
+public:
+	// Adds the given string with the given id. The id must not currently
+	// be in the index. To change the string of an id, erase it first.
+	void insert(u32 id, std::string_view text);
+
+	// Removes the string with the given id. Must be in the index.
+	// The posting lists are only compacted once enough strings
+	// were erased.
+	void erase(u32 id);
+
+	// Returns the ids of all strings that contain the needle, in the
+	// order they were inserted. An empty needle matches all strings.
+	std::vector<u32> query(std::string_view needle) const;
+
+	void clear();
+	bool contains(u32 id) const { return positions_.count(id); }
+	std::size_t size() const { return positions_.size(); }
+
+private:
+	struct Text {
+		u32 id;
+		std::string lower;
+		bool erased;
+	};
+
+	void add(u32 pos);
+	void compact();
+
+	// In insertion order. Posting lists reference positions in this
+	// vector, since we only append, they stay sorted.
+	std::vector<Text> texts_;
+	std::unordered_map<u32, std::vector<u32>> postings_;
+	// id -> position in texts_, only for non-erased texts
+	std::unordered_map<u32, u32> positions_;
+	u32 erasedCount_ {};
+};
+
+} // namespace vil
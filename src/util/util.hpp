@@ -6,6 +6,7 @@
 #include <nytl/vec.hpp>
 #include <nytl/bytes.hpp>
 #include <nytl/span.hpp>
+#include <atomic>
 #include <cstring>
 #include <memory>
 #include <vector>
@@ -84,6 +85,14 @@ inline constexpr unsigned ceilDivide(unsigned num, unsigned denom) {
 	return (num + denom - 1) / denom;
 }
 
+// Returns a new id for an object of type T. Ids start at 1 and, unlike
+// addresses, are never reused. Can be called from multiple threads.
+template<typename T>
+u64 nextUniqueID() {
+	static std::atomic<u64> counter {};
+	return ++counter;
+}
+
 // Checks the environment variable with the given name.
 // If not set, returns defaultValue.
 // If set to 0, returns false. If set to 1, returns true.
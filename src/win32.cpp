@@ -3,6 +3,7 @@
 #include <gui/gui.hpp>
 #include <vk/vulkan.h>
 #include <device.hpp>
+#include <frameCapture.hpp>
 #include <layer.hpp>
 #include <platform.hpp>
 #include <util/util.hpp>
@@ -137,6 +138,7 @@ struct Win32Platform : Platform {
 	State state {State::hidden};
 	bool togglePressed {}; // for toggle key
 	bool focusPressed {}; // for focus key
+	bool capturePressed {}; // for capture key
 
 	std::thread thread;
 	mutable std::mutex mutex;
@@ -570,6 +572,13 @@ bool Win32Platform::doUpdate() {
 		// check if cursor is shown. If not, we draw our own.
 	}
 
+	if(captureKey_ != VilKeyNone &&
+			updateEdge(capturePressed, this->checkPressed(captureKey_))) {
+		if(auto* frameCapture = gui->dev().frameCapture.get(); frameCapture) {
+			frameCapture->trigger();
+		}
+	}
+
 	if(state != State::hidden) {
 		gui->imguiIO().MouseDrawCursor = softwareCursor;
 
@@ -265,7 +265,9 @@ bool DisplayWindow::doInitSwapchain() {
 	{
 		VkSemaphoreCreateInfo sci {};
 		sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		VK_CHECK(dev.dispatch.CreateSemaphore(dev.handle, &sci, nullptr, &acquireSem));
+		for(auto& sem : acquireSems) {
+			VK_CHECK(dev.dispatch.CreateSemaphore(dev.handle, &sci, nullptr, &sem));
+		}
 	}
 
 	this->gui = &dev.getOrCreateGui(sci.imageFormat);
@@ -522,6 +524,7 @@ void DisplayWindow::doMainLoop() {
 		// vsync currently effectively happens at the end of Gui::draw
 		// (where we wait for the submission).
 		dlg_trace("acquire");
+		auto acquireSem = acquireSems[acquireSemID];
 		VkResult res = dev->dispatch.AcquireNextImageKHR(dev->handle, swapchain,
 			UINT64_MAX, acquireSem, VK_NULL_HANDLE, &imageIdx);
 		if(res == VK_SUBOPTIMAL_KHR) {
@@ -580,13 +583,15 @@ void DisplayWindow::doMainLoop() {
 
 		dlg_trace("renderFrame");
 		gui->renderFrame(frameInfo);
+		acquireSemID = (acquireSemID + 1) % acquireSems.size();
 
-		// There is no advantage in having multiple draws pending at
-		// the same time, we don't need to squeeze every last fps
-		// out of the debug window. Waiting here is better than potentially
-		// somewhere in a critical section.
+		// We keep the draw we just submitted pending, so the next frame
+		// can be built while this one is rendered and presented.
+		// More than that has no advantage, we don't need to squeeze every
+		// last fps out of the debug window. Waiting here is better than
+		// potentially somewhere in a critical section.
 		dlg_trace("waitForDraws");
-		gui->waitForDraws();
+		gui->waitForDraws(1u);
 
 		// NOTE(experimental): we also might wanna limit refreshing of this window
 		// to a maximum frame rate. We don't really need those dank 144hz
@@ -683,8 +688,10 @@ void DisplayWindow::doCleanup() {
 		swa_window_destroy(window);
 	}
 
-	if(acquireSem) {
-		dev.dispatch.DestroySemaphore(dev.handle, acquireSem, nullptr);
+	for(auto sem : acquireSems) {
+		if(sem) {
+			dev.dispatch.DestroySemaphore(dev.handle, sem, nullptr);
+		}
 	}
 }
 
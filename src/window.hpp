@@ -6,6 +6,7 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <array>
 
 struct swa_display;
 struct swa_window;
@@ -30,7 +31,11 @@ struct DisplayWindow {
 	VkSwapchainKHR swapchain {};
 	VkSwapchainCreateInfoKHR swapchainCreateInfo {};
 
-	VkSemaphore acquireSem {};
+	// We keep one frame pending while building the next one, so we need
+	// two acquire semaphores. The semaphore of the frame before the last
+	// one is guaranteed to have been waited upon.
+	std::array<VkSemaphore, 2> acquireSems {};
+	u32 acquireSemID {};
 
 	bool createDisplay(Instance&);
 	bool createWindow(Instance&);
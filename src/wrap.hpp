@@ -208,14 +208,21 @@ template<typename T> void apiHandleDestroyed(T& ourHandle) {
 // Removes the given handle from the associated map in the given device.
 // Will additionally unset the internal forward handle in the given object
 // but store it in the passed handle.
+// Handles that might be used by CommandRecords are retired, i.e. kept
+// alive until no record can reference them anymore.
 template<typename H> auto mustMoveUnset(Device& dev, H& handle) {
 	decltype(HandleDesc<H>::map(dev).mustMoveLocked(handle)) ptr {};
+	std::vector<RetiredHandle> released;
 
 	{
 		auto lock = std::lock_guard(dev.mutex);
 		ptr = HandleDesc<H>::map(dev).mustMoveLocked(handle);
 		handle = ptr->handle;
 		ptr->handle = {};
+
+		if constexpr(usedByRecords<typename HandleDesc<H>::type>) {
+			dev.reclaimer.retireLocked(ptr, released);
+		}
 	}
 
 	apiHandleDestroyed(*ptr);
@@ -240,10 +247,12 @@ Device& mustMoveUnsetKeepAlive(VkDevice vkDev, H& vkHandle) {
 
 	IntrusivePtr<typename HandleDesc<H>::type> oldPtr;
 	IntrusivePtr<typename HandleDesc<H>::type> ptr;
+	std::vector<RetiredHandle> released;
 
 	{
 		auto lock = std::lock_guard(dev.mutex);
 		ptr = HandleDesc<H>::map(dev).mustMoveLocked(handle);
+		dev.reclaimer.retireLocked(ptr, released);
 		oldPtr = (dev.*KeepAlive).pushLocked(ptr);
 		vkHandle = ptr->handle;
 		ptr->handle = {};
@@ -253,6 +262,14 @@ Device& mustMoveUnsetKeepAlive(VkDevice vkDev, H& vkHandle) {
 	return dev;
 }
 
+// Retires the given pointer to a destroyed handle, see HandleReclaimer.
+// Must not be called while the device mutex is locked.
+template<typename P> void retire(Device& dev, const P& ptr) {
+	std::vector<RetiredHandle> released;
+	std::lock_guard lock(dev.mutex);
+	dev.reclaimer.retireLocked(ptr, released);
+}
+
 template<typename T, std::size_t maxSize>
 IntrusivePtr<T> KeepAliveRingBuffer<T, maxSize>::pushLocked(IntrusivePtr<T> ptr) {
 	// keep alive to make sure we destroy it ouside of the cirtical section